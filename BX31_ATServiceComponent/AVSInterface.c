@@ -2,6 +2,28 @@
 /*
  * AVSInterface.c
  *
+ * Collects the data of one reporting cycle in a batch and pushes it to
+ * AirVantage. Instead of one le_avdata_Record* IPC call (and one time
+ * stamp) per datum, all datums of a cycle are serialized locally into a
+ * JSON document sharing one time stamp:
+ *
+ *   {"ts":1554712345678,"data":{"BTScan.stats.stations.count":12,...}}
+ *
+ * The document is handed to avcService with le_avdata_PushStream() - one
+ * IPC message per document. Documents are limited to
+ * AVS_PUSH_STREAM_MAX_BYTES (limit of the push stream API), bigger
+ * batches are split into several documents with the same time stamp.
+ *
+ * Documents which could not be pushed are appended to the on-flash spool
+ * (AVSSpool.c) and are drained again - rate limited to
+ * AVS_SPOOL_DRAIN_PER_CYCLE documents per cycle - once pushes succeed.
+ * At most AVS_MAX_PUSH_IN_FLIGHT documents are kept in memory while
+ * avcService did not report the push result yet.
+ *
+ * The connection to avcService is not waited for on start - it is tried
+ * every AVS_CONNECT_RETRY_MS, so scanning starts right away. Documents
+ * pushed before the connection is up go to the spool.
+ *
  *  This is part of the "BX31_ATService" Project
  *  Created on: Apr 8, 2019
  *      Author: Thomas Schmidt, SWI
@@ -10,84 +32,402 @@
 #include "legato.h"
 #include "interfaces.h"
 #include "AVSInterface.h"
+#include "AVSSpool.h"
+#include "config_scanner.h"
+
+#define AVS_MAX_PUSH_IN_FLIGHT 4
+#define AVS_CONNECT_RETRY_MS 1000
+
+typedef struct {
+        bool inUse;
+        bool fromSpool;                 // document was read from the spool - consume it on success
+        AVS_Spool_Position_t spoolPosition;     // ... at this position
+        char *data;
+        size_t len;
+} AVS_PushSlot_t;
 
 
 
 static le_avdata_RequestSessionObjRef_t avsSession = NULL;
-static le_avdata_RecordRef_t avsRecordRef = NULL;
+static bool serviceConnected = false;                                           // IPC connection to avcService is up
+static bool avsConnected = false;                                               // ... and the AirVantage session was granted
+static le_timer_Ref_t connectTimer = NULL;
+
+static char *batchBuffer = NULL;                                                // serialized JSON document of the running batch
+static size_t batchLen = 0;
+static size_t batchCapacity = 0;
+static unsigned int batchDatums = 0;                                            // datums in the current document
+static uint64_t batchTimeStamp = 0;                                             // 0 = no batch running
+
+static const char batchTrailer[] = "}}";
+
+static AVS_PushSlot_t pushSlots[AVS_MAX_PUSH_IN_FLIGHT];                       // documents waiting for the push result
+static bool spoolEntryInFlight = false;                                         // the oldest spool entry is being pushed
+static bool pushFailed = false;                                                 // stop draining until the next cycle
+static unsigned int drainedThisCycle = 0;
+
+static void avsService_drainSpool();
+
+/** ------------------------------------------------------------------------
+ *
+ * Tries to connect to avcService and to request the AirVantage session -
+ * called by the connect timer until both succeeded. Until then the
+ * documents go to the spool.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void avsService_connect(le_timer_Ref_t timerRef) {
+        if (!serviceConnected) {
+                le_result_t result = le_avdata_TryConnectService();
+
+                if (result != LE_OK) {
+                        LE_DEBUG("avcService not available yet: %d", result);
+                        return;                                                 // the timer tries again
+                }
+                serviceConnected = true;
+                LE_ASSERT(le_avdata_SetNamespace(LE_AVDATA_NAMESPACE_GLOBAL) == LE_OK);
+        }
 
-le_result_t avsService_init() {
         avsSession = le_avdata_RequestSession();
 
         if (NULL == avsSession) {
-                LE_ERROR("AirVantage Connection Controller does not start.");
-                return LE_UNAVAILABLE;
+                LE_ERROR("AirVantage Connection Controller does not start - trying again");
+                return;                                                         // the timer tries again
         }
 
-        LE_ASSERT(le_avdata_SetNamespace(LE_AVDATA_NAMESPACE_GLOBAL) == LE_OK);
+        le_timer_Stop(connectTimer);
+        avsConnected = true;
+        LE_INFO("connected to avcService");
+
+        avsService_drainSpool();                                                // documents spooled while connecting
+}
+
+le_result_t avsService_init() {
+        if (avsSpool_init(AVS_SPOOL_DIR, AVS_SPOOL_MAX_BYTES) != LE_OK) {
+                LE_WARN("AVS spool not available, failed pushes will be lost");
+        }
 
+        connectTimer = le_timer_Create("avsConnect");
+        le_timer_SetHandler(connectTimer, avsService_connect);
+        le_timer_SetMsInterval(connectTimer, AVS_CONNECT_RETRY_MS);
+        le_timer_SetRepeat(connectTimer, 0);
+
+        avsService_connect(connectTimer);
+        if (!avsConnected) le_timer_Start(connectTimer);
 
         return LE_OK;
 }
 
 
+/** ------------------------------------------------------------------------
+ *
+ * Called by avcService with the result of a push - failed documents go
+ * to the spool, successful pushes continue draining the spool
+ *
+ * ------------------------------------------------------------------------
+ */
+
 void PushRecordCallbackHandler(le_avdata_PushStatus_t status, void* contextPtr) {
+        AVS_PushSlot_t *slot = contextPtr;
+
         if (status == LE_AVDATA_PUSH_SUCCESS) {
                 LE_INFO("Push Timeserie OK");
+                if (slot->fromSpool) avsSpool_consume(&slot->spoolPosition);
         } else {
                 LE_INFO("Failed to push Timeserie");
+                if (!slot->fromSpool) avsSpool_append(slot->data, slot->len);   // spooled documents just stay in the spool
+                pushFailed = true;
         }
+
+        if (slot->fromSpool) spoolEntryInFlight = false;
+        free(slot->data);
+        memset(slot, 0, sizeof(AVS_PushSlot_t));
+
+        if (!pushFailed) avsService_drainSpool();
 }
 
+/** ------------------------------------------------------------------------
+ *
+ * @return a free push slot or NULL if AVS_MAX_PUSH_IN_FLIGHT are in use
+ *
+ * ------------------------------------------------------------------------
+ */
 
-le_result_t avsService_recordData(char *path, void *data, avsService_DataType_t type) {
-        struct timeval  tv;
-        gettimeofday(&tv, NULL);
-        uint64_t utcMilliSec = (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
+static AVS_PushSlot_t *avsService_getPushSlot() {
+        for (int i = 0; i < AVS_MAX_PUSH_IN_FLIGHT; ++i) {
+                if (!pushSlots[i].inUse) return &pushSlots[i];
+        }
+        return NULL;
+}
 
-        if(avsRecordRef ==NULL) {
-                LE_ASSERT( (avsRecordRef = le_avdata_CreateRecord()) != NULL);    // a record is to collect a series of events over
-                                                                                  // time and push the series later. We use the
-                                                                                  // record to keep track even if we have not
-                                                                                  // been able to push it now, because of coverage
-        }                                                                         // etc.
+/** ------------------------------------------------------------------------
+ *
+ * Hands the document of a push slot to avcService with a single
+ * le_avdata_PushStream() call. The slot has to stay allocated until the
+ * push result was reported.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static le_result_t avsService_pushSlot(AVS_PushSlot_t *slot) {
+        int pipeFds[2];
 
+        if (pipe(pipeFds) != 0) {
+                LE_ERROR("could not create pipe for push stream: %d", errno);
+                return LE_FAULT;
+        }
 
-        le_result_t recordResult;
+        ssize_t written = write(pipeFds[1], slot->data, slot->len);             // fits into the pipe buffer completely
+        close(pipeFds[1]);                                                      // (document <= AVS_PUSH_STREAM_MAX_BYTES)
 
-        switch(type)  {
-        case INT:       recordResult = le_avdata_RecordInt   (avsRecordRef, path, *((int32_t *) data), utcMilliSec); break;
-        case FLOAT:     recordResult = le_avdata_RecordFloat (avsRecordRef, path, *((double  *) data), utcMilliSec); break;
-        case BOOL:      recordResult = le_avdata_RecordBool  (avsRecordRef, path, *((bool    *) data), utcMilliSec); break;
-        case STRING:    recordResult = le_avdata_RecordString(avsRecordRef, path,  ((char    *) data), utcMilliSec); break;
-        default:  LE_ERROR("Invalid Data Type"); return LE_FAULT; break;
+        if (written != (ssize_t) slot->len) {
+                LE_ERROR("could not write document to push stream: %d", errno);
+                close(pipeFds[0]);
+                return LE_FAULT;
         }
 
-        if(recordResult != LE_OK) {
-                LE_WARN("Failed to push data to record result was : %d", recordResult);
-                return recordResult;
+        slot->inUse = true;
+        le_result_t result = le_avdata_PushStream(AVS_BASE_PATH, pipeFds[0],    // the fd is closed by the messaging
+                                                  PushRecordCallbackHandler, slot);  // system once it was sent
+        if (result != LE_OK) {
+                LE_WARN("Failed pushing time series: %d", result);
+                slot->inUse = false;
         }
 
+        return result;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Pushes the oldest spooled document - one at a time, the next one is
+ * pushed from the result callback until AVS_SPOOL_DRAIN_PER_CYCLE
+ * documents were drained in this cycle
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void avsService_drainSpool() {
+        AVS_PushSlot_t *slot;
+
+        if (!avsConnected || spoolEntryInFlight || drainedThisCycle >= AVS_SPOOL_DRAIN_PER_CYCLE
+            || avsSpool_isEmpty() || (slot = avsService_getPushSlot()) == NULL) {
+                return;
+        }
 
+        if (avsSpool_peek(&slot->data, &slot->len, &slot->spoolPosition) != LE_OK) return;
 
+        slot->fromSpool = true;
+        if (avsService_pushSlot(slot) != LE_OK) {
+                free(slot->data);
+                memset(slot, 0, sizeof(AVS_PushSlot_t));
+                pushFailed = true;
+                return;
+        }
 
-        return LE_OK;
+        spoolEntryInFlight = true;
+        ++drainedThisCycle;
+        LE_DEBUG("draining AVS spool, %zu bytes left", avsSpool_bytes());
 }
 
-le_result_t avsService_pushData() {
-        le_result_t result = LE_OK;
-        if ((result= le_avdata_PushRecord(avsRecordRef, PushRecordCallbackHandler, NULL)) == LE_OK) {
-                le_avdata_DeleteRecord(avsRecordRef);
-                avsRecordRef = NULL;
+/** ------------------------------------------------------------------------
+ *
+ * Appends formatted text to the batch buffer, the buffer grows if needed
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static le_result_t avsService_append(const char *format, ...) {
+        va_list args;
+
+        for (;;) {
+                size_t space = batchCapacity - batchLen;
+
+                va_start(args, format);
+                int len = vsnprintf(batchBuffer + batchLen, space, format, args);
+                va_end(args);
+
+                if (len < 0) return LE_FAULT;
+                if ((size_t) len < space) {
+                        batchLen += len;
+                        return LE_OK;
+                }
+
+                size_t newCapacity = batchCapacity ? batchCapacity * 2 : 1024;
+                while (newCapacity < batchLen + len + 1) newCapacity *= 2;
+
+                char *newBuffer = realloc(batchBuffer, newCapacity);
+                if (newBuffer == NULL) return LE_NO_MEMORY;
+                batchBuffer = newBuffer;
+                batchCapacity = newCapacity;
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Starts a new JSON document in the batch buffer
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static le_result_t avsService_startDocument() {
+        batchLen = 0;
+        batchDatums = 0;
+        return avsService_append("{\"ts\":%llu,\"data\":{", (unsigned long long) batchTimeStamp);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Closes the current JSON document and pushes it. In case it can't be
+ * pushed now it is appended to the spool.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static le_result_t avsService_pushDocument() {
+        le_result_t result;
+        AVS_PushSlot_t *slot;
+
+        if (batchDatums == 0) return LE_OK;
+
+        if ((result = avsService_append(batchTrailer)) != LE_OK) return result;
+
+        LE_DEBUG("pushing batch of %u datums, %zu bytes", batchDatums, batchLen);
+
+        if (!avsConnected) {
+                LE_DEBUG("not connected to avcService yet, spooling document");
+                result = LE_NOT_PERMITTED;
+        } else if ((slot = avsService_getPushSlot()) != NULL
+                   && (slot->data = malloc(batchLen)) != NULL) {
+                memcpy(slot->data, batchBuffer, batchLen);
+                slot->len = batchLen;
+                slot->fromSpool = false;
+
+                if ((result = avsService_pushSlot(slot)) == LE_OK) return LE_OK;
+
+                free(slot->data);
+                memset(slot, 0, sizeof(AVS_PushSlot_t));
         } else {
-                LE_WARN("Failed pushing time series, will retry next time");
+                LE_WARN("too many pushes in flight, spooling document");
+                result = LE_BUSY;
+        }
+
+        avsSpool_append(batchBuffer, batchLen);
+        return result;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Adds a datum to the batch of the current reporting cycle. The first
+ * datum starts the batch and takes the time stamp for the whole batch.
+ * No IPC is done here unless the document reached the size limit.
+ *
+ * @param path - resource path
+ * @param data - pointer to the value
+ * @param type - type of the value
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t avsService_batchAdd(const char *path, const void *data, avsService_DataType_t type) {
+        le_result_t result;
 
+        if (batchTimeStamp == 0) {                                              // first datum of the cycle
+                struct timeval  tv;
+                gettimeofday(&tv, NULL);
+                batchTimeStamp = (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
+
+                if ((result = avsService_startDocument()) != LE_OK) return result;
+        }
+
+        size_t lenBefore = batchLen;
+
+        result = avsService_append("%s\"%s\":", batchDatums > 0 ? "," : "", path);
+        if (result == LE_OK) {
+                switch(type)  {
+                case INT:       result = avsService_append("%d", *((const int32_t *) data)); break;
+                case FLOAT:     result = avsService_append("%.17g", *((const double *) data)); break;
+                case BOOL:      result = avsService_append("%s", *((const bool *) data) ? "true" : "false"); break;
+                case STRING:    result = avsService_append("\"%s\"", (const char *) data); break;  // paths and our strings (base64)
+                default:  LE_ERROR("Invalid Data Type"); result = LE_FAULT; break;                 // need no JSON escaping
+                }
+        }
+
+        if (result != LE_OK) {
+                LE_WARN("Failed to add data to batch, result was : %d", result);
+                batchLen = lenBefore;
+                return result;
+        }
+
+        if (batchLen + sizeof(batchTrailer) > AVS_PUSH_STREAM_MAX_BYTES) {      // document full - push what we have without
+                batchLen = lenBefore;                                           // this datum and start a new one with it
+                if (batchDatums == 0) {
+                        LE_WARN("datum %s does not fit into a push stream, dropped", path);
+                        return LE_OVERFLOW;
+                }
+                avsService_pushDocument();
+
+                if ((result = avsService_startDocument()) != LE_OK) return result;
+                return avsService_batchAdd(path, data, type);
+        }
+
+        ++batchDatums;
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Pushes the batch of the current reporting cycle to AirVantage
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t avsService_batchPush() {
+        unsigned int spoolBytes = avsSpool_bytes();
+        unsigned int spoolDropped = avsSpool_droppedEntries();
+
+        if (batchTimeStamp != 0) {                                              // spool statistics go with the batch
+                avsService_batchAdd(AVS_STATISTICS_PATH ".avs.spoolBytes", &spoolBytes, INT);
+                avsService_batchAdd(AVS_STATISTICS_PATH ".avs.spoolDropped", &spoolDropped, INT);
         }
+
+        le_result_t result = avsService_pushDocument();
+        avsService_batchDiscard();
+
+        drainedThisCycle = 0;                                                   // new cycle - try draining the spool again
+        pushFailed = (result != LE_OK);
+        if (!pushFailed) avsService_drainSpool();
+
         return result;
 }
 
+/** ------------------------------------------------------------------------
+ *
+ * Throws away the batch of the current reporting cycle
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void avsService_batchDiscard() {
+        batchLen = 0;
+        batchDatums = 0;
+        batchTimeStamp = 0;
+}
+
 
 void avsService_detroy() {
-        if(avsRecordRef) le_avdata_DeleteRecord(avsRecordRef);
+        for (int i = 0; i < AVS_MAX_PUSH_IN_FLIGHT; ++i) {                      // documents without push result are kept
+                if (pushSlots[i].inUse && !pushSlots[i].fromSpool) {            // for the next run
+                        avsSpool_append(pushSlots[i].data, pushSlots[i].len);
+                }
+                free(pushSlots[i].data);
+        }
+        memset(pushSlots, 0, sizeof(pushSlots));
+
+        free(batchBuffer);
+        batchBuffer = NULL;
+        batchLen = batchCapacity = 0;
+        if (connectTimer) le_timer_Delete(connectTimer);
+        connectTimer = NULL;
         if (avsSession) le_avdata_ReleaseSession(avsSession);
 }
@@ -22,8 +22,9 @@ typedef enum {
 
 
 le_result_t avsService_init();
-le_result_t avsService_recordData(char *path, void *data, avsService_DataType_t type);
-le_result_t avsService_pushData();
+le_result_t avsService_batchAdd(const char *path, const void *data, avsService_DataType_t type);
+le_result_t avsService_batchPush();
+void avsService_batchDiscard();
 void avsService_detroy();
 
 #endif /* AVSINTERFACE_H_ */
@@ -0,0 +1,439 @@
+/*
+ * AVSSpool.c
+ *
+ * Append-only store-and-forward spool for serialized AirVantage documents
+ * which could not be pushed (e.g. during a cellular outage). The spool
+ * lives on flash in the persistent writable area of the app (AVS_SPOOL_DIR
+ * - not in the sandbox root, which is a tmpfs in RAM), so the memory use
+ * stays flat regardless of how long the outage lasts, and it survives a
+ * restart of the application.
+ *
+ * The spool is split into AVS_SPOOL_SEGMENTS segment files named by a
+ * sequence number (<directory>/<seq>.seg). Entries are only appended to
+ * the newest segment, the oldest segment is deleted when
+ * - the byte budget would be exceeded (oldest-first drop policy)
+ * - all of its entries were consumed
+ *
+ * each entry:  [uint32 length][uint32 checksum][length bytes document]
+ *
+ * The read position (segment, offset) is kept in <directory>/head
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+#include "AVSSpool.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define AVS_SPOOL_SEGMENTS 4
+#define AVS_SPOOL_PATH_LEN 256
+
+typedef struct {
+        uint32_t len;
+        uint32_t checksum;
+} AVS_Spool_EntryHeader_t;
+
+static char spoolDir[AVS_SPOOL_PATH_LEN] = "";
+static size_t spoolMaxBytes = 0;
+static size_t segmentMaxBytes = 0;
+
+static uint32_t oldestSeq = 0;                                                  // oldestSeq > newestSeq: spool is empty
+static uint32_t newestSeq = 0;
+static size_t segmentBytes[AVS_SPOOL_SEGMENTS];                                 // size of segment seq, at [seq % SEGMENTS]
+static unsigned int segmentEntries[AVS_SPOOL_SEGMENTS];                         // entries of segment seq not consumed yet
+static size_t totalBytes = 0;
+static AVS_Spool_Position_t head = { 0, 0 };                                    // oldest not consumed entry
+static unsigned int droppedEntries = 0;
+static bool newestClosed = false;                                               // no more appends to the newest segment
+
+/** ------------------------------------------------------------------------
+ *
+ * FNV-1a checksum of a spooled document
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static uint32_t avsSpool_checksum(const char *data, size_t len) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < len; ++i) {
+                hash = (hash ^ (uint8_t) data[i]) * 16777619u;
+        }
+        return hash;
+}
+
+static void avsSpool_segmentPath(uint32_t seq, char *path) {
+        snprintf(path, AVS_SPOOL_PATH_LEN, "%s/%08x.seg", spoolDir, seq);
+}
+
+static void avsSpool_headPath(char *path) {
+        snprintf(path, AVS_SPOOL_PATH_LEN, "%s/head", spoolDir);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Writes the read position to flash
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void avsSpool_saveHead() {
+        char path[AVS_SPOOL_PATH_LEN];
+        avsSpool_headPath(path);
+
+        int headFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (headFd < 0) {
+                LE_WARN("could not write spool head %s: %d", path, errno);
+                return;
+        }
+        if (write(headFd, &head, sizeof(head)) != sizeof(head)) {
+                LE_WARN("could not write spool head %s: %d", path, errno);
+        }
+        close(headFd);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Deletes the oldest segment
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void avsSpool_dropOldestSegment() {
+        char path[AVS_SPOOL_PATH_LEN];
+
+        avsSpool_segmentPath(oldestSeq, path);
+        unlink(path);
+
+        totalBytes -= segmentBytes[oldestSeq % AVS_SPOOL_SEGMENTS];
+        segmentBytes[oldestSeq % AVS_SPOOL_SEGMENTS] = 0;
+        droppedEntries += segmentEntries[oldestSeq % AVS_SPOOL_SEGMENTS];       // 0 if it was consumed completely
+        segmentEntries[oldestSeq % AVS_SPOOL_SEGMENTS] = 0;
+        ++oldestSeq;
+
+        head.seq = oldestSeq;
+        head.offset = 0;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Counts the entries of a segment from offset on - a corrupted rest of
+ * the segment is counted as one entry
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static unsigned int avsSpool_countEntries(uint32_t seq, size_t offset) {
+        char path[AVS_SPOOL_PATH_LEN];
+        size_t segSize = segmentBytes[seq % AVS_SPOOL_SEGMENTS];
+        unsigned int entries = 0;
+
+        avsSpool_segmentPath(seq, path);
+        int segFd = open(path, O_RDONLY);
+        if (segFd < 0) return 0;
+
+        while (offset < segSize) {
+                AVS_Spool_EntryHeader_t entryHeader;
+                ++entries;
+                if (pread(segFd, &entryHeader, sizeof(entryHeader), offset) != sizeof(entryHeader)) break;
+                offset += sizeof(entryHeader) + entryHeader.len;
+        }
+        close(segFd);
+        return entries;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Initializes the spool - segments left over from a previous run are
+ * picked up again
+ *
+ * @param directory - where the segments are stored (created if needed)
+ * @param maxBytes - byte budget of the spool on flash
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t avsSpool_init(const char *directory, size_t maxBytes) {
+        char path[AVS_SPOOL_PATH_LEN];
+        bool found = false;
+
+        snprintf(spoolDir, sizeof(spoolDir), "%s", directory);
+        spoolMaxBytes = maxBytes;
+        segmentMaxBytes = maxBytes / AVS_SPOOL_SEGMENTS;
+        totalBytes = 0;
+        memset(segmentBytes, 0, sizeof(segmentBytes));
+        memset(segmentEntries, 0, sizeof(segmentEntries));
+
+        if (mkdir(spoolDir, S_IRWXU) != 0 && errno != EEXIST) {
+                LE_ERROR("could not create spool directory %s: %d", spoolDir, errno);
+                return LE_FAULT;
+        }
+
+        DIR *dir = opendir(spoolDir);
+        if (dir == NULL) {
+                LE_ERROR("could not open spool directory %s: %d", spoolDir, errno);
+                return LE_FAULT;
+        }
+
+        struct dirent *entry;                                                   // find the range of segments
+        while ((entry = readdir(dir)) != NULL) {
+                unsigned int seq;
+                char suffix[8];
+                if (sscanf(entry->d_name, "%8x.%3s", &seq, suffix) != 2 || strcmp(suffix, "seg") != 0) continue;
+
+                if (!found || seq < oldestSeq) oldestSeq = seq;
+                if (!found || seq > newestSeq) newestSeq = seq;
+                found = true;
+        }
+        closedir(dir);
+
+        if (!found) {
+                oldestSeq = 1;
+                newestSeq = 0;
+        } else if (newestSeq - oldestSeq >= AVS_SPOOL_SEGMENTS) {               // left over from a bigger configuration
+                while (newestSeq - oldestSeq >= AVS_SPOOL_SEGMENTS) {
+                        avsSpool_segmentPath(oldestSeq++, path);
+                        unlink(path);
+                }
+        }
+
+        for (uint32_t seq = oldestSeq; found && seq <= newestSeq; ++seq) {
+                struct stat st;
+                avsSpool_segmentPath(seq, path);
+                if (stat(path, &st) == 0) {
+                        segmentBytes[seq % AVS_SPOOL_SEGMENTS] = st.st_size;
+                        totalBytes += st.st_size;
+                }
+        }
+
+        head.seq = oldestSeq;
+        head.offset = 0;
+
+        avsSpool_headPath(path);                                                // continue where the previous run stopped
+        int headFd = open(path, O_RDONLY);
+        if (headFd >= 0) {
+                AVS_Spool_Position_t savedHead;
+                if (read(headFd, &savedHead, sizeof(savedHead)) == sizeof(savedHead)
+                    && savedHead.seq == oldestSeq
+                    && savedHead.offset <= segmentBytes[oldestSeq % AVS_SPOOL_SEGMENTS]) {
+                        head = savedHead;
+                }
+                close(headFd);
+        }
+
+        for (uint32_t seq = oldestSeq; found && seq <= newestSeq; ++seq) {
+                segmentEntries[seq % AVS_SPOOL_SEGMENTS] = avsSpool_countEntries(seq, seq == head.seq ? head.offset : 0);
+        }
+
+        LE_INFO("AVS spool %s: %zu bytes in %u segments, budget %zu bytes",
+                spoolDir, totalBytes, found ? newestSeq - oldestSeq + 1 : 0, spoolMaxBytes);
+
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Appends a document to the spool. In case the byte budget would be
+ * exceeded the oldest segments are dropped. A failed write is cut off
+ * again, so the segment only holds complete entries at the accounted
+ * offsets - the document is counted as dropped.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t avsSpool_append(const char *data, size_t len) {
+        char path[AVS_SPOOL_PATH_LEN];
+        AVS_Spool_EntryHeader_t entryHeader = { len, avsSpool_checksum(data, len) };
+        size_t entryBytes = sizeof(entryHeader) + len;
+
+        if (spoolDir[0] == 0) return LE_UNAVAILABLE;
+
+        if (entryBytes > segmentMaxBytes) {
+                LE_WARN("document of %zu bytes does not fit into the spool", len);
+                ++droppedEntries;
+                return LE_OVERFLOW;
+        }
+
+        if (oldestSeq > newestSeq || newestClosed                               // empty or newest segment full - start a new one
+            || segmentBytes[newestSeq % AVS_SPOOL_SEGMENTS] + entryBytes > segmentMaxBytes) {
+                if (oldestSeq <= newestSeq && newestSeq - oldestSeq + 1 == AVS_SPOOL_SEGMENTS) {
+                        LE_WARN("AVS spool full, dropping oldest segment");
+                        avsSpool_dropOldestSegment();
+                        avsSpool_saveHead();
+                }
+                ++newestSeq;
+                if (oldestSeq > newestSeq) oldestSeq = newestSeq;
+                newestClosed = false;
+        }
+
+        avsSpool_segmentPath(newestSeq, path);
+        int segFd = open(path, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+        if (segFd < 0) {
+                LE_ERROR("could not open spool segment %s: %d", path, errno);
+                return LE_FAULT;
+        }
+
+        struct stat st;
+        if (fstat(segFd, &st) != 0) {
+                LE_ERROR("could not stat spool segment %s: %d", path, errno);
+                close(segFd);
+                ++droppedEntries;
+                return LE_FAULT;
+        }
+
+        if (write(segFd, &entryHeader, sizeof(entryHeader)) != sizeof(entryHeader)
+            || write(segFd, data, len) != (ssize_t) len) {
+                LE_ERROR("could not write spool segment %s: %d", path, errno);
+                if (ftruncate(segFd, st.st_size) != 0) {                        // a partial entry would shift all entries
+                        LE_ERROR("could not truncate spool segment %s: %d", path, errno);  // appended after it, so
+                        newestClosed = true;                                    // the next one goes to a new segment
+                }
+                close(segFd);
+                ++droppedEntries;
+                return LE_FAULT;
+        }
+        close(segFd);
+
+        segmentBytes[newestSeq % AVS_SPOOL_SEGMENTS] += entryBytes;
+        ++segmentEntries[newestSeq % AVS_SPOOL_SEGMENTS];
+        totalBytes += entryBytes;
+
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Reads the oldest document of the spool - it stays in the spool until
+ * avsSpool_consume() is called with its position.
+ *
+ * @param dataPtr - set to an allocated buffer, to be freed by the caller
+ * @param lenPtr - set to the length of the document
+ * @param positionPtr - set to the position of the document in the spool
+ *
+ * @return LE_OK, LE_NOT_FOUND if the spool is empty
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t avsSpool_peek(char **dataPtr, size_t *lenPtr, AVS_Spool_Position_t *positionPtr) {
+        char path[AVS_SPOOL_PATH_LEN];
+
+        while (!avsSpool_isEmpty()) {
+                size_t segSize = segmentBytes[head.seq % AVS_SPOOL_SEGMENTS];
+
+                if (head.offset >= segSize) {                                   // segment completely consumed
+                        if (head.seq == newestSeq) return LE_NOT_FOUND;
+                        avsSpool_dropOldestSegment();
+                        avsSpool_saveHead();
+                        continue;
+                }
+
+                avsSpool_segmentPath(head.seq, path);
+                int segFd = open(path, O_RDONLY);
+                AVS_Spool_EntryHeader_t entryHeader;
+                char *data = NULL;
+
+                if (segFd >= 0
+                    && pread(segFd, &entryHeader, sizeof(entryHeader), head.offset) == sizeof(entryHeader)
+                    && head.offset + sizeof(entryHeader) + entryHeader.len <= segSize
+                    && (data = malloc(entryHeader.len)) != NULL
+                    && pread(segFd, data, entryHeader.len, head.offset + sizeof(entryHeader)) == (ssize_t) entryHeader.len
+                    && avsSpool_checksum(data, entryHeader.len) == entryHeader.checksum) {
+                        close(segFd);
+                        *dataPtr = data;
+                        *lenPtr = entryHeader.len;
+                        *positionPtr = head;
+                        return LE_OK;
+                }
+
+                LE_WARN("corrupted entry in spool segment %s at %u, skipping the segment",
+                        path, head.offset);
+                free(data);
+                if (segFd >= 0) close(segFd);
+
+                droppedEntries += segmentEntries[head.seq % AVS_SPOOL_SEGMENTS];  // the corrupted entry and all after it
+                segmentEntries[head.seq % AVS_SPOOL_SEGMENTS] = 0;
+                head.offset = segSize;                                          // skip the rest of the segment
+                if (head.seq == newestSeq) {
+                        avsSpool_saveHead();
+                        return LE_NOT_FOUND;
+                }
+        }
+
+        return LE_NOT_FOUND;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Removes a document returned by avsSpool_peek() - only if it is still
+ * the oldest one. While it was pushed its segment may have been dropped
+ * (budget) or skipped (corrupted), then it is gone already and nothing
+ * else is removed.
+ *
+ * @param position - of the document, as returned by avsSpool_peek()
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void avsSpool_consume(const AVS_Spool_Position_t *position) {
+        char path[AVS_SPOOL_PATH_LEN];
+        AVS_Spool_EntryHeader_t entryHeader;
+
+        if (avsSpool_isEmpty() || position->seq != head.seq || position->offset != head.offset) {
+                LE_DEBUG("spool entry %u/%u is gone already", position->seq, position->offset);
+                return;
+        }
+
+        avsSpool_segmentPath(head.seq, path);
+        int segFd = open(path, O_RDONLY);
+        if (segFd >= 0 && pread(segFd, &entryHeader, sizeof(entryHeader), head.offset) == sizeof(entryHeader)) {
+                head.offset += sizeof(entryHeader) + entryHeader.len;
+        } else {
+                head.offset = segmentBytes[head.seq % AVS_SPOOL_SEGMENTS];
+        }
+        if (segFd >= 0) close(segFd);
+        if (segmentEntries[head.seq % AVS_SPOOL_SEGMENTS] > 0) --segmentEntries[head.seq % AVS_SPOOL_SEGMENTS];
+
+        if (head.offset >= segmentBytes[head.seq % AVS_SPOOL_SEGMENTS]) {
+                avsSpool_dropOldestSegment();                                   // fully consumed - also when it is the newest,
+        }                                                                       // the next append starts a new segment
+        avsSpool_saveHead();
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return true if there is no document to read in the spool
+ *
+ * ------------------------------------------------------------------------
+ */
+
+bool avsSpool_isEmpty() {
+        return oldestSeq > newestSeq
+               || (head.seq == newestSeq
+                   && head.offset >= segmentBytes[newestSeq % AVS_SPOOL_SEGMENTS]);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return bytes used by the spool on flash
+ *
+ * ------------------------------------------------------------------------
+ */
+
+size_t avsSpool_bytes() {
+        return totalBytes;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return number of entries dropped because the budget was exceeded, the
+ *         data was corrupted or could not be written - a dropped segment
+ *         counts with the entries it still held
+ *
+ * ------------------------------------------------------------------------
+ */
+
+unsigned int avsSpool_droppedEntries() {
+        return droppedEntries;
+}
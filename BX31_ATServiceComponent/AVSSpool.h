@@ -0,0 +1,29 @@
+/*
+ * AVSSpool.h
+ *
+ *  Bounded on-flash store-and-forward spool for AirVantage documents
+ *  which could not be pushed.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+
+#ifndef AVSSPOOL_H_
+#define AVSSPOOL_H_
+
+typedef struct {
+        uint32_t seq;                   // segment of the entry
+        uint32_t offset;                // offset of the entry in the segment
+} AVS_Spool_Position_t;
+
+le_result_t avsSpool_init(const char *directory, size_t maxBytes);
+le_result_t avsSpool_append(const char *data, size_t len);
+le_result_t avsSpool_peek(char **dataPtr, size_t *lenPtr, AVS_Spool_Position_t *positionPtr);
+void avsSpool_consume(const AVS_Spool_Position_t *position);
+bool avsSpool_isEmpty();
+size_t avsSpool_bytes();
+unsigned int avsSpool_droppedEntries();
+
+#endif /* AVSSPOOL_H_ */
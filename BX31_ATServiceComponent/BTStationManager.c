@@ -8,24 +8,47 @@
 
 #include "BX31_ATServiceComponent.h"
 #include "BTStationManager.h"
+#include "ScanControl.h"
+#include "StationSnapshot.h"
+#include "StationEvents.h"
 #include "config_scanner.h"
 #include "base64.h"
 
 
-static le_hashmap_Ref_t stationHashMap = NULL;
-static le_mem_PoolRef_t bTStationContainerPool = NULL;
-
 static callbackOnAvsDataAdd_t avsDataAddCallback = NULL;
 static callbackOnAvsDataPush_t avsDataPushCallback = NULL;
 
 static unsigned int lastSeenStations = 0;
+static unsigned int addedStations = 0;                                          // stations added since the last check
+static uint32_t lastReportTick = 0;                                             // stations seen after this are reported
+static uint32_t stationMaxAge = MAX_BT_STATION_AGE;                             // seconds
+static unsigned int radioSeenStations[BX31_MAX_DEVICES];                        // stations seen per radio since the last check
+static size_t memoryBudget = BTMGR_MEMORY_BUDGET;                               // bytes, 0 = no budget
+static unsigned int evictedStations = 0;                                        // stations evicted since the last check
+static uint32_t lastSnapshotTick = 0;
 
 /** ------------------------------------------------------------------------
  *
- * Compares 2 scan result structs
+ * @return the tick (ms, monotonic, wraps) the station table works with
  *
- * @param scan result 1
- * @param scan result 2
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t btmgr_tick()
+{
+        le_clk_Time_t now = le_clk_GetRelativeTime();
+        return (uint32_t) (now.sec * 1000 + now.usec / 1000);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Compares the stored scan result of a station with a new one
+ * The advertisement is compared via the fingerprint the parser built,
+ * the full data is only compared to rule out a fingerprint collision if
+ * BTMGR_VERIFY_FINGERPRINT is defined
+ *
+ * @param index of the station
+ * @param scan result the new one
  *
  * @return 0 if equal
  *
@@ -34,23 +57,33 @@ static unsigned int lastSeenStations = 0;
 // FIXME not sure we should put this function here 
 // - could be also in BX31_ATServiceComponent.c
 
-int btmgr_ScanCmp (BTScanResult_t * scanResult1, BTScanResult_t * scanResult2)
+int btmgr_ScanCmp (uint32_t index, BTScanResult_t * scanResult2)
 {
-        if (scanResult1->btStationAddress != scanResult2->btStationAddress)
+        BT_Station_Container_t * scanResult1 = &stationStore.cold[index];
+
+        if (sttbl_address(index) != scanResult2->btStationAddress)
                 return 1;
-        if (scanResult1->addrType != scanResult2->addrType)
+        if (scanResult1->fingerprint != scanResult2->fingerprint)               // covers addrType, data_len and advertData
                 return 2;
-        if (scanResult1->data_len != scanResult2->data_len)
-                return 3;
         /* if(scanResult1->rssi != scanResult2->rssi) return 4; */                     // We don't compare RSSI !!
         // it changing permanently and it makes no sense to compare
 
-        for (int i = 0; i <= scanResult1->data_len; ++i) {                      // Finally we check if the advertisement data differs  before
+#ifdef BTMGR_VERIFY_FINGERPRINT
+        if (scanResult1->addrType != scanResult2->addrType
+            || scanResult1->data_len != scanResult2->data_len) {
+                LE_WARN("fingerprint collision for addr: %012llx", scanResult2->btStationAddress);
+                return 3;
+        }
+
+        const uint8_t *advertData1 = slab_data(scanResult1->payload);
+        for (int i = 0; i < scanResult1->data_len; ++i) {                       // Finally we check if the advertisement data differs  before
                 // we checked that both scanReults have the same length
-                if (scanResult1->advertData[i] != scanResult2->advertData[i])   // so it can be iterated and compared over the length
+                if (advertData1[i] != (uint8_t) scanResult2->advertData[i]) {   // so it can be iterated and compared over the length
+                        LE_WARN("fingerprint collision for addr: %012llx", scanResult2->btStationAddress);
                         return 4 + i;
-
+                }
         }
+#endif /* BTMGR_VERIFY_FINGERPRINT */
 
         return 0;                                                               // if all tests failed - the both scan results are equal
 }
@@ -59,8 +92,207 @@ int btmgr_ScanCmp (BTScanResult_t * scanResult1, BTScanResult_t * scanResult2)
 
 /** ------------------------------------------------------------------------
  *
- * initializes the HashMap which contains information about the scanned
- * BT devices
+ * Copies the used part of a scan result into the cold part of the
+ * station - the advertisement goes to a payload slab of its size
+ *
+ * @param destination
+ * @param source
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline void btmgr_copyScanResult (BT_Station_Container_t * dst, const BTScanResult_t * src)
+{
+        dst->addrType = src->addrType;
+        dst->lastRadio = src->radio;
+        dst->data_len = src->data_len;
+        dst->fingerprint = src->fingerprint;
+        dst->payload = slab_store (dst->payload, src->advertData, src->data_len);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Selects the radio which received the station with the best RSSI. Only
+ * radios which have seen the station within the max. station age are
+ * taken into account, so a radio which lost the station does not stick
+ * with an old RSSI.
+ *
+ * @param station - cold part of the station
+ * @param now - current tick
+ *
+ * @return index of the radio
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static uint8_t btmgr_bestRadio (const BT_Station_Container_t * sCont, uint32_t now)
+{
+        uint32_t maxAgeMs = stationMaxAge * 1000;
+        uint8_t best = sCont->lastRadio;                                        // the radio which just received it
+
+        for (uint8_t i = 0; i < BX31_MAX_DEVICES; ++i) {
+                const BT_Station_Radio_t *radio = &sCont->radio[i];
+
+                if (radio->rssi != STTBL_RSSI_NONE
+                    && !STTBL_TICK_AFTER(now, radio->lastSeen + maxAgeMs)
+                    && radio->rssi > sCont->radio[best].rssi) {
+                        best = i;
+                }
+        }
+
+        return best;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Removes a station from the table - subscribers get the lost event
+ * with the last sighting before
+ *
+ * @param index of the station, the last station moves to it
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void btmgr_removeStation(uint32_t index)
+{
+        stev_stationEvent(BTSCAN_LOST, index, stationStore.lastSeen[index]);
+        slab_release(stationStore.cold[index].payload);
+        sttbl_removeAt(index);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Eviction score of a station - RSSI times recency, both scaled to
+ * 0 .. 255. Weak stations which have not been seen for a while have the
+ * lowest score.
+ *
+ * @param index of the station
+ * @param now - current tick
+ * @param maxAgeMs - age at which the recency drops to 0
+ *
+ * @return 0 .. 65025
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline uint32_t btmgr_evictionScore(uint32_t index, uint32_t now, uint32_t maxAgeMs)
+{
+        uint32_t age = now - stationStore.lastSeen[index];
+        uint32_t strength = (uint32_t) (stationStore.rssi[index] - STTBL_RSSI_NONE);
+        uint32_t recency = age < maxAgeMs ? 255 - (uint32_t) ((uint64_t) age * 255 / maxAgeMs) : 0;
+
+        return strength * recency;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Evicts the stations with the lowest score. A histogram of the scores
+ * gives the score up to which stations are evicted - two passes over the
+ * hot arrays, nothing is sorted or allocated.
+ *
+ * @param count - number of stations to evict
+ * @param now - current tick
+ *
+ * @return number of evicted stations
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static unsigned int btmgr_evictStations(unsigned int count, uint32_t now)
+{
+        uint32_t histogram[BTMGR_SCORE_BUCKETS] = { 0 };
+        uint32_t maxAgeMs = stationMaxAge > 0 ? stationMaxAge * 1000 : 1;
+        unsigned int shift = 8;                                                 // 65025 >> 8 fits BTMGR_SCORE_BUCKETS
+
+        if (count > sttbl_count()) count = sttbl_count();
+        if (count == 0) return 0;
+
+        for (uint32_t i = 0; i < sttbl_count(); ++i) {
+                ++histogram[btmgr_evictionScore(i, now, maxAgeMs) >> shift];
+        }
+
+        unsigned int threshold = 0;                                             // all stations below the threshold bucket
+        unsigned int below = 0;                                                 // are evicted, the rest from that bucket
+        while (below + histogram[threshold] < count) below += histogram[threshold++];
+        unsigned int fromThreshold = count - below;
+
+        unsigned int evicted = 0;
+        for (uint32_t i = 0; i < sttbl_count() && evicted < count; ) {
+                unsigned int bucket = btmgr_evictionScore(i, now, maxAgeMs) >> shift;
+
+                if (bucket < threshold || (bucket == threshold && fromThreshold > 0)) {
+                        if (bucket == threshold) --fromThreshold;
+                        LE_DEBUG("evict BT station %012llx", sttbl_address(i));
+                        btmgr_removeStation(i);                                 // the last station moves to i
+                        ++evicted;
+                } else {
+                        ++i;
+                }
+        }
+
+        evictedStations += evicted;
+        return evicted;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return max. number of stations which fit into the memory budget with
+ *         the payload storage as it is now (each station needs at least
+ *         a block of the smallest size class)
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static size_t btmgr_stationLimit()
+{
+        if (memoryBudget == 0) return SIZE_MAX;
+
+        size_t payloadBytes = slab_memoryBytes();
+        size_t low = 1;
+        size_t high = memoryBudget / (sttbl_hotBytes() + sizeof(BT_Station_Container_t)) + 1;
+
+        while (low < high) {                                                    // the table grows in steps (slots), so
+                size_t mid = low + (high - low + 1) / 2;                        // search the biggest capacity which fits
+                size_t minPayloadBytes = mid * SLAB_MIN_BLOCK_SIZE;
+                size_t bytes = sttbl_bytesFor(mid) + (payloadBytes > minPayloadBytes ? payloadBytes : minPayloadBytes);
+
+                if (bytes <= memoryBudget) low = mid;
+                else high = mid - 1;
+        }
+        return low;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Limits the station table to the memory budget - stations above the
+ * limit are evicted and the table is made smaller if it is bigger than
+ * the limit. The payload pools do not shrink, when they grew (extended
+ * adverts) fewer stations fit.
+ *
+ * @param now - current tick
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void btmgr_applyMemoryBudget(uint32_t now)
+{
+        size_t limit = btmgr_stationLimit();
+
+        sttbl_setMaxCapacity(limit);
+        if (sttbl_count() > limit) {
+                LE_WARN("%zu BT stations exceed the memory budget of %zu bytes - evicting %zu",
+                        sttbl_count(), memoryBudget, sttbl_count() - limit);
+                btmgr_evictStations(sttbl_count() - limit, now);
+        }
+        if (sttbl_capacity() > limit && sttbl_reserve(limit) != LE_OK) {
+                LE_ERROR("could not shrink station table to %zu stations", limit);
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * initializes the station table which contains information about the
+ * scanned BT devices
  *
  * ------------------------------------------------------------------------
  */
@@ -69,19 +301,14 @@ void btmgr_init(callbackOnAvsDataAdd_t callbackOnAvsDataAdd, callbackOnAvsDataPu
 
         LE_DEBUG ("initializing BTStationManager");
 
-        LE_ASSERT ((stationHashMap = le_hashmap_Create ("BX31_ATService.station.hashtable",
-                        MAX_BT_STATION_HASHMAP_SIZE,
-                        le_hashmap_HashUInt64,
-                        le_hashmap_EqualsUInt64))
-                        != NULL);
-
-        le_hashmap_MakeTraceable (stationHashMap);
+        LE_ASSERT (sttbl_init (MAX_BT_STATION_HASHMAP_SIZE) == LE_OK);
+        slab_init (MAX_BT_STATION_HASHMAP_SIZE);                                // legacy adverts of the initial stations
+        stev_init ();
 
-        bTStationContainerPool =
-                        le_mem_CreatePool ("stationContainer",
-                                        sizeof (BT_Station_Container_t));
-        le_mem_ExpandPool (bTStationContainerPool,
-                        MAX_SCANNED_STATION_MEM_POOL_SIZE);
+        lastSnapshotTick = btmgr_tick ();                                       // warm restart - what was reported before
+        if (snap_restore (STATION_SNAPSHOT_PATH, lastSnapshotTick, &lastReportTick) != LE_OK) {  // is not reported again
+                lastReportTick = lastSnapshotTick - 1;
+        }
 
         avsDataAddCallback = callbackOnAvsDataAdd;
         avsDataPushCallback = callbackOnAvsDataPush;
@@ -93,6 +320,12 @@ void btmgr_init(callbackOnAvsDataAdd_t callbackOnAvsDataAdd, callbackOnAvsDataPu
  * scanned station. The station is looked up based on it's BT address.
  * If the address is already known the last seen time and the RSSI is updated.
  * In case the advertisement packet was changed the complete data is updated
+ * The scan result is copied into the station table, it is not kept.
+ * What needs to be reported is tracked in the changeMask of the station.
+ * Each radio has its own view (RSSI, last seen) of the station, the RSSI
+ * of the station is the best one of the radios.
+ * The station events (appeared, changed, RSSI crossed a threshold) are
+ * queued for the subscribers, they are delivered when the scan is done.
  *
  * @param scan result
  *
@@ -100,152 +333,395 @@ void btmgr_init(callbackOnAvsDataAdd_t callbackOnAvsDataAdd, callbackOnAvsDataPu
  */
 void btmgr_updateList (BTScanResult_t * scanResult)
 {
+        bool isNew;
+        uint32_t now = btmgr_tick ();
+        uint32_t index = sttbl_lookupOrInsert (scanResult->btStationAddress, &isNew);
 
-//        if (stationHashMap == NULL || bTStationContainerPool == NULL)
-//                btmgr_init ();
-
-        if (le_hashmap_ContainsKey(stationHashMap, 
-                        &scanResult->btStationAddress)) {
-                BT_Station_Container_t *sCont = NULL;
+        if (index == STTBL_NO_INDEX                                             // at the memory budget (or out of memory) -
+            && btmgr_evictStations (sttbl_count () / BTMGR_EVICT_SHARE + 1, now) > 0) {  // make room for more
+                index = sttbl_lookupOrInsert (scanResult->btStationAddress, &isNew);
+        }
 
-                LE_ASSERT ((sCont = le_hashmap_Get (stationHashMap, 
-                                &scanResult->btStationAddress))
-                                != NULL);                                             // HasMap lookup for the key (should be
-                // there because we checked before)
+        if (index == STTBL_NO_INDEX) {
+                LE_ERROR ("Could not store BT station %012llx, station table is full",
+                                scanResult->btStationAddress);
+                return;
+        }
 
-                sCont->lastSeen = le_clk_GetAbsoluteTime ();
-                sCont->scanResult->rssi = scanResult->rssi;                     // we don't throw away the old scan result
-                // in case only the RSSI changed
+        BT_Station_Container_t *sCont = &stationStore.cold[index];
+        BT_Station_Radio_t *radio = &sCont->radio[scanResult->radio];
 
+        if (isNew) {
+                for (int i = 0; i < BX31_MAX_DEVICES; ++i) sCont->radio[i].rssi = STTBL_RSSI_NONE;
+        }
 
+        if (radio->rssi == STTBL_RSSI_NONE || !STTBL_TICK_AFTER (radio->lastSeen, lastReportTick)) {
+                ++radioSeenStations[scanResult->radio];                         // first time this radio saw it in this cycle
+        }
+        radio->rssi = (int8_t) scanResult->rssi;
+        radio->lastSeen = now;
 
+        sttbl_touch (index, now);                                               // sets lastSeen, keeps the aging list ordered
 
-                if (btmgr_ScanCmp (sCont->scanResult, scanResult) == 0) {           // in case the old and the new scan result
+        if (isNew) {
 #ifdef DEBUG_BT
-                        LE_DEBUG ("No update on scan result for addr: %012llx", // are equal the new one is removed from memory
-                                        scanResult->btStationAddress);
+                LE_DEBUG("Station table did not contain addr: %012llx - adding entry",
+                                scanResult->btStationAddress);
 #endif /* DEBUG_BT */
-                        sCont->isDirty = false;
-                        le_mem_Release (scanResult);
-                } else {
-#ifdef DEBUG_BT
-                        LE_DEBUG ("Scan result for addr: %012llx updated",
-                                        scanResult->btStationAddress);
+                ++addedStations;
+                stationStore.changeMask[index] = STATION_CHANGED_NEW | STATION_CHANGED_PAYLOAD | STATION_CHANGED_RSSI;
+                stationStore.rssi[index] = radio->rssi;
+                btmgr_copyScanResult (sCont, scanResult);
+                sCont->bestRadio = scanResult->radio;
+                stev_stationEvent (BTSCAN_APPEARED, index, now);
+                stev_rssiChanged (index, STTBL_RSSI_NONE, now);
+                return;
+
+        } else if (btmgr_ScanCmp (index, scanResult) == 0) {      // in case the old and the new scan result
+#ifdef DEBUG_BT                                                                 // are equal only the RSSI is taken over
+                LE_DEBUG ("No update on scan result for addr: %012llx",
+                                scanResult->btStationAddress);
 #endif /* DEBUG_BT */
-                        le_mem_Release (sCont->scanResult);                     // in case the scan result has changed for one BT
-                        // address and they are not equal we remove the old
-
-                        sCont->isDirty = true;
-                        sCont->scanResult = scanResult;                         // and store the new in the BT_Station_Container_t
-                }
+                sCont->lastRadio = scanResult->radio;
 
         } else {
-
 #ifdef DEBUG_BT
-                LE_DEBUG("HashMap did not contain addr: %012llx - adding entry",
+                LE_DEBUG ("Scan result for addr: %012llx updated",
                                 scanResult->btStationAddress);
 #endif /* DEBUG_BT */
+                stationStore.changeMask[index] |= STATION_CHANGED_PAYLOAD;      // stays set until it was reported
+                btmgr_copyScanResult (sCont, scanResult);
+                stev_stationEvent (BTSCAN_CHANGED, index, now);
+        }
 
-                BT_Station_Container_t *sCont;
-                LE_ASSERT ((sCont = le_mem_ForceAlloc (bTStationContainerPool)) // storage for the BT station container (which contains
-                                != NULL);                                       // some side information + the scan result
-                                                                                // FIXME - not sure force le_mem_ForceAlloc is good here
-                                                                                // may TryAlloc is better and handle a negative outcome
-                                                                                // accordingly
+        int8_t previousRssi = stationStore.rssi[index];
+        sCont->bestRadio = btmgr_bestRadio (sCont, now);
+        stationStore.rssi[index] = sCont->radio[sCont->bestRadio].rssi;
+        stev_rssiChanged (index, previousRssi, now);
 
+        if (abs (stationStore.rssi[index] - sCont->lastReportedRssi) > BTMGR_RSSI_DEADBAND_DB) {
+                stationStore.changeMask[index] |= STATION_CHANGED_RSSI;
+        }
+}
+
+
+/** ------------------------------------------------------------------------
+ *
+ * Called when a scan of a radio is done - the station events of the scan
+ * are delivered to the subscribers in one batch
+ *
+ * @param radio
+ *
+ * ------------------------------------------------------------------------
+ */
+void btmgr_scanCycleDone (unsigned int radio)
+{
+        stev_flush ();
+}
 
-                sCont->btStationAddress = scanResult->btStationAddress;
-                sCont->isDirty = true;
+/** ------------------------------------------------------------------------
+ *
+ * Removes the stations which have not been seen for the max. station age
+ * (or two scan intervals, if longer - see scanctl_getExpiryInterval()).
+ * They are found at the oldest end of the aging list, so this costs only
+ * the number of expired stations - not the number of stations in the table
+ *
+ * @param now - current tick
+ *
+ * @return number of removed stations
+ *
+ * ------------------------------------------------------------------------
+ */
 
-                sCont->lastSeen = le_clk_GetAbsoluteTime ();                    // storing the new scanned device to the HasMap
+static unsigned int btmgr_expireStations(uint32_t now)  {
+        uint32_t oldest;
+        unsigned int removedStations = 0;
+        uint32_t maxAge = stationMaxAge;
+        unsigned int scanInterval = scanctl_getExpiryInterval();
 
-                sCont->scanResult = scanResult;
+        if (maxAge < 2 * scanInterval) {                                        // a station must have had the chance to be
+                maxAge = 2 * scanInterval;                                      // seen in two scans when scanning backs off
+        }
 
-                le_hashmap_Put (stationHashMap, &sCont->btStationAddress, sCont);
+        while ((oldest = sttbl_oldest()) != STTBL_NO_INDEX
+               && STTBL_TICK_AFTER(now, stationStore.lastSeen[oldest] + maxAge * 1000)) {
+                LE_DEBUG("free BT station from table %012llx", sttbl_address(oldest));
+                btmgr_removeStation(oldest);
+                ++removedStations;
         }
 
+        return removedStations;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Station report blob
+ *
+ * All stations reported in a cycle are packed into one binary blob which
+ * is base64 encoded once and recorded as a single resource
+ * (AVS_STATION_BLOB_PATH.<chunk>). In case the blob gets bigger than
+ * BTMGR_BLOB_MAX_BYTES it is split into several self contained chunks.
+ * Multi byte values are big endian. Version 2 layout:
+ *
+ * header (10 bytes):
+ *   'B' 'S'            magic
+ *   uint8  version     BTMGR_BLOB_VERSION
+ *   uint8  reserved    0
+ *   uint32 baseTime    report time - seconds (le_clk absolute time)
+ *   uint16 count       number of station records
+ *
+ * station record (12 bytes + payload):
+ *   uint8[6] address   BT address, first octet is the MSB as in "29:db:.."
+ *   uint8  flags       STATION_CHANGED_* - 0 means heartbeat only
+ *   uint8  addrType
+ *   int8   rssi        best RSSI of all radios
+ *   uint8  radio       index of the BX31 which received the best RSSI
+ *   uint16 lastSeenAge seconds between lastSeen and baseTime (saturated)
+ *   uint8  payloadLen  only if flags & STATION_CHANGED_PAYLOAD:
+ *   uint8[payloadLen]  the advertisement data
+ *
+ * Version 1 had no radio byte (record of 11 bytes).
+ * A decoder for the host side is in tools/decode_station_blob.py
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static uint8_t blobBuffer[BTMGR_BLOB_MAX_BYTES];
+static size_t blobLen = 0;
+static uint16_t blobCount = 0;
+static unsigned int blobChunk = 0;
+static le_clk_Time_t blobBaseTime;
 
+static inline uint8_t *btmgr_putUint16(uint8_t *pos, uint16_t value) {
+        pos[0] = value >> 8;
+        pos[1] = value & 0xff;
+        return pos + 2;
 }
 
+/** ------------------------------------------------------------------------
+ *
+ * Starts a new blob (chunk)
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void btmgr_blobStart(le_clk_Time_t now)  {
+        uint32_t baseTime = (uint32_t) now.sec;
+
+        blobBaseTime = now;
+        blobCount = 0;
+
+        blobBuffer[0] = 'B';
+        blobBuffer[1] = 'S';
+        blobBuffer[2] = BTMGR_BLOB_VERSION;
+        blobBuffer[3] = 0;
+        btmgr_putUint16(btmgr_putUint16(blobBuffer + 4, baseTime >> 16), baseTime & 0xffff);
+        blobLen = BTMGR_BLOB_HEADER_LEN;                                        // count is filled in on flush
+}
 
 /** ------------------------------------------------------------------------
  *
+ * Encodes the blob in base64 and records it for AirVantage
  *
  * ------------------------------------------------------------------------
  */
 
-void btmgr_periodicalCheck()  {
-        const uint64_t *nextKey;
-        BT_Station_Container_t *nextVal;
-        unsigned int stationCount = 0, removedStations = 0;
+static void btmgr_blobFlush()  {
+        static char encodedBlob[LE_BASE64_ENCODED_SIZE(BTMGR_BLOB_MAX_BYTES) + 1];
         char pathBuffer[MAX_PATH_BUFFER_LEN];
-        char encodedStringBuffer[LE_BASE64_ENCODED_SIZE(MAX_BT_DATA_STRING_SIZE) + 1];
+        size_t len = sizeof(encodedBlob);
 
+        if (blobCount == 0) return;
 
-        LE_INFO("checking periodically BT station List");
+        btmgr_putUint16(blobBuffer + 8, blobCount);
 
-        le_clk_Time_t now = le_clk_GetAbsoluteTime();
-        le_clk_Time_t diffTime;
-        diffTime.sec = MAX_BT_STATION_AGE;
-        diffTime.usec = 0;
+        le_result_t b64result = le_base64_Encode(blobBuffer, blobLen, encodedBlob, &len);
+        if (b64result == LE_OK) {
+                snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATION_BLOB_PATH ".%u", blobChunk);
+                avsDataAddCallback(pathBuffer, encodedBlob, STRING);
+        } else {
+                LE_WARN("could not convert station blob to base64: %d", b64result);
+        }
 
-        le_hashmap_It_Ref_t hashMapIterator = le_hashmap_GetIterator(stationHashMap);
+        ++blobChunk;
+        btmgr_blobStart(blobBaseTime);
+}
 
-        while (LE_OK == le_hashmap_NextNode(hashMapIterator)) {
-                nextKey = le_hashmap_GetKey(hashMapIterator);
-                nextVal = le_hashmap_GetValue(hashMapIterator);
+/** ------------------------------------------------------------------------
+ *
+ * Adds the data of one station to the report blob - only what changed:
+ * - any change or when BTMGR_LASTSEEN_HEARTBEAT expired a record is added
+ * - the rssi flag is set if it moved out of the deadband (or is new)
+ * - the payload is added if the advertisement changed
+ *
+ * @param index of the station
+ * @param now - current tick
+ *
+ * @return true if anything was reported
+ *
+ * ------------------------------------------------------------------------
+ */
 
+static bool btmgr_reportStation(uint32_t index, uint32_t now)  {
+        uint8_t flags = stationStore.changeMask[index];
 
-                if(le_clk_GreaterThan(now,le_clk_Add(nextVal->lastSeen, diffTime))) {
-                        LE_DEBUG("free BT station from HashMap %012llx", *nextKey);
-                        le_mem_Release(nextVal->scanResult);
-                        le_mem_Release(nextVal);
-                        le_hashmap_Remove(stationHashMap, nextKey);
-                        ++removedStations;
-                } else  {
-                        snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATION_PATH ".%012llx.lastseen", nextVal->btStationAddress);
-                        avsDataAddCallback(pathBuffer, &nextVal->lastSeen, INT);
+        if (flags == 0
+            && !STTBL_TICK_AFTER(now, stationStore.lastReportedSeen[index] + BTMGR_LASTSEEN_HEARTBEAT * 1000)) {
+                return false;                                                   // nothing changed and no heartbeat due
+        }
 
-                        snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATION_PATH ".%012llx.rssi", nextVal->btStationAddress);
-                        avsDataAddCallback(pathBuffer, &nextVal->scanResult->rssi, INT);
+        BT_Station_Container_t *sCont = &stationStore.cold[index];         // only now the cold part is needed
+        uint64_t btStationAddress = sttbl_address(index);
 
-                        if(nextVal->isDirty) {
-                                snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATION_PATH ".%012llx.addrType", nextVal->btStationAddress);
-                                avsDataAddCallback(pathBuffer, &nextVal->scanResult->addrType, INT);
+        size_t recordLen = BTMGR_BLOB_RECORD_LEN
+                           + ((flags & STATION_CHANGED_PAYLOAD) ? 1 + sCont->data_len : 0);
+        if (blobLen + recordLen > BTMGR_BLOB_MAX_BYTES || blobCount == UINT16_MAX) {
+                btmgr_blobFlush();
+        }
 
-                                snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATION_PATH ".%012llx.dataLen", nextVal->btStationAddress);
-                                avsDataAddCallback(pathBuffer, &nextVal->scanResult->data_len, INT);
+        uint8_t *pos = blobBuffer + blobLen;
+        for (int i = 5; i >= 0; --i) {
+                *pos++ = (uint8_t) (btStationAddress >> (8 * i));
+        }
+        *pos++ = flags;
+        *pos++ = sCont->addrType;
+        *pos++ = (uint8_t) stationStore.rssi[index];
+        *pos++ = sCont->bestRadio;
+
+        uint32_t age = (now - stationStore.lastSeen[index]) / 1000;
+        pos = btmgr_putUint16(pos, age > UINT16_MAX ? UINT16_MAX : age);
+
+        if (flags & STATION_CHANGED_PAYLOAD) {
+                *pos++ = (uint8_t) sCont->data_len;
+                if (sCont->data_len > 0) memcpy(pos, slab_data(sCont->payload), sCont->data_len);
+                pos += sCont->data_len;
+        }
 
+        blobLen = pos - blobBuffer;
+        ++blobCount;
 
-                                unsigned int len = LE_BASE64_ENCODED_SIZE(MAX_BT_DATA_STRING_SIZE) + 1;
-                                memset(encodedStringBuffer,0,len);
+        stationStore.lastReportedSeen[index] = stationStore.lastSeen[index];
+        if (flags & STATION_CHANGED_RSSI) sCont->lastReportedRssi = stationStore.rssi[index];
+        stationStore.changeMask[index] = 0;
+        return true;
+}
 
-                                le_result_t b64result = le_base64_Encode((uint8_t * ) nextVal->scanResult->advertData ,nextVal->scanResult->data_len,encodedStringBuffer,&len);
+/** ------------------------------------------------------------------------
+ *
+ * Reports all stations which have been seen since the last report. These
+ * are at the newest end of the aging list - the list is walked backwards
+ * until the first station which was seen before the last report. Stations
+ * which have not been seen have nothing new to report.
+ *
+ * Only the hot arrays are looked at for the stations which have nothing
+ * to report.
+ *
+ * @param since - tick of the last report
+ * @param now - current tick
+ *
+ * @return number of reported stations
+ *
+ * ------------------------------------------------------------------------
+ */
 
-                                if(b64result == LE_OK) {
-                                        snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATION_PATH ".%012llx.data", nextVal->btStationAddress);
-                                        avsDataAddCallback(pathBuffer, encodedStringBuffer, STRING);
+static unsigned int btmgr_reportStations(uint32_t since, uint32_t now)  {
+        unsigned int reportedStations = 0;
 
-                                } else {
-                                        LE_WARN("could not convert binary to base64: %d", b64result);
-                                }
+        if (avsDataAddCallback == NULL) return 0;
 
-                        }
+        blobChunk = 0;
+        btmgr_blobStart(le_clk_GetAbsoluteTime());
 
-                }
+        for (uint32_t index = sttbl_newest();
+             index != STTBL_NO_INDEX && STTBL_TICK_AFTER(stationStore.lastSeen[index], since);
+             index = sttbl_older(index)) {
+                if (btmgr_reportStation(index, now)) ++reportedStations;
+        }
+
+        btmgr_blobFlush();
+        return reportedStations;
+}
 
+/** ------------------------------------------------------------------------
+ *
+ * called periodically by the janitor timer: removes expired stations,
+ * reports the stations seen since the last run and the statistics to
+ * AirVantage
+ *
+ * ------------------------------------------------------------------------
+ */
 
-                ++stationCount;
+void btmgr_periodicalCheck()  {
+
+        LE_INFO("checking periodically BT station List");
+
+        uint32_t now = btmgr_tick();
+        unsigned int stationCount = sttbl_count();
+
+        unsigned int removedStations = btmgr_expireStations(now);
+        btmgr_applyMemoryBudget(now);                                           // the payload pools may have grown
+        stev_flush();                                                           // lost stations
+        unsigned int reportedStations = btmgr_reportStations(lastReportTick, now);
+        lastReportTick = now;
+
+        if (STTBL_TICK_AFTER(now, lastSnapshotTick + BTMGR_SNAPSHOT_INTERVAL * 1000)) {
+                snap_save(STATION_SNAPSHOT_PATH, now, lastReportTick, STATION_SNAPSHOT_MAX_BYTES);
+                lastSnapshotTick = now;
         }
 
-        unsigned int stationsAfterCleanup =  stationCount-removedStations;
-        unsigned int stationsAdded =  ( stationCount - lastSeenStations) > 0 ? // are there stations added ? then print the
-                        stationCount - lastSeenStations : 0;                    // number - otherwise we don't print negative number
+        unsigned int stationsAfterCleanup = sttbl_count();
+        unsigned int stationsAdded = addedStations;
+        unsigned int stationsEvicted = evictedStations;
+        addedStations = 0;
+        evictedStations = 0;
+
+        stev_Stats_t eventStats;                                                // btScan station event subscriptions
+        stev_getStats(&eventStats);
+
+        unsigned int memoryBytes = (unsigned int) (sttbl_memoryBytes() + slab_memoryBytes());
+        unsigned int memoryLimit = (unsigned int) memoryBudget;
+
+        unsigned int radioCount = bx31at_getDeviceCount();
+        unsigned int timeToFirstScan = bx31at_getTimeToFirstScan();
+        unsigned int scansDropped = bx31at_getDroppedScanResults();
+        unsigned int scanQueueHighWater = bx31at_getScanQueueHighWater();
+        unsigned int scanDutyCycle = bx31at_getScanDutyCycle();
+        unsigned int recoveries = bx31at_getRecoveryCount();
+        unsigned int resets = bx31at_getResetCount();
+        unsigned int downtime = (unsigned int) bx31at_getDowntimeMs();
+
+        unsigned int slabBlocks[SLAB_CLASS_COUNT];                              // payload storage per size class
+        unsigned int slabInUse[SLAB_CLASS_COUNT];
+        for (unsigned int i = 0; i < SLAB_CLASS_COUNT; ++i) {
+                slab_ClassStats_t slabStats;
+                slab_getStats(i, &slabStats);
+                slabBlocks[i] = slabStats.blocks;
+                slabInUse[i] = slabStats.inUse;
+                LE_INFO("BTstat: payload slab %zu bytes: %zu of %zu blocks in use (max. %zu)",
+                        slabStats.blockSize, slabStats.inUse, slabStats.blocks, slabStats.maxInUse);
+        }
+
+        scanctl_update(stationsAdded, removedStations, stationsAfterCleanup);  // adapt scanning to the churn
+        unsigned int scanWindow = scanctl_getWindow();
+        unsigned int scanInterval = scanctl_getInterval();
 
         LE_INFO("BTstat: Stations in list=%u; "
-                        "After cleanup=%u; removed Stations=%u; added stations=%u; last seen=%u",
+                        "After cleanup=%u; removed Stations=%u; added stations=%u; last seen=%u; reported=%u",
                         stationCount,  stationsAfterCleanup, removedStations,
-                        stationsAdded, lastSeenStations);
+                        stationsAdded, lastSeenStations, reportedStations);
+        LE_INFO("BTstat: Scan duty cycle=%u%%; window=%u s; interval=%u s; "
+                        "scan queue high water=%u; dropped scan results=%u; time to first scan=%u ms",
+                        scanDutyCycle, scanWindow, scanInterval, scanQueueHighWater, scansDropped, timeToFirstScan);
+        for (unsigned int i = 0; i < radioCount; ++i) {
+                LE_INFO("BTstat: radio %u saw %u stations", i, radioSeenStations[i]);
+        }
+        LE_INFO("BTstat: station memory=%u bytes; budget=%u bytes; evicted stations=%u",
+                        memoryBytes, memoryLimit, stationsEvicted);
+        LE_INFO("BTstat: btScan subscribers=%u; station events=%u; dropped=%u; notifications=%u",
+                        eventStats.subscribers, eventStats.events, eventStats.dropped, eventStats.notifications);
+        if (recoveries != 0 || resets != 0) {
+                LE_INFO("BTstat: BX31 recoveries=%u; resets=%u; downtime=%u ms", recoveries, resets, downtime);
+        }
 
 // TODO - put here the Update to AVS !!!!
 
@@ -254,39 +730,106 @@ void btmgr_periodicalCheck()  {
                 avsDataAddCallback(AVS_STATISTICS_PATH ".stations.countAfterCleanup", &stationsAfterCleanup, INT);
                 avsDataAddCallback(AVS_STATISTICS_PATH ".stations.removed", &removedStations, INT);
                 avsDataAddCallback(AVS_STATISTICS_PATH ".stations.added", &stationsAdded, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".stations.reported", &reportedStations, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".stations.evicted", &stationsEvicted, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".stations.memoryBytes", &memoryBytes, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".stations.memoryBudget", &memoryLimit, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".events.subscribers", &eventStats.subscribers, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".events.count", &eventStats.events, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".events.dropped", &eventStats.dropped, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".events.notifications", &eventStats.notifications, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.queueHighWater", &scanQueueHighWater, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.dropped", &scansDropped, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.dutyCycle", &scanDutyCycle, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.window", &scanWindow, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.interval", &scanInterval, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.radios", &radioCount, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.timeToFirstScanMs", &timeToFirstScan, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.recoveries", &recoveries, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.resets", &resets, INT);
+                avsDataAddCallback(AVS_STATISTICS_PATH ".scan.downtimeMs", &downtime, INT);
+                for (unsigned int i = 0; i < radioCount; ++i) {
+                        char pathBuffer[MAX_PATH_BUFFER_LEN];
+                        snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATISTICS_PATH ".radio.%u.seen", i);
+                        avsDataAddCallback(pathBuffer, &radioSeenStations[i], INT);
+                }
+                for (unsigned int i = 0; i < SLAB_CLASS_COUNT; ++i) {
+                        char pathBuffer[MAX_PATH_BUFFER_LEN];
+                        unsigned int blockSize = SLAB_MIN_BLOCK_SIZE << i;
+                        snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATISTICS_PATH ".payload.%u.blocks", blockSize);
+                        avsDataAddCallback(pathBuffer, &slabBlocks[i], INT);
+                        snprintf(pathBuffer, MAX_PATH_BUFFER_LEN, AVS_STATISTICS_PATH ".payload.%u.inUse", blockSize);
+                        avsDataAddCallback(pathBuffer, &slabInUse[i], INT);
+                }
                 avsDataPushCallback();
         } else  {
                 LE_WARN("callback not set, can't record data: %s", AVS_STATISTICS_PATH ".*" );
         }
 
         lastSeenStations = stationsAfterCleanup;
+        memset(radioSeenStations, 0, sizeof(radioSeenStations));
 
 }
 
 /** ------------------------------------------------------------------------
  *
- * destroys the allocated data from the HashMap inclusive content
- * to release memory typically on process exit
+ * Sets the time after which a station which is not seen anymore is
+ * removed - applied on the next periodical check
+ *
+ * @param seconds
  *
  * ------------------------------------------------------------------------
  */
-void btmgr_destroy() {
-        const uint64_t *nextKey;
-        BT_Station_Container_t *nextVal;
+void btmgr_setMaxAge(uint32_t seconds) {
+        stationMaxAge = seconds;
+}
 
-        LE_INFO("free BT stations from HashMap");
-        le_hashmap_It_Ref_t hashMapIterator = le_hashmap_GetIterator(stationHashMap);
+/** ------------------------------------------------------------------------
+ *
+ * Changes the capacity of the station table, the stations in it are kept
+ *
+ * @param capacity - number of stations which fit without growing the table
+ *
+ * ------------------------------------------------------------------------
+ */
+void btmgr_setTableCapacity(uint32_t capacity) {
+        if (sttbl_reserve(capacity) != LE_OK) {
+                LE_ERROR("could not resize station table to %u stations", capacity);
+        }
+}
 
-        while (LE_OK == le_hashmap_NextNode(hashMapIterator)) {
-                nextKey = le_hashmap_GetKey(hashMapIterator);
-                nextVal = le_hashmap_GetValue(hashMapIterator);
-                LE_DEBUG("free BT station from HashMap %012llx", *nextKey);
+/** ------------------------------------------------------------------------
+ *
+ * Sets the memory budget of the station table and the payloads. When it
+ * is hit, the stations with the lowest RSSI x recency score are evicted
+ * to make room for new ones. Stations above the budget are evicted right
+ * away.
+ *
+ * @param bytes - 0 for no budget
+ *
+ * ------------------------------------------------------------------------
+ */
+void btmgr_setMemoryBudget(uint32_t bytes) {
+        memoryBudget = bytes;
+        btmgr_applyMemoryBudget(btmgr_tick());
+}
 
-                le_mem_Release(nextVal->scanResult);
-                le_mem_Release(nextVal);
+/** ------------------------------------------------------------------------
+ *
+ * destroys the station table inclusive content
+ * to release memory typically on process exit - the stations are saved
+ * for the next start before
+ *
+ * ------------------------------------------------------------------------
+ */
+void btmgr_destroy() {
+        snap_save(STATION_SNAPSHOT_PATH, btmgr_tick(), lastReportTick, STATION_SNAPSHOT_MAX_BYTES);
 
+        LE_INFO("free %zu BT stations from table", sttbl_count());
+        for (size_t i = 0; i < sttbl_count(); ++i) {
+                slab_release(stationStore.cold[i].payload);
         }
-        le_hashmap_RemoveAll(stationHashMap);
+        sttbl_destroy();
         avsDataAddCallback = NULL;
 }
 
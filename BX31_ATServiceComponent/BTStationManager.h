@@ -9,22 +9,27 @@
 
 #include "BX31_ATServiceComponent.h"
 #include "AVSInterface.h"
+#include "StationTable.h"
 
 #ifndef BTSTATIONMANAGER_H_
 #define BTSTATIONMANAGER_H_
 
-#define MAX_BT_STATION_HASHMAP_SIZE 600
+#define MAX_BT_STATION_HASHMAP_SIZE 600          // initial number of stations in the station table - it grows if required
 #define MAX_BT_STATION_AGE 12                 // FIXME - this age of 2min is a bit low - just for demo
 #define MAX_PATH_BUFFER_LEN 1024
-
-typedef struct  {
-	uint64_t btStationAddress;		// redundant storage of the btStationAddress (here and in scanResult)
-									// - because the hasmap uses the reference to the address as key, scanResult
-									// might be freed on update and the key reference would be destroyed
-	le_clk_Time_t lastSeen;			// here the relative time stamp is set - in case the station was seen
-	bool isDirty;					// in case the BT advertisement data has changed - this is set to true
-	BTScanResult_t *scanResult;		// here the BT Scan result pointer is stored
-} BT_Station_Container_t;
+#define BTMGR_RSSI_DEADBAND_DB 6              // RSSI is reported only if it moved more than this since last report
+#define BTMGR_LASTSEEN_HEARTBEAT 300          // lastseen of an unchanged station is reported every n seconds
+#define BTMGR_MEMORY_BUDGET (4 * 1024 * 1024) // bytes for the station table and the payloads, 0 = no budget
+#define BTMGR_EVICT_SHARE 32                  // when the budget is hit 1/n of the stations are evicted at once
+#define BTMGR_SCORE_BUCKETS 256               // histogram of the eviction scores
+#define BTMGR_SNAPSHOT_INTERVAL 300           // seconds between the snapshots of the station table (flash wear)
+// #define BTMGR_VERIFY_FINGERPRINT             // compare the full advertisement if the fingerprints match
+
+#define BTMGR_BLOB_VERSION 2                  // version of the binary station report blob - see BTStationManager.c
+#define BTMGR_BLOB_HEADER_LEN 10
+#define BTMGR_BLOB_RECORD_LEN 12              // station record without payload
+#define BTMGR_BLOB_MAX_BYTES (12 * 1024)      // max. size of one blob chunk (base64 encoded it has to fit into
+                                              // one AirVantage push stream document)
 
 typedef void (*callbackOnAvsDataAdd_t)(char *path, void *data, avsService_DataType_t type);
 typedef void (*callbackOnAvsDataPush_t)();
@@ -32,7 +37,12 @@ typedef void (*callbackOnAvsDataPush_t)();
 
 void btmgr_init(callbackOnAvsDataAdd_t callbackOnAvsDataAdd, callbackOnAvsDataPush_t callbackOnAvsDataPush);
 void btmgr_updateList(BTScanResult_t *scanResult);
+void btmgr_scanCycleDone(unsigned int radio);
 void btmgr_periodicalCheck();
+void btmgr_setMaxAge(uint32_t seconds);
+void btmgr_setTableCapacity(uint32_t capacity);
+void btmgr_setMemoryBudget(uint32_t bytes);
+uint32_t btmgr_tick();
 void btmgr_destroy();
 
 #endif /* BTSTATIONMANAGER_H_ */
@@ -6,16 +6,63 @@
  * The BXModule is configured on initialization to be passive
  * (no own BT advertisement) WiFi of the BX31 module is disabled
  *
- * The ScanBLE function can be called and the BX310x module will
- * perform a BT scan. Once stations are found it will callback to
- * a previously provided function. Each found station is parsed,
- * the AT unsolicited scan message is binary packed and stored in
- * an allocated struct this struct is given as a parameter to the
- * callback function
+ * Several BX31 modules can be scanned in parallel (BX31_SERIAL_DEVICES),
+ * e.g. the module on the IoT card plus a second one on USB. Each module
+ * is a BX31_Device_t with its own serial device, AT client connection,
+ * scan thread and scan queue - the modules do not wait for each other.
+ * The results of all modules are handed to the same callback, tagged
+ * with the index of the radio which received them.
+ *
+ * A module is started by its scan thread (see bx31at_startupStep()):
+ * "AT" is polled until the module answers, the module is only reset via
+ * GPIO if it does not answer. Settings are queried and only written if
+ * they differ. The first scan is started as soon as the module is ready.
+ *
+ * A failing scan command does not stop the process, the scan thread
+ * works through a recovery ladder (see bx31at_recover()): the scan is
+ * retried, then the module is re-synced with a bare "AT", at last it is
+ * reset (GPIO, the module on the IoT card) or re-opened and started again.
+ * The station table is kept meanwhile.
+ *
+ * The ScanBLE function can be called and the BX310x modules will
+ * perform a BT scan. In continuous mode (default) the scan thread issues
+ * the next scan as soon as the final response of the previous one
+ * arrived, so the radio is (almost) always scanning - the results of
+ * the previous scan are processed meanwhile from the scan queue.
+ * Scan window and interval can be changed at runtime (see ScanControl.c),
+ * if the interval is longer than the window the scan thread pauses in
+ * between. The scan command itself is run on a separate
+ * scan thread, so the Legato event loop of the calling thread is not
+ * blocked while the module is scanning. The scan thread itself blocks
+ * in the AT command until the final response, so the +SRBLESCAN lines
+ * are received on a reader thread of the device: the unsolicited response
+ * handler is registered there and that thread never sends an AT command,
+ * so each line is delivered while the scan is running. It is parsed
+ * (ScanParser.c) and binary packed straight into a pre-allocated slot of
+ * the scan queue (ScanQueue.c) - the reader thread is the producer of the queue.
+ * The calling thread is woken up by the queue and gives each result as
+ * a parameter to the previously provided callback function. Each result
+ * is tagged with the number of its scan, so in continuous mode the
+ * results of the next scan are only handed over after the scan done
+ * callback of the previous one (with the AT client a line which is still
+ * on its way to the reader thread when the final response arrives counts
+ * for the next scan). Nothing is
+ * allocated per scan or per result - the final response is handed over
+ * in a stack buffer.
+ * In case the calling thread is busy (e.g. reporting to AirVantage) the
+ * results wait in the queue - if it overflows they are dropped and
+ * counted.
+ *
+ * With BX31_RAW_TTY defined the AT client is used for the initialization
+ * only. Afterwards the scan thread owns the UART file descriptor: it
+ * writes the scan command itself, reads into a receive buffer, frames
+ * the lines and parses the +SRBLESCAN lines straight out of the buffer.
+ * It does not block, so there is no reader thread - the scan thread is
+ * the producer of the scan queue.
  *
  * CAREFUL: the BTScanResult_t struct which is given to callback
- * function is allocated from pool - but _not_ freed here
- * - take care of freeing it outside of this module
+ * function is a queue slot - it is only valid during the callback,
+ * copy what needs to be kept
  *
  *  This is part of the "BX31_ATService" Project
  *  Created on: Feb 21, 2019
@@ -23,486 +70,1523 @@
  */
 
 #include "BX31_ATServiceComponent.h"
+#include "ScanQueue.h"
 #include "legato.h"
 #include "interfaces.h"
 #include <unistd.h>
 #include <string.h>
 
-le_atClient_DeviceRef_t DevRef;
-le_atClient_UnsolicitedResponseHandlerRef_t UnsolCmtiRef;
-static le_atClient_CmdRef_t cmdRef;
-static int fd = 0;                                                              // BX31 (Module UART1) serial device file descriptor
+typedef enum {
+	BX31_STATE_OPEN,
+	BX31_STATE_PROBE,
+	BX31_STATE_BOOT,
+	BX31_STATE_IDENTIFY,
+	BX31_STATE_CONFIGURE,
+	BX31_STATE_READY,
+	BX31_STATE_FAILED
+} BX31_State_t;
+
+typedef struct {
+	uint8_t radio;						// index in devices[], given with each scan result
+	const char *devicePath;
+	int fd;								// BX31 serial device file descriptor
+	le_atClient_DeviceRef_t devRef;
+	le_atClient_UnsolicitedResponseHandlerRef_t unsolScanRef;
+
+	BX31_State_t state;					// startup state - owned by the scan thread
+	le_timer_Ref_t startupTimerRef;		// polls the module during startup
+	le_clk_Time_t probeStartTime;
+	bool ready;							// startup done - owned by the calling thread
+	bool booting;						// module was reset - wait for it to boot after opening
+	uint32_t firstScanMs;				// time from start to the first scan, 0 until then
+
+	unsigned int failedCommands;		// recovery ladder - failed scans in a row, owned by the scan thread
+	bool down;							// module is failing, owned by the scan thread
+	le_clk_Time_t downSince;
+	uint32_t recoveries;				// statistics - written by the scan thread only
+	uint32_t resets;
+	uint64_t downtimeMs;
+
+	le_thread_Ref_t scanThreadRef;		// thread which runs the blocking scan command
+	le_atClient_CmdRef_t scanCmdRef;	// command reference owned by the scan thread
+	ScanQueue_t *queue;					// scan results from the I/O thread to the calling thread
+	le_fdMonitor_Ref_t queueMonitorRef;	// wakes up the calling thread on new results
+	bool scanInProgress;				// owned by the calling thread
+	int deliveredResultNumber;			// owned by the calling thread: results of the running scan
+										// given to the callback
+	uint32_t deliveredScan;				// owned by the calling thread: number of the scan whose results
+										// are given to the callback
+	uint32_t scanNumber;				// number of the running scan - advanced by the scan thread when a
+										// scan finished, the I/O thread tags each result with it
+	bool scanContinued;					// written by the scan thread: it issued the next scan itself
+	le_timer_Ref_t scanPauseTimerRef;	// owned by the scan thread
+
+	int scanResultNumber;				// number of lines received within the running scan - counted
+										// by the I/O thread, reset by the scan thread
+	le_clk_Time_t scanStartTime;		// owned by the scan thread
+	uint64_t scanBusyMs;				// time the radio was scanning, written by the scan thread only
+
+#ifdef BX31_RAW_TTY
+	int rawFd;							// UART fd owned by the scan thread after init
+	le_fdMonitor_Ref_t rawMonitorRef;
+	le_timer_Ref_t rawScanTimeoutRef;	// final response of the scan did not arrive
+	bool rawScanRunning;				// scan command sent, final response pending
+	bool rawProbeRunning;				// recovery: "AT" sent, final response pending
+	size_t rxLen;
+	char rxBuffer[BX31_RAW_RX_BUFFER_SIZE];	// received but not yet framed bytes
+#else
+	le_thread_Ref_t readerThreadRef;	// receives the +SRBLESCAN lines, never sends an AT command
+	le_sem_Ref_t readerSem;				// the scan thread waits on it for calls run on the reader thread
+#endif /* BX31_RAW_TTY */
+} BX31_Device_t;
+
+static const char *const devicePaths[] = BX31_SERIAL_DEVICES;
+static BX31_Device_t devices[BX31_MAX_DEVICES];
+static unsigned int deviceCount = 0;                                            // number of configured devices
+
+static le_thread_Ref_t callerThreadRef = NULL;                                  // thread which receives the scan results
+static le_clk_Time_t startTime;                                                 // bx31at_initBLE() was called
+#ifndef RUN_BX_ON_USB
+static le_timer_Ref_t resetTimerRef = NULL;                                     // length of the GPIO reset pulse
+#endif /* RUN_BX_ON_USB */
+static bool continuousScan = BX31_CONTINUOUS_SCAN;                              // next scan is issued on the final response
 
+static unsigned int scanWindow = BX31_SCAN_WINDOW_DEFAULT;                      // seconds - read by the scan threads on each scan
+static unsigned int scanInterval = BX31_SCAN_WINDOW_DEFAULT;                    // seconds from scan start to scan start
 
 static callbackOnScan_t callback = NULL;                                        // this callback is called in case a BT scan was
                                                                                 // received from AT CLI
+static callbackOnScanDone_t scanDoneCallback = NULL;                            // called when a scan finished, after its results
 
 
-le_mem_PoolRef_t scannedBTStationsPool;
-
 /** ------------------------------------------------------------------------
  *
- * Is called to initialize the BT scanner
+ * @return true if the module can be reset via the enable GPIO - only the
+ *         (first) module, the one on the IoT card
  *
- *  @param  callback in case advertisement messages are collected, callback
- *          will be called for each advertisement and after ScanBLE was called.
- *          CAREFUL: the BTScanResult_t struct which is given as parameter to
- *          callback function is allocated from pool - but _not_ freed here
- *          - take care of freeing it outside of this module
+ * -------------------------------------------------------------------------
+ */
+
+static inline bool bx31at_hasResetGpio(const BX31_Device_t *dev) {
+#ifndef RUN_BX_ON_USB
+        return dev->radio == 0;
+#else
+        return false;
+#endif /* RUN_BX_ON_USB */
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the I/O thread (reader thread, in raw mode the scan thread) -
+ * parses one +SRBLESCAN line into the next free slot of the scan queue
+ * of the device
  *
+ *  @param dev the device which received the line
+ *  @param line the +SRBLESCAN line, does not need to be 0 terminated
+ *  @param len number of characters in line
  *
  * -------------------------------------------------------------------------
  */
 
-void bx31at_initBLE(callbackOnScan_t callbackOnScan) {
+static void bx31at_queueScanLine(BX31_Device_t *dev, const char *line, size_t len) {
 
-        char buffer[LE_ATDEFS_RESPONSE_MAX_BYTES];
-        memset(buffer, 0, LE_ATDEFS_RESPONSE_MAX_BYTES);
+        __atomic_add_fetch(&dev->scanResultNumber, 1, __ATOMIC_RELAXED);
 
-        LE_INFO("Initializing BX31 AT interface");
+        BTScanResult_t *scanResult = scanq_reserve(dev->queue);
+        if (scanResult == NULL) return;                                         // queue is full - counted as dropped
 
+        le_result_t result = bx31at_parseScanResult(line, len, scanResult);
+        if (result != LE_OK) {
+                LE_ERROR("Problem to tokenize BL Scan String (%d), "
+                                "given buffer was \"%.*s\".", result, (int) len, line);
+                return;
+        }
 
+        scanResult->radio = dev->radio;
+        scanResult->scan = __atomic_load_n(&dev->scanNumber, __ATOMIC_ACQUIRE);
+        scanq_commit(dev->queue);
+}
 
-#ifdef __CDT_PARSER__
-#define GPIO_BX_ENABLE_ACTIVE_HIGH 0    // this is a workaround for the eclipse environment - not to highlight
-#define GPIO_BX_FWFLASH_ACTIVE_LOW 1    // the auto generated Macros as error or undefined
-#endif
+/** ------------------------------------------------------------------------
+ *
+ * Unsolicited response handler - runs on the reader thread and is called
+ * for each +SRBLESCAN line as soon as the BX31 reports it, while the scan
+ * thread still waits for the final response of the scan command.
+ *
+ *  @param unsolicitedRsp the complete +SRBLESCAN line
+ *  @param contextPtr the device
+ *
+ * -------------------------------------------------------------------------
+ */
 
-#ifndef RUN_BX_ON_USB
-        gpio_bx_enable_SetPushPullOutput(GPIO_BX_ENABLE_ACTIVE_HIGH, false);    // the BX31 IoT board can be controlled via GPIO Pins
-        gpio_bx_fwFlash_SetPushPullOutput(GPIO_BX_FWFLASH_ACTIVE_LOW, false);   // GPIO 2 =  gpio_bx_enable switches the board/on off. It can be used for reset
-        sleep(0.2);                                                             // GPIO 42 =  gpio_bx_fwFlash can be used to flash the FW.
-        gpio_bx_enable_Activate();                                              // here we initialize the GPIOs correctly and reset the IoT Card
-        sleep(2);
-#endif /* RUN_BX_ON_USB */
+#ifndef BX31_RAW_TTY
+static void bx31at_unsolScanHandler(const char *unsolicitedRsp, void *contextPtr) {
+        bx31at_queueScanLine(contextPtr, unsolicitedRsp, strnlen(unsolicitedRsp, LE_ATDEFS_RESPONSE_MAX_BYTES));
+}
+#endif /* BX31_RAW_TTY */
 
-        LE_ASSERT((scannedBTStationsPool =
-                   le_mem_CreatePool("stationScan",
-                                     sizeof(BTScanResult_t))) != NULL);
-        le_mem_ExpandPool(scannedBTStationsPool,
-                          MAX_SCANNED_STATION_MEM_POOL_SIZE);
+/** ------------------------------------------------------------------------
+ *
+ * Hands the queued scan results of the device over to the callback -
+ * runs on the calling thread, from the fd monitor handler of the scan
+ * queue eventfd and when a scan is done. Only the results of the scan
+ * which is delivered now are handed over: in continuous mode the next
+ * scan is running before bx31at_scanDone() of the previous one was
+ * called, its results stay in the queue until then.
+ *
+ *  @param dev the device
+ * -------------------------------------------------------------------------
+ */
 
-        callback = callbackOnScan;
+static void bx31at_deliverScanResults(BX31_Device_t *dev) {
+        BTScanResult_t *scanResult;
+        while ((scanResult = scanq_front(dev->queue)) != NULL
+               && (int32_t) (scanResult->scan - dev->deliveredScan) <= 0) {
+                ++dev->deliveredResultNumber;
+
+                if (callback != NULL) {
+                        callback(dev->deliveredResultNumber, scanResult);
+                } else {
+                        LE_WARN("BT Callback NOT SET - got BT Scan  %d: %012llx",
+                                dev->deliveredResultNumber, scanResult->btStationAddress);
+                }
 
-        fd = le_tty_Open(BX31_SERIAL_DEVICE, O_RDWR | O_NDELAY
-                                                | O_NOCTTY | O_NONBLOCK);       // opening the UART2 - which is connected to the
-        if (fd == -1) {                // IoT Board
-                LE_ERROR("failed to open UART device");
-                exit(EXIT_FAILURE);
+                scanq_pop(dev->queue);
         }
+}
 
-        LE_ASSERT(le_tty_SetBaudRate(fd, LE_TTY_SPEED_115200) == LE_OK);        // assuming BX31 is on 115200
-        LE_ASSERT(le_tty_SetFraming(fd, 'N', 8, 1) == LE_OK);                   // set UART framing to 8bit, No Parity, 1 Stop bit
-        LE_ASSERT(le_tty_SetRaw(fd, 10, 30000) == LE_OK);                       // We need raw UART mode (the canonical echo's
-                                                                                // back to peer)
-
-        int newFd = dup(fd);                                                    // we need to duplicate the file descriptor because
-        DevRef = le_atClient_Start(fd);                                         // we are checking two times if there is still an
-                                                                                // open atClient
+static void bx31at_scanQueueHandler(int fd, short events) {
+        BX31_Device_t *dev = le_fdMonitor_GetContextPtr();
 
-        /* Try to stop the device */
-        LE_ASSERT(le_atClient_Stop(DevRef) == LE_OK);                           // checking twice
-        LE_ASSERT(le_atClient_Stop(DevRef) == LE_FAULT);
-        DevRef = le_atClient_Start(newFd);
+        scanq_clearEvent(dev->queue);                                           // clear first - results committed from now
+        bx31at_deliverScanResults(dev);                                         // on signal again or are found below
+}
 
-        cmdRef = le_atClient_Create();                                          // instantiate an AT interpreter client
+/** ------------------------------------------------------------------------
+ *
+ * Queued back to the calling thread once the scan thread got the final
+ * response of the scan command. The results of the scan which are still
+ * in the queue are delivered first, so the scan done callback comes
+ * after all results of the scan. Then the results of the next scan are
+ * delivered, its count starts again - also in continuous mode, where
+ * startScan() is not called.
+ *
+ *  @param param1Ptr the device
+ *  @param param2Ptr number of the scan which finished
+ *
+ * -------------------------------------------------------------------------
+ */
 
-        /* ======= Here first BX31 checks and initialization starts */
+static void bx31at_scanDone(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+        uint32_t finishedScan = (uint32_t) (uintptr_t) param2Ptr;
 
-        /* --- Clean Up a may messed AT interface --- */
-        LE_INFO("Cleaning AT interface");                                       // Just send an empty AT command to get the interface clean
+        dev->scanInProgress = __atomic_load_n(&dev->scanContinued, __ATOMIC_ACQUIRE);
 
-        LE_ASSERT(le_atClient_SetCommandAndSend
-                  (&cmdRef, DevRef, "AT", "", "OK|ERROR|+CME ERROR",
-                   LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT) == LE_OK);
+        dev->deliveredScan = finishedScan;
+        bx31at_deliverScanResults(dev);
+        LE_DEBUG("BT Scan %u on %s done, %d results delivered",
+                 finishedScan, dev->devicePath, dev->deliveredResultNumber);
+        dev->deliveredResultNumber = 0;
+        if (scanDoneCallback != NULL) scanDoneCallback(dev->radio);
 
-        LE_ASSERT(le_atClient_GetFinalResponse(cmdRef,
-                   buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);             // We don't care about the result
+        dev->deliveredScan = finishedScan + 1;
+        bx31at_deliverScanResults(dev);                                         // the next scan, the queue event may
+}                                                                               // have been cleared for them already
 
-        memset(buffer, 0, 50);
+static void bx31at_runScan(void *param1Ptr, void *param2Ptr);
+static bool bx31at_recover(BX31_Device_t *dev);
+static void bx31at_recovered(BX31_Device_t *dev);
 
-        /* --- check if we're really talking to BX31 --- */
-        LE_INFO("Check BX310x presence");                                       // We ask for device identification string
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread when the final response of the scan command
+ * was received. Accounts the scan time and, in continuous mode, issues
+ * the next scan right away - or after a pause if the scan interval is
+ * longer than the scan. After an error the recovery ladder decides how
+ * to go on.
+ *
+ *  @param dev the device which finished the scan
+ *  @param finalResponse final response string - only used during the call
+ *
+ * -------------------------------------------------------------------------
+ */
 
-        LE_ASSERT(le_atClient_SetCommandAndSend
-                  (&cmdRef, DevRef, "ATI", "", "OK|ERROR|+CME ERROR",
-                   LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT) == LE_OK);
+static void bx31at_finishScan(BX31_Device_t *dev, const char *finalResponse) {
+        le_clk_Time_t duration = le_clk_Sub(le_clk_GetRelativeTime(), dev->scanStartTime);
+        bool succeeded = strcmp(finalResponse, "OK") == 0;
+        bool continued = continuousScan && succeeded;
+        uint32_t finishedScan = dev->scanNumber;
+
+        __atomic_store_n(&dev->scanNumber, finishedScan + 1, __ATOMIC_RELEASE); // results from now on belong to the next
+                                                                                // scan - before it is issued
+
+        __atomic_add_fetch(&dev->scanBusyMs, duration.sec * 1000 + duration.usec / 1000, __ATOMIC_RELAXED);
+
+        LE_DEBUG("Final response after Scan on %s: %s, got %d results in %ld.%03ld s",
+                 dev->devicePath, finalResponse, __atomic_load_n(&dev->scanResultNumber, __ATOMIC_RELAXED),
+                 (long) duration.sec, (long) duration.usec / 1000);
+
+        if (continued) {
+                int64_t pauseMs = (int64_t) __atomic_load_n(&scanInterval, __ATOMIC_RELAXED) * 1000
+                                  - (duration.sec * 1000 + duration.usec / 1000);
+                if (pauseMs > 0) {
+                        le_timer_SetMsInterval(dev->scanPauseTimerRef, pauseMs);
+                        le_timer_Start(dev->scanPauseTimerRef);
+                } else {
+                        le_event_QueueFunction(bx31at_runScan, dev, NULL);      // queued first - the radio is busy again
+                }                                                               // before the results are processed
+        }
 
-        LE_ASSERT(le_atClient_GetFinalResponse
-                  (cmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
+        if (succeeded) {
+                bx31at_recovered(dev);
+        } else {
+                LE_WARN("BT Scan on %s did not succeed: %s", dev->devicePath, finalResponse);
+                continued = bx31at_recover(dev);                                // true if the scan thread goes on by itself
+        }
+        __atomic_store_n(&dev->scanContinued, continued, __ATOMIC_RELEASE);
+        le_event_QueueFunctionToThread(callerThreadRef, bx31at_scanDone, dev, (void *) (uintptr_t) finishedScan);
+}
 
-        memset(buffer, 0, 50);
+#ifdef BX31_RAW_TTY
 
-        LE_ASSERT(le_atClient_GetFirstIntermediateResponse
-                  (cmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
-        /*   LE_ASSERT(le_atClient_GetNextIntermediateResponse(cmdRef,buffer, LE_ATDEFS_RESPONSE_MAX_BYTES)
-           == LE_NOT_FOUND); */
+/** ------------------------------------------------------------------------
+ *
+ * Raw mode: the final response of the scan command was received (or the
+ * scan timed out) - hands it over to the calling thread. The final
+ * response of a recovery "AT" goes to the recovery ladder.
+ *
+ *  @param dev the device which received the line
+ *  @param line final response, does not need to be 0 terminated
+ *  @param len number of characters in line
+ *
+ * -------------------------------------------------------------------------
+ */
 
-        if (strncmp(buffer, "BX310", 4) != 0) {                                 // and compare it with the expected
-                LE_ERROR("This doesn seem to be a BX310x bluetooth module, "
-                                "exiting. Response was \"%s\"", buffer);        // if the BT module is not answering we better exit
+static void bx31at_resyncDone(BX31_Device_t *dev, bool answered);
 
-                LE_ASSERT(le_atClient_Delete(cmdRef) == LE_OK);                 // there might be a better strategy to recover eg.
-                le_tty_Close(newFd);                                            // an uninitialized Module
-                exit(EXIT_FAILURE);
+static void bx31at_rawFinalResponse(BX31_Device_t *dev, const char *line, size_t len) {
+        if (dev->rawProbeRunning) {
+                dev->rawProbeRunning = false;
+                le_timer_Stop(dev->rawScanTimeoutRef);
+                bx31at_resyncDone(dev, len == 2 && memcmp(line, "OK", 2) == 0);
+                return;
         }
-        memset(buffer, 0, 50);
-
-        /* --- Disable WiFi --- */
-        LE_INFO("Disable WiFi on BX310x");                                      // We use the BX just for BT scanning
-        LE_ASSERT(le_atClient_SetCommandAndSend
-                  (&cmdRef, DevRef, "AT+SRWCFG=0", "", "OK|ERROR|+CME ERROR",
-                   LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT) == LE_OK);
 
-        LE_ASSERT(le_atClient_GetFinalResponse
-                  (cmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
+        if (!dev->rawScanRunning) {
+                LE_WARN("unexpected final response \"%.*s\" on %s", (int) len, line, dev->devicePath);
+                return;
+        }
 
-        memset(buffer, 0, 50);
+        char finalResponse[BX31_FINAL_RESPONSE_MAX];
 
-        /* --- Enable BT --- */
-        LE_DEBUG("Enable BT on BX310x");
+        dev->rawScanRunning = false;
+        le_timer_Stop(dev->rawScanTimeoutRef);
 
-        LE_ASSERT(le_atClient_SetCommandAndSend
-                  (&cmdRef, DevRef, "AT+SRBTSYSTEM=1", "",
-                   "OK|ERROR|+CME ERROR",
-                   LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT) == LE_OK);
+        snprintf(finalResponse, sizeof(finalResponse), "%.*s", (int) len, line);
+        bx31at_finishScan(dev, finalResponse);
+}
 
-        LE_ASSERT(le_atClient_GetFinalResponse
-                  (cmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
+static void bx31at_rawScanTimeout(le_timer_Ref_t timerRef) {
+        BX31_Device_t *dev = le_timer_GetContextPtr(timerRef);
 
-        memset(buffer, 0, 50);
+        LE_ERROR("no final response for the %s on %s",
+                 dev->rawProbeRunning ? "AT probe" : "BT scan", dev->devicePath);
+        bx31at_rawFinalResponse(dev, "TIMEOUT", 7);
+}
 
-        /* --- Disable BT power save --- */
-        LE_DEBUG("Disable BT power save for BX310x");
+/** ------------------------------------------------------------------------
+ *
+ * Raw mode: finds the next CR or LF. The buffer is scanned a machine word
+ * (8 characters) at a time, bytes are only looked at one by one around
+ * the line end.
+ *
+ *  @param pos start of the scan
+ *  @param end end of the received data
+ *
+ *  @return pointer to the CR/LF or NULL if there is none
+ *
+ * -------------------------------------------------------------------------
+ */
 
-        LE_ASSERT(le_atClient_SetCommandAndSend
-                  (&cmdRef, DevRef, "AT+SRBTPS=0", "", "OK|ERROR|+CME ERROR",
-                   LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT) == LE_OK);
+#define BX31_ONES 0x0101010101010101ULL
+#define BX31_HAS_ZERO_BYTE(v) (((v) - BX31_ONES) & ~(v) & (BX31_ONES << 7))
 
-        LE_ASSERT(le_atClient_GetFinalResponse
-                  (cmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
+static const char *bx31at_findLineEnd(const char *pos, const char *end) {
 
-        memset(buffer, 0, 50);
+        for (; end - pos >= 8; pos += 8) {
+                uint64_t word;
+                memcpy(&word, pos, sizeof(word));                               // compiles to one (unaligned) load
+                if (BX31_HAS_ZERO_BYTE(word ^ (BX31_ONES * '\r'))
+                    || BX31_HAS_ZERO_BYTE(word ^ (BX31_ONES * '\n'))) {
+                        break;
+                }
+        }
 
-        /* --- No own advertising --- */
-        LE_INFO("Disable own BT advertising on BX310x");
+        for (; pos < end; ++pos) {
+                if (*pos == '\r' || *pos == '\n') return pos;
+        }
 
-        le_atClient_SetCommandAndSend(&cmdRef, DevRef, "AT+SRBLEADV=1", "",
-                                      "OK|ERROR|+CME ERROR",
-                                      LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT);
+        return NULL;
+}
 
-        //      LE_ASSERT(le_atClient_GetFinalResponse( cmdRef,buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
-        //      memset(buffer,0,50);
+/** ------------------------------------------------------------------------
+ *
+ * Raw mode: handles one complete line received from the BX31
+ *
+ *  @param dev the device which received the line
+ *  @param line the line without CR/LF
+ *  @param len number of characters in line
+ *
+ * -------------------------------------------------------------------------
+ */
 
-        LE_ASSERT(le_atClient_SetCommandAndSend
-                  (&cmdRef, DevRef, "AT+SRBLEADV=0", "", "OK|ERROR|+CME ERROR",
-                   LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT) == LE_OK);
+static void bx31at_rawLine(BX31_Device_t *dev, const char *line, size_t len) {
+        static const char scanPrefix[] = "+SRBLESCAN:";
 
-        LE_ASSERT(le_atClient_GetFinalResponse
-                  (cmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
+#define BX31_LINE_IS(str) (len == sizeof(str) - 1 && memcmp(line, str, len) == 0)
+#define BX31_LINE_STARTS(str) (len >= sizeof(str) - 1 && memcmp(line, str, sizeof(str) - 1) == 0)
 
-        memset(buffer, 0, 50);
+        if (BX31_LINE_STARTS(scanPrefix)) {
+                bx31at_queueScanLine(dev, line, len);
+        } else if (BX31_LINE_IS("OK") || BX31_LINE_IS("ERROR") || BX31_LINE_STARTS("+CME ERROR")) {
+                bx31at_rawFinalResponse(dev, line, len);
+        } else {                                                                // command echo, +SRBLESCAN_NONE
+#ifdef DEBUG_BX31
+                LE_DEBUG("ignoring line \"%.*s\"", (int) len, line);
+#endif /* DEBUG_BX31 */
+        }
 
+#undef BX31_LINE_IS
+#undef BX31_LINE_STARTS
 }
 
 /** ------------------------------------------------------------------------
- * Stops the BX31 AT Service, releases all resources
+ *
+ * Raw mode: fd monitor handler of the UART - reads what is available and
+ * handles all complete lines in place. The rest of an incomplete line is
+ * moved to the start of the receive buffer.
+ *
+ *  @param fd the UART file descriptor
+ *  @param events poll events
+ *
  * -------------------------------------------------------------------------
  */
-void bx31at_stopBLE() {
-        LE_INFO("Stopping BX_AT");
-        LE_ASSERT(le_atClient_Delete(cmdRef) == LE_OK);
-        le_tty_Close(fd);                                                       // Close the serial file descriptor
-        callback = NULL;
-        gpio_bx_enable_Deactivate();
+
+static void bx31at_rawReadHandler(int fd, short events) {
+        BX31_Device_t *dev = le_fdMonitor_GetContextPtr();
+        char *rxBuffer = dev->rxBuffer;
+
+        if (events & (POLLERR | POLLHUP)) {
+                LE_ERROR("BX31 UART error on %s (events 0x%x)", dev->devicePath, events);
+        }
+
+        for (;;) {
+                ssize_t received = read(fd, rxBuffer + dev->rxLen, sizeof(dev->rxBuffer) - dev->rxLen);
+                if (received <= 0) {
+                        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                                LE_ERROR("could not read from BX31 UART %s: %m", dev->devicePath);
+                        }
+                        return;
+                }
+
+                const char *pos = rxBuffer + dev->rxLen;                        // the kept rest contains no line end
+                const char *lineStart = rxBuffer;
+                const char *end = rxBuffer + dev->rxLen + received;
+                const char *lineEnd;
+
+                while ((lineEnd = bx31at_findLineEnd(pos, end)) != NULL) {
+                        if (lineEnd > lineStart) bx31at_rawLine(dev, lineStart, lineEnd - lineStart);
+                        lineStart = pos = lineEnd + 1;
+                }
+
+                dev->rxLen = end - lineStart;
+                if (dev->rxLen == sizeof(dev->rxBuffer)) {
+                        LE_WARN("line longer than %zu characters - discarded", sizeof(dev->rxBuffer));
+                        dev->rxLen = 0;
+                } else if (lineStart != rxBuffer && dev->rxLen > 0) {
+                        memmove(rxBuffer, lineStart, dev->rxLen);
+                }
+        }
 }
 
+#endif /* BX31_RAW_TTY */
+
 /** ------------------------------------------------------------------------
  *
- * Getter for command reference this is required for timer
+ * Runs on the scan thread - sends the scan command and blocks until the
+ * final response (in raw mode it returns after sending the command).
+ * The scan results itself are not collected here, they arrive in the
+ * meantime as unsolicited responses on the reader thread (in raw mode
+ * they are read on this thread).
+ *
+ *  @param param1Ptr the device
  *
  * -------------------------------------------------------------------------
  */
-// FIXME timer and command reference could be better isolated
 
-le_atClient_CmdRef_t bx31at_getCmdRef() {
-        return cmdRef;
+static void bx31at_runScan(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+
+        if (dev->state != BX31_STATE_READY) {                                   // handed over just before a reset
+                LE_DEBUG("BX31 on %s not ready, BT Scan skipped", dev->devicePath);
+                return;
+        }
+
+        unsigned int window = __atomic_load_n(&scanWindow, __ATOMIC_RELAXED);
+        uint32_t timeoutMs = window * 1000 + LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT;
+        char command[sizeof(BX31_SCAN_COMMAND_FMT) + 12];
+
+        /* --- Run BT Scan  --- */
+        LE_DEBUG("run the BT Scan on %s, window %u s", dev->devicePath, window);
+        __atomic_store_n(&dev->scanResultNumber, 0, __ATOMIC_RELAXED);
+        dev->scanStartTime = le_clk_GetRelativeTime();
+
+        if (dev->firstScanMs == 0) {                                            // time to first scan - the startup metric
+                le_clk_Time_t startup = le_clk_Sub(dev->scanStartTime, startTime);
+                uint32_t startupMs = startup.sec * 1000 + startup.usec / 1000;
+
+                LE_INFO("first BT Scan on %s %u ms after start", dev->devicePath, startupMs);
+                __atomic_store_n(&dev->firstScanMs, startupMs ? startupMs : 1, __ATOMIC_RELAXED);
+        }
+
+#ifdef BX31_RAW_TTY
+        int len = snprintf(command, sizeof(command), BX31_SCAN_COMMAND_FMT "\r", window);
+
+        dev->rawScanRunning = true;
+        le_timer_SetMsInterval(dev->rawScanTimeoutRef, timeoutMs);
+        le_timer_Start(dev->rawScanTimeoutRef);
+        if (write(dev->rawFd, command, len) != len) {
+                LE_ERROR("could not send scan command to %s: %m", dev->devicePath);
+                bx31at_rawFinalResponse(dev, "ERROR", 5);
+        }
+#else
+        char buffer[LE_ATDEFS_RESPONSE_MAX_BYTES];
+
+        snprintf(command, sizeof(command), BX31_SCAN_COMMAND_FMT, window);
+        le_result_t result = le_atClient_SetCommandAndSend
+                  (&dev->scanCmdRef, dev->devRef, command, BX31_NO_INTERMEDIATE,
+                   "OK|ERROR|+CME ERROR",
+                   timeoutMs);
+
+        if (result == LE_OK) {
+                result = le_atClient_GetFinalResponse
+                          (dev->scanCmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES);
+        }
+        if (result != LE_OK) {                                                  // no (valid) final response - handled
+                LE_ERROR("BT Scan command on %s failed: %d", dev->devicePath, result);  // as error by finishScan
+                snprintf(buffer, sizeof(buffer), result == LE_TIMEOUT ? "TIMEOUT" : "ERROR");
+        }
+
+        bx31at_finishScan(dev, buffer);
+#endif /* BX31_RAW_TTY */
+}
+
+static void bx31at_scanPauseExpired(le_timer_Ref_t timerRef) {
+        bx31at_runScan(le_timer_GetContextPtr(timerRef), NULL);
 }
 
 /** ------------------------------------------------------------------------
  *
- * Converts a Bluetooth address String (eventually in quotes)
- * into an integer representation
- *  @param *addrStr - pointer to address string
+ * Runs on the scan thread - sends an AT command and waits for the final
+ * response
  *
- *  @return uint64 integer representation of the address string
+ *  @param dev the device
+ *  @param command the AT command
+ *  @param intermediate prefix of the intermediate response to get or ""
+ *  @param timeoutMs how long to wait for the final response
+ *  @param response buffer for the first intermediate response, may be
+ *         NULL if there is none expected
+ *  @param responseLen size of the response buffer
  *
- * ------------------------------------------------------------------------
+ *  @return LE_OK if the final response was OK, LE_TIMEOUT if the module
+ *          did not answer, LE_FAULT otherwise
+ *
+ * -------------------------------------------------------------------------
  */
 
-uint64_t bx31at_btAddrToInt(char *addrStr) {
+static le_result_t bx31at_sendCommand(BX31_Device_t *dev, const char *command, const char *intermediate,
+                                      uint32_t timeoutMs, char *response, size_t responseLen) {
+        char finalResponse[LE_ATDEFS_RESPONSE_MAX_BYTES];
 
-        uint64_t result = 0;
+        le_result_t result = le_atClient_SetCommandAndSend(&dev->scanCmdRef, dev->devRef, command, intermediate,
+                                                           "OK|ERROR|+CME ERROR", timeoutMs);
+        if (result != LE_OK) return result == LE_TIMEOUT ? LE_TIMEOUT : LE_FAULT;
 
-        if (addrStr == NULL) {
-                LE_ERROR("NULL pointer given for addr string");
-                return 0;
+        if (le_atClient_GetFinalResponse(dev->scanCmdRef, finalResponse, sizeof(finalResponse)) != LE_OK
+            || strcmp(finalResponse, "OK") != 0) {
+                return LE_FAULT;
         }
 
-        if (strnlen(addrStr, 20) < 19) {                                        // addr str including quotes
-                LE_ERROR("Problem parsing BT address to int Addr Str was: %s",
-                         addrStr);
-                return 0;
+        if (response != NULL) {
+                response[0] = '\0';
+                if (le_atClient_GetFirstIntermediateResponse(dev->scanCmdRef, response, responseLen) != LE_OK) {
+                        return LE_FAULT;
+                }
         }
 
-        if (addrStr[0] == '\"') ++addrStr;                                      // remove leading quote
-        if (addrStr[17] == '\"') addrStr[17] = 0;                               // remove tailing quote
+        return LE_OK;
+}
 
-        int oct[6];
-        if (sscanf
-            (addrStr, "%x:%x:%x:%x:%x:%x", &oct[5], &oct[4], &oct[3], &oct[2],
-             &oct[1], &oct[0]) < 6) {
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread - opens the serial device and starts the AT
+ * client on it
+ *
+ *  @param dev the device
+ *
+ *  @return LE_OK or LE_FAULT if the device could not be opened
+ *
+ * -------------------------------------------------------------------------
+ */
 
-                LE_ERROR("Problem parsing BT address to int Addr Str was: %s",
-                         addrStr);
+static le_result_t bx31at_openDevice(BX31_Device_t *dev) {
 
-                return 0;
+        dev->fd = le_tty_Open(dev->devicePath, O_RDWR | O_NDELAY
+                                                | O_NOCTTY | O_NONBLOCK);       // opening the UART2 - which is connected to the
+        if (dev->fd == -1) {           // IoT Board
+                LE_ERROR("failed to open UART device %s", dev->devicePath);
+                return LE_FAULT;
         }
 
-        for (int i = 5; i >= 0; i--) {
-                result |= (uint64_t) oct[i] << (CHAR_BIT * i);
+        if (le_tty_SetBaudRate(dev->fd, LE_TTY_SPEED_115200) != LE_OK           // assuming BX31 is on 115200
+            || le_tty_SetFraming(dev->fd, 'N', 8, 1) != LE_OK                   // set UART framing to 8bit, No Parity, 1 Stop bit
+            || le_tty_SetRaw(dev->fd, 10, 30000) != LE_OK) {                    // We need raw UART mode (the canonical echo's
+                LE_ERROR("failed to configure UART device %s", dev->devicePath);  // back to peer)
+                le_tty_Close(dev->fd);
+                dev->fd = -1;
+                return LE_FAULT;
         }
 
-#ifdef DEBUG_BX31
-        LE_DEBUG("Converted address string \"%s\" to int: \"%012llx\"", addrStr,
-                 result);
-#endif  /* DEBUG_BX31 */
+        int newFd = dup(dev->fd);                                               // we need to duplicate the file descriptor because
+        dev->devRef = le_atClient_Start(dev->fd);                               // we are checking two times if there is still an
+                                                                                // open atClient
+
+        /* Try to stop the device */
+        if (newFd < 0 || dev->devRef == NULL
+            || le_atClient_Stop(dev->devRef) != LE_OK                           // checking twice
+            || le_atClient_Stop(dev->devRef) != LE_FAULT
+            || (dev->devRef = le_atClient_Start(newFd)) == NULL) {
+                LE_ERROR("failed to start AT client on %s", dev->devicePath);
+                if (newFd >= 0) le_tty_Close(newFd);
+                dev->devRef = NULL;
+                dev->fd = -1;
+                return LE_FAULT;
+        }
+        dev->fd = newFd;
 
-        return result;
+        return LE_OK;
 }
 
 /** ------------------------------------------------------------------------
  *
- *  Converts the escaped BT advertisment string - e.g. "\1E\FF\06" to a
- *  binary representation 0x1e 0xff 0x06 ...
+ * Runs on the scan thread - brings the module settings to what the
+ * scanner needs. Each setting is queried first and only written if it
+ * differs, so a module which is already configured (warm start) costs
+ * one query per setting.
  *
- *  @param the escaped source string
- *  @param the buffer where to write to
+ *  @param dev the device
  *
- *  @return length of converted string
+ *  @return LE_OK or LE_FAULT if a setting could not be written
  *
  * -------------------------------------------------------------------------
  */
 
-int bx31at_escapedAdvrtStr2Binary(char *escapedStrIn, char *dstBuffer) {
+static le_result_t bx31at_configure(BX31_Device_t *dev) {
+        static const struct {
+                const char *command;
+                const char *value;
+                const char *description;
+        } settings[] = {
+                { "AT+SRWCFG", "0", "Disable WiFi" },                           // We use the BX just for BT scanning
+                { "AT+SRBTSYSTEM", "1", "Enable BT" },
+                { "AT+SRBTPS", "0", "Disable BT power save" },
+                { "AT+SRBLEADV", "0", "Disable own BT advertising" },
+        };
+        char command[32];
+        char prefix[32];
+        char response[LE_ATDEFS_RESPONSE_MAX_BYTES];
+        unsigned int written = 0;
+
+        for (unsigned int i = 0; i < NUM_ARRAY_MEMBERS(settings); ++i) {
+                snprintf(command, sizeof(command), "%s?", settings[i].command);
+                snprintf(prefix, sizeof(prefix), "+%s:", settings[i].command + 3);      // "AT+SRWCFG" answers "+SRWCFG: 0"
+
+                if (bx31at_sendCommand(dev, command, prefix, BX31_PROBE_TIMEOUT_MS,
+                                       response, sizeof(response)) == LE_OK) {
+                        const char *value = response + strlen(prefix);
+                        size_t valueLen = strlen(settings[i].value);
+
+                        while (*value == ' ') ++value;
+                        if (strncmp(value, settings[i].value, valueLen) == 0
+                            && (value[valueLen] == '\0' || value[valueLen] == ',')) {
+                                continue;                                       // already set
+                        }
+                }                                                               // query not answered - just set it
 
-        if (escapedStrIn == NULL) {
-                LE_ERROR("NULL pointer given for escaped string ");
-                return 0;
+                LE_INFO("%s on %s", settings[i].description, dev->devicePath);
+                snprintf(command, sizeof(command), "%s=%s", settings[i].command, settings[i].value);
+                if (bx31at_sendCommand(dev, command, "", LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT, NULL, 0) != LE_OK) {
+                        LE_ERROR("%s failed on %s", command, dev->devicePath);
+                        return LE_FAULT;
+                }
+                ++written;
         }
 
-        if (escapedStrIn[0] == '\"') ++escapedStrIn;                            // remove leading quote if present
+        LE_INFO("BX31 on %s configured, %u of %zu settings changed",
+                dev->devicePath, written, NUM_ARRAY_MEMBERS(settings));
+        return LE_OK;
+}
 
-        if (escapedStrIn
-            [strnlen(escapedStrIn, MAX_BT_DATA_STRING_SIZE * 3 + 1) - 1] ==
-            '\"')
-                escapedStrIn[strnlen(escapedStrIn, MAX_BT_DATA_STRING_SIZE * 3 + 1) - 1] = 0; // remove tailing quote if present
+#ifndef BX31_RAW_TTY
 
-#ifdef DEBUG_BX31
-        LE_DEBUG("got ESC str: %s", escapedStrIn);
+/** ------------------------------------------------------------------------
+ *
+ * Main function of the reader thread of a device - it has its own
+ * connection to the AT client service, so the unsolicited responses it
+ * registers for are delivered to its event loop. It never sends an AT
+ * command, so it is never blocked while a scan is running.
+ *
+ *  @param contextPtr the device
+ *
+ * -------------------------------------------------------------------------
+ */
 
-        LE_DEBUG("ESC strLen: %d",
-                 strnlen(escapedStrIn, MAX_BT_DATA_STRING_SIZE * 3 + 1));
-#endif /* DEBUG_BX31 */
+static void *bx31at_readerThread(void *contextPtr) {
+        le_atClient_ConnectService();
+
+        le_event_RunLoop();
+        return NULL;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Run on the reader thread - register / remove the unsolicited response
+ * handler for the scan results. The scan thread waits until they are done
+ * (see bx31at_runOnReaderThread()).
+ *
+ *  @param param1Ptr the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_addScanHandler(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+
+        dev->unsolScanRef = le_atClient_AddUnsolicitedResponseHandler(          // scan results are delivered
+                        "+SRBLESCAN:", dev->devRef, bx31at_unsolScanHandler, dev, 1);  // line by line
+        le_sem_Post(dev->readerSem);
+}
+
+static void bx31at_removeScanHandler(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+
+        if (dev->unsolScanRef != NULL) le_atClient_RemoveUnsolicitedResponseHandler(dev->unsolScanRef);
+        dev->unsolScanRef = NULL;
+        le_sem_Post(dev->readerSem);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread - runs a function on the reader thread and
+ * waits until it is done. The reader thread does not block, so this
+ * returns right away. Used so the handler is in place before the first
+ * scan and gone before the device is closed.
+ *
+ *  @param dev the device
+ *  @param func function to run, it posts readerSem when done
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_runOnReaderThread(BX31_Device_t *dev, le_event_DeferredFunc_t func) {
+        le_event_QueueFunctionToThread(dev->readerThreadRef, func, dev, NULL);
+        le_sem_Wait(dev->readerSem);
+}
+
+#endif /* BX31_RAW_TTY */
+
+static void bx31at_resetModule(void *param1Ptr, void *param2Ptr);
+static void bx31at_deviceReady(void *param1Ptr, void *param2Ptr);
+static void bx31at_deviceDown(void *param1Ptr, void *param2Ptr);
+static void bx31at_closeDevice(BX31_Device_t *dev);
+
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread - startup state machine of a device:
+ *
+ *   OPEN       open the serial device
+ *   PROBE      poll "AT" until the module answers - a module which is
+ *              already running answers right away
+ *   BOOT       the module did not answer within BX31_PROBE_WINDOW_MS and
+ *              was reset via GPIO (IoT card only) - poll "AT" until it
+ *              answers, for at most BX31_BOOT_TIMEOUT_MS
+ *   IDENTIFY   check the ATI response
+ *   CONFIGURE  write the settings which differ
+ *   READY      scanning - the calling thread is told and starts the scans
+ *
+ * Polling is done with the startup timer, so the thread does not sleep
+ * and nothing is waited for longer than needed.
+ *
+ *  @param dev the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_startupStep(BX31_Device_t *dev) {
+        char response[LE_ATDEFS_RESPONSE_MAX_BYTES] = "";
+
+        for (;;) {
+                switch (dev->state) {
+                case BX31_STATE_OPEN:
+                        if (bx31at_openDevice(dev) != LE_OK) {
+                                dev->state = BX31_STATE_FAILED;
+                                break;
+                        }
+                        dev->state = dev->booting ? BX31_STATE_BOOT : BX31_STATE_PROBE;
+                        dev->probeStartTime = le_clk_GetRelativeTime();
+                        break;
+
+                case BX31_STATE_PROBE:
+                case BX31_STATE_BOOT:
+                        if (bx31at_sendCommand(dev, "AT", "", BX31_PROBE_TIMEOUT_MS, NULL, 0) == LE_OK) {
+                                dev->state = BX31_STATE_IDENTIFY;
+                                break;
+                        }
+
+                        le_clk_Time_t probing = le_clk_Sub(le_clk_GetRelativeTime(), dev->probeStartTime);
+                        uint32_t probingMs = probing.sec * 1000 + probing.usec / 1000;
+
+                        if (dev->state == BX31_STATE_PROBE && probingMs >= BX31_PROBE_WINDOW_MS
+                            && bx31at_hasResetGpio(dev)) {
+                                LE_INFO("BX31 on %s does not answer, resetting it", dev->devicePath);
+                                dev->state = BX31_STATE_BOOT;
+                                dev->booting = true;
+                                __atomic_add_fetch(&dev->resets, 1, __ATOMIC_RELAXED);
+                                le_event_QueueFunctionToThread(callerThreadRef, bx31at_resetModule, dev, NULL);
+                                return;                                         // continued when the reset pulse is done
+                        }
+                        if (probingMs >= BX31_BOOT_TIMEOUT_MS) {
+                                LE_ERROR("BX31 on %s does not answer", dev->devicePath);
+                                dev->state = BX31_STATE_FAILED;
+                                break;
+                        }
 
-        int numberOfEscapedCharacters = 0;
-
-        int escapedStrlen =
-            strnlen(escapedStrIn, MAX_BT_DATA_STRING_SIZE * 3 + 1);
-        for (int i = 0; i <= escapedStrlen; ++i) {                              // counting the number of escaped bytes in the
-                                                                                // advertisement message
-                if (escapedStrIn[i] == '\\') {                                  // MAX_BT_DATA_STRING_SIZE is the maximum size in
-                                                                                // bytes of a Advertisement message,
-                        ++numberOfEscapedCharacters;                            // escaped it is the ASCII plus backslash = 3 ASCII
-                                                                                // characters per byte
-                        escapedStrIn[i] = 0;                                    // to get the number of bytes in the string we count
-                                                                                // the number of backslashes
+                        le_timer_SetMsInterval(dev->startupTimerRef, BX31_PROBE_INTERVAL_MS);
+                        le_timer_Start(dev->startupTimerRef);                   // poll again
+                        return;
+
+                case BX31_STATE_IDENTIFY:
+                        if (bx31at_sendCommand(dev, "ATI", "", LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT,
+                                               response, sizeof(response)) != LE_OK
+                            || strncmp(response, "BX310", 4) != 0) {            // and compare it with the expected
+                                LE_ERROR("This doesn seem to be a BX310x bluetooth module, "
+                                         "skipping %s. Response was \"%s\"", dev->devicePath, response);
+                                dev->state = BX31_STATE_FAILED;
+                                break;
+                        }
+                        dev->state = BX31_STATE_CONFIGURE;
+                        break;
+
+                case BX31_STATE_CONFIGURE:
+                        dev->state = bx31at_configure(dev) == LE_OK ? BX31_STATE_READY : BX31_STATE_FAILED;
+                        break;
+
+                case BX31_STATE_READY:
+#ifdef BX31_RAW_TTY
+                        /* --- Take over the UART from the AT client --- */
+                        LE_INFO("Switching BX31 UART %s to raw mode", dev->devicePath);
+                        dev->rawFd = dup(dev->fd);                              // stopping the AT client closes its fd
+                        if (dev->rawFd < 0) {
+                                LE_ERROR("could not take over UART %s: %m", dev->devicePath);
+                                dev->state = BX31_STATE_FAILED;
+                                break;
+                        }
+                        le_atClient_Stop(dev->devRef);
+                        dev->devRef = NULL;
+                        dev->rxLen = 0;
+
+                        dev->rawMonitorRef = le_fdMonitor_Create("BX31Uart", dev->rawFd, bx31at_rawReadHandler, POLLIN);
+                        le_fdMonitor_SetContextPtr(dev->rawMonitorRef, dev);
+#else
+                        bx31at_runOnReaderThread(dev, bx31at_addScanHandler);   // the scan results are received there
+#endif /* BX31_RAW_TTY */
+                        dev->booting = false;
+                        dev->failedCommands = 0;
+                        bx31at_recovered(dev);
+                        le_event_QueueFunctionToThread(callerThreadRef, bx31at_deviceReady, dev, NULL);
+                        return;
+
+                case BX31_STATE_FAILED:
+                default:
+                        LE_ERROR("BX31 on %s not available, trying again in %u s",
+                                 dev->devicePath, BX31_RECOVERY_BACKOFF_MS / 1000);
+                        bx31at_closeDevice(dev);
+                        dev->state = BX31_STATE_OPEN;                           // the process keeps running, so the station
+                        dev->booting = false;                                   // table is kept
+                        le_timer_SetMsInterval(dev->startupTimerRef, BX31_RECOVERY_BACKOFF_MS);
+                        le_timer_Start(dev->startupTimerRef);
+                        return;
                 }
         }
+}
 
-        for (int i = 0; i < numberOfEscapedCharacters; ++i) {                   // read the escaped advertisement string and convert
-                                                                                // it to binary
-                dstBuffer[i] =
-                    (char)strtol(escapedStrIn + (i * 3) + 1, NULL, 16);
-        }
+static void bx31at_startupTimerExpired(le_timer_Ref_t timerRef) {
+        bx31at_startupStep(le_timer_GetContextPtr(timerRef));
+}
 
-#ifdef DEBUG_BX31
-        char dbgBuffer[MAX_BT_DATA_STRING_SIZE * 5 + 1];
-        memset(dbgBuffer, 0, MAX_BT_DATA_STRING_SIZE * 5 + 1);
-        for (int i = 0; i < numberOfEscapedCharacters; ++i) {
-                sprintf(dbgBuffer + (5 * i), " 0x%02x", dstBuffer[i]);
-        }
-        LE_DEBUG("packed buffer: %s", dbgBuffer);
+static void bx31at_continueStartup(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+
+        dev->probeStartTime = le_clk_GetRelativeTime();
+        bx31at_startupStep(dev);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Main function of the scan thread of a device - it has its own
+ * connection to the AT client service and its own event loop to get scan
+ * requests queued. It runs the startup of the device and the scan
+ * commands. The scan results are received by the reader thread of the
+ * device (in raw mode on this thread).
+ *
+ *  @param contextPtr the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void *bx31at_scanThread(void *contextPtr) {
+        BX31_Device_t *dev = contextPtr;
+
+        dev->scanPauseTimerRef = le_timer_Create("BX31ScanPause");
+        le_timer_SetHandler(dev->scanPauseTimerRef, bx31at_scanPauseExpired);
+        le_timer_SetContextPtr(dev->scanPauseTimerRef, dev);
 
-        LE_DEBUG("converted %d chars", numberOfEscapedCharacters);
-#endif                                /* DEBUG_BX31 */
+        dev->startupTimerRef = le_timer_Create("BX31Startup");
+        le_timer_SetHandler(dev->startupTimerRef, bx31at_startupTimerExpired);
+        le_timer_SetContextPtr(dev->startupTimerRef, dev);
 
-        return numberOfEscapedCharacters;
+#ifdef BX31_RAW_TTY
+        dev->rawScanTimeoutRef = le_timer_Create("BX31ScanTimeout");
+        le_timer_SetHandler(dev->rawScanTimeoutRef, bx31at_rawScanTimeout);
+        le_timer_SetContextPtr(dev->rawScanTimeoutRef, dev);
+#endif /* BX31_RAW_TTY */
+
+        le_atClient_ConnectService();
+        dev->scanCmdRef = le_atClient_Create();
+
+        dev->state = BX31_STATE_OPEN;
+        bx31at_startupStep(dev);
+
+        le_event_RunLoop();
+        return NULL;
 }
 
 /** ------------------------------------------------------------------------
  *
- * takes the full unsolicited +SRBLESCAN message from BX31 BT scan and
- * extracts the content
+ * Runs on the scan thread - has the unsolicited response handler removed
+ * by the reader thread (or in raw mode releases the UART) and closes the
+ * device
+ *
+ *  @param dev the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_closeDevice(BX31_Device_t *dev) {
+#ifdef BX31_RAW_TTY
+        if (dev->rawScanTimeoutRef != NULL) le_timer_Stop(dev->rawScanTimeoutRef);
+        dev->rawScanRunning = dev->rawProbeRunning = false;
+        if (dev->rawMonitorRef != NULL) le_fdMonitor_Delete(dev->rawMonitorRef);
+        dev->rawMonitorRef = NULL;
+        if (dev->rawFd >= 0) le_tty_Close(dev->rawFd);
+        dev->rawFd = -1;
+#else
+        bx31at_runOnReaderThread(dev, bx31at_removeScanHandler);
+#endif /* BX31_RAW_TTY */
+        if (dev->devRef != NULL) le_atClient_Stop(dev->devRef);                 // closes the serial device
+        dev->devRef = NULL;
+        dev->fd = -1;
+}
+
+/** ------------------------------------------------------------------------
  *
- * the unsolicited message looks like:
- * +SRBLESCAN: "29:db:3c:cd:01:5a",   1,     -53,"\1E\FF\06\00\01\09\20\02\77\62\22\BC\EE\52\C2\BE\85\AB\73\AF\FB\A9\64\26\AE\EE\8D"
- * \----v----/ \-------v-------/      v       v   \--------------------------------------v-----------------------------------------/
- * AT preamble      BT addr       Addr Type  RSSI                                    Advert Data
+ * Runs on the scan thread - last step of the recovery ladder: the module
+ * is closed and reset via GPIO (module on the IoT card) or just opened
+ * again, then the startup state machine brings it up. The calling thread
+ * stops handing scans to the device until it is ready again.
+ * Queued, so it does not close the device under a running handler.
  *
- * @return struct containing the content of unsolicited
- *  +SRBLESCAN message already binary packed
+ *  @param param1Ptr the device
  *
  * -------------------------------------------------------------------------
  */
-BTScanResult_t *bx31at_tokenizeScanResult(char *buffer) {
 
-        if (strncmp(buffer, "+SRBLESCAN: ", 12) != 0) {
-                LE_ERROR("The given buffer seems not to contain a BX31 scan result, "
-                            "it should start with \"+SRBLESCAN:\", given buffer was \"%s\".",
-                     buffer);
+static void bx31at_resetDevice(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
 
-                return NULL;
-        }
+        LE_WARN("resetting BX31 on %s", dev->devicePath);
+        __atomic_add_fetch(&dev->resets, 1, __ATOMIC_RELAXED);
 
-        BTScanResult_t *scanResult;
-        scanResult = le_mem_TryAlloc(scannedBTStationsPool);                    // storage for the result
-        if (scanResult == NULL) {
+        le_timer_Stop(dev->scanPauseTimerRef);
+        bx31at_closeDevice(dev);
+        le_event_QueueFunctionToThread(callerThreadRef, bx31at_deviceDown, dev, NULL);
 
-                LE_ERROR("Problem to allocate memory from Pool "
-                                "for tokenizeScanResult");
+        dev->state = BX31_STATE_OPEN;
+        dev->booting = bx31at_hasResetGpio(dev);
+        if (dev->booting) {
+                le_event_QueueFunctionToThread(callerThreadRef, bx31at_resetModule, dev, NULL);
+        } else {
+                bx31at_startupStep(dev);
+        }
+}
 
-                return NULL;
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread - result of the "AT" sent to re-sync with the
+ * module: scanning goes on if it answered, otherwise the module is reset
+ *
+ *  @param dev the device
+ *  @param answered the module answered OK
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_resyncDone(BX31_Device_t *dev, bool answered) {
+        if (answered) {
+                LE_INFO("BX31 on %s re-synced", dev->devicePath);
+                le_event_QueueFunction(bx31at_runScan, dev, NULL);
+        } else {
+                le_event_QueueFunction(bx31at_resetDevice, dev, NULL);
         }
+}
 
-        char *parameter = strtok(buffer + 12, ",");                             // get the first parameter (BT address) from the
-                                                                                // unsolicited string
-        if ((scanResult->btStationAddress = bx31at_btAddrToInt(parameter)) == 0) {
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread when a scan failed - recovery ladder:
+ *
+ *   1. the scan is retried (BX31_RECOVERY_RETRIES times)
+ *   2. re-sync: a bare "AT" is sent, if the module answers it is scanned
+ *      again
+ *   3. the module is reset and started again (bx31at_resetDevice())
+ *
+ * The first failure starts the downtime of the device, it ends with the
+ * next successful scan (bx31at_recovered()).
+ *
+ *  @param dev the device
+ *
+ *  @return true if the scan thread goes on scanning by itself, false if
+ *          the device was reset
+ *
+ * -------------------------------------------------------------------------
+ */
 
-                LE_ERROR("Problem to tokenize BL Scan String , "
-                                "could not extract BL Address");
+static bool bx31at_recover(BX31_Device_t *dev) {
+        if (!dev->down) {
+                dev->down = true;
+                dev->downSince = le_clk_GetRelativeTime();
+        }
 
-                le_mem_Release(scanResult);
-                return NULL;
+        ++dev->failedCommands;
+        if (dev->failedCommands <= BX31_RECOVERY_RETRIES) {
+                LE_WARN("retrying BT Scan on %s (%u)", dev->devicePath, dev->failedCommands);
+                le_event_QueueFunction(bx31at_runScan, dev, NULL);
+                return true;
         }
 
-        parameter = strtok(NULL, ",");                                          // get the address type from the unsolicited string
-        if (parameter == NULL) {
+        if (dev->failedCommands == BX31_RECOVERY_RETRIES + 1) {                 // re-sync once, reset if the scans
+                LE_WARN("re-syncing BX31 on %s", dev->devicePath);             // fail again afterwards
+#ifdef BX31_RAW_TTY
+                dev->rxLen = 0;                                                 // drop a partial line
+                dev->rawProbeRunning = true;
+                le_timer_SetMsInterval(dev->rawScanTimeoutRef, BX31_PROBE_TIMEOUT_MS);
+                le_timer_Start(dev->rawScanTimeoutRef);
+                if (write(dev->rawFd, "AT\r", 3) != 3) {
+                        dev->rawProbeRunning = false;
+                        le_timer_Stop(dev->rawScanTimeoutRef);
+                        bx31at_resyncDone(dev, false);
+                        return false;
+                }
+#else
+                le_result_t result = bx31at_sendCommand(dev, "AT", "", BX31_PROBE_TIMEOUT_MS, NULL, 0);
+                bx31at_resyncDone(dev, result == LE_OK);
+                return result == LE_OK;
+#endif /* BX31_RAW_TTY */
+                return true;
+        }
 
-                LE_ERROR("Problem to tokenize BL Scan String , "
-                            "could not extract BL Address type");
+        le_event_QueueFunction(bx31at_resetDevice, dev, NULL);
+        return false;
+}
 
-                le_mem_Release(scanResult);
-                return NULL;
-        }
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread after a successful scan (or startup) - ends the
+ * downtime of a device which was recovering
+ *
+ *  @param dev the device
+ *
+ * -------------------------------------------------------------------------
+ */
 
-        scanResult->addrType = strtol(parameter, NULL, 10);
-        if ((scanResult->addrType != BX31_BT_PUBLIC_ADDR)
-            && (scanResult->addrType != BX31_BT_PRIVATE_ADDR)) {
+static void bx31at_recovered(BX31_Device_t *dev) {
+        dev->failedCommands = 0;
+        if (!dev->down) return;
 
-                LE_ERROR("Problem to tokenize BL Scan String , "
-                                "could not extract BL Address type");
+        le_clk_Time_t downtime = le_clk_Sub(le_clk_GetRelativeTime(), dev->downSince);
+        uint64_t downtimeMs = downtime.sec * 1000 + downtime.usec / 1000;
 
-                le_mem_Release(scanResult);
-                return NULL;
-        }
+        dev->down = false;
+        __atomic_add_fetch(&dev->downtimeMs, downtimeMs, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&dev->recoveries, 1, __ATOMIC_RELAXED);
+        LE_INFO("BX31 on %s recovered after %llu ms", dev->devicePath, (unsigned long long) downtimeMs);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the scan thread on stop - has the unsolicited response handler
+ * removed (or in raw mode releases the UART) and closes the device
+ *
+ *  @param param1Ptr the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_stopScanThread(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+
+        le_timer_Stop(dev->startupTimerRef);
+        le_timer_Stop(dev->scanPauseTimerRef);
+        bx31at_closeDevice(dev);
+        if (dev->scanCmdRef != NULL) le_atClient_Delete(dev->scanCmdRef);
+        dev->scanCmdRef = NULL;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the calling thread (it owns the GPIO connection) - resets the
+ * module on the IoT card: the enable GPIO is pulled for
+ * BX31_RESET_PULSE_MS, then the scan thread polls until it answers
+ *
+ *  @param param1Ptr the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_resetModule(void *param1Ptr, void *param2Ptr) {
+#ifndef RUN_BX_ON_USB
+        gpio_bx_enable_Deactivate();                                            // GPIO 2 =  gpio_bx_enable switches the board/on off
+        le_timer_SetContextPtr(resetTimerRef, param1Ptr);
+        le_timer_Start(resetTimerRef);
+#endif /* RUN_BX_ON_USB */
+}
+
+static void bx31at_resetPulseDone(le_timer_Ref_t timerRef) {
+        BX31_Device_t *dev = le_timer_GetContextPtr(timerRef);
+
+#ifndef RUN_BX_ON_USB
+        gpio_bx_enable_Activate();
+#endif /* RUN_BX_ON_USB */
+        le_event_QueueFunctionToThread(dev->scanThreadRef, bx31at_continueStartup, dev, NULL);
+}
 
-        parameter = strtok(NULL, ",");                                          // get RSSI from the unsolicited string
-        if (parameter == NULL) {
+static void bx31at_startScan(BX31_Device_t *dev);
 
-                LE_ERROR("Problem to tokenize BL Scan String , "
-                                "could not extract RSSI");
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the calling thread when a device finished its startup - the
+ * first scan is started right away in continuous mode, the scan timer is
+ * not waited for
+ *
+ *  @param param1Ptr the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_deviceReady(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+        le_clk_Time_t startup = le_clk_Sub(le_clk_GetRelativeTime(), startTime);
+
+        LE_INFO("BX31 on %s ready %ld.%03ld s after start", dev->devicePath,
+                (long) startup.sec, (long) startup.usec / 1000);
+
+        dev->ready = true;
+        dev->scanInProgress = false;                                            // no scan can be running on a fresh start
+        if (continuousScan) bx31at_startScan(dev);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the calling thread when a device is reset - no scans are
+ * handed to it until it is ready again
+ *
+ *  @param param1Ptr the device
+ *
+ * -------------------------------------------------------------------------
+ */
+
+static void bx31at_deviceDown(void *param1Ptr, void *param2Ptr) {
+        BX31_Device_t *dev = param1Ptr;
+
+        dev->ready = false;
+        dev->scanInProgress = false;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Is called to initialize the BT scanner - all BX31 modules given in
+ * BX31_SERIAL_DEVICES. Each module is started on its own scan thread, so
+ * this returns right away and the modules start in parallel. Each module
+ * scans as soon as it is ready, independent of the others. A module which
+ * does not respond is not given up: it is closed and started again every
+ * BX31_RECOVERY_BACKOFF_MS until it answers.
+ *
+ *  @param  callback in case advertisement messages are collected, callback
+ *          will be called for each advertisement and after ScanBLE was called.
+ *          CAREFUL: the BTScanResult_t struct which is given as parameter to
+ *          callback function is only valid during the callback
+ *
+ *
+ * -------------------------------------------------------------------------
+ */
+
+void bx31at_initBLE(callbackOnScan_t callbackOnScan) {
+
+        LE_INFO("Initializing BX31 AT interface");
+
+        startTime = le_clk_GetRelativeTime();
+
+#ifdef __CDT_PARSER__
+#define GPIO_BX_ENABLE_ACTIVE_HIGH 0    // this is a workaround for the eclipse environment - not to highlight
+#define GPIO_BX_FWFLASH_ACTIVE_LOW 1    // the auto generated Macros as error or undefined
+#endif
+
+#ifndef RUN_BX_ON_USB
+        gpio_bx_enable_SetPushPullOutput(GPIO_BX_ENABLE_ACTIVE_HIGH, true);     // the BX31 IoT board can be controlled via GPIO Pins
+        gpio_bx_fwFlash_SetPushPullOutput(GPIO_BX_FWFLASH_ACTIVE_LOW, false);   // GPIO 2 =  gpio_bx_enable switches the board/on off. It can be used for reset
+                                                                                // GPIO 42 =  gpio_bx_fwFlash can be used to flash the FW.
+                                                                                // the enable GPIO stays active - a running module is
+                                                                                // only reset if it does not answer (see bx31at_startupStep())
+        resetTimerRef = le_timer_Create("BX31Reset");
+        le_timer_SetHandler(resetTimerRef, bx31at_resetPulseDone);
+        le_timer_SetMsInterval(resetTimerRef, BX31_RESET_PULSE_MS);
+#endif /* RUN_BX_ON_USB */
 
-                le_mem_Release(scanResult);
-                return NULL;
+        callback = callbackOnScan;
+        callerThreadRef = le_thread_GetCurrent();
+
+        for (unsigned int i = 0; i < NUM_ARRAY_MEMBERS(devicePaths) && i < BX31_MAX_DEVICES; ++i) {
+                BX31_Device_t *dev = &devices[deviceCount++];
+                char name[32];
+
+                memset(dev, 0, sizeof(BX31_Device_t));
+                dev->radio = i;
+                dev->devicePath = devicePaths[i];
+                dev->fd = -1;
+#ifdef BX31_RAW_TTY
+                dev->rawFd = -1;
+#endif /* BX31_RAW_TTY */
+
+                LE_ASSERT((dev->queue = scanq_create(BX31_SCAN_QUEUE_SIZE)) != NULL);  // scan results are handed over from the
+                                                                                        // I/O thread through this queue
+                dev->queueMonitorRef = le_fdMonitor_Create("BX31ScanQueue", scanq_getEventFd(dev->queue),
+                                                           bx31at_scanQueueHandler, POLLIN);
+                le_fdMonitor_SetContextPtr(dev->queueMonitorRef, dev);
+
+#ifndef BX31_RAW_TTY
+                dev->readerSem = le_sem_Create("BX31Reader", 0);
+                snprintf(name, sizeof(name), "BX31ReaderThread%u", dev->radio);
+                dev->readerThreadRef = le_thread_Create(name, bx31at_readerThread, dev);
+                le_thread_Start(dev->readerThreadRef);
+#endif /* BX31_RAW_TTY */
+
+                snprintf(name, sizeof(name), "BX31ScanThread%u", dev->radio);
+                dev->scanThreadRef = le_thread_Create(name, bx31at_scanThread, dev);
+                le_thread_Start(dev->scanThreadRef);
         }
-        scanResult->rssi = strtol(parameter, NULL, 10);
+}
 
-        parameter = strtok(NULL, ",");                                          // get BT advertisement data from the unsolicited
-                                                                                // string and pack it (string to binary)
-        if (parameter == NULL) {
+/** ------------------------------------------------------------------------
+ * Stops the BX31 AT Service, releases all resources
+ * -------------------------------------------------------------------------
+ */
+void bx31at_stopBLE() {
+        LE_INFO("Stopping BX_AT");
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+                BX31_Device_t *dev = &devices[i];
+
+                if (dev->scanThreadRef != NULL) {
+                        le_event_QueueFunctionToThread(dev->scanThreadRef, bx31at_stopScanThread, dev, NULL);
+                }
+                if (dev->queueMonitorRef != NULL) le_fdMonitor_Delete(dev->queueMonitorRef);
+                dev->queueMonitorRef = NULL;
+                dev->ready = false;
+        }
+        callback = NULL;
+        scanDoneCallback = NULL;
+        gpio_bx_enable_Deactivate();
+}
 
-                LE_ERROR("Problem to tokenize BL Scan String , "
-                                "could not extract RSSI");
 
-                le_mem_Release(scanResult);
-                return NULL;
+/** ------------------------------------------------------------------------
+ *
+ * Hands a scan over to the scan thread of a device - unless the device is
+ * still starting up or the previous scan did not finish yet
+ *
+ * @param dev the device
+ *
+ * ------------------------------------------------------------------------
+ */
+static void bx31at_startScan(BX31_Device_t *dev)
+{
+        if (!dev->ready) return;                                                // still starting up
+
+        if (dev->scanInProgress) {                                              // the previous scan did not finish yet
+                if (!continuousScan) {
+                        LE_WARN("BT Scan on %s still in progress, skipping this scan interval",
+                                dev->devicePath);
+                }
+                return;
         }
-        scanResult->data_len = bx31at_escapedAdvrtStr2Binary(parameter, scanResult->advertData);
 
-        return scanResult;
+        dev->scanInProgress = true;
+        dev->deliveredResultNumber = 0;
+
+        le_event_QueueFunctionToThread(dev->scanThreadRef, bx31at_runScan, dev, NULL);
 }
 
 /** ------------------------------------------------------------------------
  *
  * called by timer periodically to perform the BT scan
- * In case unsolicited messages with BT scan results are received
- * a callback is performed
- * CAREFUL: the BTScanResult_t struct which is given as parameter to
- * callback function is allocated from pool - but _not_ freed here
- * - take care of freeing it outside of this module
+ * The scan is handed over to the scan threads of all devices and this
+ * function returns immediately. In case unsolicited messages with BT scan
+ * results are received a callback is performed
+ * In continuous mode the timer only (re)starts the scan pipeline, it is
+ * kept running by the scan threads afterwards
  *
- * @param reference to the calling timer  //FIXME this could be better isolated
+ * @param reference to the calling timer
  *
  * ------------------------------------------------------------------------
  */
 void bx31at_ScanBLE(le_timer_Ref_t timerRef)
 {
+        for (unsigned int i = 0; i < deviceCount; ++i) bx31at_startScan(&devices[i]);
+}
 
-        char buffer[LE_ATDEFS_RESPONSE_MAX_BYTES];
-        memset(buffer, 0, LE_ATDEFS_RESPONSE_MAX_BYTES);
+/** ------------------------------------------------------------------------
+ *
+ * @return number of scan results dropped since start because the scan
+ *         queue of a device was full
+ *
+ * ------------------------------------------------------------------------
+ */
+uint32_t bx31at_getDroppedScanResults()
+{
+        uint32_t dropped = 0;
 
-        le_atClient_CmdRef_t cmdRef =
-            (le_atClient_CmdRef_t) le_timer_GetContextPtr(timerRef);
+        for (unsigned int i = 0; i < deviceCount; ++i) dropped += scanq_droppedCount(devices[i].queue);
+        return dropped;
+}
 
-        /* --- Run BT Scan  --- */
-        LE_DEBUG("run the BT Scan");                                            // We use the BX just for BT scanning
+/** ------------------------------------------------------------------------
+ *
+ * @return max. number of scan results which have been waiting in one of
+ *         the scan queues since the last call
+ *
+ * ------------------------------------------------------------------------
+ */
+uint32_t bx31at_getScanQueueHighWater()
+{
+        uint32_t highWater = 0;
 
-        LE_ASSERT(le_atClient_SetCommandAndSend
-                  (&cmdRef, DevRef, "AT+SRBLESCAN=5,1", "",
-                   "OK|ERROR|+CME ERROR",
-                   LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT) == LE_OK);
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+                uint32_t queueHighWater = scanq_highWater(devices[i].queue, true);
+                if (queueHighWater > highWater) highWater = queueHighWater;
+        }
+        return highWater;
+}
 
-        LE_ASSERT(le_atClient_GetFinalResponse
-                  (cmdRef, buffer, LE_ATDEFS_RESPONSE_MAX_BYTES) == LE_OK);
+/** ------------------------------------------------------------------------
+ *
+ * @return ms from bx31at_initBLE() to the first scan of the module which
+ *         started first, 0 if no module is scanning yet
+ *
+ * ------------------------------------------------------------------------
+ */
+uint32_t bx31at_getTimeToFirstScan()
+{
+        uint32_t firstScanMs = 0;
 
-        LE_DEBUG("Final response after Scan: %s", buffer);
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+                uint32_t ms = __atomic_load_n(&devices[i].firstScanMs, __ATOMIC_RELAXED);
+                if (ms != 0 && (firstScanMs == 0 || ms < firstScanMs)) firstScanMs = ms;
+        }
+        return firstScanMs;
+}
 
-        if (strcmp(buffer, "OK") == 0) {
-                memset(buffer, 0, 50);
+/** ------------------------------------------------------------------------
+ *
+ * Recovery statistics, summed over the modules - may be called from any
+ * thread. The downtime of a module is added when it recovered.
+ *
+ * @return number of recoveries, module resets, downtime in ms
+ *
+ * ------------------------------------------------------------------------
+ */
+uint32_t bx31at_getRecoveryCount()
+{
+        uint32_t recoveries = 0;
 
-                le_result_t res = le_atClient_GetFirstIntermediateResponse(cmdRef, buffer,
-                                                             LE_ATDEFS_RESPONSE_MAX_BYTES);
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+                recoveries += __atomic_load_n(&devices[i].recoveries, __ATOMIC_RELAXED);
+        }
+        return recoveries;
+}
 
-                int intNumber = 1;
+uint32_t bx31at_getResetCount()
+{
+        uint32_t resets = 0;
 
-                while (res == LE_OK) {
-                        if (callback != NULL) {
-                                BTScanResult_t *scanResult =
-                                    bx31at_tokenizeScanResult(buffer);
-                                callback(intNumber, scanResult);
-                        } else {
-                                LE_WARN("BT Callback NOT SET - got BT Scan  %d: %s",
-                                     intNumber, buffer);
-                        }
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+                resets += __atomic_load_n(&devices[i].resets, __ATOMIC_RELAXED);
+        }
+        return resets;
+}
 
-                        memset(buffer, 0, LE_ATDEFS_RESPONSE_MAX_BYTES);        // FIXME - needs optimization
-                        intNumber++;
+uint64_t bx31at_getDowntimeMs()
+{
+        uint64_t downtimeMs = 0;
 
-                        res = le_atClient_GetNextIntermediateResponse(cmdRef,
-                                                                    buffer,
-                                                                    LE_ATDEFS_RESPONSE_MAX_BYTES);
-                }
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+                downtimeMs += __atomic_load_n(&devices[i].downtimeMs, __ATOMIC_RELAXED);
+        }
+        return downtimeMs;
+}
 
+/** ------------------------------------------------------------------------
+ *
+ * @return number of BX31 modules which are scanning
+ *
+ * ------------------------------------------------------------------------
+ */
+unsigned int bx31at_getDeviceCount()
+{
+        return deviceCount;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Enables or disables continuous scanning - when disabled a scan is
+ * only run when bx31at_ScanBLE() is called
+ *
+ * @param enable
+ *
+ * ------------------------------------------------------------------------
+ */
+void bx31at_setContinuousScan(bool enable)
+{
+        continuousScan = enable;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Sets the callback which is called on the calling thread when a scan of
+ * a radio finished - after the last result of the scan was delivered
+ *
+ * @param callbackOnScanDone
+ *
+ * ------------------------------------------------------------------------
+ */
+void bx31at_setScanDoneCallback(callbackOnScanDone_t callbackOnScanDone)
+{
+        scanDoneCallback = callbackOnScanDone;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return share of the time the radios were scanning since the last call
+ *         in percent - the average over all devices
+ *
+ * ------------------------------------------------------------------------
+ */
+unsigned int bx31at_getScanDutyCycle()
+{
+        static le_clk_Time_t lastCall = { 0, 0 };
+        static uint64_t lastBusyMs = 0;
+
+        le_clk_Time_t now = le_clk_GetRelativeTime();
+        uint64_t busyMs = 0;
+        le_clk_Time_t elapsed = le_clk_Sub(now, lastCall);
+        uint64_t elapsedMs = (elapsed.sec * 1000 + elapsed.usec / 1000) * deviceCount;
+
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+                busyMs += __atomic_load_n(&devices[i].scanBusyMs, __ATOMIC_RELAXED);
+        }
+
+        unsigned int dutyCycle = 0;
+        if (lastCall.sec != 0 && elapsedMs > 0) {                               // a scan is accounted when it finished, so
+                dutyCycle = (busyMs - lastBusyMs) * 100 / elapsedMs;            // it may stick out of the interval
+                if (dutyCycle > 100) dutyCycle = 100;
+        }
+
+        lastCall = now;
+        lastBusyMs = busyMs;
+        return dutyCycle;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Sets the scan timing of all devices - it is taken over with the next
+ * scan
+ *
+ * @param window - scan duration in seconds
+ * @param interval - seconds from the start of one scan to the start of
+ *        the next (continuous mode), scans are back to back if it is
+ *        not longer than window
+ *
+ * ------------------------------------------------------------------------
+ */
+void bx31at_setScanTiming(unsigned int window, unsigned int interval)
+{
+        __atomic_store_n(&scanWindow, window, __ATOMIC_RELAXED);
+        __atomic_store_n(&scanInterval, interval, __ATOMIC_RELAXED);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Runs on the I/O thread (the producer of the scan queue) to resize the
+ * queue of the device
+ *
+ * ------------------------------------------------------------------------
+ */
+static void bx31at_resizeScanQueue(void *param1Ptr, void *param2Ptr)
+{
+        BX31_Device_t *dev = param1Ptr;
+        uint32_t size = (uint32_t) (uintptr_t) param2Ptr;
+
+        if (scanq_resize(dev->queue, size) != LE_OK) {
+                LE_ERROR("could not resize scan queue of %s to %u results", dev->devicePath, size);
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Changes the number of scan results which can wait for the callback,
+ * per device. The queued results are kept.
+ *
+ * @param size - rounded up to a power of 2
+ *
+ * ------------------------------------------------------------------------
+ */
+void bx31at_setScanQueueSize(uint32_t size)
+{
+        for (unsigned int i = 0; i < deviceCount; ++i) {
+#ifdef BX31_RAW_TTY
+                le_thread_Ref_t producerRef = devices[i].scanThreadRef;
+#else
+                le_thread_Ref_t producerRef = devices[i].readerThreadRef;
+#endif /* BX31_RAW_TTY */
+                le_event_QueueFunctionToThread(producerRef, bx31at_resizeScanQueue,
+                                               &devices[i], (void *) (uintptr_t) size);
         }
 }
@@ -12,35 +12,85 @@
 #define BX31_ATSERVICECOMPONENT_H_
 
 
-#define MAX_SCANNED_STATION_MEM_POOL_SIZE 1024
-#define MAX_BT_DATA_STRING_SIZE 31				// BT Advert Packet is not longer than 31 bytes
+#define BX31_SCAN_QUEUE_SIZE 1024                // scan results waiting for the station manager (power of 2)
+#define BX31_RAW_RX_BUFFER_SIZE 4096             // BX31_RAW_TTY: receive buffer, must hold at least one line
+#define BX31_FINAL_RESPONSE_MAX 32               // final response of the scan command, longer ones are cut
+#define MAX_BT_DATA_STRING_SIZE 255				// BLE 5 extended advertising - legacy adverts are up to 31 bytes
+#define BX31_LEGACY_ADVERT_LEN 31
 
-#ifndef RUN_BX_ON_USB
+#ifndef BX31_SERIAL_DEVICE                               // can be given in the cflags, e.g. to point to
+#ifndef RUN_BX_ON_USB                                    // the pty of tools/bx31_sim.py
 #define BX31_SERIAL_DEVICE "/dev/ttyHS0"
 #else
 #define BX31_SERIAL_DEVICE "/dev/ttyUSB1"
 #endif
+#endif
+
+#define BX31_MAX_DEVICES 2                       // number of BX31 modules which can be scanned in parallel
+
+#ifdef BX31_SECOND_SERIAL_DEVICE                         // a second module can be given in the cflags, e.g.
+#define BX31_SERIAL_DEVICES { BX31_SERIAL_DEVICE, \
+                              BX31_SECOND_SERIAL_DEVICE }  // -DBX31_SECOND_SERIAL_DEVICE=\"/dev/ttyUSB1\"
+#else
+#define BX31_SERIAL_DEVICES { BX31_SERIAL_DEVICE }
+#endif
 
 
 
+#define BX31_PROBE_TIMEOUT_MS 300                // startup: a running module answers "AT" within this
+#define BX31_PROBE_INTERVAL_MS 100               // startup: "AT" is polled in this interval
+#define BX31_PROBE_WINDOW_MS 1000                // startup: module is reset via GPIO if it did not answer within
+#define BX31_BOOT_TIMEOUT_MS 5000                // startup: max. time to wait for the module after reset
+#define BX31_RESET_PULSE_MS 200                  // startup: enable GPIO is pulled this long for a reset
+#define BX31_RECOVERY_RETRIES 1                  // recovery: failed scans retried before the module is re-synced
+#define BX31_RECOVERY_BACKOFF_MS 30000           // recovery: a module which failed to start is tried again after
+
+#define BX31_SCAN_COMMAND_FMT "AT+SRBLESCAN=%u,1"  // parameter is the scan window in seconds
+#define BX31_SCAN_WINDOW_DEFAULT 5
+#define BX31_CONTINUOUS_SCAN true                // issue the next scan on the final response of the previous one
+#define BX31_SCAN_TIMER_MS 10000                 // scan timer - (re)starts continuous scanning
+#define BX31_NO_INTERMEDIATE "+SRBLESCAN_NONE"   // the scan lines are received as unsolicited responses, this
+                                                 // prefix never matches - so the AT client does not buffer them
+
 #define BX31_BT_PUBLIC_ADDR 0
 #define BX31_BT_PRIVATE_ADDR 1
 
+#define BX31_FINGERPRINT_OFFSET 0xcbf29ce484222325ULL      // FNV-1a 64 bit offset basis
+#define BX31_FINGERPRINT_PRIME 0x100000001b3ULL            // FNV-1a 64 bit prime
+
+#define BX31_FINGERPRINT_ADD(hash, byte) (((hash) ^ (uint8_t) (byte)) * BX31_FINGERPRINT_PRIME)
+
 
 typedef struct  {
 	uint64_t btStationAddress;
 	uint8_t addrType;
+	uint8_t radio;                             // index of the BX31 which received it - set by the I/O thread
+	uint32_t scan;                             // number of the scan which received it - set by the I/O thread
 	int rssi;
 	int data_len;
-	char advertData[MAX_BT_DATA_STRING_SIZE];  // Fixed buffer no allocation for simplicity -
-                                               // need to take care it is not copied more than MAX_BT_DATA_STRING_SIZE
+	uint64_t fingerprint;                      // FNV-1a over addrType, data_len and advertData - set by the parser
+	char advertData[MAX_BT_DATA_STRING_SIZE];  // Fixed buffer no allocation for simplicity - transient (scan queue slot),
+                                               // the station table keeps the payload in PayloadSlab.c
 } BTScanResult_t;
 
 typedef void (*callbackOnScan_t)(int, BTScanResult_t*);
+typedef void (*callbackOnScanDone_t)(unsigned int radio);
 void bx31at_initBLE(callbackOnScan_t callbackOnScan);
+void bx31at_setScanDoneCallback(callbackOnScanDone_t callbackOnScanDone);
+le_result_t bx31at_parseScanResult(const char *line, size_t len, BTScanResult_t *scanResult);
 void bx31at_stopBLE();
-le_atClient_CmdRef_t bx31at_getCmdRef();
 void bx31at_ScanBLE(le_timer_Ref_t timerRef);
+uint32_t bx31at_getDroppedScanResults();
+uint32_t bx31at_getScanQueueHighWater();
+void bx31at_setContinuousScan(bool enable);
+void bx31at_setScanTiming(unsigned int window, unsigned int interval);
+void bx31at_setScanQueueSize(uint32_t size);
+unsigned int bx31at_getScanDutyCycle();
+unsigned int bx31at_getDeviceCount();
+uint32_t bx31at_getTimeToFirstScan();
+uint32_t bx31at_getRecoveryCount();
+uint32_t bx31at_getResetCount();
+uint64_t bx31at_getDowntimeMs();
 
 #endif /* BX31_ATSERVICECOMPONENT_H_ */
 
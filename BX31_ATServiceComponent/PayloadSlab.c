@@ -0,0 +1,163 @@
+/*
+ * PayloadSlab.c
+ *
+ * Storage of the advertisement data of the stations in memory pools of
+ * 32, 64, 128 and 256 byte blocks. Legacy adverts are at most 31 bytes,
+ * BLE 5 extended adverts up to 255 bytes - with one fixed buffer per
+ * station every station would pay for the longest advert.
+ *
+ * The first byte of a block holds its size class, the payload follows.
+ * So a legacy advert fits into a 32 byte block and a payload which
+ * changes its length stays in its block as long as it fits. The length
+ * of the payload is kept by the caller (in the station record).
+ *
+ * The pools grow by SLAB_EXPAND_BLOCKS when a class runs empty, blocks
+ * are returned to their pool (not to the heap) when released.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "PayloadSlab.h"
+
+struct Payload {
+        uint8_t sizeClass;
+        uint8_t data[];
+};
+
+static const char * const poolNames[SLAB_CLASS_COUNT] = { "payload32", "payload64", "payload128", "payload256" };
+static le_mem_PoolRef_t pools[SLAB_CLASS_COUNT];
+
+/** ------------------------------------------------------------------------
+ *
+ * @return the smallest size class a payload of len bytes fits in
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline unsigned int slab_sizeClass(size_t len) {
+        unsigned int sizeClass = 0;
+
+        while (((size_t) SLAB_MIN_BLOCK_SIZE << sizeClass) < len + sizeof(struct Payload)) ++sizeClass;
+        return sizeClass;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Creates the pools of the size classes
+ *
+ * @param legacyBlocks - blocks of the 32 byte class allocated up front,
+ *                       the stations with a legacy advert
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void slab_init(size_t legacyBlocks) {
+        for (unsigned int i = 0; i < SLAB_CLASS_COUNT; ++i) {
+                pools[i] = le_mem_CreatePool(poolNames[i], SLAB_MIN_BLOCK_SIZE << i);
+        }
+        le_mem_ExpandPool(pools[0], legacyBlocks);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Stores a payload. The block of the previous payload is reused if the
+ * new one needs the same size class, otherwise it is released.
+ *
+ * @param payload - handle of the previous payload or NULL
+ * @param data - the payload
+ * @param len - length of the payload, at most SLAB_MAX_PAYLOAD_LEN
+ *
+ * @return handle of the stored payload, NULL if len is 0
+ *
+ * ------------------------------------------------------------------------
+ */
+
+PayloadRef_t slab_store(PayloadRef_t payload, const void *data, size_t len) {
+        LE_ASSERT(len <= SLAB_MAX_PAYLOAD_LEN);
+
+        if (len == 0) {
+                slab_release(payload);
+                return NULL;
+        }
+
+        unsigned int sizeClass = slab_sizeClass(len);
+
+        if (payload != NULL && payload->sizeClass != sizeClass) {
+                slab_release(payload);
+                payload = NULL;
+        }
+
+        if (payload == NULL) {
+                if ((payload = le_mem_TryAlloc(pools[sizeClass])) == NULL) {
+                        le_mem_ExpandPool(pools[sizeClass], SLAB_EXPAND_BLOCKS);
+                        payload = le_mem_AssertAlloc(pools[sizeClass]);
+                }
+                payload->sizeClass = sizeClass;
+        }
+
+        memcpy(payload->data, data, len);
+        return payload;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return the stored payload - valid until it is stored again or released
+ *
+ * ------------------------------------------------------------------------
+ */
+
+const uint8_t *slab_data(PayloadRef_t payload) {
+        return payload != NULL ? payload->data : NULL;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Returns the block of a payload to its pool
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void slab_release(PayloadRef_t payload) {
+        if (payload != NULL) le_mem_Release(payload);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Statistics of a size class
+ *
+ * @param sizeClass - 0 .. SLAB_CLASS_COUNT - 1
+ * @param stats - filled in
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void slab_getStats(unsigned int sizeClass, slab_ClassStats_t *stats) {
+        le_mem_PoolStats_t poolStats;
+
+        le_mem_GetStats(pools[sizeClass], &poolStats);
+
+        stats->blockSize = SLAB_MIN_BLOCK_SIZE << sizeClass;
+        stats->inUse = poolStats.numBlocksInUse;
+        stats->blocks = poolStats.numBlocksInUse + poolStats.numFree;
+        stats->maxInUse = poolStats.maxNumBlocksUsed;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return bytes in the blocks of all size classes, used or free - the
+ *         pools do not shrink
+ *
+ * ------------------------------------------------------------------------
+ */
+
+size_t slab_memoryBytes() {
+        size_t bytes = 0;
+
+        for (unsigned int i = 0; i < SLAB_CLASS_COUNT; ++i) {
+                slab_ClassStats_t stats;
+                slab_getStats(i, &stats);
+                bytes += stats.blocks * stats.blockSize;
+        }
+        return bytes;
+}
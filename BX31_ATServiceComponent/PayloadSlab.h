@@ -0,0 +1,38 @@
+/*
+ * PayloadSlab.h
+ *
+ *  Size classed storage of the advertisement data of the stations -
+ *  legacy adverts (up to 31 bytes) take a 32 byte block, BLE 5 extended
+ *  adverts (up to 255 bytes) a block of the smallest class they fit in.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+
+#ifndef PAYLOADSLAB_H_
+#define PAYLOADSLAB_H_
+
+#define SLAB_CLASS_COUNT 4                    // block sizes 32, 64, 128, 256 bytes
+#define SLAB_MIN_BLOCK_SIZE 32
+#define SLAB_MAX_PAYLOAD_LEN 255              // one byte of each block holds its size class
+#define SLAB_EXPAND_BLOCKS 32                 // blocks added to a class when it runs empty
+
+typedef struct Payload *PayloadRef_t;         // handle of a stored payload, NULL = no payload
+
+typedef struct {
+	size_t blockSize;				// bytes per block
+	size_t blocks;					// blocks in the pool
+	size_t inUse;					// blocks holding a payload
+	size_t maxInUse;				// high water mark of inUse
+} slab_ClassStats_t;
+
+void slab_init(size_t legacyBlocks);
+PayloadRef_t slab_store(PayloadRef_t payload, const void *data, size_t len);
+const uint8_t *slab_data(PayloadRef_t payload);
+void slab_release(PayloadRef_t payload);
+void slab_getStats(unsigned int sizeClass, slab_ClassStats_t *stats);
+size_t slab_memoryBytes();
+
+#endif /* PAYLOADSLAB_H_ */
@@ -0,0 +1,153 @@
+/*
+ * ScanControl.c
+ *
+ * Adapts the BT scan window and interval to the observed station churn.
+ * On each periodical check of the station manager the number of added
+ * and removed stations is related to the number of stations:
+ * - high churn  - jump to the busiest level: longest window, scanning
+ *                 back to back
+ * - some churn  - one level busier
+ * - quiet       - one level back, shorter window and longer pauses
+ * So new stations are detected quickly when things change, while in
+ * quiet periods UART bandwidth, CPU and power are saved.
+ *
+ * Level 0 is the quietest: SCANCTL_WINDOW_MIN scanned every
+ * SCANCTL_INTERVAL_MAX seconds. Level SCANCTL_LEVELS - 1 scans
+ * SCANCTL_WINDOW_MAX back to back. In between window and interval
+ * are interpolated.
+ *
+ * The stations are expired after two scan intervals at least. When the
+ * interval gets shorter, the stations were last heard by the slower
+ * scans - so the longer interval is kept for the expiry until two of
+ * its intervals passed, otherwise they would all expire at once and be
+ * taken as churn.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "ScanControl.h"
+#include "BX31_ATServiceComponent.h"
+
+static unsigned int windowMin = SCANCTL_WINDOW_MIN;
+static unsigned int windowMax = SCANCTL_WINDOW_MAX;
+static unsigned int intervalMax = SCANCTL_INTERVAL_MAX;
+static unsigned int level = SCANCTL_LEVELS - 1;                                 // start busy, the station table is empty
+static unsigned int window = 0;
+static unsigned int interval = 0;
+static unsigned int expiryInterval = 0;                                         // interval the stations are expired by
+static time_t expiryIntervalSince;                                              // relative time expiryInterval was last
+                                                                                // longer than interval
+
+/** ------------------------------------------------------------------------
+ *
+ * Calculates window and interval of the current level and hands them
+ * over to the scanner
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void scanctl_apply()  {
+        const unsigned int top = SCANCTL_LEVELS - 1;
+
+        window = windowMin + (windowMax - windowMin) * level / top;
+        interval = window + (intervalMax - window) * (top - level) / top;
+
+        if (interval >= expiryInterval) {
+                expiryInterval = interval;
+        } else {
+                expiryIntervalSince = le_clk_GetRelativeTime().sec;             // keep the longer one for a while
+        }
+
+        bx31at_setScanTiming(window, interval);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * initializes the controller and sets the initial scan timing
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void scanctl_init()  {
+        level = SCANCTL_LEVELS - 1;
+        scanctl_apply();
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Sets the bounds of the controller
+ *
+ * @param newWindowMin - shortest scan window in seconds
+ * @param newWindowMax - longest scan window in seconds
+ * @param newIntervalMax - longest time between the start of two scans
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void scanctl_setBounds(unsigned int newWindowMin, unsigned int newWindowMax, unsigned int newIntervalMax)  {
+        if (newWindowMin == 0 || newWindowMin > newWindowMax || newIntervalMax < newWindowMax) {
+                LE_WARN("invalid scan bounds: window %u..%u s, interval max %u s - ignored",
+                        newWindowMin, newWindowMax, newIntervalMax);
+                return;
+        }
+
+        windowMin = newWindowMin;
+        windowMax = newWindowMax;
+        intervalMax = newIntervalMax;
+        scanctl_apply();
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Called on each periodical check of the station manager
+ *
+ * @param added - stations added since the last check
+ * @param removed - stations expired since the last check
+ * @param stations - stations in the table after the check
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void scanctl_update(unsigned int added, unsigned int removed, unsigned int stations)  {
+        unsigned int churn = (added + removed) * 100 / (stations > 0 ? stations : 1);
+        unsigned int previousLevel = level;
+
+        if (churn >= SCANCTL_CHURN_HIGH) {
+                level = SCANCTL_LEVELS - 1;
+        } else if (churn >= SCANCTL_CHURN_LOW) {
+                if (level < SCANCTL_LEVELS - 1) ++level;
+        } else if (level > 0) {
+                --level;
+        }
+
+        if (level != previousLevel) {
+                scanctl_apply();
+                LE_INFO("scan churn %u%% - level %u: window %u s, interval %u s",
+                        churn, level, window, interval);
+        }
+}
+
+unsigned int scanctl_getWindow()  {
+        return window;
+}
+
+unsigned int scanctl_getInterval()  {
+        return interval;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Interval to expire the stations by - the current scan interval, or a
+ * longer one used within the last two of its intervals
+ *
+ * ------------------------------------------------------------------------
+ */
+
+unsigned int scanctl_getExpiryInterval()  {
+        if (expiryInterval > interval
+            && le_clk_GetRelativeTime().sec - expiryIntervalSince >= 2 * (time_t) expiryInterval) {
+                expiryInterval = interval;
+        }
+        return expiryInterval;
+}
@@ -0,0 +1,30 @@
+/*
+ * ScanControl.h
+ *
+ *  Adapts the BT scan window and interval to the observed station churn
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+
+#ifndef SCANCONTROL_H_
+#define SCANCONTROL_H_
+
+#define SCANCTL_WINDOW_MIN 2                  // scan window bounds in seconds
+#define SCANCTL_WINDOW_MAX 10
+#define SCANCTL_INTERVAL_MAX 60               // longest time from scan start to scan start in seconds
+#define SCANCTL_LEVELS 6                      // number of steps between quiet and busy
+#define SCANCTL_CHURN_LOW 2                   // churn (added + removed per check) in percent of the stations,
+#define SCANCTL_CHURN_HIGH 10                 // below LOW the scanning backs off a step, from HIGH on it jumps to
+                                              // full scanning, in between it steps up
+
+void scanctl_init();
+void scanctl_setBounds(unsigned int windowMin, unsigned int windowMax, unsigned int intervalMax);
+void scanctl_update(unsigned int added, unsigned int removed, unsigned int stations);
+unsigned int scanctl_getWindow();
+unsigned int scanctl_getInterval();
+unsigned int scanctl_getExpiryInterval();
+
+#endif /* SCANCONTROL_H_ */
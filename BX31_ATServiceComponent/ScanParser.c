@@ -0,0 +1,208 @@
+/*
+ * ScanParser.c
+ *
+ * Parser for the unsolicited +SRBLESCAN lines of the BX310x. It is kept
+ * apart from the AT handling in BX31_ATServiceComponent.c as it has no
+ * state and no Legato dependency beyond the result codes - so it can
+ * be built on the host for test/test_scanParser.c.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "BX31_ATServiceComponent.h"
+#include "legato.h"
+#include <limits.h>
+#include <string.h>
+
+/** ------------------------------------------------------------------------
+ *
+ * Converts a single ASCII hex digit into its value
+ *
+ *  @param c - character to convert
+ *
+ *  @return 0..15 or -1 in case c is not a hex digit
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline int bx31at_hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Skips blanks and expects a field separator (comma) at the cursor
+ *
+ *  @param pos - cursor in the line
+ *  @param end - end of the line
+ *
+ *  @return cursor behind the separator or NULL if there was none
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline const char *bx31at_nextField(const char *pos, const char *end) {
+        while (pos < end && *pos == ' ') ++pos;
+        if (pos >= end || *pos != ',') return NULL;
+        ++pos;
+        while (pos < end && *pos == ' ') ++pos;
+        return pos;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Parses a (signed) decimal integer at the cursor
+ *
+ *  @param posPtr - cursor in the line, moved behind the number
+ *  @param end - end of the line
+ *  @param valuePtr - where the number is written to
+ *
+ *  @return LE_OK or LE_FORMAT_ERROR if there is no number at the cursor
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline le_result_t bx31at_parseInt(const char **posPtr, const char *end, int *valuePtr) {
+        const char *pos = *posPtr;
+        bool negative = false;
+        int value = 0;
+
+        if (pos < end && (*pos == '-' || *pos == '+')) negative = (*pos++ == '-');
+        if (pos >= end || *pos < '0' || *pos > '9') return LE_FORMAT_ERROR;
+
+        while (pos < end && *pos >= '0' && *pos <= '9' && value < 10000) {      // values are small (addr type, RSSI) - the bound
+                value = value * 10 + (*pos++ - '0');                            // just keeps garbage from overflowing
+        }
+
+        *valuePtr = negative ? -value : value;
+        *posPtr = pos;
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Single pass parser for the unsolicited +SRBLESCAN message. The line is
+ * walked exactly once from left to right, each field is converted while
+ * it is read and written straight into the given scan result.
+ * The input line is not modified and does not need to be 0 terminated.
+ *
+ * the unsolicited message looks like:
+ * +SRBLESCAN: "29:db:3c:cd:01:5a",   1,     -53,"\1E\FF\06\00\01\09\20\02\77\62\22\BC\EE\52\C2\BE\85\AB\73\AF\FB\A9\64\26\AE\EE\8D"
+ * \----v----/ \-------v-------/      v       v   \--------------------------------------v-----------------------------------------/
+ * AT preamble      BT addr       Addr Type  RSSI                                    Advert Data
+ *
+ *  @param line - the line as received from the BX31
+ *  @param len - number of characters in line
+ *  @param scanResult - storage the binary packed result is written to
+ *
+ * While the advertisement data is converted a 64 bit fingerprint is built
+ * on the fly, so the station manager can detect changed advertisements
+ * with a single compare.
+ *
+ *  @return LE_OK on success, LE_FORMAT_ERROR if the line could not be parsed,
+ *          LE_OVERFLOW if the advertisement is longer than MAX_BT_DATA_STRING_SIZE
+ *
+ * -------------------------------------------------------------------------
+ */
+
+le_result_t bx31at_parseScanResult(const char *line, size_t len, BTScanResult_t *scanResult) {
+
+        static const char preamble[] = "+SRBLESCAN:";
+        const size_t preambleLen = sizeof(preamble) - 1;
+        const char *end = line + len;
+        const char *pos;
+        int value;
+
+        if (len < preambleLen || memcmp(line, preamble, preambleLen) != 0) {
+                return LE_FORMAT_ERROR;
+        }
+
+        pos = line + preambleLen;
+        while (pos < end && *pos == ' ') ++pos;
+
+        /* --- BT address: "29:db:3c:cd:01:5a" first octet is the MSB --- */
+        if (pos < end && *pos == '\"') ++pos;
+
+        uint64_t addr = 0;
+        for (int octet = 0; octet < 6; ++octet) {
+                int digits = 0, nibble;
+                unsigned int octetValue = 0;
+
+                while (pos < end && digits < 2 && (nibble = bx31at_hexDigit(*pos)) >= 0) {
+                        octetValue = (octetValue << 4) | nibble;
+                        ++digits;
+                        ++pos;
+                }
+                if (digits == 0) return LE_FORMAT_ERROR;
+
+                addr = (addr << CHAR_BIT) | octetValue;
+
+                if (octet < 5) {
+                        if (pos >= end || *pos != ':') return LE_FORMAT_ERROR;
+                        ++pos;
+                }
+        }
+        if (pos < end && *pos == '\"') ++pos;
+
+        /* --- address type --- */
+        if ((pos = bx31at_nextField(pos, end)) == NULL
+            || bx31at_parseInt(&pos, end, &value) != LE_OK
+            || (value != BX31_BT_PUBLIC_ADDR && value != BX31_BT_PRIVATE_ADDR)) {
+                return LE_FORMAT_ERROR;
+        }
+        scanResult->addrType = (uint8_t) value;
+
+        /* --- RSSI --- */
+        if ((pos = bx31at_nextField(pos, end)) == NULL
+            || bx31at_parseInt(&pos, end, &value) != LE_OK) {
+                return LE_FORMAT_ERROR;
+        }
+        scanResult->rssi = value;
+
+        /* --- advertisement data: "\1E\FF\06..." each byte is escaped as \XX --- */
+        if ((pos = bx31at_nextField(pos, end)) == NULL) return LE_FORMAT_ERROR;
+        if (pos < end && *pos == '\"') ++pos;
+
+        int dataLen = 0;
+        uint64_t fingerprint = BX31_FINGERPRINT_ADD(BX31_FINGERPRINT_OFFSET, scanResult->addrType);
+        while (pos < end && *pos != '\"' && *pos != '\r' && *pos != '\n') {
+                int hi, lo;
+                char byte;
+
+                if (*pos == '\\') {                                             // escaped byte
+                        if (end - pos < 3
+                            || (hi = bx31at_hexDigit(pos[1])) < 0
+                            || (lo = bx31at_hexDigit(pos[2])) < 0) {
+                                return LE_FORMAT_ERROR;
+                        }
+                        byte = (char) ((hi << 4) | lo);
+                        pos += 3;
+                } else {                                                        // the BX31 escapes all bytes but we accept
+                        byte = *pos++;                                          // printable characters as they are
+                }
+
+                if (dataLen >= MAX_BT_DATA_STRING_SIZE) return LE_OVERFLOW;
+                scanResult->advertData[dataLen++] = byte;
+                fingerprint = BX31_FINGERPRINT_ADD(fingerprint, byte);
+        }
+
+        scanResult->btStationAddress = addr;
+        scanResult->data_len = dataLen;
+        scanResult->fingerprint = BX31_FINGERPRINT_ADD(fingerprint, dataLen);
+
+#ifdef DEBUG_BX31
+        char dbgBuffer[MAX_BT_DATA_STRING_SIZE * 5 + 1];
+        memset(dbgBuffer, 0, MAX_BT_DATA_STRING_SIZE * 5 + 1);
+        for (int i = 0; i < dataLen; ++i) {
+                sprintf(dbgBuffer + (5 * i), " 0x%02x", (uint8_t) scanResult->advertData[i]);
+        }
+        LE_DEBUG("parsed addr=%012llx, addrType=%d, rssi=%d, data_len=%d, data:%s",
+                 addr, scanResult->addrType, scanResult->rssi, dataLen, dbgBuffer);
+#endif                                /* DEBUG_BX31 */
+
+        return LE_OK;
+}
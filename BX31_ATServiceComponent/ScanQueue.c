@@ -0,0 +1,292 @@
+/*
+ * ScanQueue.c
+ *
+ * Bounded lock free single producer / single consumer ring of scan
+ * results. Each queue has exactly one producer (the I/O thread of one
+ * BX31) and one consumer (the thread running the station manager).
+ *
+ * The producer reserves the next free slot, parses into it and commits
+ * it. In case the ring is full the scan result is dropped and counted -
+ * the I/O thread never waits for the consumer.
+ * The consumer is woken up via an eventfd, which is only written when
+ * the ring was empty before the commit - while the consumer is behind
+ * it finds the new results when it drains the ring anyway.
+ *
+ * The ring can be resized while both sides are running: the producer
+ * links a new ring to the current one and continues on the new ring,
+ * the consumer switches over (and frees the old ring) once it drained
+ * the old one. So the order of the scan results is kept.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "ScanQueue.h"
+#include "legato.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+typedef struct ScanRing {
+	BTScanResult_t *slots;
+	uint32_t mask;					// capacity - 1, capacity is a power of 2
+	uint32_t head;					// next slot to consume - written by consumer only
+	uint32_t tail;					// next slot to produce - written by producer only
+	struct ScanRing *next;			// set by the producer when it moved on to a resized ring
+} ScanRing_t;
+
+struct ScanQueue {
+	ScanRing_t *producerRing;		// ring the producer fills
+	ScanRing_t *consumerRing;		// ring the consumer drains - the same or an older one after a resize
+	int eventFd;
+	uint32_t dropped;				// written by producer only
+	uint32_t highWater;				// written by producer only
+};
+
+/** ------------------------------------------------------------------------
+ *
+ * Allocates an empty ring
+ *
+ * @param capacity - number of slots, rounded up to a power of 2
+ *
+ * @return the ring or NULL
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static ScanRing_t *scanq_createRing(uint32_t capacity)  {
+        uint32_t size = 2;
+
+        while (size < capacity) size <<= 1;
+
+        ScanRing_t *ring = calloc(1, sizeof(ScanRing_t));
+        if (ring == NULL) return NULL;
+
+        if ((ring->slots = calloc(size, sizeof(BTScanResult_t))) == NULL) {
+                free(ring);
+                return NULL;
+        }
+
+        ring->mask = size - 1;
+        return ring;
+}
+
+static void scanq_freeRing(ScanRing_t *ring)  {
+        if (ring == NULL) return;
+        free(ring->slots);
+        free(ring);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Allocates a queue with its ring and eventfd
+ *
+ * @param capacity - number of slots, rounded up to a power of 2
+ *
+ * @return the queue or NULL
+ *
+ * ------------------------------------------------------------------------
+ */
+
+ScanQueue_t *scanq_create(uint32_t capacity)  {
+        ScanQueue_t *queue = calloc(1, sizeof(ScanQueue_t));
+        if (queue == NULL) return NULL;
+
+        if ((queue->producerRing = queue->consumerRing = scanq_createRing(capacity)) == NULL) {
+                free(queue);
+                return NULL;
+        }
+
+        if ((queue->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+                LE_ERROR("could not create eventfd for scan queue: %m");
+                scanq_freeRing(queue->producerRing);
+                free(queue);
+                return NULL;
+        }
+
+        return queue;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Releases the queue - producer and consumer must have stopped
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void scanq_destroy(ScanQueue_t *queue)  {
+        if (queue == NULL) return;
+        if (queue->eventFd >= 0) close(queue->eventFd);
+
+        while (queue->consumerRing != NULL) {
+                ScanRing_t *next = queue->consumerRing->next;
+                scanq_freeRing(queue->consumerRing);
+                queue->consumerRing = next;
+        }
+        free(queue);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Producer: moves on to a ring with a new capacity. The results which
+ * are still in the current ring are consumed before the ones in the new
+ * ring. Must be called on the producer thread.
+ *
+ * @param capacity - number of slots, rounded up to a power of 2
+ *
+ * @return LE_OK or LE_NO_MEMORY (the current ring is kept)
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t scanq_resize(ScanQueue_t *queue, uint32_t capacity)  {
+        if (capacity <= queue->producerRing->mask + 1 && capacity > (queue->producerRing->mask + 1) / 2) {
+                return LE_OK;                                                   // rounds to the current size
+        }
+
+        ScanRing_t *ring = scanq_createRing(capacity);
+        if (ring == NULL) return LE_NO_MEMORY;
+
+        __atomic_store_n(&queue->producerRing->next, ring, __ATOMIC_SEQ_CST);   // consumer switches when the old
+                                                                                // one is empty
+        queue->producerRing = ring;
+
+        LE_INFO("scan queue resized to %u results", ring->mask + 1);
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Producer: returns the next free slot to parse a scan result into.
+ * The slot is handed over to the consumer with scanq_commit(), if it is
+ * not committed it is reused by the next reserve.
+ *
+ * @return the slot or NULL if the ring is full (the result is counted
+ *         as dropped)
+ *
+ * ------------------------------------------------------------------------
+ */
+
+BTScanResult_t *scanq_reserve(ScanQueue_t *queue)  {
+        ScanRing_t *ring = queue->producerRing;
+        uint32_t consumed = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        if (ring->tail - consumed > ring->mask) {
+                __atomic_store_n(&queue->dropped, queue->dropped + 1, __ATOMIC_RELAXED);
+                return NULL;
+        }
+
+        return &ring->slots[ring->tail & ring->mask];
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Producer: publishes the slot returned by the last scanq_reserve() and
+ * wakes up the consumer in case the ring was empty
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void scanq_commit(ScanQueue_t *queue)  {
+        ScanRing_t *ring = queue->producerRing;
+        uint32_t produced = ring->tail + 1;
+
+        __atomic_store_n(&ring->tail, produced, __ATOMIC_SEQ_CST);              // store tail before load head - pairs with
+        uint32_t consumed = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);     // scanq_pop(), so no wakeup gets lost
+
+        if (produced - consumed > __atomic_load_n(&queue->highWater, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&queue->highWater, produced - consumed, __ATOMIC_RELAXED);
+        }
+
+        if (produced - consumed == 1) {                                         // ring was empty - consumer is idle
+                uint64_t one = 1;
+                if (write(queue->eventFd, &one, sizeof(one)) != sizeof(one)) {
+                        LE_WARN("could not signal scan queue: %m");
+                }
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Consumer: returns the oldest scan result in the ring - it stays valid
+ * until scanq_pop() is called
+ *
+ * @return the scan result or NULL if the ring is empty
+ *
+ * ------------------------------------------------------------------------
+ */
+
+BTScanResult_t *scanq_front(ScanQueue_t *queue)  {
+        for (;;) {
+                ScanRing_t *ring = queue->consumerRing;
+                uint32_t produced = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+
+                if (produced != ring->head) return &ring->slots[ring->head & ring->mask];
+
+                ScanRing_t *next = __atomic_load_n(&ring->next, __ATOMIC_SEQ_CST);
+                if (next == NULL) return NULL;
+
+                if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != ring->head) {
+                        continue;                                               // committed before the producer moved on
+                }
+
+                queue->consumerRing = next;                                     // the producer does not touch the old ring
+                scanq_freeRing(ring);                                           // anymore
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Consumer: releases the slot returned by scanq_front()
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void scanq_pop(ScanQueue_t *queue)  {
+        __atomic_store_n(&queue->consumerRing->head, queue->consumerRing->head + 1, __ATOMIC_SEQ_CST);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Consumer: the eventfd becomes readable when results are available.
+ * Call scanq_clearEvent() before draining the ring with scanq_front()
+ *
+ * ------------------------------------------------------------------------
+ */
+
+int scanq_getEventFd(ScanQueue_t *queue)  {
+        return queue->eventFd;
+}
+
+void scanq_clearEvent(ScanQueue_t *queue)  {
+        uint64_t count;
+        if (read(queue->eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                LE_WARN("could not read scan queue event: %m");
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Statistics - may be called from any thread
+ *
+ * @return number of scan results dropped because the ring was full
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t scanq_droppedCount(ScanQueue_t *queue)  {
+        return __atomic_load_n(&queue->dropped, __ATOMIC_RELAXED);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @param reset - restart the high water mark
+ *
+ * @return max. number of scan results waiting in the ring
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t scanq_highWater(ScanQueue_t *queue, bool reset)  {
+        return reset ? __atomic_exchange_n(&queue->highWater, 0, __ATOMIC_RELAXED)
+                     : __atomic_load_n(&queue->highWater, __ATOMIC_RELAXED);
+}
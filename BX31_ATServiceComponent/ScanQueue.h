@@ -0,0 +1,35 @@
+/*
+ * ScanQueue.h
+ *
+ *  Bounded lock free single producer / single consumer ring of scan
+ *  results. The I/O thread of a BX31 parses the +SRBLESCAN lines straight
+ *  into the pre-allocated slots, the main thread is woken up via an
+ *  eventfd and consumes them. There is one queue per BX31.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "BX31_ATServiceComponent.h"
+
+#ifndef SCANQUEUE_H_
+#define SCANQUEUE_H_
+
+typedef struct ScanQueue ScanQueue_t;
+
+ScanQueue_t *scanq_create(uint32_t capacity);
+le_result_t scanq_resize(ScanQueue_t *queue, uint32_t capacity);
+void scanq_destroy(ScanQueue_t *queue);
+
+BTScanResult_t *scanq_reserve(ScanQueue_t *queue);
+void scanq_commit(ScanQueue_t *queue);
+
+BTScanResult_t *scanq_front(ScanQueue_t *queue);
+void scanq_pop(ScanQueue_t *queue);
+int scanq_getEventFd(ScanQueue_t *queue);
+void scanq_clearEvent(ScanQueue_t *queue);
+
+uint32_t scanq_droppedCount(ScanQueue_t *queue);
+uint32_t scanq_highWater(ScanQueue_t *queue, bool reset);
+
+#endif /* SCANQUEUE_H_ */
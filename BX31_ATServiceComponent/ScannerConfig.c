@@ -0,0 +1,120 @@
+/*
+ * ScannerConfig.c
+ *
+ * Loads the scanner settings from the config tree of the app. Settings
+ * which are not in the tree keep their compile time defaults. A change
+ * handler on SCANCFG_ROOT reloads all settings and hands them to the
+ * callback, so the tuning can be changed without rebuilding, e.g.:
+ *
+ *     config set BX31_ATService:/scanner/stations/maxAge 120 int
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "ScannerConfig.h"
+#include "BX31_ATServiceComponent.h"
+#include "BTStationManager.h"
+#include "ScanControl.h"
+
+static ScannerConfig_t config;
+static callbackOnConfigChange_t callback = NULL;
+static le_cfg_ChangeHandlerRef_t changeHandlerRef = NULL;
+
+/** ------------------------------------------------------------------------
+ *
+ * reads an unsigned value, negative values fall back to the default
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static uint32_t scancfg_getUint(le_cfg_IteratorRef_t iterRef, const char *path, uint32_t defaultValue)  {
+        int32_t value = le_cfg_GetInt(iterRef, path, (int32_t) defaultValue);
+
+        if (value < 0) {
+                LE_WARN("invalid config value %s/%s=%d - using %u", SCANCFG_ROOT, path, value, defaultValue);
+                return defaultValue;
+        }
+        return (uint32_t) value;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * (re)loads all settings from the config tree
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void scancfg_load()  {
+        le_cfg_IteratorRef_t iterRef = le_cfg_CreateReadTxn(SCANCFG_ROOT);
+
+        config.stationMaxAge = scancfg_getUint(iterRef, "stations/maxAge", MAX_BT_STATION_AGE);
+        config.stationTableSize = scancfg_getUint(iterRef, "stations/tableSize", MAX_BT_STATION_HASHMAP_SIZE);
+        config.stationMemoryBudget = scancfg_getUint(iterRef, "stations/memoryBudget", BTMGR_MEMORY_BUDGET);
+        config.scanQueueSize = scancfg_getUint(iterRef, "scan/queueSize", BX31_SCAN_QUEUE_SIZE);
+        config.continuousScan = le_cfg_GetBool(iterRef, "scan/continuous", BX31_CONTINUOUS_SCAN);
+        config.scanTimerMs = scancfg_getUint(iterRef, "scan/timerMs", BX31_SCAN_TIMER_MS);
+        config.scanWindowMin = scancfg_getUint(iterRef, "scan/windowMin", SCANCTL_WINDOW_MIN);
+        config.scanWindowMax = scancfg_getUint(iterRef, "scan/windowMax", SCANCTL_WINDOW_MAX);
+        config.scanIntervalMax = scancfg_getUint(iterRef, "scan/intervalMax", SCANCTL_INTERVAL_MAX);
+        config.reportIntervalMs = scancfg_getUint(iterRef, "report/intervalMs", MAX_BT_STATION_AGE * 1000);
+
+        le_cfg_CancelTxn(iterRef);
+
+        if (config.scanTimerMs == 0) config.scanTimerMs = BX31_SCAN_TIMER_MS;  // timers need an interval
+        if (config.reportIntervalMs == 0) config.reportIntervalMs = MAX_BT_STATION_AGE * 1000;
+
+        LE_INFO("scanner config: station max age=%u s, table size=%u, memory budget=%u bytes, queue size=%u, "
+                "continuous=%d, scan timer=%u ms, window=%u..%u s, interval max=%u s, report interval=%u ms",
+                config.stationMaxAge, config.stationTableSize, config.stationMemoryBudget, config.scanQueueSize,
+                config.continuousScan, config.scanTimerMs, config.scanWindowMin,
+                config.scanWindowMax, config.scanIntervalMax, config.reportIntervalMs);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * called by the config tree if anything below SCANCFG_ROOT changed
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void scancfg_changeHandler(void *contextPtr)  {
+        LE_INFO("scanner config changed");
+        scancfg_load();
+        if (callback != NULL) callback(&config);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Loads the settings and registers for changes. The callback is called
+ * with the initial settings as well
+ *
+ * @param callbackOnConfigChange - applies the settings
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void scancfg_init(callbackOnConfigChange_t callbackOnConfigChange)  {
+        callback = callbackOnConfigChange;
+        changeHandlerRef = le_cfg_AddChangeHandler(SCANCFG_ROOT, scancfg_changeHandler, NULL);
+
+        scancfg_load();
+        if (callback != NULL) callback(&config);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return the current settings
+ *
+ * ------------------------------------------------------------------------
+ */
+
+const ScannerConfig_t *scancfg_get()  {
+        return &config;
+}
+
+void scancfg_destroy()  {
+        if (changeHandlerRef != NULL) le_cfg_RemoveChangeHandler(changeHandlerRef);
+        changeHandlerRef = NULL;
+        callback = NULL;
+}
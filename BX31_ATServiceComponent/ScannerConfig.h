@@ -0,0 +1,37 @@
+/*
+ * ScannerConfig.h
+ *
+ *  Scanner settings from the Legato config tree of the app
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+#include "interfaces.h"
+
+#ifndef SCANNERCONFIG_H_
+#define SCANNERCONFIG_H_
+
+#define SCANCFG_ROOT "/scanner"                  // config tree path, e.g. "config set BX31_ATService:/scanner/..."
+
+typedef struct {
+	uint32_t stationMaxAge;			// stations/maxAge - seconds until a station which is not seen expires
+	uint32_t stationTableSize;		// stations/tableSize - stations which fit without growing the table
+	uint32_t stationMemoryBudget;	// stations/memoryBudget - bytes for the station table and payloads, 0 = none
+	uint32_t scanQueueSize;			// scan/queueSize - scan results waiting for the station manager
+	bool continuousScan;			// scan/continuous - next scan on the final response of the previous one
+	uint32_t scanTimerMs;			// scan/timerMs - scan timer, (re)starts continuous scanning
+	uint32_t scanWindowMin;			// scan/windowMin - bounds of the adaptive scan timing in seconds
+	uint32_t scanWindowMax;			// scan/windowMax
+	uint32_t scanIntervalMax;		// scan/intervalMax
+	uint32_t reportIntervalMs;		// report/intervalMs - periodical check and report to AirVantage
+} ScannerConfig_t;
+
+typedef void (*callbackOnConfigChange_t)(const ScannerConfig_t *config);
+
+void scancfg_init(callbackOnConfigChange_t callbackOnConfigChange);
+const ScannerConfig_t *scancfg_get();
+void scancfg_destroy();
+
+#endif /* SCANNERCONFIG_H_ */
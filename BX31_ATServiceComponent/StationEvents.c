@@ -0,0 +1,380 @@
+/*
+ * StationEvents.c
+ *
+ * Station events of btScan.api. The station manager reports the events
+ * while it merges the scan results (appeared, payload changed, RSSI
+ * changed) and while it ages the stations (lost). Each event is checked
+ * against the filters of the subscribers right away and queued for the
+ * subscribers it matches - nothing is kept for the others. The queues
+ * are ring buffers of STEV_QUEUE_EVENTS, a subscriber which does not
+ * fetch its events loses the oldest ones.
+ *
+ * The subscribers are not called per event: stev_flush() is called once
+ * per scan cycle (and after the aging) and calls the handler of each
+ * subscriber which got events since - with the number of events waiting.
+ * The subscriber fetches them with GetEvents(), up to BTSCAN_MAX_RESULTS
+ * per call. So the IPC messages are bounded by the scan cycles, not by
+ * the number of stations.
+ *
+ * Each event carries the tick of the sighting (for lost stations the
+ * last one), GetEvents() converts it to absolute time.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "StationEvents.h"
+#include "BTStationManager.h"
+
+#define STEV_AD_TYPE_MANUFACTURER 0xff          // manufacturer specific data, starts with the company id (little endian)
+
+typedef struct {
+	uint64_t address;
+	uint32_t tick;					// sighting - btmgr_tick()
+	uint8_t type;					// BTSCAN_APPEARED ...
+	int8_t rssi;
+} StationEvent_t;
+
+typedef struct {
+	btScan_SubscriptionRef_t ref;
+	le_msg_SessionRef_t session;	// client which subscribed - its subscriptions go when it disconnects
+	btScan_StationEventHandlerFunc_t handlerPtr;
+	void *contextPtr;
+	btScan_EventType_t events;		// filters
+	uint64_t addressPrefix;			// the top prefixBits of the 48 bit address
+	uint64_t prefixMask;
+	uint16_t manufacturerId;
+	uint8_t addrType;
+	int8_t rssiThreshold;
+	bool notify;					// events were queued since the last handler call
+	uint32_t dropped;				// events overwritten since the last GetEvents()
+	uint32_t head;					// oldest event
+	uint32_t count;
+	StationEvent_t queue[STEV_QUEUE_EVENTS];
+} Subscriber_t;
+
+static le_mem_PoolRef_t subscriberPool = NULL;
+static le_ref_MapRef_t subscriptionMap = NULL;
+static Subscriber_t *subscribers[STEV_MAX_SUBSCRIBERS];
+static unsigned int subscriberCount = 0;
+
+static unsigned int queuedEvents = 0;                                           // statistics since the last stev_getStats()
+static unsigned int droppedEvents = 0;
+static unsigned int notifications = 0;
+
+/** ------------------------------------------------------------------------
+ *
+ * @return the company id of the first manufacturer specific AD structure
+ *         of the advertisement, BTSCAN_MANUFACTURER_ANY if there is none
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static uint16_t stev_manufacturerId(const uint8_t *data, size_t len) {
+        size_t pos = 0;
+
+        while (pos + 1 < len && data[pos] != 0) {                               // AD structure: length, type, data
+                size_t adLen = data[pos];
+
+                if (pos + 1 + adLen > len) break;
+                if (data[pos + 1] == STEV_AD_TYPE_MANUFACTURER && adLen >= 3) {
+                        return data[pos + 2] | (data[pos + 3] << 8);
+                }
+                pos += 1 + adLen;
+        }
+        return BTSCAN_MANUFACTURER_ANY;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Queues an event for a subscriber, the oldest one is dropped if the
+ * queue is full
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void stev_queue(Subscriber_t *sub, const StationEvent_t *event) {
+        if (sub->count == STEV_QUEUE_EVENTS) {
+                sub->head = (sub->head + 1) % STEV_QUEUE_EVENTS;
+                --sub->count;
+                ++sub->dropped;
+                ++droppedEvents;
+        }
+        sub->queue[(sub->head + sub->count) % STEV_QUEUE_EVENTS] = *event;
+        ++sub->count;
+        sub->notify = true;
+        ++queuedEvents;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Queues an event of a station for the subscribers whose filters match.
+ * The manufacturer id is only parsed if a subscriber filters on it.
+ *
+ * @param type - one BTSCAN_* event
+ * @param index of the station - still in the table
+ * @param tick of the sighting
+ * @param previousRssi - RSSI before the sighting, only for the RSSI events
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void stev_dispatch(btScan_EventType_t type, uint32_t index, uint32_t tick, int8_t previousRssi) {
+        uint64_t address = sttbl_address(index);
+        const BT_Station_Container_t *sCont = &stationStore.cold[index];
+        int8_t rssi = stationStore.rssi[index];
+        int manufacturerId = -1;                                                // not parsed yet
+        StationEvent_t event = { .address = address, .tick = tick, .rssi = rssi };
+
+        for (unsigned int i = 0; i < subscriberCount; ++i) {
+                Subscriber_t *sub = subscribers[i];
+                btScan_EventType_t wanted = sub->events & type;
+
+                if (wanted & (BTSCAN_RSSI_ABOVE | BTSCAN_RSSI_BELOW)) {         // only where the threshold was crossed
+                        if (!(previousRssi < sub->rssiThreshold && rssi >= sub->rssiThreshold)) wanted &= ~BTSCAN_RSSI_ABOVE;
+                        if (!(previousRssi >= sub->rssiThreshold && rssi < sub->rssiThreshold)) wanted &= ~BTSCAN_RSSI_BELOW;
+                }
+                if (wanted == 0) continue;
+                if ((address & sub->prefixMask) != sub->addressPrefix) continue;
+                if (sub->addrType != BTSCAN_ADDR_TYPE_ANY && sCont->addrType != sub->addrType) continue;
+                if (sub->manufacturerId != BTSCAN_MANUFACTURER_ANY) {
+                        if (manufacturerId < 0) {
+                                manufacturerId = sCont->data_len > 0
+                                                 ? stev_manufacturerId(slab_data(sCont->payload), sCont->data_len)
+                                                 : BTSCAN_MANUFACTURER_ANY;
+                        }
+                        if (manufacturerId != sub->manufacturerId) continue;
+                }
+
+                event.type = (uint8_t) wanted;                                  // one event - RSSI_ABOVE and BELOW exclude
+                stev_queue(sub, &event);                                        // each other
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Reports an event of a station - for the stations which appeared, lost
+ * (before it is removed from the table) or changed their payload
+ *
+ * @param type - BTSCAN_APPEARED, BTSCAN_CHANGED or BTSCAN_LOST
+ * @param index of the station
+ * @param tick of the sighting
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void stev_stationEvent(btScan_EventType_t type, uint32_t index, uint32_t tick) {
+        if (subscriberCount == 0) return;
+        stev_dispatch(type, index, tick, STTBL_RSSI_NONE);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Reports that the RSSI of a station changed - an RSSI event is queued
+ * for the subscribers whose threshold it crossed. A new station comes
+ * from STTBL_RSSI_NONE, so it crosses the threshold upwards if it is
+ * strong enough.
+ *
+ * @param index of the station, stationStore.rssi holds the new RSSI
+ * @param previousRssi
+ * @param tick of the sighting
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void stev_rssiChanged(uint32_t index, int8_t previousRssi, uint32_t tick) {
+        if (subscriberCount == 0 || stationStore.rssi[index] == previousRssi) return;
+        stev_dispatch(BTSCAN_RSSI_ABOVE | BTSCAN_RSSI_BELOW, index, tick, previousRssi);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Calls the handler of each subscriber which got events since the last
+ * call - once per scan cycle
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void stev_flush() {
+        for (unsigned int i = 0; i < subscriberCount; ++i) {
+                Subscriber_t *sub = subscribers[i];
+
+                if (!sub->notify) continue;
+                sub->notify = false;
+                ++notifications;
+                sub->handlerPtr(sub->ref, sub->count, sub->contextPtr);         // may unsubscribe - but only
+        }                                                                       // after it returned (IPC)
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Removes a subscriber
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void stev_remove(Subscriber_t *sub) {
+        for (unsigned int i = 0; i < subscriberCount; ++i) {
+                if (subscribers[i] == sub) {
+                        subscribers[i] = subscribers[--subscriberCount];
+                        break;
+                }
+        }
+        le_ref_DeleteRef(subscriptionMap, sub->ref);
+        le_mem_Release(sub);
+        LE_INFO("btScan subscription removed, %u left", subscriberCount);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * btScan.api - subscribes to station events
+ *
+ * ------------------------------------------------------------------------
+ */
+
+btScan_StationEventHandlerRef_t btScan_AddStationEventHandler(btScan_EventType_t events,
+                                                              uint64_t addressPrefix, uint8_t prefixBits,
+                                                              uint16_t manufacturerId, uint8_t addrType,
+                                                              int8_t rssiThreshold,
+                                                              btScan_StationEventHandlerFunc_t handlerPtr,
+                                                              void *contextPtr) {
+        if (handlerPtr == NULL || prefixBits > 48) {
+                LE_ERROR("invalid btScan subscription");
+                return NULL;
+        }
+        if (subscriberCount == STEV_MAX_SUBSCRIBERS) {
+                LE_ERROR("too many btScan subscriptions (%d)", STEV_MAX_SUBSCRIBERS);
+                return NULL;
+        }
+
+        Subscriber_t *sub = le_mem_ForceAlloc(subscriberPool);
+        memset(sub, 0, sizeof(Subscriber_t));
+
+        sub->session = btScan_GetClientSessionRef();
+        sub->handlerPtr = handlerPtr;
+        sub->contextPtr = contextPtr;
+        sub->events = events;
+        sub->prefixMask = prefixBits > 0 ? (0xffffffffffffULL << (48 - prefixBits)) & 0xffffffffffffULL : 0;
+        sub->addressPrefix = addressPrefix & sub->prefixMask;
+        sub->manufacturerId = manufacturerId;
+        sub->addrType = addrType;
+        sub->rssiThreshold = rssiThreshold;
+        sub->ref = le_ref_CreateRef(subscriptionMap, sub);
+
+        subscribers[subscriberCount++] = sub;
+        LE_INFO("btScan subscription: events 0x%x, prefix %012llx/%u, manufacturer 0x%04x, addr type %u, threshold %d",
+                events, (unsigned long long) sub->addressPrefix, prefixBits, manufacturerId, addrType, rssiThreshold);
+
+        return (btScan_StationEventHandlerRef_t) sub->ref;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * btScan.api - unsubscribes, the queued events are discarded. Like
+ * GetEvents() only the client which subscribed may do that.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void btScan_RemoveStationEventHandler(btScan_StationEventHandlerRef_t handlerRef) {
+        Subscriber_t *sub = le_ref_Lookup(subscriptionMap, handlerRef);
+
+        if (sub == NULL || sub->session != btScan_GetClientSessionRef()) {     // only the client which subscribed
+                LE_WARN("unknown btScan subscription %p", handlerRef);
+                return;
+        }
+        stev_remove(sub);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * btScan.api - fetches the queued events of a subscription, oldest first
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t btScan_GetEvents(btScan_SubscriptionRef_t subscription,
+                             uint64_t *addressesPtr, size_t *addressesSizePtr,
+                             uint32_t *typesPtr, size_t *typesSizePtr,
+                             int8_t *rssisPtr, size_t *rssisSizePtr,
+                             uint64_t *seenAtMsPtr, size_t *seenAtMsSizePtr,
+                             uint32_t *droppedPtr) {
+        Subscriber_t *sub = le_ref_Lookup(subscriptionMap, subscription);
+
+        if (sub == NULL || sub->session != btScan_GetClientSessionRef()) {
+                *addressesSizePtr = *typesSizePtr = *rssisSizePtr = *seenAtMsSizePtr = 0;
+                *droppedPtr = 0;
+                return LE_NOT_FOUND;
+        }
+
+        size_t maxEvents = *addressesSizePtr;
+        if (*typesSizePtr < maxEvents) maxEvents = *typesSizePtr;
+        if (*rssisSizePtr < maxEvents) maxEvents = *rssisSizePtr;
+        if (*seenAtMsSizePtr < maxEvents) maxEvents = *seenAtMsSizePtr;
+
+        le_clk_Time_t absNow = le_clk_GetAbsoluteTime();                        // tick -> absolute time
+        uint64_t absNowMs = (uint64_t) absNow.sec * 1000 + absNow.usec / 1000;
+        uint32_t now = btmgr_tick();
+        size_t n;
+
+        for (n = 0; n < maxEvents && sub->count > 0; ++n) {
+                const StationEvent_t *event = &sub->queue[sub->head];
+
+                addressesPtr[n] = event->address;
+                typesPtr[n] = event->type;
+                rssisPtr[n] = event->rssi;
+                seenAtMsPtr[n] = absNowMs - (now - event->tick);
+
+                sub->head = (sub->head + 1) % STEV_QUEUE_EVENTS;
+                --sub->count;
+        }
+
+        *addressesSizePtr = *typesSizePtr = *rssisSizePtr = *seenAtMsSizePtr = n;
+        *droppedPtr = sub->dropped;
+        sub->dropped = 0;
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Removes the subscriptions of a client which disconnected
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void stev_sessionClosed(le_msg_SessionRef_t sessionRef, void *contextPtr) {
+        for (unsigned int i = subscriberCount; i > 0; --i) {                    // stev_remove() moves the last one to i - 1
+                if (subscribers[i - 1]->session == sessionRef) stev_remove(subscribers[i - 1]);
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Statistics of the station events since the last call
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void stev_getStats(stev_Stats_t *stats) {
+        stats->subscribers = subscriberCount;
+        stats->events = queuedEvents;
+        stats->dropped = droppedEvents;
+        stats->notifications = notifications;
+
+        queuedEvents = 0;
+        droppedEvents = 0;
+        notifications = 0;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * initializes the subscriptions
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void stev_init() {
+        subscriberPool = le_mem_CreatePool("btScanSubscribers", sizeof(Subscriber_t));
+        subscriptionMap = le_ref_CreateMap("btScanSubscriptions", STEV_MAX_SUBSCRIBERS);
+        le_msg_AddServiceCloseHandler(btScan_GetServiceRef(), stev_sessionClosed, NULL);
+}
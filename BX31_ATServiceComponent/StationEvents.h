@@ -0,0 +1,34 @@
+/*
+ * StationEvents.h
+ *
+ *  btScan.api - station events (appeared, changed, lost, RSSI crossed a
+ *  threshold) pushed to subscribed apps, filtered on the server side and
+ *  delivered in batches once per scan cycle
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+#include "interfaces.h"
+
+#ifndef STATIONEVENTS_H_
+#define STATIONEVENTS_H_
+
+#define STEV_MAX_SUBSCRIBERS 8
+#define STEV_QUEUE_EVENTS 512                 // events queued per subscriber - the oldest are dropped when it is full
+
+typedef struct {
+	unsigned int subscribers;
+	unsigned int events;			// events queued (all subscribers) since the last stev_getStats()
+	unsigned int dropped;			// events dropped - a subscriber did not fetch them in time
+	unsigned int notifications;		// handler calls
+} stev_Stats_t;
+
+void stev_init();
+void stev_stationEvent(btScan_EventType_t type, uint32_t index, uint32_t tick);
+void stev_rssiChanged(uint32_t index, int8_t previousRssi, uint32_t tick);
+void stev_flush();
+void stev_getStats(stev_Stats_t *stats);
+
+#endif /* STATIONEVENTS_H_ */
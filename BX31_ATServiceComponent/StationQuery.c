@@ -0,0 +1,200 @@
+/*
+ * StationQuery.c
+ *
+ * Server side of btScan.api. The calls are served on the main thread,
+ * the same thread which merges the scan results into the station table,
+ * so they see a consistent table without locking - and they have to be
+ * short, so each call has a bound on the stations it looks at:
+ * - GetStation: one lookup
+ * - FindStations: BTSCAN_MAX_STATIONS_PER_CALL, continued with a cursor
+ * - GetStrongest: BTSCAN_MAX_STATIONS_PER_CALL, continued with a cursor -
+ *   the client keeps the strongest of all calls
+ * The filters are checked on the hot arrays (RSSI, last seen) first, the
+ * cold part of a station is only looked at when these match.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+#include "interfaces.h"
+#include "BTStationManager.h"
+
+/** ------------------------------------------------------------------------
+ *
+ * @return true if the station matches the filters
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline bool stq_matches(uint32_t index, uint8_t addrType, int8_t minRssi, uint32_t seenWithinMs, uint32_t now) {
+        if (stationStore.rssi[index] < minRssi) return false;
+        if (seenWithinMs != BTSCAN_SEEN_ANY && now - stationStore.lastSeen[index] > seenWithinMs) return false;
+        return addrType == BTSCAN_ADDR_TYPE_ANY || stationStore.cold[index].addrType == addrType;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Cursor of an iteration over the station arrays: the index to go on
+ * with in the lower 32 bits, the first station move (sttbl_moves()) not
+ * caught up with in the upper 32 bits. 0 = start.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+typedef struct {
+        uint32_t index;
+        uint32_t move;
+} stq_Cursor_t;
+
+static inline stq_Cursor_t stq_cursor(uint64_t cursor) {
+        stq_Cursor_t c = { (uint32_t) cursor, (uint32_t) (cursor >> 32) };
+        if (cursor == 0) c.move = sttbl_moves();
+        return c;
+}
+
+static inline uint64_t stq_nextCursor(stq_Cursor_t c) {
+        if (c.index >= sttbl_count() && c.move == sttbl_moves()) return 0;     // all stations looked at
+        return ((uint64_t) c.move << 32) | c.index;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Visits the next station of an iteration - first the stations which
+ * were moved below the index since the last call (they would be skipped
+ * otherwise), then the index goes on
+ *
+ * @return index of the station, STTBL_NO_INDEX if all were visited
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline uint32_t stq_next(stq_Cursor_t *c) {
+        while (c->move != sttbl_moves()) {
+                uint32_t movedTo = sttbl_movedTo(c->move++);
+                if (movedTo < c->index && movedTo < sttbl_count()) return movedTo;
+        }
+        return c->index < sttbl_count() ? c->index++ : STTBL_NO_INDEX;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * btScan.api - looks up a station by its address
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t btScan_GetStation(uint64_t address, uint8_t *addrTypePtr, int8_t *rssiPtr, uint8_t *radioPtr,
+                              uint32_t *lastSeenAgeMsPtr, uint8_t *payloadPtr, size_t *payloadSizePtr) {
+        le_result_t result = LE_OK;
+        uint32_t index = sttbl_lookup(address);
+
+        if (index == STTBL_NO_INDEX) {
+                *payloadSizePtr = 0;
+                result = LE_NOT_FOUND;
+        } else {
+                const BT_Station_Container_t *sCont = &stationStore.cold[index];
+                size_t len = sCont->data_len;
+
+                *addrTypePtr = sCont->addrType;
+                *rssiPtr = stationStore.rssi[index];
+                *radioPtr = sCont->bestRadio;
+                *lastSeenAgeMsPtr = btmgr_tick() - stationStore.lastSeen[index];
+
+                if (len > *payloadSizePtr) {
+                        len = *payloadSizePtr;
+                        result = LE_OVERFLOW;
+                }
+                if (len > 0) memcpy(payloadPtr, slab_data(sCont->payload), len);
+                *payloadSizePtr = len;
+        }
+
+        return result;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * btScan.api - iterates the stations matching the filters, the cursor is
+ * the index in the station arrays and the station moves caught up with,
+ * so a station moved below the index by a removal is not skipped
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t btScan_FindStations(uint8_t addrType, int8_t minRssi, uint32_t seenWithinMs, uint64_t cursor,
+                                uint64_t *addressesPtr, size_t *addressesSizePtr,
+                                int8_t *rssisPtr, size_t *rssisSizePtr, uint64_t *nextCursorPtr) {
+        size_t maxResults = *addressesSizePtr < *rssisSizePtr ? *addressesSizePtr : *rssisSizePtr;
+        size_t found = 0;
+        uint32_t now = btmgr_tick();
+        stq_Cursor_t c = stq_cursor(cursor);
+
+        if (sttbl_moves() - c.move > STTBL_MOVE_HISTORY) {                     // too many removals to catch up with
+                *addressesSizePtr = *rssisSizePtr = 0;
+                *nextCursorPtr = 0;
+                return LE_OUT_OF_RANGE;
+        }
+
+        uint32_t index;
+        for (unsigned int visited = 0;
+             visited < BTSCAN_MAX_STATIONS_PER_CALL && found < maxResults && (index = stq_next(&c)) != STTBL_NO_INDEX;
+             ++visited) {
+                if (stq_matches(index, addrType, minRssi, seenWithinMs, now)) {
+                        addressesPtr[found] = sttbl_address(index);
+                        rssisPtr[found] = stationStore.rssi[index];
+                        ++found;
+                }
+        }
+
+        *addressesSizePtr = *rssisSizePtr = found;
+        *nextCursorPtr = stq_nextCursor(c);
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * btScan.api - the stations with the best RSSI among the next
+ * BTSCAN_MAX_STATIONS_PER_CALL stations of the iteration. The result
+ * arrays are kept sorted, a station which is stronger than the weakest
+ * one in them is inserted and the weakest one drops out.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t btScan_GetStrongest(uint8_t addrType, uint32_t seenWithinMs, uint64_t cursor,
+                                uint64_t *addressesPtr, size_t *addressesSizePtr,
+                                int8_t *rssisPtr, size_t *rssisSizePtr, uint64_t *nextCursorPtr) {
+        size_t maxResults = *addressesSizePtr < *rssisSizePtr ? *addressesSizePtr : *rssisSizePtr;
+        size_t found = 0;
+        uint32_t now = btmgr_tick();
+        stq_Cursor_t c = stq_cursor(cursor);
+
+        if (sttbl_moves() - c.move > STTBL_MOVE_HISTORY) {                     // too many removals to catch up with
+                *addressesSizePtr = *rssisSizePtr = 0;
+                *nextCursorPtr = 0;
+                return LE_OUT_OF_RANGE;
+        }
+
+        uint32_t index;
+        for (unsigned int visited = 0;
+             visited < BTSCAN_MAX_STATIONS_PER_CALL && maxResults > 0 && (index = stq_next(&c)) != STTBL_NO_INDEX;
+             ++visited) {
+                int8_t rssi = stationStore.rssi[index];
+
+                if (found == maxResults && rssi <= rssisPtr[found - 1]) continue;
+                if (!stq_matches(index, addrType, BTSCAN_RSSI_ANY, seenWithinMs, now)) continue;
+
+                size_t pos = found < maxResults ? found++ : found - 1;
+                while (pos > 0 && rssisPtr[pos - 1] < rssi) {
+                        rssisPtr[pos] = rssisPtr[pos - 1];
+                        addressesPtr[pos] = addressesPtr[pos - 1];
+                        --pos;
+                }
+                rssisPtr[pos] = rssi;
+                addressesPtr[pos] = sttbl_address(index);
+        }
+
+        *addressesSizePtr = *rssisSizePtr = found;
+        *nextCursorPtr = stq_nextCursor(c);
+        return LE_OK;
+}
@@ -0,0 +1,295 @@
+/*
+ * StationSnapshot.c
+ *
+ * Saves the station table into a memory mapped file and restores it on
+ * start. The file is written to <path>.tmp and renamed, so there is
+ * always a complete snapshot - a torn or foreign file is rejected by the
+ * header check and the checksum.
+ *
+ * layout:  [SnapHeader_t][count x SnapRecord_t][payloads]
+ *
+ * The records are stored newest first (so the newest stations are kept
+ * when maxBytes does not fit all of them), each refers to its payload in
+ * the payload area. Times are stored as age in ms before the snapshot -
+ * on restore the ages are moved by the time the app was not running
+ * (absolute clock), the ticks of the relative clock do not survive a
+ * reboot.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "StationSnapshot.h"
+#include "StationTable.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAP_PATH_LEN 256
+
+typedef struct {
+        uint32_t magic;                 // SNAP_MAGIC
+        uint16_t version;               // SNAP_VERSION
+        uint16_t recordSize;            // sizeof(SnapRecord_t) - changes with BX31_MAX_DEVICES
+        uint32_t count;                 // number of records
+        uint32_t payloadBytes;          // size of the payload area
+        uint64_t savedAtMs;             // absolute time of the snapshot
+        uint32_t lastReportAge;         // ms between the last report and the snapshot
+        uint32_t checksum;              // FNV-1a of the header (checksum 0), records and payloads
+} SnapHeader_t;
+
+typedef struct {
+        uint64_t address;
+        uint64_t fingerprint;
+        uint32_t lastSeenAge;           // ms before the snapshot
+        uint32_t lastReportedSeenAge;
+        uint32_t payloadOffset;         // in the payload area
+        uint32_t radioAge[BX31_MAX_DEVICES];
+        int8_t radioRssi[BX31_MAX_DEVICES];
+        int8_t rssi;
+        int8_t lastReportedRssi;
+        uint8_t changeMask;
+        uint8_t addrType;
+        uint8_t lastRadio;
+        uint8_t bestRadio;
+        uint8_t dataLen;
+} SnapRecord_t;
+
+/** ------------------------------------------------------------------------
+ *
+ * FNV-1a checksum, continued from hash
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static uint32_t snap_checksum(uint32_t hash, const void *data, size_t len) {
+        const uint8_t *bytes = data;
+
+        for (size_t i = 0; i < len; ++i) {
+                hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+}
+
+static uint32_t snap_fileChecksum(const uint8_t *file, size_t len) {
+        SnapHeader_t header = *(const SnapHeader_t *) file;
+
+        header.checksum = 0;
+        uint32_t hash = snap_checksum(2166136261u, &header, sizeof(header));
+        return snap_checksum(hash, file + sizeof(header), len - sizeof(header));
+}
+
+static inline uint64_t snap_absoluteMs() {
+        le_clk_Time_t now = le_clk_GetAbsoluteTime();
+        return (uint64_t) now.sec * 1000 + now.usec / 1000;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Saves the station table
+ *
+ * @param path - snapshot file, in the persistent writable area of the app
+ * @param now - current tick
+ * @param lastReportTick - tick of the last report, stations seen after it
+ *                         are reported again after the restore
+ * @param maxBytes - max. size of the file, the oldest stations which do
+ *                   not fit are not saved
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t snap_save(const char *path, uint32_t now, uint32_t lastReportTick, size_t maxBytes) {
+        char tmpPath[SNAP_PATH_LEN];
+        uint32_t count = 0;
+        size_t payloadBytes = 0;
+
+        for (uint32_t i = sttbl_newest(); i != STTBL_NO_INDEX; i = sttbl_older(i)) {
+                size_t dataLen = stationStore.cold[i].data_len;
+                if (sizeof(SnapHeader_t) + (count + 1) * sizeof(SnapRecord_t) + payloadBytes + dataLen > maxBytes) {
+                        LE_WARN("station snapshot is limited to %zu bytes - %zu stations are not saved",
+                                maxBytes, sttbl_count() - count);
+                        break;
+                }
+                payloadBytes += dataLen;
+                ++count;
+        }
+
+        size_t fileBytes = sizeof(SnapHeader_t) + count * sizeof(SnapRecord_t) + payloadBytes;
+
+        snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+        int fd = open(tmpPath, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+                LE_ERROR("could not create station snapshot %s: %d", tmpPath, errno);
+                return LE_FAULT;
+        }
+        if (ftruncate(fd, fileBytes) != 0) {
+                LE_ERROR("could not size station snapshot %s to %zu bytes: %d", tmpPath, fileBytes, errno);
+                close(fd);
+                unlink(tmpPath);
+                return LE_NO_MEMORY;
+        }
+
+        uint8_t *file = mmap(NULL, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (file == MAP_FAILED) {
+                LE_ERROR("could not map station snapshot %s: %d", tmpPath, errno);
+                unlink(tmpPath);
+                return LE_FAULT;
+        }
+
+        SnapHeader_t *header = (SnapHeader_t *) file;
+        SnapRecord_t *record = (SnapRecord_t *) (file + sizeof(SnapHeader_t));
+        uint8_t *payloads = (uint8_t *) (record + count);
+        uint32_t payloadOffset = 0;
+
+        uint32_t index = sttbl_newest();
+        for (uint32_t n = 0; n < count; ++n, ++record, index = sttbl_older(index)) {
+                const BT_Station_Container_t *sCont = &stationStore.cold[index];
+
+                memset(record, 0, sizeof(*record));
+                record->address = sttbl_address(index);
+                record->fingerprint = sCont->fingerprint;
+                record->lastSeenAge = now - stationStore.lastSeen[index];
+                record->lastReportedSeenAge = now - stationStore.lastReportedSeen[index];
+                record->payloadOffset = payloadOffset;
+                for (int r = 0; r < BX31_MAX_DEVICES; ++r) {
+                        record->radioRssi[r] = sCont->radio[r].rssi;
+                        record->radioAge[r] = now - sCont->radio[r].lastSeen;
+                }
+                record->rssi = stationStore.rssi[index];
+                record->lastReportedRssi = sCont->lastReportedRssi;
+                record->changeMask = stationStore.changeMask[index];
+                record->addrType = sCont->addrType;
+                record->lastRadio = sCont->lastRadio;
+                record->bestRadio = sCont->bestRadio;
+                record->dataLen = sCont->data_len;
+
+                if (sCont->data_len > 0) {
+                        memcpy(payloads + payloadOffset, slab_data(sCont->payload), sCont->data_len);
+                        payloadOffset += sCont->data_len;
+                }
+        }
+
+        header->magic = SNAP_MAGIC;
+        header->version = SNAP_VERSION;
+        header->recordSize = sizeof(SnapRecord_t);
+        header->count = count;
+        header->payloadBytes = payloadOffset;
+        header->savedAtMs = snap_absoluteMs();
+        header->lastReportAge = now - lastReportTick;
+        header->checksum = snap_fileChecksum(file, fileBytes);
+
+        bool synced = msync(file, fileBytes, MS_SYNC) == 0;
+        munmap(file, fileBytes);
+
+        if (!synced || rename(tmpPath, path) != 0) {
+                LE_ERROR("could not write station snapshot %s: %d", path, errno);
+                unlink(tmpPath);
+                return LE_FAULT;
+        }
+
+        LE_INFO("saved %u BT stations to %s (%zu bytes)", count, path, fileBytes);
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Restores the stations of a snapshot into the (empty) station table.
+ * The ages are moved by the time since the snapshot was saved - the
+ * stations which are too old now expire on the next periodical check.
+ *
+ * @param path - snapshot file
+ * @param now - current tick
+ * @param lastReportTickPtr - set to the tick of the last report before
+ *                            the snapshot
+ *
+ * @return LE_NOT_FOUND if there is no snapshot, LE_FORMAT_ERROR if it is
+ *         not valid
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t snap_restore(const char *path, uint32_t now, uint32_t *lastReportTickPtr) {
+        struct stat fileStat;
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                LE_INFO("no station snapshot %s", path);
+                return LE_NOT_FOUND;
+        }
+        if (fstat(fd, &fileStat) != 0 || (size_t) fileStat.st_size < sizeof(SnapHeader_t)) {
+                LE_WARN("station snapshot %s is too short", path);
+                close(fd);
+                return LE_FORMAT_ERROR;
+        }
+
+        size_t fileBytes = fileStat.st_size;
+        const uint8_t *file = mmap(NULL, fileBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (file == MAP_FAILED) {
+                LE_ERROR("could not map station snapshot %s: %d", path, errno);
+                return LE_FAULT;
+        }
+
+        const SnapHeader_t *header = (const SnapHeader_t *) file;
+        if (header->magic != SNAP_MAGIC || header->version != SNAP_VERSION
+            || header->recordSize != sizeof(SnapRecord_t)
+            || fileBytes != sizeof(SnapHeader_t) + (size_t) header->count * sizeof(SnapRecord_t) + header->payloadBytes
+            || header->checksum != snap_fileChecksum(file, fileBytes)) {
+                LE_WARN("station snapshot %s is not valid (version %u) - ignored", path, header->version);
+                munmap((void *) file, fileBytes);
+                return LE_FORMAT_ERROR;
+        }
+
+        uint64_t nowMs = snap_absoluteMs();
+        uint64_t downMs = nowMs > header->savedAtMs ? nowMs - header->savedAtMs : 0;  // clock went back: assume 0
+        if (downMs > SNAP_MAX_AGE_MS) downMs = SNAP_MAX_AGE_MS;
+
+        const SnapRecord_t *records = (const SnapRecord_t *) (file + sizeof(SnapHeader_t));
+        const uint8_t *payloads = (const uint8_t *) (records + header->count);
+        uint32_t restored = 0;
+
+        for (uint32_t n = header->count; n-- > 0; ) {                          // oldest first - keeps the aging list
+                const SnapRecord_t *record = &records[n];                       // ordered
+                bool isNew;
+
+                if ((size_t) record->payloadOffset + record->dataLen > header->payloadBytes) continue;
+
+                uint32_t index = sttbl_lookupOrInsert(record->address, &isNew);
+                if (index == STTBL_NO_INDEX) {
+                        LE_WARN("station table is full - %u BT stations of the snapshot are not restored", n + 1);
+                        break;
+                }
+
+                BT_Station_Container_t *sCont = &stationStore.cold[index];
+                uint64_t age = record->lastSeenAge + downMs;
+                uint64_t reportedAge = record->lastReportedSeenAge + downMs;
+
+                sttbl_touch(index, now - (uint32_t) (age < SNAP_MAX_AGE_MS ? age : SNAP_MAX_AGE_MS));
+                stationStore.lastReportedSeen[index] =
+                        now - (uint32_t) (reportedAge < SNAP_MAX_AGE_MS ? reportedAge : SNAP_MAX_AGE_MS);
+                stationStore.rssi[index] = record->rssi;
+                stationStore.changeMask[index] = record->changeMask;
+
+                for (int r = 0; r < BX31_MAX_DEVICES; ++r) {
+                        uint64_t radioAge = record->radioAge[r] + downMs;
+                        sCont->radio[r].rssi = record->radioRssi[r];
+                        sCont->radio[r].lastSeen = now - (uint32_t) (radioAge < SNAP_MAX_AGE_MS ? radioAge : SNAP_MAX_AGE_MS);
+                }
+                sCont->addrType = record->addrType;
+                sCont->lastRadio = record->lastRadio < BX31_MAX_DEVICES ? record->lastRadio : 0;
+                sCont->bestRadio = record->bestRadio < BX31_MAX_DEVICES ? record->bestRadio : 0;
+                sCont->lastReportedRssi = record->lastReportedRssi;
+                sCont->fingerprint = record->fingerprint;
+                sCont->data_len = record->dataLen;
+                sCont->payload = slab_store(sCont->payload, payloads + record->payloadOffset, record->dataLen);
+                ++restored;
+        }
+
+        uint64_t lastReportAge = header->lastReportAge + downMs;
+        *lastReportTickPtr = now - (uint32_t) (lastReportAge < SNAP_MAX_AGE_MS ? lastReportAge : SNAP_MAX_AGE_MS);
+
+        LE_INFO("restored %u BT stations from %s, saved %llu s ago", restored, path,
+                (unsigned long long) (downMs / 1000));
+        munmap((void *) file, fileBytes);
+        return LE_OK;
+}
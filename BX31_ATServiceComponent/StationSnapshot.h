@@ -0,0 +1,24 @@
+/*
+ * StationSnapshot.h
+ *
+ *  Snapshot of the station table in a memory mapped file, so a restart
+ *  of the app continues with the stations (and what was reported of
+ *  them) instead of reporting every station as new.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+
+#ifndef STATIONSNAPSHOT_H_
+#define STATIONSNAPSHOT_H_
+
+#define SNAP_MAGIC 0x53535842                 // "BXSS"
+#define SNAP_VERSION 1
+#define SNAP_MAX_AGE_MS (INT32_MAX / 2)       // older stations are restored with this age - keeps the ticks comparable
+
+le_result_t snap_save(const char *path, uint32_t now, uint32_t lastReportTick, size_t maxBytes);
+le_result_t snap_restore(const char *path, uint32_t now, uint32_t *lastReportTickPtr);
+
+#endif /* STATIONSNAPSHOT_H_ */
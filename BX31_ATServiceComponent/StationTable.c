@@ -0,0 +1,586 @@
+/*
+ * StationTable.c
+ *
+ * Purpose built hash table for the BT station list. It replaces the
+ * le_hashmap + container pool + scan result pool combination, which
+ * costs three allocations and several pointer chases per station.
+ *
+ * - the stations are stored in a dense structure of arrays, index
+ *   0..count-1. Removing a station moves the last one into the gap, so
+ *   the arrays stay dense for iterating.
+ * - hot / cold split: what a sighting and the aging and reporting sweeps
+ *   look at (address, lastSeen, RSSI, change flags, aging links) is kept
+ *   in parallel arrays of a few bytes per station, so a sweep streams
+ *   through a handful of cache lines. The rest of the station
+ *   (BT_Station_Container_t - payload handle, per radio view, ...) is in
+ *   the cold array and only touched when it is needed.
+ * - the hash slots are an open addressing table with Robin Hood
+ *   insertion and backward shift deletion. A slot holds the key and the
+ *   index of the station, so probing touches only the small slot array.
+ * - one probe sequence does lookup-or-insert
+ * - the stations are linked in an aging list ordered by lastSeen (oldest
+ *   first). Touching a station moves it to the newest end, so expired
+ *   stations are always found at the oldest end without a full sweep.
+ *
+ * CAREFUL: indexes are only valid until the next remove, pointers into
+ * the arrays only until the next insert or remove, as both may move the
+ * stations in memory
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+#include "StationTable.h"
+
+typedef struct {
+        uint64_t key;                   // BT address of the station
+        uint32_t recordIndex;           // index in the station arrays
+        uint32_t probeLen;              // distance from the home slot + 1, 0 = slot is empty
+} Station_Slot_t;
+
+static Station_Slot_t *slots = NULL;
+static size_t slotMask = 0;                                                     // number of slots - 1 (power of 2)
+
+BT_Station_Store_t stationStore;
+
+static uint32_t *olderIndexes = NULL;                                           // aging list links - hot, parallel to the
+static uint32_t *newerIndexes = NULL;                                           // station arrays
+static size_t recordCapacity = 0;
+static size_t recordCount = 0;
+static size_t maxCapacity = SIZE_MAX;                                           // the table does not grow beyond this
+
+static uint32_t oldestIndex = STTBL_NO_INDEX;                                   // ends of the aging list
+static uint32_t newestIndex = STTBL_NO_INDEX;
+
+static uint32_t moves = 0;                                                      // stations moved by removals, wraps
+static uint32_t movedTo[STTBL_MOVE_HISTORY];                                    // index the last moves went to, at [move % HISTORY]
+
+#define STTBL_HOT_BYTES (sizeof(uint32_t) + sizeof(uint16_t) + 2 * sizeof(uint32_t) + sizeof(int8_t) \
+                         + sizeof(uint8_t) + 2 * sizeof(uint32_t))
+
+/** ------------------------------------------------------------------------
+ *
+ * Removes a station from the aging list
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void sttbl_unlink(uint32_t index) {
+        uint32_t older = olderIndexes[index];
+        uint32_t newer = newerIndexes[index];
+
+        if (older != STTBL_NO_INDEX) newerIndexes[older] = newer;
+        else oldestIndex = newer;
+
+        if (newer != STTBL_NO_INDEX) olderIndexes[newer] = older;
+        else newestIndex = older;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Appends a station at the newest end of the aging list
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void sttbl_linkNewest(uint32_t index) {
+        olderIndexes[index] = newestIndex;
+        newerIndexes[index] = STTBL_NO_INDEX;
+
+        if (newestIndex != STTBL_NO_INDEX) newerIndexes[newestIndex] = index;
+        else oldestIndex = index;
+        newestIndex = index;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Hash of the 48 bit BT address (Fibonacci hashing - the upper bits of
+ * the product are well mixed)
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline size_t sttbl_hash(uint64_t key) {
+        return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Finds the slot of a key
+ *
+ * @return slot position or -1 if the key is not in the table
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static long sttbl_findSlot(uint64_t key) {
+        size_t pos = sttbl_hash(key) & slotMask;
+
+        for (uint32_t probeLen = 1;; ++probeLen) {
+                Station_Slot_t *slot = &slots[pos];
+
+                if (slot->probeLen < probeLen) return -1;                       // empty or a "richer" slot - key can't be further
+                if (slot->key == key) return (long) pos;
+
+                pos = (pos + 1) & slotMask;
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Robin Hood insertion of a slot starting at a given position. Entries
+ * closer to their home slot are displaced by the one to insert.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void sttbl_placeSlot(Station_Slot_t carry, size_t pos) {
+        for (;;) {
+                Station_Slot_t *slot = &slots[pos];
+
+                if (slot->probeLen == 0) {
+                        *slot = carry;
+                        return;
+                }
+                if (slot->probeLen < carry.probeLen) {
+                        Station_Slot_t tmp = *slot;
+                        *slot = carry;
+                        carry = tmp;
+                }
+
+                pos = (pos + 1) & slotMask;
+                ++carry.probeLen;
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return number of slots for a given capacity - at least twice as many,
+ *         so the load factor never exceeds 0.5
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static inline size_t sttbl_slotCount(size_t capacity) {
+        size_t slotCount = 16;
+        while (slotCount < capacity * 2) slotCount <<= 1;
+        return slotCount;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * (Re)allocates the station arrays and slots for a given capacity and
+ * rehashes the existing stations. All new arrays are allocated before
+ * any of them replaces the old one - if one allocation fails the table
+ * stays as it was, so a failed shrink does not leave arrays smaller than
+ * the capacity.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static le_result_t sttbl_resize(size_t capacity) {
+        size_t slotCount = sttbl_slotCount(capacity);
+        struct {
+                void **array;
+                size_t elementSize;
+        } arrays[] = {
+                { (void **) &stationStore.addressLow, sizeof(uint32_t) },
+                { (void **) &stationStore.addressHigh, sizeof(uint16_t) },
+                { (void **) &stationStore.lastSeen, sizeof(uint32_t) },
+                { (void **) &stationStore.lastReportedSeen, sizeof(uint32_t) },
+                { (void **) &stationStore.rssi, sizeof(int8_t) },
+                { (void **) &stationStore.changeMask, sizeof(uint8_t) },
+                { (void **) &olderIndexes, sizeof(uint32_t) },
+                { (void **) &newerIndexes, sizeof(uint32_t) },
+                { (void **) &stationStore.cold, sizeof(BT_Station_Container_t) },
+        };
+        void *newArrays[NUM_ARRAY_MEMBERS(arrays)];
+
+        Station_Slot_t *newSlots = calloc(slotCount, sizeof(Station_Slot_t));
+        if (newSlots == NULL) return LE_NO_MEMORY;
+
+        for (size_t i = 0; i < NUM_ARRAY_MEMBERS(arrays); ++i) {
+                newArrays[i] = malloc(capacity * arrays[i].elementSize);
+                if (newArrays[i] == NULL) {
+                        while (i > 0) free(newArrays[--i]);
+                        free(newSlots);
+                        return LE_NO_MEMORY;
+                }
+        }
+
+        for (size_t i = 0; i < NUM_ARRAY_MEMBERS(arrays); ++i) {               // commit - nothing can fail from here
+                if (recordCount > 0) memcpy(newArrays[i], *arrays[i].array, recordCount * arrays[i].elementSize);
+                free(*arrays[i].array);
+                *arrays[i].array = newArrays[i];
+        }
+        recordCapacity = capacity;
+
+        free(slots);
+        slots = newSlots;
+        slotMask = slotCount - 1;
+
+        for (size_t i = 0; i < recordCount; ++i) {
+                Station_Slot_t slot = { sttbl_address(i), i, 1 };
+                sttbl_placeSlot(slot, sttbl_hash(slot.key) & slotMask);
+        }
+
+        LE_DEBUG("station table resized to %zu stations, %zu slots", capacity, slotCount);
+        return LE_OK;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * initializes the station table
+ *
+ * @param capacity - number of stations which fit without growing the table
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t sttbl_init(size_t capacity) {
+        recordCount = 0;
+        oldestIndex = newestIndex = STTBL_NO_INDEX;
+        return sttbl_resize(capacity > 0 ? capacity : 1);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * changes the capacity of the station table, it is not made smaller than
+ * the number of stations in it and not bigger than the limit set with
+ * sttbl_setMaxCapacity()
+ *
+ * @param capacity - number of stations which fit without growing the table
+ *
+ * ------------------------------------------------------------------------
+ */
+
+le_result_t sttbl_reserve(size_t capacity) {
+        if (capacity > maxCapacity) capacity = maxCapacity;
+        if (capacity < recordCount) capacity = recordCount;
+        if (capacity == 0) capacity = 1;
+        if (capacity == recordCapacity) return LE_OK;
+        return sttbl_resize(capacity);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * releases the memory of the station table
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void sttbl_destroy() {
+        free(slots);
+        free(stationStore.addressLow);
+        free(stationStore.addressHigh);
+        free(stationStore.lastSeen);
+        free(stationStore.lastReportedSeen);
+        free(stationStore.rssi);
+        free(stationStore.changeMask);
+        free(stationStore.cold);
+        free(olderIndexes);
+        free(newerIndexes);
+        slots = NULL;
+        memset(&stationStore, 0, sizeof(stationStore));
+        olderIndexes = newerIndexes = NULL;
+        slotMask = recordCapacity = recordCount = 0;
+        oldestIndex = newestIndex = STTBL_NO_INDEX;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Looks up a station and inserts an empty one in case it is not there
+ * - both in a single probe sequence. In case the table is full it grows,
+ * up to the limit set with sttbl_setMaxCapacity().
+ * A new station is linked at the newest end of the aging list, all its
+ * fields are 0.
+ *
+ * @param btStationAddress - key
+ * @param isNewPtr - set to true if the station was inserted. The caller
+ *                   has to fill it
+ *
+ * @return index of the station or STTBL_NO_INDEX in case the table is at
+ *         its limit or no memory was left
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t sttbl_lookupOrInsert(uint64_t btStationAddress, bool *isNewPtr) {
+        size_t pos = sttbl_hash(btStationAddress) & slotMask;
+        uint32_t probeLen = 1;
+
+        for (;; ++probeLen, pos = (pos + 1) & slotMask) {
+                Station_Slot_t *slot = &slots[pos];
+
+                if (slot->probeLen < probeLen) break;                           // not in table - pos is where it belongs to
+                if (slot->key == btStationAddress) {
+                        *isNewPtr = false;
+                        return slot->recordIndex;
+                }
+        }
+
+        if (recordCount == recordCapacity) {                                    // full - grow and find the insert position
+                size_t capacity = recordCapacity * 2;                           // again in the new slot array
+
+                if (capacity > maxCapacity) capacity = maxCapacity;
+                if (capacity <= recordCapacity) {
+                        LE_DEBUG("station table is at its limit of %zu stations", recordCapacity);
+                        return STTBL_NO_INDEX;
+                }
+                if (sttbl_resize(capacity) != LE_OK) {
+                        LE_ERROR("could not grow station table beyond %zu stations", recordCapacity);
+                        return STTBL_NO_INDEX;
+                }
+                pos = sttbl_hash(btStationAddress) & slotMask;
+                probeLen = 1;
+        }
+
+        uint32_t index = recordCount++;
+        Station_Slot_t carry = { btStationAddress, index, probeLen };
+        sttbl_placeSlot(carry, pos);
+
+        stationStore.addressLow[index] = (uint32_t) btStationAddress;
+        stationStore.addressHigh[index] = (uint16_t) (btStationAddress >> 32);
+        stationStore.lastSeen[index] = 0;
+        stationStore.lastReportedSeen[index] = 0;
+        stationStore.rssi[index] = 0;
+        stationStore.changeMask[index] = 0;
+        memset(&stationStore.cold[index], 0, sizeof(BT_Station_Container_t));
+        sttbl_linkNewest(index);
+
+        *isNewPtr = true;
+        return index;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Looks up a station
+ *
+ * @return index of the station or STTBL_NO_INDEX in case it is not in the
+ *         table
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t sttbl_lookup(uint64_t btStationAddress) {
+        long pos = sttbl_findSlot(btStationAddress);
+        return pos < 0 ? STTBL_NO_INDEX : slots[pos].recordIndex;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return number of stations in the table
+ *
+ * ------------------------------------------------------------------------
+ */
+
+size_t sttbl_count() {
+        return recordCount;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return number of stations which fit without growing the table
+ *
+ * ------------------------------------------------------------------------
+ */
+
+size_t sttbl_capacity() {
+        return recordCapacity;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Limits the capacity the table grows to. The table is not made smaller
+ * here - see sttbl_reserve()
+ *
+ * @param capacity - max. number of stations, SIZE_MAX for no limit
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void sttbl_setMaxCapacity(size_t capacity) {
+        maxCapacity = capacity > 0 ? capacity : 1;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return heap memory of a table with the given capacity - station
+ *         arrays and slots
+ *
+ * ------------------------------------------------------------------------
+ */
+
+size_t sttbl_bytesFor(size_t capacity) {
+        return capacity * (STTBL_HOT_BYTES + sizeof(BT_Station_Container_t))
+               + sttbl_slotCount(capacity) * sizeof(Station_Slot_t);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return heap memory of the table as it is now
+ *
+ * ------------------------------------------------------------------------
+ */
+
+size_t sttbl_memoryBytes() {
+        return sttbl_bytesFor(recordCapacity);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return bytes per station in the hot arrays (the cold part is
+ *         sizeof(BT_Station_Container_t))
+ *
+ * ------------------------------------------------------------------------
+ */
+
+size_t sttbl_hotBytes() {
+        return STTBL_HOT_BYTES;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Moves a station to another index - all arrays, its slot and the aging
+ * list links are updated
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void sttbl_move(uint32_t from, uint32_t to) {
+        stationStore.addressLow[to] = stationStore.addressLow[from];
+        stationStore.addressHigh[to] = stationStore.addressHigh[from];
+        stationStore.lastSeen[to] = stationStore.lastSeen[from];
+        stationStore.lastReportedSeen[to] = stationStore.lastReportedSeen[from];
+        stationStore.rssi[to] = stationStore.rssi[from];
+        stationStore.changeMask[to] = stationStore.changeMask[from];
+        stationStore.cold[to] = stationStore.cold[from];
+
+        long found = sttbl_findSlot(sttbl_address(to));
+        LE_ASSERT(found >= 0);
+        slots[found].recordIndex = to;
+
+        uint32_t older = olderIndexes[to] = olderIndexes[from];
+        uint32_t newer = newerIndexes[to] = newerIndexes[from];
+        if (older != STTBL_NO_INDEX) newerIndexes[older] = to;
+        else oldestIndex = to;
+        if (newer != STTBL_NO_INDEX) olderIndexes[newer] = to;
+        else newestIndex = to;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Removes the station at the given index. The last station is moved into
+ * the gap - when iterating and removing, the same index has to be looked
+ * at again.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void sttbl_removeAt(uint32_t index) {
+        LE_ASSERT(index < recordCount);
+
+        sttbl_unlink(index);
+
+        long found = sttbl_findSlot(sttbl_address(index));
+        LE_ASSERT(found >= 0);
+
+        size_t pos = (size_t) found;                                            // backward shift deletion - following entries
+        size_t next = (pos + 1) & slotMask;                                     // which are not in their home slot move up
+        while (slots[next].probeLen > 1) {
+                slots[pos] = slots[next];
+                --slots[pos].probeLen;
+                pos = next;
+                next = (next + 1) & slotMask;
+        }
+        slots[pos].probeLen = 0;
+
+        uint32_t last = --recordCount;                                          // keep the arrays dense
+        if (index != last) {
+                sttbl_move(last, index);
+                movedTo[moves++ % STTBL_MOVE_HISTORY] = index;                  // for the iterating cursors
+        }
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return number of stations moved by sttbl_removeAt() so far - wraps.
+ *
+ * A removal moves the last station into the gap. An iteration over the
+ * station arrays which goes on later would skip a station moved below
+ * the index it stopped at - it has to look at the stations moved since
+ * (sttbl_movedTo()) as well.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t sttbl_moves() {
+        return moves;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @param move - 0 .. sttbl_moves() - 1
+ *
+ * @return index the station was moved to, STTBL_NO_INDEX if the move is
+ *         older than the last STTBL_MOVE_HISTORY moves
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t sttbl_movedTo(uint32_t move) {
+        if (moves - move > STTBL_MOVE_HISTORY || move == moves) return STTBL_NO_INDEX;
+        return movedTo[move % STTBL_MOVE_HISTORY];
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Marks a station as just seen - lastSeen is set and it is moved to the
+ * newest end of the aging list. The tick has to be monotonic.
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void sttbl_touch(uint32_t index, uint32_t tick) {
+        stationStore.lastSeen[index] = tick;
+
+        if (index == newestIndex) return;
+        sttbl_unlink(index);
+        sttbl_linkNewest(index);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return the station seen longest ago or STTBL_NO_INDEX if the table is
+ *         empty
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t sttbl_oldest() {
+        return oldestIndex;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return the station seen most recently or STTBL_NO_INDEX if the table
+ *         is empty
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t sttbl_newest() {
+        return newestIndex;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * @return the station seen before the given one or STTBL_NO_INDEX
+ *
+ * ------------------------------------------------------------------------
+ */
+
+uint32_t sttbl_older(uint32_t index) {
+        return olderIndexes[index];
+}
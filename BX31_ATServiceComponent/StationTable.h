@@ -0,0 +1,82 @@
+/*
+ * StationTable.h
+ *
+ *  Open addressing (Robin Hood) table for the scanned BT stations,
+ *  keyed by the 48 bit BT address. The stations are stored in a dense
+ *  structure of arrays - the fields looked at on every sighting and on
+ *  the aging / reporting sweeps in parallel hot arrays, the rest of the
+ *  record (BT_Station_Container_t) in a separate cold array. The hash
+ *  slots just refer to the record index.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "BX31_ATServiceComponent.h"
+#include "PayloadSlab.h"
+
+#ifndef STATIONTABLE_H_
+#define STATIONTABLE_H_
+
+#define STATION_CHANGED_NEW 0x01			// station was added to the table
+#define STATION_CHANGED_PAYLOAD 0x02		// advertisement data (or addr type) changed
+#define STATION_CHANGED_RSSI 0x04			// RSSI moved out of the deadband around the last reported value
+
+#define STTBL_NO_INDEX UINT32_MAX
+#define STTBL_RSSI_NONE INT8_MIN			// radio has not seen the station
+#define STTBL_MOVE_HISTORY 256				// moves by removals an iteration can catch up with, see sttbl_moves()
+
+#define STTBL_TICK_AFTER(a, b) ((int32_t) ((uint32_t) (a) - (uint32_t) (b)) > 0)   // ms ticks, wrap safe
+
+typedef struct  {
+	int8_t rssi;					// latest RSSI as received by this radio, STTBL_RSSI_NONE if not seen
+	uint32_t lastSeen;				// tick
+} BT_Station_Radio_t;
+
+typedef struct  {					// cold part of a station - only looked at when the
+	uint8_t addrType;				// payload changed or the station is reported
+	uint8_t lastRadio;				// radio which received the latest scan result
+	uint8_t bestRadio;				// radio with the best RSSI - stationStore.rssi is the one of this radio
+	int8_t lastReportedRssi;		// RSSI when it was reported the last time
+	uint8_t data_len;
+	uint64_t fingerprint;			// see BTScanResult_t
+	PayloadRef_t payload;			// advertisement data - data_len bytes, NULL if there is none
+	BT_Station_Radio_t radio[BX31_MAX_DEVICES];	// the station as seen by each BX31
+} BT_Station_Container_t;
+
+typedef struct  {					// parallel arrays, index 0 .. sttbl_count() - 1
+	uint32_t *addressLow;			// BT address, lower 32 bit
+	uint16_t *addressHigh;			// BT address, upper 16 bit
+	uint32_t *lastSeen;				// tick (ms) the station was seen the last time - set by sttbl_touch()
+	uint32_t *lastReportedSeen;		// lastSeen when it was reported the last time
+	int8_t *rssi;					// best RSSI of all radios
+	uint8_t *changeMask;			// STATION_CHANGED_* - what has to be reported, cleared when reported
+	BT_Station_Container_t *cold;
+} BT_Station_Store_t;
+
+extern BT_Station_Store_t stationStore;		// CAREFUL: the arrays move on insert and resize
+
+le_result_t sttbl_init(size_t capacity);
+le_result_t sttbl_reserve(size_t capacity);
+void sttbl_destroy();
+uint32_t sttbl_lookupOrInsert(uint64_t btStationAddress, bool *isNewPtr);
+uint32_t sttbl_lookup(uint64_t btStationAddress);
+size_t sttbl_count();
+size_t sttbl_capacity();
+size_t sttbl_hotBytes();
+void sttbl_setMaxCapacity(size_t capacity);
+size_t sttbl_bytesFor(size_t capacity);
+size_t sttbl_memoryBytes();
+void sttbl_removeAt(uint32_t index);
+uint32_t sttbl_moves();
+uint32_t sttbl_movedTo(uint32_t move);
+void sttbl_touch(uint32_t index, uint32_t tick);
+uint32_t sttbl_oldest();
+uint32_t sttbl_newest();
+uint32_t sttbl_older(uint32_t index);
+
+static inline uint64_t sttbl_address(uint32_t index) {
+        return ((uint64_t) stationStore.addressHigh[index] << 32) | stationStore.addressLow[index];
+}
+
+#endif /* STATIONTABLE_H_ */
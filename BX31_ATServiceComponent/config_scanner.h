@@ -11,6 +11,18 @@
 
 #define AVS_BASE_PATH "BTScan"
 #define AVS_STATISTICS_PATH AVS_BASE_PATH ".stats"
-#define AVS_STATION_PATH AVS_BASE_PATH ".station"
+#define AVS_STATION_BLOB_PATH AVS_BASE_PATH ".stations"
+
+#define AVS_PUSH_STREAM_MAX_BYTES (20 * 1024)   // le_avdata_PushStream() limit per document
+
+#define AVS_SPOOL_DIR "/data/avsSpool"           // store-and-forward spool for failed pushes, in the
+                                                 // persistent writable area of the app (bundled /data,
+                                                 // see the .adef - the sandbox root is a tmpfs)
+#define AVS_SPOOL_MAX_BYTES (256 * 1024)         // byte budget of the spool on flash
+#define AVS_SPOOL_DRAIN_PER_CYCLE 4              // max. spooled documents pushed per reporting cycle
+
+#define STATION_SNAPSHOT_PATH "/data/stations.snap"  // station table snapshot for a warm restart, in
+                                                      // the persistent writable area of the app
+#define STATION_SNAPSHOT_MAX_BYTES (256 * 1024)  // the oldest stations which do not fit are not saved
 
 #endif /* CONFIG_SCANNER_H_ */
@@ -13,6 +13,8 @@
 #include "BX31_ATServiceComponent.h"
 #include "BTStationManager.h"
 #include "AVSInterface.h"
+#include "ScanControl.h"
+#include "ScannerConfig.h"
 
 static le_timer_Ref_t scanTimer = NULL;
 static le_timer_Ref_t btStationJanitorTimer = NULL;
@@ -21,12 +23,14 @@ static le_timer_Ref_t btStationJanitorTimer = NULL;
 /** ------------------------------------------------------------------------
  *
  * callback - called data set should be queued for AirVantage
+ * it is added to the batch of the current reporting cycle
  *
  * ------------------------------------------------------------------------
  */
 
 void main_addDataToAvsCallback(char *path, void *data, avsService_DataType_t type) {
 
+#ifdef DEBUG_MAIN
         switch(type)  {
         case INT:  LE_INFO("got AVS callback path=%s; data=%d", path, *(int*) data); break;
         case FLOAT: LE_INFO("got AVS callback path=%s; data=%f", path, *(double*) data); break;
@@ -34,8 +38,9 @@ void main_addDataToAvsCallback(char *path, void *data, avsService_DataType_t typ
         case STRING:  LE_INFO("got AVS callback path=%s; data=%s", path, (char *) data); break;
         default: LE_INFO("got AVS callback path=%s; unknown data ", path); break;
         }
+#endif                                /* DEBUG */
 
-        avsService_recordData(path, data, type);
+        avsService_batchAdd(path, data, type);
 
 }
 
@@ -49,7 +54,9 @@ void main_addDataToAvsCallback(char *path, void *data, avsService_DataType_t typ
 
 void main_pushDataToAvsCallback() {
 #ifndef TEST_DRYRUN
-        avsService_pushData();
+        avsService_batchPush();
+#else
+        avsService_batchDiscard();
 #endif
 }
 
@@ -86,6 +93,41 @@ void main_scanCallback(int index, BTScanResult_t * scanResult) {
 
 }
 
+/** ------------------------------------------------------------------------
+ *
+ * changes the interval of a timer, a running timer is restarted
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static void main_setTimerInterval(le_timer_Ref_t timer, uint32_t ms) {
+        bool running = le_timer_IsRunning(timer);
+
+        if (running) le_timer_Stop(timer);
+        le_timer_SetMsInterval(timer, ms);
+        if (running) le_timer_Start(timer);
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * callback - called with the scanner settings on start and whenever
+ * they are changed in the config tree
+ *
+ * ------------------------------------------------------------------------
+ */
+
+void main_applyConfigCallback(const ScannerConfig_t *config) {
+        btmgr_setMaxAge(config->stationMaxAge);
+        btmgr_setMemoryBudget(config->stationMemoryBudget);                    // limits the table capacity as well
+        btmgr_setTableCapacity(config->stationTableSize);
+        bx31at_setScanQueueSize(config->scanQueueSize);
+        bx31at_setContinuousScan(config->continuousScan);
+        scanctl_setBounds(config->scanWindowMin, config->scanWindowMax, config->scanIntervalMax);
+
+        main_setTimerInterval(scanTimer, config->scanTimerMs);
+        main_setTimerInterval(btStationJanitorTimer, config->reportIntervalMs);
+}
+
 /** ------------------------------------------------------------------------
  *
  *   Handle System Signals on termination of the legato application
@@ -97,6 +139,7 @@ static void main_SigHandler(int signal) {
         LE_INFO("Terminating BX31_ATService");
         if(scanTimer != NULL) le_timer_Stop(scanTimer);
         if(btStationJanitorTimer != NULL) le_timer_Stop(btStationJanitorTimer);
+        scancfg_destroy();
         bx31at_stopBLE();
         btmgr_destroy();
         avsService_detroy();
@@ -121,22 +164,21 @@ COMPONENT_INIT {
         le_sig_Block(SIGTERM);                                                   // catch the termination of the Application
         le_sig_SetEventHandler(SIGTERM, main_SigHandler);                        // to clean up allocated resources
 
-        avsService_init();
-
         btmgr_init(main_addDataToAvsCallback, main_pushDataToAvsCallback);
 
         bx31at_initBLE(main_scanCallback);                                      // initialize the BX31 Module for BT scanning,
-                                                                                // callback is called on scan events
-        le_atClient_CmdRef_t cmdRef = bx31at_getCmdRef();                       // the timer needs the reference to the command
-                                                                                // it needs to be executed
+                                                                                // callback is called on scan events - the modules
+                                                                                // start on their own threads and scan when ready
+        bx31at_setScanDoneCallback(btmgr_scanCycleDone);                        // station events are delivered per scan
+        avsService_init();                                                      // does not wait for the AirVantage connection
+        scanctl_init();                                                         // scan window/interval follow the station churn
 
 
-        scanTimer = le_timer_Create("scanBleTimer");                            // set up a Timer to scan BT
-        le_timer_SetContextPtr(scanTimer, cmdRef);
-        le_timer_SetHandler(scanTimer, bx31at_ScanBLE);
+        scanTimer = le_timer_Create("scanBleTimer");                            // set up a Timer to scan BT, the scan runs
+        le_timer_SetHandler(scanTimer, bx31at_ScanBLE);                         // asynchronously - results are streamed in,
+                                                                                // in continuous mode it just (re)starts scanning
         le_timer_SetRepeat(scanTimer, 0);
-        le_timer_SetMsInterval(scanTimer, 10000);
-        le_timer_Start(scanTimer);
+        le_timer_SetMsInterval(scanTimer, BX31_SCAN_TIMER_MS);
 
 
         btStationJanitorTimer = le_timer_Create("cleanBtStationsTimer");        // set up Timer to clean the BT station Database
@@ -144,6 +186,10 @@ COMPONENT_INIT {
         le_timer_SetHandler(btStationJanitorTimer, btmgr_periodicalCheck);      // for a period of time
         le_timer_SetRepeat(btStationJanitorTimer, 0);                           // on each cleanup changes are as well reported
         le_timer_SetMsInterval(btStationJanitorTimer, MAX_BT_STATION_AGE * 1000);  // to AirVantage
+
+        scancfg_init(main_applyConfigCallback);                                 // settings from the config tree, they are
+                                                                                // applied again whenever they change
+        le_timer_Start(scanTimer);
         le_timer_Start(btStationJanitorTimer);
 
 
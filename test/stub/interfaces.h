@@ -0,0 +1,103 @@
+/*
+ * interfaces.h
+ *
+ * Host stand-in for the interfaces.h generated by mkcomp - the parts of
+ * the client and server APIs the modules built by test/Makefile use.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef INTERFACES_H_
+#define INTERFACES_H_
+
+#include "legato.h"
+
+/* --- btScan.api (server) --- */
+#define BTSCAN_MAX_PAYLOAD_BYTES 255
+#define BTSCAN_MAX_RESULTS 64
+#define BTSCAN_MAX_STATIONS_PER_CALL 4096
+#define BTSCAN_ADDR_TYPE_ANY 255
+#define BTSCAN_RSSI_ANY -128
+#define BTSCAN_SEEN_ANY 0
+typedef enum {
+	BTSCAN_APPEARED = 0x1,
+	BTSCAN_CHANGED = 0x2,
+	BTSCAN_LOST = 0x4,
+	BTSCAN_RSSI_ABOVE = 0x8,
+	BTSCAN_RSSI_BELOW = 0x10
+} btScan_EventType_t;
+le_result_t btScan_GetStation(uint64_t address, uint8_t *addrTypePtr, int8_t *rssiPtr, uint8_t *radioPtr,
+                              uint32_t *lastSeenAgeMsPtr, uint8_t *payloadPtr, size_t *payloadSizePtr);
+le_result_t btScan_FindStations(uint8_t addrType, int8_t minRssi, uint32_t seenWithinMs, uint64_t cursor,
+                                uint64_t *addressesPtr, size_t *addressesSizePtr,
+                                int8_t *rssisPtr, size_t *rssisSizePtr, uint64_t *nextCursorPtr);
+le_result_t btScan_GetStrongest(uint8_t addrType, uint32_t seenWithinMs, uint64_t cursor,
+                                uint64_t *addressesPtr, size_t *addressesSizePtr,
+                                int8_t *rssisPtr, size_t *rssisSizePtr, uint64_t *nextCursorPtr);
+
+/* --- le_atDefs.api, le_atClient.api (client) - the fake module of test_startup.c --- */
+#define LE_ATDEFS_RESPONSE_MAX_BYTES 513
+#define LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT 30000
+typedef struct le_atClient_Cmd *le_atClient_CmdRef_t;
+typedef struct le_atClient_Device *le_atClient_DeviceRef_t;
+typedef struct le_atClient_UnsolicitedResponseHandler *le_atClient_UnsolicitedResponseHandlerRef_t;
+typedef void (*le_atClient_UnsolicitedResponseHandlerFunc_t)(const char *unsolicitedRsp, void *contextPtr);
+void le_atClient_ConnectService(void);
+le_atClient_DeviceRef_t le_atClient_Start(int fd);
+le_result_t le_atClient_Stop(le_atClient_DeviceRef_t device);
+le_atClient_CmdRef_t le_atClient_Create(void);
+le_result_t le_atClient_Delete(le_atClient_CmdRef_t cmdRef);
+le_result_t le_atClient_SetCommandAndSend(le_atClient_CmdRef_t *cmdRefPtr, le_atClient_DeviceRef_t devRef,
+                                          const char *command, const char *interResp, const char *finalResp,
+                                          uint32_t timeout);
+le_result_t le_atClient_GetFinalResponse(le_atClient_CmdRef_t cmdRef, char *finalRsp, size_t finalRspSize);
+le_result_t le_atClient_GetFirstIntermediateResponse(le_atClient_CmdRef_t cmdRef, char *intermediateRsp,
+                                                     size_t intermediateRspSize);
+le_atClient_UnsolicitedResponseHandlerRef_t le_atClient_AddUnsolicitedResponseHandler(const char *unsolRsp,
+                le_atClient_DeviceRef_t devRef, le_atClient_UnsolicitedResponseHandlerFunc_t handlerPtr,
+                void *contextPtr, uint32_t lineCount);
+void le_atClient_RemoveUnsolicitedResponseHandler(le_atClient_UnsolicitedResponseHandlerRef_t handlerRef);
+
+/* --- gpio.api (client) - enable and firmware flash pin of the BX310x on the IoT card --- */
+typedef enum {
+	GPIO_BX_ENABLE_ACTIVE_HIGH = 0,
+	GPIO_BX_ENABLE_ACTIVE_LOW = 1
+} gpio_bx_enable_Polarity_t;
+typedef enum {
+	GPIO_BX_FWFLASH_ACTIVE_HIGH = 0,
+	GPIO_BX_FWFLASH_ACTIVE_LOW = 1
+} gpio_bx_fwFlash_Polarity_t;
+le_result_t gpio_bx_enable_SetPushPullOutput(gpio_bx_enable_Polarity_t polarity, bool value);
+le_result_t gpio_bx_enable_Activate(void);
+le_result_t gpio_bx_enable_Deactivate(void);
+le_result_t gpio_bx_fwFlash_SetPushPullOutput(gpio_bx_fwFlash_Polarity_t polarity, bool value);
+
+/* --- le_avdata.api (client) - the stream push used now and the records it replaced --- */
+typedef struct le_avdata_RequestSessionObj *le_avdata_RequestSessionObjRef_t;
+typedef struct le_avdata_Record *le_avdata_RecordRef_t;
+typedef enum {
+	LE_AVDATA_PUSH_SUCCESS = 0,
+	LE_AVDATA_PUSH_FAILED = 1
+} le_avdata_PushStatus_t;
+typedef enum {
+	LE_AVDATA_NAMESPACE_DEVICE = 0,
+	LE_AVDATA_NAMESPACE_GLOBAL = 1
+} le_avdata_Namespace_t;
+typedef void (*le_avdata_CallbackResultFunc_t)(le_avdata_PushStatus_t status, void *contextPtr);
+le_result_t le_avdata_TryConnectService(void);
+le_result_t le_avdata_SetNamespace(le_avdata_Namespace_t nameSpace);
+le_avdata_RequestSessionObjRef_t le_avdata_RequestSession(void);
+void le_avdata_ReleaseSession(le_avdata_RequestSessionObjRef_t sessionRequestRef);
+le_result_t le_avdata_PushStream(const char *path, int fd,
+                                 le_avdata_CallbackResultFunc_t handlerPtr, void *contextPtr);
+le_avdata_RecordRef_t le_avdata_CreateRecord(void);
+void le_avdata_DeleteRecord(le_avdata_RecordRef_t recordRef);
+le_result_t le_avdata_RecordInt(le_avdata_RecordRef_t recordRef, const char *path, int32_t value, uint64_t timestamp);
+le_result_t le_avdata_RecordFloat(le_avdata_RecordRef_t recordRef, const char *path, double value, uint64_t timestamp);
+le_result_t le_avdata_RecordBool(le_avdata_RecordRef_t recordRef, const char *path, bool value, uint64_t timestamp);
+le_result_t le_avdata_RecordString(le_avdata_RecordRef_t recordRef, const char *path, const char *value, uint64_t timestamp);
+le_result_t le_avdata_PushRecord(le_avdata_RecordRef_t recordRef,
+                                 le_avdata_CallbackResultFunc_t handlerPtr, void *contextPtr);
+
+#endif /* INTERFACES_H_ */
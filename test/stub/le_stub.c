@@ -0,0 +1,318 @@
+/*
+ * le_stub.c
+ *
+ * Host implementation of the Legato functions declared in legato.h.
+ * A pool keeps its free objects on a free list and grows only when it
+ * is expanded or forced to, as the Legato pools. The clock only moves when
+ * the test sets it, timers never expire and queued functions are not
+ * run - the tests call the handlers themselves. Threads are not started
+ * and semaphores do not wait, fd monitors do not watch their fd.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "legato.h"
+
+#define LE_STUB_ABSOLUTE_BASE 1790000000                // absolute time at relative time 0
+
+typedef struct le_mem_Pool {
+	struct le_mem_Pool *next;                      // pools are never deleted, as in Legato
+	const char *name;
+	size_t objSize;
+	le_mem_Destructor_t destructor;
+	void *freeList;
+	void *chunks;                                  // heap blocks of the expansions, kept as the pool
+	le_mem_PoolStats_t stats;
+} le_mem_Pool_t;
+
+typedef union {
+	struct {
+		le_mem_Pool_t *pool;
+		unsigned int refCount;
+	};
+	long double align;                              // objects aligned as malloc() aligns them
+} le_mem_Header_t;
+
+bool le_stub_verbose = true;
+
+static le_mem_Pool_t *pools;
+static uint64_t poolAllocs;
+static le_clk_Time_t now;
+
+/* --- memory pools --- */
+
+le_mem_PoolRef_t le_mem_CreatePool(const char *name, size_t objSize) {
+        le_mem_Pool_t *pool = calloc(1, sizeof(le_mem_Pool_t));
+
+        LE_ASSERT(pool != NULL);
+        pool->name = name;
+        pool->objSize = objSize;
+        pool->next = pools;
+        pools = pool;
+        return pool;
+}
+
+le_mem_PoolRef_t le_mem_ExpandPool(le_mem_PoolRef_t pool, size_t numObjects) {
+        size_t blockSize = sizeof(le_mem_Header_t)                             // objects stay aligned
+                           + (pool->objSize + sizeof(le_mem_Header_t) - 1) / sizeof(le_mem_Header_t) * sizeof(le_mem_Header_t);
+        char *chunk;
+
+        if (numObjects == 0) return pool;
+        chunk = malloc(sizeof(le_mem_Header_t) + numObjects * blockSize);       // one heap allocation per expansion,
+        LE_ASSERT(chunk != NULL);                                               // linked to the pool by its first bytes
+        *(void **) chunk = pool->chunks;
+        pool->chunks = chunk;
+        for (size_t i = 0; i < numObjects; ++i) {
+                le_mem_Header_t *header = (le_mem_Header_t *) (chunk + sizeof(le_mem_Header_t) + i * blockSize);
+
+                header->pool = pool;
+                *(void **) (header + 1) = pool->freeList;
+                pool->freeList = header + 1;
+                ++pool->stats.numFree;
+        }
+        return pool;
+}
+
+void *le_mem_TryAlloc(le_mem_PoolRef_t pool) {
+        void *obj = pool->freeList;
+
+        if (obj == NULL) return NULL;                                           // empty - not expanded by itself
+        pool->freeList = *(void **) obj;
+        --pool->stats.numFree;
+
+        le_mem_Header_t *header = (le_mem_Header_t *) obj - 1;
+        header->refCount = 1;
+        ++poolAllocs;
+        ++pool->stats.numAllocs;
+        if (++pool->stats.numBlocksInUse > pool->stats.maxNumBlocksUsed) {
+                pool->stats.maxNumBlocksUsed = pool->stats.numBlocksInUse;
+        }
+        return obj;
+}
+
+void *le_mem_ForceAlloc(le_mem_PoolRef_t pool) {
+        if (pool->freeList == NULL) {
+                le_mem_ExpandPool(pool, 1);
+                ++pool->stats.numOverflows;
+        }
+        return le_mem_TryAlloc(pool);
+}
+
+void *le_mem_AssertAlloc(le_mem_PoolRef_t pool) {
+        void *obj = le_mem_TryAlloc(pool);
+
+        LE_FATAL_IF(obj == NULL, "pool %s is empty", pool->name);
+        return obj;
+}
+
+void le_mem_AddRef(void *objPtr) {
+        ++((le_mem_Header_t *) objPtr - 1)->refCount;
+}
+
+void le_mem_Release(void *objPtr) {
+        le_mem_Header_t *header = (le_mem_Header_t *) objPtr - 1;
+        le_mem_Pool_t *pool = header->pool;
+
+        if (--header->refCount > 0) return;
+        if (pool->destructor != NULL) pool->destructor(objPtr);
+
+        *(void **) objPtr = pool->freeList;
+        pool->freeList = objPtr;
+        --pool->stats.numBlocksInUse;
+        ++pool->stats.numFree;
+}
+
+void le_mem_SetDestructor(le_mem_PoolRef_t pool, le_mem_Destructor_t destructor) {
+        pool->destructor = destructor;
+}
+
+size_t le_mem_GetObjectSize(le_mem_PoolRef_t pool) {
+        return pool->objSize;
+}
+
+le_result_t le_mem_GetStats(le_mem_PoolRef_t pool, le_mem_PoolStats_t *statsPtr) {
+        *statsPtr = pool->stats;
+        return LE_OK;
+}
+
+uint64_t le_stub_getPoolAllocs(void) {
+        return poolAllocs;
+}
+
+/* --- clock --- */
+
+void le_stub_setTime(time_t sec, long usec) {
+        now.sec = sec;
+        now.usec = usec;
+}
+
+le_clk_Time_t le_clk_GetRelativeTime(void) {
+        return now;
+}
+
+le_clk_Time_t le_clk_GetAbsoluteTime(void) {
+        le_clk_Time_t absolute = now;
+
+        absolute.sec += LE_STUB_ABSOLUTE_BASE;
+        return absolute;
+}
+
+le_clk_Time_t le_clk_Add(le_clk_Time_t t1, le_clk_Time_t t2) {
+        le_clk_Time_t sum = { t1.sec + t2.sec, t1.usec + t2.usec };
+
+        if (sum.usec >= 1000000) {
+                sum.usec -= 1000000;
+                ++sum.sec;
+        }
+        return sum;
+}
+
+le_clk_Time_t le_clk_Sub(le_clk_Time_t t1, le_clk_Time_t t2) {
+        le_clk_Time_t diff = { t1.sec - t2.sec, t1.usec - t2.usec };
+
+        if (diff.usec < 0) {
+                diff.usec += 1000000;
+                --diff.sec;
+        }
+        return diff;
+}
+
+bool le_clk_GreaterThan(le_clk_Time_t t1, le_clk_Time_t t2) {
+        return t1.sec > t2.sec || (t1.sec == t2.sec && t1.usec > t2.usec);
+}
+
+/* --- timer --- */
+
+struct le_timer {
+	bool running;
+	uint32_t interval;
+	void *contextPtr;
+};
+
+le_timer_Ref_t le_timer_Create(const char *name) {
+        le_timer_Ref_t timerRef = calloc(1, sizeof(struct le_timer));
+
+        LE_ASSERT(timerRef != NULL);
+        return timerRef;
+}
+
+void le_timer_Delete(le_timer_Ref_t timerRef) {
+        free(timerRef);
+}
+
+le_result_t le_timer_SetHandler(le_timer_Ref_t timerRef, le_timer_ExpiryHandler_t handler) {
+        return LE_OK;
+}
+
+le_result_t le_timer_SetMsInterval(le_timer_Ref_t timerRef, uint32_t interval) {
+        timerRef->interval = interval;
+        return LE_OK;
+}
+
+uint32_t le_timer_GetMsInterval(le_timer_Ref_t timerRef) {
+        return timerRef->interval;
+}
+
+le_result_t le_timer_SetContextPtr(le_timer_Ref_t timerRef, void *contextPtr) {
+        timerRef->contextPtr = contextPtr;
+        return LE_OK;
+}
+
+void *le_timer_GetContextPtr(le_timer_Ref_t timerRef) {
+        return timerRef->contextPtr;
+}
+
+le_result_t le_timer_SetRepeat(le_timer_Ref_t timerRef, uint32_t repeatCount) {
+        return LE_OK;
+}
+
+le_result_t le_timer_Start(le_timer_Ref_t timerRef) {
+        if (timerRef->running) return LE_BUSY;
+        timerRef->running = true;
+        return LE_OK;
+}
+
+le_result_t le_timer_Stop(le_timer_Ref_t timerRef) {
+        if (!timerRef->running) return LE_FAULT;
+        timerRef->running = false;
+        return LE_OK;
+}
+
+le_result_t le_timer_Restart(le_timer_Ref_t timerRef) {
+        timerRef->running = true;
+        return LE_OK;
+}
+
+bool le_timer_IsRunning(le_timer_Ref_t timerRef) {
+        return timerRef->running;
+}
+
+/* --- threads and events --- */
+
+le_thread_Ref_t le_thread_Create(const char *name, le_thread_MainFunc_t mainFunc, void *contextPtr) {
+        return NULL;
+}
+
+void le_thread_Start(le_thread_Ref_t threadRef) {
+}
+
+le_thread_Ref_t le_thread_GetCurrent(void) {
+        return NULL;
+}
+
+void le_event_QueueFunction(le_event_DeferredFunc_t func, void *param1Ptr, void *param2Ptr) {
+}
+
+void le_event_QueueFunctionToThread(le_thread_Ref_t thread, le_event_DeferredFunc_t func,
+                                    void *param1Ptr, void *param2Ptr) {
+}
+
+void le_event_RunLoop(void) {
+}
+
+le_sem_Ref_t le_sem_Create(const char *name, int32_t initialCount) {
+        return NULL;
+}
+
+void le_sem_Post(le_sem_Ref_t semRef) {
+}
+
+void le_sem_Wait(le_sem_Ref_t semRef) {
+}
+
+le_fdMonitor_Ref_t le_fdMonitor_Create(const char *name, int fd, le_fdMonitor_HandlerFunc_t handlerFunc, short events) {
+        return NULL;
+}
+
+void le_fdMonitor_Delete(le_fdMonitor_Ref_t monitorRef) {
+}
+
+void le_fdMonitor_SetContextPtr(le_fdMonitor_Ref_t monitorRef, void *contextPtr) {
+}
+
+void *le_fdMonitor_GetContextPtr(void) {
+        return NULL;
+}
+
+/* --- serial devices --- */
+
+int le_tty_Open(const char *ttyDev, int flags) {
+        return open(ttyDev, flags);
+}
+
+void le_tty_Close(int fd) {
+        close(fd);
+}
+
+le_result_t le_tty_SetBaudRate(int fd, tty_Speed_t speed) {
+        return LE_OK;
+}
+
+le_result_t le_tty_SetFraming(int fd, char parity, int wordSize, int stopBits) {
+        return LE_OK;
+}
+
+le_result_t le_tty_SetRaw(int fd, int numChars, int timeout) {
+        return LE_OK;
+}
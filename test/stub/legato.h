@@ -0,0 +1,168 @@
+/*
+ * legato.h
+ *
+ * Host stand-in for the Legato framework header, just the parts the
+ * modules built by test/Makefile use. The functions are implemented in
+ * le_stub.c: memory pools count the objects they hand out, the clock is
+ * set by the test, timers and events do nothing. Threads are not started,
+ * semaphores do not wait - the tests are single threaded.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef LEGATO_H_
+#define LEGATO_H_
+
+#define _GNU_SOURCE 1
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/time.h>
+
+typedef enum {
+	LE_OK = 0,
+	LE_NOT_FOUND = -1,
+	LE_NOT_POSSIBLE = -2,
+	LE_OUT_OF_RANGE = -3,
+	LE_NO_MEMORY = -4,
+	LE_NOT_PERMITTED = -5,
+	LE_FAULT = -6,
+	LE_COMM_ERROR = -7,
+	LE_TIMEOUT = -8,
+	LE_OVERFLOW = -9,
+	LE_UNDERFLOW = -10,
+	LE_WOULD_BLOCK = -11,
+	LE_DEADLOCK = -12,
+	LE_FORMAT_ERROR = -13,
+	LE_DUPLICATE = -14,
+	LE_BAD_PARAMETER = -15,
+	LE_CLOSED = -16,
+	LE_BUSY = -17,
+	LE_UNSUPPORTED = -18,
+	LE_IO_ERROR = -19,
+	LE_NOT_IMPLEMENTED = -20,
+	LE_UNAVAILABLE = -21,
+	LE_TERMINATED = -22
+} le_result_t;
+
+/* --- logging: info and debug are compiled (so the arguments are checked) but not printed --- */
+#define LE_DEBUG(...) do { if (0) fprintf(stderr, __VA_ARGS__); } while (0)
+#define LE_INFO(...) do { if (0) fprintf(stderr, __VA_ARGS__); } while (0)
+#define LE_WARN(...) do { if (le_stub_verbose) { fprintf(stderr, "WARN: " __VA_ARGS__); fputc('\n', stderr); } } while (0)
+#define LE_ERROR(...) do { if (le_stub_verbose) { fprintf(stderr, "ERROR: " __VA_ARGS__); fputc('\n', stderr); } } while (0)
+#define LE_CRIT(...) do { fprintf(stderr, "CRIT: " __VA_ARGS__); fputc('\n', stderr); } while (0)
+#define LE_FATAL(...) do { fprintf(stderr, "FATAL: " __VA_ARGS__); fputc('\n', stderr); abort(); } while (0)
+#define LE_FATAL_IF(c, ...) do { if (c) LE_FATAL(__VA_ARGS__); } while (0)
+#define LE_ERROR_IF(c, ...) do { if (c) LE_ERROR(__VA_ARGS__); } while (0)
+#define LE_WARN_IF(c, ...) do { if (c) LE_WARN(__VA_ARGS__); } while (0)
+#define LE_ASSERT(c) do { if (!(c)) LE_FATAL("assert failed: %s", #c); } while (0)
+#define LE_ASSERT_OK(c) LE_ASSERT((c) == LE_OK)
+#define LE_UNUSED __attribute__((unused))
+#define NUM_ARRAY_MEMBERS(a) (sizeof(a) / sizeof((a)[0]))
+#define COMPONENT_INIT void _le_component_init(void)
+
+extern bool le_stub_verbose;                     // print LE_WARN / LE_ERROR, off for the benchmarks
+
+/* --- memory pools - a free list per pool, grown only by expanding or forcing, as the Legato pools --- */
+typedef struct le_mem_Pool *le_mem_PoolRef_t;
+typedef void (*le_mem_Destructor_t)(void *);
+le_mem_PoolRef_t le_mem_CreatePool(const char *name, size_t objSize);
+le_mem_PoolRef_t le_mem_ExpandPool(le_mem_PoolRef_t pool, size_t numObjects);
+void *le_mem_TryAlloc(le_mem_PoolRef_t pool);
+void *le_mem_ForceAlloc(le_mem_PoolRef_t pool);
+void *le_mem_AssertAlloc(le_mem_PoolRef_t pool);
+void le_mem_Release(void *objPtr);
+void le_mem_AddRef(void *objPtr);
+void le_mem_SetDestructor(le_mem_PoolRef_t pool, le_mem_Destructor_t destructor);
+size_t le_mem_GetObjectSize(le_mem_PoolRef_t pool);
+typedef struct {
+	size_t numBlocksInUse;
+	size_t maxNumBlocksUsed;
+	size_t numOverflows;
+	uint64_t numAllocs;
+	size_t numFree;
+} le_mem_PoolStats_t;
+le_result_t le_mem_GetStats(le_mem_PoolRef_t pool, le_mem_PoolStats_t *statsPtr);
+
+/* --- clock - le_stub_setTime() moves it --- */
+typedef struct {
+	time_t sec;
+	long usec;
+} le_clk_Time_t;
+le_clk_Time_t le_clk_GetAbsoluteTime(void);
+le_clk_Time_t le_clk_GetRelativeTime(void);
+le_clk_Time_t le_clk_Add(le_clk_Time_t t1, le_clk_Time_t t2);
+le_clk_Time_t le_clk_Sub(le_clk_Time_t t1, le_clk_Time_t t2);
+bool le_clk_GreaterThan(le_clk_Time_t t1, le_clk_Time_t t2);
+
+/* --- timer - never expires, the test calls the handler --- */
+typedef struct le_timer *le_timer_Ref_t;
+typedef void (*le_timer_ExpiryHandler_t)(le_timer_Ref_t timerRef);
+le_timer_Ref_t le_timer_Create(const char *name);
+void le_timer_Delete(le_timer_Ref_t timerRef);
+le_result_t le_timer_SetHandler(le_timer_Ref_t timerRef, le_timer_ExpiryHandler_t handler);
+le_result_t le_timer_SetMsInterval(le_timer_Ref_t timerRef, uint32_t interval);
+uint32_t le_timer_GetMsInterval(le_timer_Ref_t timerRef);
+le_result_t le_timer_SetContextPtr(le_timer_Ref_t timerRef, void *contextPtr);
+void *le_timer_GetContextPtr(le_timer_Ref_t timerRef);
+le_result_t le_timer_SetRepeat(le_timer_Ref_t timerRef, uint32_t repeatCount);
+le_result_t le_timer_Start(le_timer_Ref_t timerRef);
+le_result_t le_timer_Stop(le_timer_Ref_t timerRef);
+le_result_t le_timer_Restart(le_timer_Ref_t timerRef);
+bool le_timer_IsRunning(le_timer_Ref_t timerRef);
+
+/* --- threads and events - single threaded on the host --- */
+typedef struct le_thread *le_thread_Ref_t;
+typedef void *(*le_thread_MainFunc_t)(void *contextPtr);
+typedef void (*le_event_DeferredFunc_t)(void *param1Ptr, void *param2Ptr);
+le_thread_Ref_t le_thread_Create(const char *name, le_thread_MainFunc_t mainFunc, void *contextPtr);
+void le_thread_Start(le_thread_Ref_t threadRef);
+le_thread_Ref_t le_thread_GetCurrent(void);
+void le_event_QueueFunction(le_event_DeferredFunc_t func, void *param1Ptr, void *param2Ptr);
+void le_event_QueueFunctionToThread(le_thread_Ref_t thread, le_event_DeferredFunc_t func,
+                                    void *param1Ptr, void *param2Ptr);
+void le_event_RunLoop(void);
+
+typedef struct le_sem *le_sem_Ref_t;
+le_sem_Ref_t le_sem_Create(const char *name, int32_t initialCount);
+void le_sem_Post(le_sem_Ref_t semRef);
+void le_sem_Wait(le_sem_Ref_t semRef);
+
+typedef struct le_fdMonitor *le_fdMonitor_Ref_t;
+typedef void (*le_fdMonitor_HandlerFunc_t)(int fd, short events);
+le_fdMonitor_Ref_t le_fdMonitor_Create(const char *name, int fd, le_fdMonitor_HandlerFunc_t handlerFunc, short events);
+void le_fdMonitor_Delete(le_fdMonitor_Ref_t monitorRef);
+void le_fdMonitor_SetContextPtr(le_fdMonitor_Ref_t monitorRef, void *contextPtr);
+void *le_fdMonitor_GetContextPtr(void);
+
+/* --- serial devices - opened as files, the settings are not applied --- */
+typedef enum {
+	LE_TTY_SPEED_9600,
+	LE_TTY_SPEED_115200
+} tty_Speed_t;
+int le_tty_Open(const char *ttyDev, int flags);
+void le_tty_Close(int fd);
+le_result_t le_tty_SetBaudRate(int fd, tty_Speed_t speed);
+le_result_t le_tty_SetFraming(int fd, char parity, int wordSize, int stopBits);
+le_result_t le_tty_SetRaw(int fd, int numChars, int timeout);
+
+/* --- messaging - only the types the generated server headers use --- */
+typedef struct le_msg_Session *le_msg_SessionRef_t;
+typedef struct le_msg_Service *le_msg_ServiceRef_t;
+
+/* --- test control, not part of Legato --- */
+void le_stub_setTime(time_t sec, long usec);
+uint64_t le_stub_getPoolAllocs(void);            // objects allocated from all pools since the start
+
+#endif /* LEGATO_H_ */
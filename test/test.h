@@ -0,0 +1,58 @@
+/*
+ * test.h
+ *
+ * Check macros and timing helpers of the host tests and benchmarks.
+ * A test binary runs its checks and exits with the number of failed
+ * checks, with -b it runs its benchmarks instead.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include "legato.h"
+
+extern unsigned int test_failures;
+
+#define CHECK(cond) do {                                                        \
+        if (!(cond)) {                                                          \
+                fprintf(stderr, "%s:%d: check failed: %s\n",                    \
+                        __FILE__, __LINE__, #cond);                             \
+                ++test_failures;                                                \
+        }                                                                       \
+} while (0)
+
+#define CHECK_EQ(a, b) do {                                                     \
+        long long _a = (long long) (a), _b = (long long) (b);                   \
+        if (_a != _b) {                                                         \
+                fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n",\
+                        __FILE__, __LINE__, #a, #b, _a, _b);                    \
+                ++test_failures;                                                \
+        }                                                                       \
+} while (0)
+
+#define TEST_RUN(func) do {                                                     \
+        unsigned int _before = test_failures;                                   \
+        func();                                                                 \
+        printf("%-40s %s\n", #func, test_failures == _before ? "ok" : "FAILED");\
+} while (0)
+
+static inline double test_now() {                                               // monotonic wall clock in seconds
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint32_t test_random(uint32_t *state) {                          // xorshift32 - the same sequence on every host
+        uint32_t x = *state;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return *state = x;
+}
+
+#endif /* TEST_H_ */
@@ -0,0 +1,372 @@
+/*
+ * test_avsInterface.c
+ *
+ * Host test of the AirVantage batching (AVSInterface.c) against a stub of
+ * the avcService client API. Every le_avdata call of the stub is one IPC
+ * round trip - request and response go through a SOCK_SEQPACKET socket
+ * pair, as the Legato messages do, so the kernel part of the messaging is
+ * paid (the context switches to avcService are not). le_avdata_PushStream()
+ * reads the document from the fd as avcService does. The spool is faked,
+ * it only counts what is appended.
+ *
+ * The tests check the JSON document of a batch, the split at
+ * AVS_PUSH_STREAM_MAX_BYTES and the spooling of a failed push. With -b
+ * the messages and the time per station of a report are measured for the
+ * batch and for the le_avdata_Record* calls it replaced.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "test.h"
+#include "interfaces.h"
+#include "AVSInterface.h"
+#include "AVSSpool.h"
+#include "config_scanner.h"
+#include <sys/socket.h>
+
+#define TEST_BENCH_SECONDS 0.3                           // per measurement
+#define TEST_MSG_MAX_BYTES 512                           // larger than any request of the stub
+#define TEST_MAX_PENDING 16
+#define TEST_DATUMS_PER_STATION 5                        // lastseen, rssi, addrType, dataLen, data
+
+unsigned int test_failures;
+
+/* --- fake spool - counts only, never drained --- */
+
+static unsigned int spooledDocuments;
+static size_t spooledBytes;
+
+le_result_t avsSpool_init(const char *directory, size_t maxBytes) { return LE_OK; }
+le_result_t avsSpool_append(const char *data, size_t len) { ++spooledDocuments; spooledBytes += len; return LE_OK; }
+le_result_t avsSpool_peek(char **dataPtr, size_t *lenPtr, AVS_Spool_Position_t *positionPtr) { return LE_NOT_FOUND; }
+void avsSpool_consume(const AVS_Spool_Position_t *position) { }
+bool avsSpool_isEmpty() { return true; }
+size_t avsSpool_bytes() { return spooledBytes; }
+unsigned int avsSpool_droppedEntries() { return 0; }
+
+/* --- le_avdata stub --- */
+
+typedef struct {
+        le_avdata_CallbackResultFunc_t handler;
+        void *context;
+} test_Pending_t;
+
+static int ipc[2] = { -1, -1 };                                                 // client / avcService end
+static unsigned int messages;
+static test_Pending_t pending[TEST_MAX_PENDING];                               // push results not reported yet
+static unsigned int pendingCount;
+
+static char document[2 * AVS_PUSH_STREAM_MAX_BYTES];                            // the last pushed document
+static size_t documentLen;
+static unsigned int documents;
+static size_t largestDocument;
+
+/* one request / response round trip with avcService */
+static void test_message(const char *path, const char *value) {
+        char msg[TEST_MSG_MAX_BYTES];
+        int len = snprintf(msg, sizeof(msg), "%s=%s", path ? path : "", value ? value : "");
+
+        if (ipc[0] < 0) LE_ASSERT(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, ipc) == 0);
+        if (len >= (int) sizeof(msg)) len = sizeof(msg) - 1;
+
+        LE_ASSERT(send(ipc[0], msg, len, 0) == len);                           // request
+        LE_ASSERT(recv(ipc[1], msg, sizeof(msg), 0) == len);
+        LE_ASSERT(send(ipc[1], msg, sizeof(le_result_t), 0) == sizeof(le_result_t));  // response
+        LE_ASSERT(recv(ipc[0], msg, sizeof(msg), 0) == sizeof(le_result_t));
+        ++messages;
+}
+
+static void test_defer(le_avdata_CallbackResultFunc_t handler, void *context) {
+        LE_ASSERT(pendingCount < TEST_MAX_PENDING);
+        pending[pendingCount].handler = handler;
+        pending[pendingCount].context = context;
+        ++pendingCount;
+}
+
+/* the event loop - reports the push results */
+static void test_reportPushes(le_avdata_PushStatus_t status) {
+        unsigned int count = pendingCount;
+
+        pendingCount = 0;
+        for (unsigned int i = 0; i < count; ++i) pending[i].handler(status, pending[i].context);
+}
+
+le_result_t le_avdata_TryConnectService(void) { test_message("connect", NULL); return LE_OK; }
+le_result_t le_avdata_SetNamespace(le_avdata_Namespace_t nameSpace) { test_message("namespace", NULL); return LE_OK; }
+le_avdata_RequestSessionObjRef_t le_avdata_RequestSession(void) {
+        test_message("session", NULL);
+        return (le_avdata_RequestSessionObjRef_t) 1;
+}
+void le_avdata_ReleaseSession(le_avdata_RequestSessionObjRef_t sessionRequestRef) { test_message("release", NULL); }
+
+le_result_t le_avdata_PushStream(const char *path, int fd,
+                                 le_avdata_CallbackResultFunc_t handlerPtr, void *contextPtr) {
+        ssize_t len;
+
+        test_message(path, NULL);
+        documentLen = 0;
+        while ((len = read(fd, document + documentLen, sizeof(document) - 1 - documentLen)) > 0) {
+                documentLen += len;
+        }
+        close(fd);
+        document[documentLen] = '\0';
+        if (documentLen > largestDocument) largestDocument = documentLen;
+        ++documents;
+
+        test_defer(handlerPtr, contextPtr);
+        return LE_OK;
+}
+
+le_avdata_RecordRef_t le_avdata_CreateRecord(void) { test_message("record", NULL); return (le_avdata_RecordRef_t) 1; }
+void le_avdata_DeleteRecord(le_avdata_RecordRef_t recordRef) { test_message("delete", NULL); }
+
+le_result_t le_avdata_RecordInt(le_avdata_RecordRef_t recordRef, const char *path, int32_t value, uint64_t timestamp) {
+        char text[16];
+
+        snprintf(text, sizeof(text), "%d", value);
+        test_message(path, text);
+        return LE_OK;
+}
+
+le_result_t le_avdata_RecordFloat(le_avdata_RecordRef_t recordRef, const char *path, double value, uint64_t timestamp) {
+        char text[32];
+
+        snprintf(text, sizeof(text), "%.17g", value);
+        test_message(path, text);
+        return LE_OK;
+}
+
+le_result_t le_avdata_RecordBool(le_avdata_RecordRef_t recordRef, const char *path, bool value, uint64_t timestamp) {
+        test_message(path, value ? "true" : "false");
+        return LE_OK;
+}
+
+le_result_t le_avdata_RecordString(le_avdata_RecordRef_t recordRef, const char *path, const char *value, uint64_t timestamp) {
+        test_message(path, value);
+        return LE_OK;
+}
+
+le_result_t le_avdata_PushRecord(le_avdata_RecordRef_t recordRef,
+                                 le_avdata_CallbackResultFunc_t handlerPtr, void *contextPtr) {
+        test_message("push", NULL);
+        test_defer(handlerPtr, contextPtr);
+        return LE_OK;
+}
+
+/* --- the record path before the batch, as it was in AVSInterface.c --- */
+
+static le_avdata_RecordRef_t bx31old_recordRef = NULL;
+
+static void bx31old_pushCallback(le_avdata_PushStatus_t status, void *contextPtr) {
+}
+
+static le_result_t bx31old_recordData(const char *path, const void *data, avsService_DataType_t type) {
+        struct timeval  tv;
+        gettimeofday(&tv, NULL);
+        uint64_t utcMilliSec = (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
+
+        if (bx31old_recordRef == NULL) {
+                LE_ASSERT((bx31old_recordRef = le_avdata_CreateRecord()) != NULL);
+        }
+
+        switch(type)  {
+        case INT:       return le_avdata_RecordInt   (bx31old_recordRef, path, *((const int32_t *) data), utcMilliSec);
+        case FLOAT:     return le_avdata_RecordFloat (bx31old_recordRef, path, *((const double  *) data), utcMilliSec);
+        case BOOL:      return le_avdata_RecordBool  (bx31old_recordRef, path, *((const bool    *) data), utcMilliSec);
+        case STRING:    return le_avdata_RecordString(bx31old_recordRef, path,  ((const char    *) data), utcMilliSec);
+        default:        return LE_FAULT;
+        }
+}
+
+static le_result_t bx31old_pushData() {
+        le_result_t result;
+
+        if ((result = le_avdata_PushRecord(bx31old_recordRef, bx31old_pushCallback, NULL)) == LE_OK) {
+                le_avdata_DeleteRecord(bx31old_recordRef);
+                bx31old_recordRef = NULL;
+        }
+        return result;
+}
+
+/* --- helpers --- */
+
+static void test_init() {
+        avsService_init();
+        messages = 0;
+        documents = 0;
+        largestDocument = 0;
+        spooledDocuments = 0;
+        spooledBytes = 0;
+}
+
+static void test_destroy() {
+        test_reportPushes(LE_AVDATA_PUSH_SUCCESS);
+        avsService_detroy();
+}
+
+/* the datums the station manager reported per station before the blob */
+static void test_stationDatums(uint64_t addr, le_result_t (*add)(const char *, const void *, avsService_DataType_t)) {
+        static const char data[] = "AgEGG/9MAAIVSmD84kZMTgqQgaRSAWKcWwAAAADD";        // 31 byte advert, base64
+        static const int32_t lastSeen = 1790000000, rssi = -70, addrType = 1, dataLen = 31;
+        char path[64];
+
+        snprintf(path, sizeof(path), AVS_BASE_PATH ".station.%012llx.lastseen", (unsigned long long) addr);
+        add(path, &lastSeen, INT);
+        snprintf(path, sizeof(path), AVS_BASE_PATH ".station.%012llx.rssi", (unsigned long long) addr);
+        add(path, &rssi, INT);
+        snprintf(path, sizeof(path), AVS_BASE_PATH ".station.%012llx.addrType", (unsigned long long) addr);
+        add(path, &addrType, INT);
+        snprintf(path, sizeof(path), AVS_BASE_PATH ".station.%012llx.dataLen", (unsigned long long) addr);
+        add(path, &dataLen, INT);
+        snprintf(path, sizeof(path), AVS_BASE_PATH ".station.%012llx.data", (unsigned long long) addr);
+        add(path, data, STRING);
+}
+
+/* number of "path":value pairs in the last document */
+static unsigned int test_documentDatums() {
+        unsigned int datums = 0;
+        const char *data = strstr(document, "\"data\":{");
+
+        if (data == NULL) return 0;
+        for (const char *p = data + 8; *p; ++p) {
+                if (p[0] == '"' && (p[-1] == '{' || p[-1] == ',')) ++datums;
+        }
+        return datums;
+}
+
+/* --- tests --- */
+
+static void test_batchDocument() {
+        int32_t count = 12;
+        double ratio = 0.5;
+        bool flag = true;
+
+        test_init();
+        CHECK_EQ(avsService_batchAdd(AVS_STATISTICS_PATH ".stations.count", &count, INT), LE_OK);
+        CHECK_EQ(avsService_batchAdd(AVS_STATISTICS_PATH ".ratio", &ratio, FLOAT), LE_OK);
+        CHECK_EQ(avsService_batchAdd(AVS_STATISTICS_PATH ".flag", &flag, BOOL), LE_OK);
+        CHECK_EQ(avsService_batchAdd(AVS_STATION_BLOB_PATH ".0", "QlMC", STRING), LE_OK);
+        CHECK_EQ(messages, 0);                                                  // nothing sent while collecting
+
+        CHECK_EQ(avsService_batchPush(), LE_OK);
+        CHECK_EQ(messages, 1);
+        CHECK_EQ(documents, 1);
+        CHECK(strncmp(document, "{\"ts\":", 6) == 0);
+        CHECK(strstr(document, ",\"data\":{\"BTScan.stats.stations.count\":12,"
+                               "\"BTScan.stats.ratio\":0.5,\"BTScan.stats.flag\":true,"
+                               "\"BTScan.stations.0\":\"QlMC\",\"BTScan.stats.avs.spoolBytes\":0,"
+                               "\"BTScan.stats.avs.spoolDropped\":0}}") != NULL);
+        CHECK_EQ(document[documentLen - 1], '}');
+
+        CHECK_EQ(avsService_batchPush(), LE_OK);                                // empty batch - nothing pushed
+        CHECK_EQ(documents, 1);
+
+        test_reportPushes(LE_AVDATA_PUSH_SUCCESS);
+        CHECK_EQ(spooledDocuments, 0);
+        test_destroy();
+}
+
+static void test_split() {
+        const unsigned int stations = 1000;                                     // about 130 kB of JSON
+        unsigned int datums = 0;
+
+        test_init();
+        for (unsigned int i = 0; i < stations; ++i) {
+                test_stationDatums(0x100000000000ULL + i, avsService_batchAdd);
+                if (pendingCount > 0) {                                         // avcService reports while we collect
+                        CHECK(documentLen <= AVS_PUSH_STREAM_MAX_BYTES);
+                        datums += test_documentDatums();
+                        test_reportPushes(LE_AVDATA_PUSH_SUCCESS);
+                }
+        }
+        CHECK_EQ(avsService_batchPush(), LE_OK);
+        datums += test_documentDatums();
+
+        CHECK(documents > 1);
+        CHECK_EQ(messages, documents);
+        CHECK(largestDocument <= AVS_PUSH_STREAM_MAX_BYTES);
+        CHECK(largestDocument > AVS_PUSH_STREAM_MAX_BYTES - 200);               // documents are filled up
+        CHECK_EQ(datums, stations * TEST_DATUMS_PER_STATION + 2);               // + spool statistics
+        CHECK_EQ(spooledDocuments, 0);
+        test_destroy();
+}
+
+static void test_failedPushSpooled() {
+        int32_t count = 3;
+
+        test_init();
+        CHECK_EQ(avsService_batchAdd(AVS_STATISTICS_PATH ".stations.count", &count, INT), LE_OK);
+        CHECK_EQ(avsService_batchPush(), LE_OK);
+        CHECK_EQ(documents, 1);
+        size_t pushedLen = documentLen;
+
+        test_reportPushes(LE_AVDATA_PUSH_FAILED);
+        CHECK_EQ(spooledDocuments, 1);
+        CHECK_EQ(spooledBytes, pushedLen);
+        test_destroy();
+}
+
+/* --- benchmark --- */
+
+static void bench_report(unsigned int stations) {
+        double start, seconds;
+        uint64_t reports;
+        uint64_t oldMessages, newMessages;
+
+        test_init();
+        le_stub_verbose = false;
+
+        reports = 0;                                                            // one le_avdata_Record* call per datum
+        messages = 0;
+        start = test_now();
+        do {
+                for (unsigned int i = 0; i < stations; ++i) {
+                        test_stationDatums(0x100000000000ULL + i, bx31old_recordData);
+                }
+                bx31old_pushData();
+                test_reportPushes(LE_AVDATA_PUSH_SUCCESS);
+                ++reports;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double oldUs = seconds * 1e6 / (reports * stations);
+        oldMessages = messages;
+        double oldPerStation = (double) oldMessages / (reports * stations);
+
+        reports = 0;                                                            // the batch - one push stream per document
+        messages = 0;
+        start = test_now();
+        do {
+                for (unsigned int i = 0; i < stations; ++i) {
+                        test_stationDatums(0x100000000000ULL + i, avsService_batchAdd);
+                        test_reportPushes(LE_AVDATA_PUSH_SUCCESS);
+                }
+                avsService_batchPush();
+                test_reportPushes(LE_AVDATA_PUSH_SUCCESS);
+                ++reports;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double newUs = seconds * 1e6 / (reports * stations);
+        newMessages = messages;
+        double newPerStation = (double) newMessages / (reports * stations);
+
+        printf("%5u stations: records %6.3f msg %6.2f us, push stream %6.3f msg %6.2f us per station "
+               "(%.1fx fewer messages, %.1fx faster)\n",
+               stations, oldPerStation, oldUs, newPerStation, newUs,
+               oldPerStation / newPerStation, oldUs / newUs);
+
+        le_stub_verbose = true;
+        test_destroy();
+}
+
+int main(int argc, char **argv) {
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                bench_report(10);
+                bench_report(100);
+                bench_report(1000);
+                return 0;
+        }
+
+        TEST_RUN(test_batchDocument);
+        TEST_RUN(test_split);
+        TEST_RUN(test_failedPushSpooled);
+        return test_failures > 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * test_bx31Startup.c
+ *
+ * Host test of the startup of a BX310x module (bx31at_startupStep() in
+ * BX31_ATServiceComponent.c, included by the test) against a fake module
+ * behind the le_atClient API. The fake answers each command after
+ * TEST_ANSWER_MS, does not answer at all while it is off or booting (the
+ * command times out) and keeps its settings, so a warm module - already
+ * running and configured - can be told from one with factory settings or
+ * one which hangs. The GPIO reset switches it off and on again.
+ *
+ * Nothing runs on its own on the host: the clock is moved by the fake
+ * (answers, time outs) and by the test when it fires the startup and
+ * reset timers, the functions the component queues to other threads are
+ * called by the test. So the time to the first scan is the time on the
+ * Legato clock the startup takes with a module as modelled here - the
+ * answer and boot times are assumptions, the polls, time outs and
+ * commands are those of the code.
+ *
+ * The tests check the commands sent for a configured module, one with
+ * factory settings, a hanging module which is reset and a module which
+ * is no BX310x, and that bx31at_getTimeToFirstScan() reports the time.
+ * With -b the time to the first scan is printed for each of them and for
+ * the sequence there was before (GPIO reset, sleep(2), all settings
+ * written, the first scan on the 10 s scan timer).
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#define BX31_SERIAL_DEVICE "/dev/null"                   // opened by le_tty_Open() of the stub
+
+#include "test.h"
+#include "BX31_ATServiceComponent.c"
+
+#define TEST_ANSWER_MS 20                                // a short command and its answer at 115200 baud, assumed
+#define TEST_BOOT_MS 2000                                // module boot after power on or reset - the old code slept 2 s
+#define TEST_MAX_STEPS 1000                              // a startup which does not get to the first scan
+#define TEST_SETTINGS 4
+
+unsigned int test_failures;
+
+/* --- the fake module --- */
+
+static const char *const settingNames[TEST_SETTINGS] = { "SRWCFG", "SRBTSYSTEM", "SRBTPS", "SRBLEADV" };
+static const char *const configured[TEST_SETTINGS] = { "0", "1", "0", "0" };   // as bx31at_configure() sets them
+static const char *const factory[TEST_SETTINGS] = { "1", "0", "1", "1" };
+
+typedef struct {
+	bool powered;                                  // enable GPIO active
+	bool hangs;                                    // answers nothing until it is reset
+	uint32_t answersFrom;                          // tick the module is booted
+	const char *identity;                          // ATI response
+	char settings[TEST_SETTINGS][8];
+	unsigned int commands;                         // commands sent, up to the first scan
+	unsigned int writes;                           // settings written
+	unsigned int resets;                           // GPIO resets
+	unsigned int scans;
+} test_Module_t;
+
+static test_Module_t module;
+
+struct le_atClient_Device {
+	bool started;
+	int fd;
+};
+
+struct le_atClient_Cmd {
+	char intermediate[LE_ATDEFS_RESPONSE_MAX_BYTES];
+	char final[LE_ATDEFS_RESPONSE_MAX_BYTES];
+};
+
+static struct le_atClient_Device atDevice;
+static struct le_atClient_Cmd atCmd;
+static uint32_t nowMs;
+
+static void test_advance(uint32_t ms) {
+        nowMs += ms;
+        le_stub_setTime(nowMs / 1000, (nowMs % 1000) * 1000);
+}
+
+static bool test_answers() {
+        return module.powered && !module.hangs && nowMs >= module.answersFrom;
+}
+
+void le_atClient_ConnectService(void) {
+}
+
+le_atClient_DeviceRef_t le_atClient_Start(int fd) {
+        if (atDevice.started) return NULL;
+        atDevice.started = true;
+        atDevice.fd = fd;
+        return &atDevice;
+}
+
+le_result_t le_atClient_Stop(le_atClient_DeviceRef_t device) {
+        if (!device->started) return LE_FAULT;
+        device->started = false;
+        close(device->fd);                                                      // as the AT client does
+        return LE_OK;
+}
+
+le_atClient_CmdRef_t le_atClient_Create(void) {
+        return &atCmd;
+}
+
+le_result_t le_atClient_Delete(le_atClient_CmdRef_t cmdRef) {
+        return LE_OK;
+}
+
+le_result_t le_atClient_SetCommandAndSend(le_atClient_CmdRef_t *cmdRefPtr, le_atClient_DeviceRef_t devRef,
+                                          const char *command, const char *interResp, const char *finalResp,
+                                          uint32_t timeout) {
+        struct le_atClient_Cmd *cmd = *cmdRefPtr;
+        unsigned int window;
+
+        LE_ASSERT(devRef == &atDevice && atDevice.started);
+        if (module.scans == 0) ++module.commands;
+        if (!test_answers()) {
+                test_advance(timeout);
+                return LE_TIMEOUT;
+        }
+
+        test_advance(TEST_ANSWER_MS);
+        cmd->intermediate[0] = '\0';
+        strcpy(cmd->final, "OK");
+        if (strcmp(command, "AT") == 0) return LE_OK;
+        if (strcmp(command, "ATI") == 0) {
+                strcpy(cmd->intermediate, module.identity);
+                return LE_OK;
+        }
+        if (sscanf(command, "AT+SRBLESCAN=%u,1", &window) == 1) {
+                ++module.scans;
+                test_advance(window * 1000);
+                return LE_OK;
+        }
+        for (int i = 0; i < TEST_SETTINGS; ++i) {
+                size_t nameLen = strlen(settingNames[i]);
+
+                if (strncmp(command + 3, settingNames[i], nameLen) != 0) continue;
+                if (command[3 + nameLen] == '?') {
+                        snprintf(cmd->intermediate, sizeof(cmd->intermediate), "+%s: %s",
+                                 settingNames[i], module.settings[i]);
+                        return LE_OK;
+                }
+                if (command[3 + nameLen] == '=') {
+                        snprintf(module.settings[i], sizeof(module.settings[i]), "%s", command + 4 + nameLen);
+                        ++module.writes;
+                        return LE_OK;
+                }
+        }
+        strcpy(cmd->final, "ERROR");
+        return LE_OK;
+}
+
+le_result_t le_atClient_GetFinalResponse(le_atClient_CmdRef_t cmdRef, char *finalRsp, size_t finalRspSize) {
+        snprintf(finalRsp, finalRspSize, "%s", cmdRef->final);
+        return LE_OK;
+}
+
+le_result_t le_atClient_GetFirstIntermediateResponse(le_atClient_CmdRef_t cmdRef, char *intermediateRsp,
+                                                     size_t intermediateRspSize) {
+        if (cmdRef->intermediate[0] == '\0') return LE_NOT_FOUND;
+        snprintf(intermediateRsp, intermediateRspSize, "%s", cmdRef->intermediate);
+        return LE_OK;
+}
+
+le_atClient_UnsolicitedResponseHandlerRef_t le_atClient_AddUnsolicitedResponseHandler(const char *unsolRsp,
+                le_atClient_DeviceRef_t devRef, le_atClient_UnsolicitedResponseHandlerFunc_t handlerPtr,
+                void *contextPtr, uint32_t lineCount) {
+        return NULL;
+}
+
+void le_atClient_RemoveUnsolicitedResponseHandler(le_atClient_UnsolicitedResponseHandlerRef_t handlerRef) {
+}
+
+le_result_t gpio_bx_enable_SetPushPullOutput(gpio_bx_enable_Polarity_t polarity, bool value) {
+        if (value && !module.powered) gpio_bx_enable_Activate();                // power on with the app
+        return LE_OK;
+}
+
+le_result_t gpio_bx_enable_Activate(void) {
+        module.powered = true;
+        module.hangs = false;
+        module.answersFrom = nowMs + TEST_BOOT_MS;
+        return LE_OK;
+}
+
+le_result_t gpio_bx_enable_Deactivate(void) {
+        module.powered = false;
+        ++module.resets;
+        return LE_OK;
+}
+
+le_result_t gpio_bx_fwFlash_SetPushPullOutput(gpio_bx_fwFlash_Polarity_t polarity, bool value) {
+        return LE_OK;
+}
+
+/* --- helpers --- */
+
+static void test_scanCallback(int index, BTScanResult_t *scanResult) {
+}
+
+static void test_module(bool powered, bool hangs, const char *const *settings, const char *identity) {
+        memset(&module, 0, sizeof(module));
+        module.powered = powered;
+        module.hangs = hangs;
+        module.identity = identity;
+        for (int i = 0; i < TEST_SETTINGS; ++i) strcpy(module.settings[i], settings[i]);
+}
+
+/*
+ * starts the component and does what the threads would do until the first
+ * scan was issued - fires the timers which are due and calls the functions
+ * which were queued to the calling thread and the scan thread
+ *
+ * @return the device - if it failed its startup timer runs for the retry
+ *         after BX31_RECOVERY_BACKOFF_MS
+ */
+static BX31_Device_t *test_start() {
+        BX31_Device_t *dev = &devices[0];
+        unsigned int resetsDone = 0;
+
+        nowMs = 0;
+        test_advance(1000);
+        bx31at_initBLE(test_scanCallback);
+        bx31at_scanThread(dev);
+
+        for (int step = 0; step < TEST_MAX_STEPS && module.scans == 0; ++step) {
+                if (le_timer_IsRunning(dev->startupTimerRef)
+                    && le_timer_GetMsInterval(dev->startupTimerRef) == BX31_RECOVERY_BACKOFF_MS) {
+                        break;                                                  // failed
+                }
+                if (dev->state == BX31_STATE_READY) {                           // queued to the calling thread, which
+                        bx31at_deviceReady(dev, NULL);                          // queues the scan to the scan thread
+                        bx31at_runScan(dev, NULL);
+                } else if (dev->resets > resetsDone) {                          // reset queued to the calling thread
+                        ++resetsDone;
+                        bx31at_resetModule(dev, NULL);
+                } else if (le_timer_IsRunning(resetTimerRef)) {                 // reset pulse
+                        le_timer_Stop(resetTimerRef);
+                        test_advance(le_timer_GetMsInterval(resetTimerRef));
+                        bx31at_resetPulseDone(resetTimerRef);
+                        bx31at_continueStartup(dev, NULL);                      // queued to the scan thread
+                } else if (le_timer_IsRunning(dev->startupTimerRef)) {          // next poll
+                        le_timer_Stop(dev->startupTimerRef);
+                        test_advance(le_timer_GetMsInterval(dev->startupTimerRef));
+                        bx31at_startupTimerExpired(dev->startupTimerRef);
+                } else {
+                        LE_FATAL("startup stuck in state %d", dev->state);
+                }
+        }
+        return dev;
+}
+
+static void test_stop() {
+        BX31_Device_t *dev = &devices[0];
+
+        bx31at_stopScanThread(dev, NULL);                                       // queued to the scan thread
+        bx31at_stopBLE();
+        scanq_destroy(dev->queue);
+        le_timer_Delete(dev->startupTimerRef);
+        le_timer_Delete(dev->scanPauseTimerRef);
+        le_timer_Delete(resetTimerRef);
+        deviceCount = 0;
+}
+
+/* --- tests --- */
+
+/* running and configured: "AT", "ATI" and a query per setting - the first scan well within 1 s */
+static void test_warmConfigured() {
+        test_module(true, false, configured, "BX310x");
+        BX31_Device_t *dev = test_start();
+
+        CHECK_EQ(dev->state, BX31_STATE_READY);
+        CHECK_EQ(module.scans, 1);
+        CHECK_EQ(module.commands, 2 + TEST_SETTINGS + 1);
+        CHECK_EQ(module.writes, 0);
+        CHECK_EQ(module.resets, 0);
+        CHECK_EQ(bx31at_getTimeToFirstScan(), (2 + TEST_SETTINGS) * TEST_ANSWER_MS);
+        CHECK(bx31at_getTimeToFirstScan() < 1000);
+        test_stop();
+}
+
+/* running with factory settings: each setting is written after its query */
+static void test_warmFactory() {
+        test_module(true, false, factory, "BX310x");
+        BX31_Device_t *dev = test_start();
+
+        CHECK_EQ(dev->state, BX31_STATE_READY);
+        CHECK_EQ(module.writes, TEST_SETTINGS);
+        for (int i = 0; i < TEST_SETTINGS; ++i) CHECK(strcmp(module.settings[i], configured[i]) == 0);
+        CHECK_EQ(module.commands, 2 + 2 * TEST_SETTINGS + 1);
+        CHECK_EQ(bx31at_getTimeToFirstScan(), (2 + 2 * TEST_SETTINGS) * TEST_ANSWER_MS);
+        test_stop();
+}
+
+/* hangs: "AT" is polled for BX31_PROBE_WINDOW_MS, then it is reset and polled until it booted */
+static void test_hungModule() {
+        test_module(true, true, configured, "BX310x");
+        BX31_Device_t *dev = test_start();
+        uint32_t poll = BX31_PROBE_INTERVAL_MS + BX31_PROBE_TIMEOUT_MS;         // a poll which is not answered
+        uint32_t bootedAt = BX31_PROBE_WINDOW_MS + BX31_RESET_PULSE_MS + TEST_BOOT_MS;
+
+        CHECK_EQ(dev->state, BX31_STATE_READY);
+        CHECK_EQ(module.resets, 1);
+        CHECK_EQ(bx31at_getResetCount(), 1);
+        CHECK(bx31at_getTimeToFirstScan() >= bootedAt);                          // the window and the boot are each
+        CHECK(bx31at_getTimeToFirstScan() <= bootedAt + 2 * poll                // found over at most one poll late
+                                            + (2 + TEST_SETTINGS) * TEST_ANSWER_MS);
+        test_stop();
+}
+
+/* another module on the UART: not configured, tried again after BX31_RECOVERY_BACKOFF_MS */
+static void test_notBX31() {
+        test_module(true, false, factory, "ESP32");
+        le_stub_verbose = false;                                                // the errors are expected
+        BX31_Device_t *dev = test_start();
+        le_stub_verbose = true;
+
+        CHECK_EQ(dev->state, BX31_STATE_OPEN);                                  // closed, opened again on the retry
+        CHECK_EQ(module.writes, 0);
+        CHECK_EQ(module.scans, 0);
+        CHECK_EQ(bx31at_getTimeToFirstScan(), 0);
+        CHECK(le_timer_IsRunning(dev->startupTimerRef));
+        CHECK_EQ(le_timer_GetMsInterval(dev->startupTimerRef), BX31_RECOVERY_BACKOFF_MS);
+        test_stop();
+}
+
+/* --- benchmark --- */
+
+/* the startup before: reset, sleep(0.2) (truncated to 0), sleep(2), all settings written, scan timer */
+static uint32_t bench_oldStartup() {
+        static const char *const commands[] = { "AT", "ATI", "AT+SRWCFG=0", "AT+SRBTSYSTEM=1", "AT+SRBTPS=0",
+                                                "AT+SRBLEADV=1", "AT+SRBLEADV=0" };
+        le_atClient_CmdRef_t cmdRef = le_atClient_Create();
+        le_atClient_DeviceRef_t devRef;
+        int fd = le_tty_Open(BX31_SERIAL_DEVICE, O_RDWR);
+        uint32_t start;
+
+        nowMs = 0;
+        test_advance(1000);
+        start = nowMs;
+        gpio_bx_enable_Deactivate();
+        gpio_bx_enable_Activate();
+        test_advance(2000);
+        devRef = le_atClient_Start(fd);
+        for (size_t i = 0; i < NUM_ARRAY_MEMBERS(commands); ++i) {
+                LE_ASSERT_OK(le_atClient_SetCommandAndSend(&cmdRef, devRef, commands[i], "", "OK|ERROR|+CME ERROR",
+                                                           LE_ATDEFS_COMMAND_DEFAULT_TIMEOUT));
+        }
+        le_atClient_Stop(devRef);
+        test_advance(BX31_SCAN_TIMER_MS);                                       // the first scan on the scan timer
+        return nowMs - start;
+}
+
+static void bench_startup(const char *name, bool hangs, const char *const *settings) {
+        test_module(true, hangs, settings, "BX310x");
+        test_start();
+        printf("%-28s first scan after %5u ms, %2u commands, %u settings written, %u resets\n",
+               name, bx31at_getTimeToFirstScan(), module.commands - 1, module.writes, module.resets);
+        test_stop();
+}
+
+int main(int argc, char **argv) {
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                printf("module answers in %u ms, boots in %u ms\n", TEST_ANSWER_MS, TEST_BOOT_MS);
+                bench_startup("warm, configured", false, configured);
+                bench_startup("warm, factory settings", false, factory);
+                bench_startup("hangs, reset via GPIO", true, configured);
+                test_module(true, false, factory, "BX310x");
+                uint32_t oldMs = bench_oldStartup();
+                printf("%-28s first scan after %5u ms, %2u commands, %u settings written, %u resets\n",
+                       "before (any module)", oldMs, module.commands, module.writes, module.resets);
+                return 0;
+        }
+
+        TEST_RUN(test_warmConfigured);
+        TEST_RUN(test_warmFactory);
+        TEST_RUN(test_hungModule);
+        TEST_RUN(test_notBX31);
+        return test_failures > 0;
+}
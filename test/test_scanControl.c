@@ -0,0 +1,435 @@
+/*
+ * test_scanControl.c
+ *
+ * Host test of the adaptive scan controller (ScanControl.c). The window
+ * and interval it hands to the scanner are caught by a fake of
+ * bx31at_setScanTiming().
+ *
+ * The tests check the rules of scanctl_update() one by one - back off
+ * below SCANCTL_CHURN_LOW, step up in between, jump to the top level from
+ * SCANCTL_CHURN_HIGH on - the window and interval of each level within
+ * the bounds, scanctl_setBounds() and the longer expiry interval kept
+ * after stepping up. Then the controller is run in a closed loop against
+ * a simulated station population, as tools/scanctl_sim.py does it but on
+ * the C code: the stations arrive and leave at random with a quiet, a
+ * busy and a quiet phase, the radio hears them with the window and
+ * interval of the controller (missing 5% of them in a scan), each check
+ * (every MAX_BT_STATION_AGE, as the janitor timer) expires the stations
+ * as btmgr_expireStations() and feeds the added / removed counts back.
+ * The quiet phases have to settle at the lowest levels, the busy phase
+ * has to reach the top level and detect its stations faster than the
+ * quietest level would. With -b the duty cycle and detection latency of
+ * each phase are printed, and of each fixed level on the busy phase.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "test.h"
+#include "ScanControl.h"
+#include "BTStationManager.h"
+#include <math.h>
+
+#define TEST_STATIONS 500                                // population size of the simulation
+#define TEST_MISS 0.05                                   // a station is not heard in a scan
+#define TEST_PHASES 3
+#define TEST_SEEDS 10                                    // simulation runs checked
+
+unsigned int test_failures;
+
+/* --- fake of the scanner --- */
+
+static unsigned int window, interval, timings;
+
+void bx31at_setScanTiming(unsigned int newWindow, unsigned int newInterval) {
+        window = newWindow;
+        interval = newInterval;
+        ++timings;
+}
+
+/* --- simulation --- */
+
+typedef struct {
+	const char *name;
+	double seconds;
+	double lifetime;                               // mean time a station stays
+	double start, end;
+	double busy;                                   // time the radio scanned
+	double *latencies;                             // arrival until first heard
+	size_t detected;
+	size_t missed;                                 // left without being heard
+	unsigned int levels[200];                      // level after each check
+	size_t checks;
+} sim_Phase_t;
+
+typedef struct {
+	double arrival, departure;
+	double pending;                                // last sighting not yet taken by a check, < 0 if none
+	double previous;                               // the one before, not taken either
+	double lastSeen;                               // in the table since, < 0 if not
+	bool heard;
+} sim_Station_t;
+
+static uint32_t seed;
+static time_t epoch;                                   // relative time of a run's start - the clock never goes back
+
+static double sim_uniform() {                                                   // (0, 1)
+        return (test_random(&seed) + 0.5) / 4294967296.0;
+}
+
+static double sim_exponential(double mean) {
+        return -log(sim_uniform()) * mean;
+}
+
+static void sim_setTime(double t) {
+        le_stub_setTime(epoch + (time_t) t, (long) ((t - (time_t) t) * 1e6));
+}
+
+static unsigned int levelWindows[SCANCTL_LEVELS];                              // window of each level
+
+/* the window of each level, as reached by quiet checks from the top - at the default bounds */
+static void sim_levels() {
+        scanctl_init();
+        for (unsigned int level = SCANCTL_LEVELS; level-- > 0; scanctl_update(0, 0, 100)) {
+                levelWindows[level] = window;
+        }
+}
+
+/* the level of the controller, told by its window */
+static unsigned int sim_level() {
+        unsigned int level = 0;
+
+        while (level < SCANCTL_LEVELS - 1 && levelWindows[level] != window) ++level;
+        return level;
+}
+
+/* the population: TEST_STATIONS at the start, arrivals so the size stays, with the lifetime of each phase */
+static sim_Station_t *sim_population(sim_Phase_t *phases, size_t count, size_t *stationsPtr) {
+        size_t capacity = 4 * TEST_STATIONS, stations = 0;
+        sim_Station_t *population = malloc(capacity * sizeof(sim_Station_t));
+
+        LE_ASSERT(population != NULL);
+        for (size_t i = 0; i < TEST_STATIONS; ++i) {
+                population[stations++] = (sim_Station_t) { 0, sim_exponential(phases[0].lifetime), -1, -1, -1, false };
+        }
+        for (size_t p = 0; p < count; ++p) {
+                for (double t = phases[p].start + sim_exponential(phases[p].lifetime / TEST_STATIONS);
+                     t < phases[p].end; t += sim_exponential(phases[p].lifetime / TEST_STATIONS)) {
+                        if (stations == capacity) {
+                                capacity *= 2;
+                                LE_ASSERT((population = realloc(population, capacity * sizeof(sim_Station_t))) != NULL);
+                        }
+                        population[stations++] = (sim_Station_t) { t, t + sim_exponential(phases[p].lifetime),
+                                                                   -1, -1, -1, false };
+                }
+        }
+        *stationsPtr = stations;
+        return population;
+}
+
+static sim_Phase_t *sim_phaseAt(sim_Phase_t *phases, size_t count, double t) {
+        for (size_t p = 0; p < count; ++p) {
+                if (phases[p].start <= t && t < phases[p].end) return &phases[p];
+        }
+        return NULL;
+}
+
+/* a check of the station manager - sightings taken, stations expired, churn handed to the controller */
+static void sim_check(sim_Station_t *population, size_t stations, double now, bool adapt) {
+        unsigned int added = 0, removed = 0, inTable = 0;
+        double maxAge;
+
+        sim_setTime(now);
+        maxAge = 2.0 * scanctl_getExpiryInterval();
+        if (maxAge < MAX_BT_STATION_AGE) maxAge = MAX_BT_STATION_AGE;
+
+        for (size_t i = 0; i < stations; ++i) {
+                sim_Station_t *station = &population[i];
+
+                double seen = -1;
+
+                if (station->pending >= 0 && station->pending <= now) {                 // only the last scan can
+                        seen = station->pending;                                        // still be running
+                        station->pending = -1;
+                } else {
+                        seen = station->previous;
+                }
+                station->previous = -1;
+                if (seen >= 0) {
+                        if (station->lastSeen < 0) ++added;
+                        station->lastSeen = seen;
+                }
+                if (station->lastSeen >= 0 && now - station->lastSeen > maxAge) {
+                        station->lastSeen = -1;
+                        ++removed;
+                }
+                if (station->lastSeen >= 0) ++inTable;
+        }
+        if (adapt) scanctl_update(added, removed, inTable);
+}
+
+/*
+ * runs the phases - adapting, or at a fixed level if level < SCANCTL_LEVELS
+ */
+static void sim_run(sim_Phase_t *phases, size_t count, unsigned int level) {
+        double end, scanStart = 0, nextCheck = MAX_BT_STATION_AGE;
+        size_t stations;
+        sim_Station_t *population;
+
+        for (size_t p = 0, start = 0; p < count; start += phases[p++].seconds) {
+                phases[p].start = start;
+                phases[p].end = start + phases[p].seconds;
+                phases[p].busy = 0;
+                phases[p].detected = phases[p].missed = phases[p].checks = 0;
+        }
+        end = phases[count - 1].end;
+        population = sim_population(phases, count, &stations);
+        for (size_t p = 0; p < count; ++p) {
+                phases[p].latencies = malloc(stations * sizeof(double));
+                LE_ASSERT(phases[p].latencies != NULL);
+        }
+
+        epoch = le_clk_GetRelativeTime().sec + 1000;
+        sim_setTime(0);
+        scanctl_init();
+        for (unsigned int l = SCANCTL_LEVELS - 1; level < SCANCTL_LEVELS && l > level; --l) {
+                scanctl_update(0, 0, 100);                                      // down to the fixed level
+        }
+
+        while (scanStart < end) {
+                double scanEnd = scanStart + window;
+                sim_Phase_t *phase = sim_phaseAt(phases, count, scanStart);
+
+                for (size_t i = 0; i < stations; ++i) {                         // the scan
+                        sim_Station_t *station = &population[i];
+                        double first = station->arrival > scanStart ? station->arrival : scanStart;
+                        double last = station->departure < scanEnd ? station->departure : scanEnd;
+
+                        if (last <= first || sim_uniform() < TEST_MISS) continue;
+                        station->previous = station->pending;
+                        station->pending = first + (last - first) * sim_uniform();
+                        if (!station->heard) {
+                                sim_Phase_t *arrivalPhase = sim_phaseAt(phases, count, station->arrival);
+
+                                station->heard = true;
+                                if (arrivalPhase != NULL) {
+                                        arrivalPhase->latencies[arrivalPhase->detected++] =
+                                                station->pending - station->arrival;
+                                }
+                        }
+                }
+                if (phase != NULL) phase->busy += scanEnd < end ? window : end - scanStart;
+                scanStart += interval;
+
+                for (; nextCheck <= scanStart && nextCheck <= end; nextCheck += MAX_BT_STATION_AGE) {
+                        sim_check(population, stations, nextCheck, level >= SCANCTL_LEVELS);
+                        phase = sim_phaseAt(phases, count, nextCheck - 1e-9);
+                        if (phase != NULL && phase->checks < NUM_ARRAY_MEMBERS(phase->levels)) {
+                                phase->levels[phase->checks++] = sim_level();
+                        }
+                }
+        }
+
+        for (size_t i = 0; i < stations; ++i) {
+                sim_Phase_t *phase = sim_phaseAt(phases, count, population[i].arrival);
+                if (phase != NULL && !population[i].heard && population[i].departure < end) ++phase->missed;
+        }
+        free(population);
+}
+
+static void sim_free(sim_Phase_t *phases, size_t count) {
+        for (size_t p = 0; p < count; ++p) free(phases[p].latencies);
+}
+
+static double sim_mean(const sim_Phase_t *phase) {
+        double sum = 0;
+
+        for (size_t i = 0; i < phase->detected; ++i) sum += phase->latencies[i];
+        return phase->detected > 0 ? sum / phase->detected : NAN;
+}
+
+static int sim_compare(const void *a, const void *b) {
+        double x = *(const double *) a, y = *(const double *) b;
+        return x < y ? -1 : x > y;
+}
+
+static double sim_p95(sim_Phase_t *phase) {
+        if (phase->detected == 0) return NAN;
+        qsort(phase->latencies, phase->detected, sizeof(double), sim_compare);
+        return phase->latencies[phase->detected * 95 / 100];
+}
+
+static void sim_phases(sim_Phase_t *phases) {
+        static const sim_Phase_t scenario[TEST_PHASES] = {              // as the default of tools/scanctl_sim.py
+                { "quiet", 900, 3600 }, { "busy", 300, 60 }, { "quiet", 900, 3600 }
+        };
+
+        memcpy(phases, scenario, sizeof(scenario));
+}
+
+/* --- tests --- */
+
+static void test_rules() {
+        const unsigned int top = SCANCTL_LEVELS - 1;
+
+        scanctl_init();                                                         // start busy, the table is empty
+        CHECK_EQ(window, SCANCTL_WINDOW_MAX);
+        CHECK_EQ(interval, SCANCTL_WINDOW_MAX);                                 // back to back
+
+        for (unsigned int level = top; level > 0; --level) {                    // quiet - a level back per check
+                unsigned int previousWindow = window, previousInterval = interval;
+
+                scanctl_update(SCANCTL_CHURN_LOW - 1, 0, 100);
+                CHECK_EQ(sim_level(), level - 1);
+                CHECK(window < previousWindow && interval > previousInterval);
+                CHECK(window >= SCANCTL_WINDOW_MIN && interval <= SCANCTL_INTERVAL_MAX && window <= interval);
+        }
+        CHECK_EQ(window, SCANCTL_WINDOW_MIN);
+        CHECK_EQ(interval, SCANCTL_INTERVAL_MAX);
+
+        timings = 0;
+        scanctl_update(0, 0, 100);                                              // stays at level 0, timing not set again
+        CHECK_EQ(sim_level(), 0);
+        CHECK_EQ(timings, 0);
+        scanctl_update(SCANCTL_CHURN_LOW, 0, 100);                              // some churn - a level up per check
+        CHECK_EQ(sim_level(), 1);
+        scanctl_update(0, SCANCTL_CHURN_HIGH - 1, 100);
+        CHECK_EQ(sim_level(), 2);
+        scanctl_update(199, 0, 10000);                                          // 1.99% - below the threshold
+        CHECK_EQ(sim_level(), 1);
+        scanctl_update(SCANCTL_CHURN_HIGH / 2, SCANCTL_CHURN_HIGH - SCANCTL_CHURN_HIGH / 2, 100);
+        CHECK_EQ(sim_level(), top);                                             // high churn - straight to the top
+        scanctl_update(0, 0, 0);                                                // empty table, nothing changed
+        CHECK_EQ(sim_level(), top - 1);
+        scanctl_update(1, 0, 0);                                                // a station in an empty table
+        CHECK_EQ(sim_level(), top);
+}
+
+static void test_bounds() {
+        scanctl_init();
+        scanctl_setBounds(3, 8, 30);
+        CHECK_EQ(window, 8);
+        CHECK_EQ(interval, 8);
+        for (unsigned int level = 0; level < SCANCTL_LEVELS; ++level) scanctl_update(0, 0, 100);
+        CHECK_EQ(window, 3);
+        CHECK_EQ(interval, 30);
+
+        timings = 0;                                                            // invalid bounds are ignored
+        le_stub_verbose = false;
+        scanctl_setBounds(0, 8, 30);
+        scanctl_setBounds(9, 8, 30);
+        scanctl_setBounds(3, 8, 7);
+        le_stub_verbose = true;
+        CHECK_EQ(timings, 0);
+        CHECK_EQ(window, 3);
+
+        scanctl_setBounds(SCANCTL_WINDOW_MIN, SCANCTL_WINDOW_MAX, SCANCTL_INTERVAL_MAX);
+}
+
+/* stepping up from the slow scans - the stations are expired by the long interval for two of them */
+static void test_expiryInterval() {
+        sim_setTime(1000);
+        scanctl_init();
+        for (unsigned int level = 0; level < SCANCTL_LEVELS; ++level) scanctl_update(0, 0, 100);
+        CHECK_EQ(scanctl_getExpiryInterval(), SCANCTL_INTERVAL_MAX);
+
+        scanctl_update(SCANCTL_CHURN_HIGH, 0, 100);
+        CHECK_EQ(interval, SCANCTL_WINDOW_MAX);
+        CHECK_EQ(scanctl_getExpiryInterval(), SCANCTL_INTERVAL_MAX);
+        sim_setTime(1000 + 2 * SCANCTL_INTERVAL_MAX - 1);
+        CHECK_EQ(scanctl_getExpiryInterval(), SCANCTL_INTERVAL_MAX);
+        sim_setTime(1000 + 2 * SCANCTL_INTERVAL_MAX);
+        CHECK_EQ(scanctl_getExpiryInterval(), SCANCTL_WINDOW_MAX);
+
+        scanctl_update(0, 0, 100);                                              // longer again - taken right away
+        CHECK_EQ(scanctl_getExpiryInterval(), interval);
+}
+
+/* closed loop: the quiet phases settle at level 0 / 1, the busy phase reaches the top and detects faster */
+static void test_simulation() {
+        const unsigned int reaction = SCANCTL_INTERVAL_MAX / MAX_BT_STATION_AGE + 2;    // checks until the stations of
+                                                                                        // the busy phase were counted
+        for (seed = 1; seed <= TEST_SEEDS; ++seed) {
+                sim_Phase_t phases[TEST_PHASES], fixed[TEST_PHASES];
+                bool reached = false;
+
+                sim_phases(phases);
+                sim_run(phases, TEST_PHASES, SCANCTL_LEVELS);
+                sim_phases(fixed);
+                seed += 1000;                                                   // another population, same phases
+                sim_run(fixed, TEST_PHASES, 0);
+                seed -= 1000;
+
+                for (size_t p = 0; p < TEST_PHASES; p += 2) {                   // the quiet ones
+                        size_t backedOff = 0, settled = phases[p].checks - phases[p].checks / 2;
+
+                        for (size_t i = phases[p].checks / 2; i < phases[p].checks; ++i) {
+                                if (phases[p].levels[i] <= 1) ++backedOff;
+                        }
+                        CHECK(3 * backedOff >= 2 * settled);
+                }
+                CHECK(phases[1].busy / phases[1].seconds > phases[0].busy / phases[0].seconds);
+                for (size_t i = 0; i < reaction && i < phases[1].checks; ++i) {
+                        if (phases[1].levels[i] == SCANCTL_LEVELS - 1) reached = true;
+                }
+                CHECK(reached);
+                CHECK(sim_mean(&phases[1]) < sim_mean(&fixed[1]));
+                sim_free(phases, TEST_PHASES);
+                sim_free(fixed, TEST_PHASES);
+        }
+}
+
+/* --- benchmark --- */
+
+static void bench_phases() {
+        sim_Phase_t phases[TEST_PHASES];
+
+        seed = 1;
+        sim_phases(phases);
+        sim_run(phases, TEST_PHASES, SCANCTL_LEVELS);
+
+        printf("adaptive: thresholds %d%% / %d%%, %d levels, window %d..%d s, interval max %d s, check every %d s, "
+               "%d stations\n", SCANCTL_CHURN_LOW, SCANCTL_CHURN_HIGH, SCANCTL_LEVELS, SCANCTL_WINDOW_MIN,
+               SCANCTL_WINDOW_MAX, SCANCTL_INTERVAL_MAX, MAX_BT_STATION_AGE, TEST_STATIONS);
+        for (size_t p = 0; p < TEST_PHASES; ++p) {
+                unsigned int minLevel = SCANCTL_LEVELS, maxLevel = 0;
+
+                for (size_t i = 0; i < phases[p].checks; ++i) {
+                        if (phases[p].levels[i] < minLevel) minLevel = phases[p].levels[i];
+                        if (phases[p].levels[i] > maxLevel) maxLevel = phases[p].levels[i];
+                }
+                printf("%-6s %4.0f s, lifetime %4.0f s: levels %u..%u, duty %5.1f%%, latency %5.1f s (p95 %5.1f s), "
+                       "%zu missed\n", phases[p].name, phases[p].seconds, phases[p].lifetime, minLevel, maxLevel,
+                       100.0 * phases[p].busy / phases[p].seconds, sim_mean(&phases[p]), sim_p95(&phases[p]),
+                       phases[p].missed);
+        }
+        sim_free(phases, TEST_PHASES);
+
+        for (unsigned int level = 0; level < SCANCTL_LEVELS; ++level) {        // each level on the busy phase alone
+                sim_Phase_t busy[1];
+
+                seed = 1;
+                sim_phases(phases);
+                busy[0] = phases[1];
+                sim_run(busy, 1, level);
+                printf("fixed level %u on the busy phase: window %2u s, interval %2u s, duty %5.1f%%, "
+                       "latency %5.1f s (p95 %5.1f s), %zu missed\n", level, window, interval,
+                       100.0 * busy[0].busy / busy[0].seconds, sim_mean(&busy[0]), sim_p95(&busy[0]),
+                       busy[0].missed);
+                sim_free(busy, 1);
+        }
+}
+
+int main(int argc, char **argv) {
+        sim_levels();
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                bench_phases();
+                return 0;
+        }
+
+        TEST_RUN(test_rules);
+        TEST_RUN(test_bounds);
+        TEST_RUN(test_expiryInterval);
+        TEST_RUN(test_simulation);
+        return test_failures > 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * test_scanParser.c
+ *
+ * Host test of the single pass +SRBLESCAN parser (ScanParser.c). The
+ * parser is checked against the strtok / sscanf based parser it replaced,
+ * which is kept here (bx31old_*) as it was in BX31_ATServiceComponent.c,
+ * only its result pool is created by the test. With -b the lines/s of both
+ * are measured.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "test.h"
+#include "BX31_ATServiceComponent.h"
+
+#define TEST_LINE_MAX 1024
+#define TEST_LINES 1024                                  // distinct lines of the comparison and the benchmark
+#define TEST_BENCH_SECONDS 1.0                           // per parser and advert length
+
+unsigned int test_failures;
+
+static le_mem_PoolRef_t scannedBTStationsPool;
+
+/** ------------------------------------------------------------------------
+ *
+ * The parser before the single pass parser - unchanged, except for the
+ * bx31old_ prefix and without its DEBUG_BX31 output
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static uint64_t bx31old_btAddrToInt(char *addrStr) {
+
+        uint64_t result = 0;
+
+        if (addrStr == NULL) {
+                LE_ERROR("NULL pointer given for addr string");
+                return 0;
+        }
+
+        if (strnlen(addrStr, 20) < 19) {                                        // addr str including quotes
+                LE_ERROR("Problem parsing BT address to int Addr Str was: %s",
+                         addrStr);
+                return 0;
+        }
+
+        if (addrStr[0] == '\"') ++addrStr;                                      // remove leading quote
+        if (addrStr[17] == '\"') addrStr[17] = 0;                               // remove tailing quote
+
+        int oct[6];
+        if (sscanf
+            (addrStr, "%x:%x:%x:%x:%x:%x", &oct[5], &oct[4], &oct[3], &oct[2],
+             &oct[1], &oct[0]) < 6) {
+
+                LE_ERROR("Problem parsing BT address to int Addr Str was: %s",
+                         addrStr);
+
+                return 0;
+        }
+
+        for (int i = 5; i >= 0; i--) {
+                result |= (uint64_t) oct[i] << (CHAR_BIT * i);
+        }
+
+        return result;
+}
+
+static int bx31old_escapedAdvrtStr2Binary(char *escapedStrIn, char *dstBuffer) {
+
+        if (escapedStrIn == NULL) {
+                LE_ERROR("NULL pointer given for escaped string ");
+                return 0;
+        }
+
+        if (escapedStrIn[0] == '\"') ++escapedStrIn;                            // remove leading quote if present
+
+        if (escapedStrIn
+            [strnlen(escapedStrIn, MAX_BT_DATA_STRING_SIZE * 3 + 1) - 1] ==
+            '\"')
+                escapedStrIn[strnlen(escapedStrIn, MAX_BT_DATA_STRING_SIZE * 3 + 1) - 1] = 0; // remove tailing quote if present
+
+        int numberOfEscapedCharacters = 0;
+
+        int escapedStrlen =
+            strnlen(escapedStrIn, MAX_BT_DATA_STRING_SIZE * 3 + 1);
+        for (int i = 0; i <= escapedStrlen; ++i) {                              // counting the number of escaped bytes in the
+                                                                                // advertisement message
+                if (escapedStrIn[i] == '\\') {
+                        ++numberOfEscapedCharacters;
+                        escapedStrIn[i] = 0;
+                }
+        }
+
+        for (int i = 0; i < numberOfEscapedCharacters; ++i) {                   // read the escaped advertisement string and convert
+                                                                                // it to binary
+                dstBuffer[i] =
+                    (char)strtol(escapedStrIn + (i * 3) + 1, NULL, 16);
+        }
+
+        return numberOfEscapedCharacters;
+}
+
+static BTScanResult_t *bx31old_tokenizeScanResult(char *buffer) {
+
+        if (strncmp(buffer, "+SRBLESCAN: ", 12) != 0) {
+                LE_ERROR("The given buffer seems not to contain a BX31 scan result, "
+                            "it should start with \"+SRBLESCAN:\", given buffer was \"%s\".",
+                     buffer);
+
+                return NULL;
+        }
+
+        BTScanResult_t *scanResult;
+        scanResult = le_mem_TryAlloc(scannedBTStationsPool);                    // storage for the result
+        if (scanResult == NULL) {
+
+                LE_ERROR("Problem to allocate memory from Pool "
+                                "for tokenizeScanResult");
+
+                return NULL;
+        }
+
+        char *parameter = strtok(buffer + 12, ",");                             // get the first parameter (BT address) from the
+                                                                                // unsolicited string
+        if ((scanResult->btStationAddress = bx31old_btAddrToInt(parameter)) == 0) {
+
+                LE_ERROR("Problem to tokenize BL Scan String , "
+                                "could not extract BL Address");
+
+                le_mem_Release(scanResult);
+                return NULL;
+        }
+
+        parameter = strtok(NULL, ",");                                          // get the address type from the unsolicited string
+        if (parameter == NULL) {
+
+                LE_ERROR("Problem to tokenize BL Scan String , "
+                            "could not extract BL Address type");
+
+                le_mem_Release(scanResult);
+                return NULL;
+        }
+
+        scanResult->addrType = strtol(parameter, NULL, 10);
+        if ((scanResult->addrType != BX31_BT_PUBLIC_ADDR)
+            && (scanResult->addrType != BX31_BT_PRIVATE_ADDR)) {
+
+                LE_ERROR("Problem to tokenize BL Scan String , "
+                                "could not extract BL Address type");
+
+                le_mem_Release(scanResult);
+                return NULL;
+        }
+
+        parameter = strtok(NULL, ",");                                          // get RSSI from the unsolicited string
+        if (parameter == NULL) {
+
+                LE_ERROR("Problem to tokenize BL Scan String , "
+                                "could not extract RSSI");
+
+                le_mem_Release(scanResult);
+                return NULL;
+        }
+        scanResult->rssi = strtol(parameter, NULL, 10);
+
+        parameter = strtok(NULL, ",");                                          // get BT advertisement data from the unsolicited
+                                                                                // string and pack it (string to binary)
+        if (parameter == NULL) {
+
+                LE_ERROR("Problem to tokenize BL Scan String , "
+                                "could not extract RSSI");
+
+                le_mem_Release(scanResult);
+                return NULL;
+        }
+        scanResult->data_len = bx31old_escapedAdvrtStr2Binary(parameter, scanResult->advertData);
+
+        return scanResult;
+}
+
+/** ------------------------------------------------------------------------
+ *
+ * Formats a +SRBLESCAN line as the BX31 sends it (see tools/bx31_sim.py)
+ *
+ * @return length of the line
+ *
+ * ------------------------------------------------------------------------
+ */
+
+static size_t test_makeLine(char *line, uint64_t addr, int addrType, int rssi,
+                            const uint8_t *data, int dataLen) {
+        int len = sprintf(line, "+SRBLESCAN: \"%02x:%02x:%02x:%02x:%02x:%02x\",%d,%d,\"",
+                          (unsigned int) (addr >> 40) & 0xff, (unsigned int) (addr >> 32) & 0xff,
+                          (unsigned int) (addr >> 24) & 0xff, (unsigned int) (addr >> 16) & 0xff,
+                          (unsigned int) (addr >> 8) & 0xff, (unsigned int) addr & 0xff,
+                          addrType, rssi);
+
+        for (int i = 0; i < dataLen; ++i) {
+                len += sprintf(line + len, "\\%02X", data[i]);
+        }
+        line[len++] = '\"';
+        line[len] = '\0';
+        return len;
+}
+
+static uint64_t test_fingerprint(int addrType, const char *data, int dataLen) {
+        uint64_t fingerprint = BX31_FINGERPRINT_ADD(BX31_FINGERPRINT_OFFSET, addrType);
+
+        for (int i = 0; i < dataLen; ++i) {
+                fingerprint = BX31_FINGERPRINT_ADD(fingerprint, data[i]);
+        }
+        return BX31_FINGERPRINT_ADD(fingerprint, dataLen);
+}
+
+/* random station, advert length 1..maxLen */
+static size_t test_randomLine(char *line, uint32_t *seed, int maxLen) {
+        uint8_t data[MAX_BT_DATA_STRING_SIZE];
+        uint64_t addr = ((uint64_t) test_random(seed) << 16 ^ test_random(seed)) & 0xffffffffffffULL;
+        int dataLen = 1 + test_random(seed) % maxLen;
+
+        for (int i = 0; i < dataLen; ++i) data[i] = test_random(seed);
+        return test_makeLine(line, addr | 1, test_random(seed) % 2, -(int) (test_random(seed) % 100),
+                             data, dataLen);
+}
+
+/* --- tests --- */
+
+static void test_fields() {
+        static const char line[] = "+SRBLESCAN: \"29:db:3c:cd:01:5a\",   1,     -53,"
+                                   "\"\\1E\\FF\\06\\00\\01\\09\\20\\02\\77\"";
+        static const char data[] = { 0x1e, (char) 0xff, 0x06, 0x00, 0x01, 0x09, 0x20, 0x02, 0x77 };
+        BTScanResult_t result;
+
+        CHECK_EQ(bx31at_parseScanResult(line, sizeof(line) - 1, &result), LE_OK);
+        CHECK_EQ(result.btStationAddress, 0x29db3ccd015aULL);
+        CHECK_EQ(result.addrType, BX31_BT_PRIVATE_ADDR);
+        CHECK_EQ(result.rssi, -53);
+        CHECK_EQ(result.data_len, sizeof(data));
+        CHECK(memcmp(result.advertData, data, sizeof(data)) == 0);
+        CHECK_EQ(result.fingerprint, test_fingerprint(1, data, sizeof(data)));
+
+        static const char publicLine[] = "+SRBLESCAN: \"00:00:00:00:00:01\",0,+7,\"\"\r\n";
+
+        CHECK_EQ(bx31at_parseScanResult(publicLine, sizeof(publicLine) - 1, &result), LE_OK);
+        CHECK_EQ(result.btStationAddress, 1);
+        CHECK_EQ(result.addrType, BX31_BT_PUBLIC_ADDR);
+        CHECK_EQ(result.rssi, 7);
+        CHECK_EQ(result.data_len, 0);
+}
+
+static void test_againstOldParser() {
+        uint32_t seed = 0x5ca11ed;
+        char line[TEST_LINE_MAX], copy[TEST_LINE_MAX];
+        BTScanResult_t result;
+
+        for (int i = 0; i < TEST_LINES; ++i) {
+                size_t len = test_randomLine(line, &seed, BX31_LEGACY_ADVERT_LEN);
+
+                memcpy(copy, line, len + 1);                                    // the old parser writes into the line
+                BTScanResult_t *old = bx31old_tokenizeScanResult(copy);
+
+                CHECK(old != NULL);
+                CHECK_EQ(bx31at_parseScanResult(line, len, &result), LE_OK);
+                if (old == NULL) continue;
+
+                CHECK_EQ(result.btStationAddress, old->btStationAddress);
+                CHECK_EQ(result.addrType, old->addrType);
+                CHECK_EQ(result.rssi, old->rssi);
+                CHECK_EQ(result.data_len, old->data_len);
+                CHECK(memcmp(result.advertData, old->advertData, old->data_len) == 0);
+                CHECK_EQ(result.fingerprint, test_fingerprint(old->addrType, old->advertData, old->data_len));
+                le_mem_Release(old);
+        }
+}
+
+static void test_overflow() {
+        uint8_t data[MAX_BT_DATA_STRING_SIZE + 1];
+        char line[TEST_LINE_MAX];
+        BTScanResult_t result;
+        size_t len;
+
+        for (int i = 0; i < MAX_BT_DATA_STRING_SIZE + 1; ++i) data[i] = i;
+
+        len = test_makeLine(line, 0x112233445566ULL, 0, -70, data, MAX_BT_DATA_STRING_SIZE);
+        CHECK_EQ(bx31at_parseScanResult(line, len, &result), LE_OK);
+        CHECK_EQ(result.data_len, MAX_BT_DATA_STRING_SIZE);
+        CHECK(memcmp(result.advertData, data, MAX_BT_DATA_STRING_SIZE) == 0);
+
+        len = test_makeLine(line, 0x112233445566ULL, 0, -70, data, MAX_BT_DATA_STRING_SIZE + 1);
+        CHECK_EQ(bx31at_parseScanResult(line, len, &result), LE_OVERFLOW);
+}
+
+static void test_malformed() {
+        static const char *const lines[] = {
+                "",
+                "+SRBLESCAN",
+                "+SRBLESCAN:",
+                "+SRBLESCAN_NONE: \"29:db:3c:cd:01:5a\",1,-53,\"\\1E\"",
+                "+SRBLESCAX: \"29:db:3c:cd:01:5a\",1,-53,\"\\1E\"",
+                "+SRBLESCAN: \"29:db:3c:cd:01\",1,-53,\"\\1E\"",               // 5 octets
+                "+SRBLESCAN: \"29-db-3c-cd-01-5a\",1,-53,\"\\1E\"",
+                "+SRBLESCAN: \"zz:db:3c:cd:01:5a\",1,-53,\"\\1E\"",
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",2,-53,\"\\1E\"",             // addr type out of range
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",x,-53,\"\\1E\"",
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1,,\"\\1E\"",
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1,-,\"\\1E\"",
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1;-53,\"\\1E\"",
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1,-53",                      // no advert data
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1,-53,\"\\1G\"",             // not a hex digit
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1,-53,\"\\1",                // cut in an escape
+                "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1,-53,\"\\",
+        };
+        BTScanResult_t result;
+
+        for (size_t i = 0; i < NUM_ARRAY_MEMBERS(lines); ++i) {
+                le_result_t res = bx31at_parseScanResult(lines[i], strlen(lines[i]), &result);
+
+                if (res != LE_FORMAT_ERROR) fprintf(stderr, "accepted: %s\n", lines[i]);
+                CHECK_EQ(res, LE_FORMAT_ERROR);
+        }
+}
+
+/* every line cut before the advert data is rejected, the parser reads only len characters */
+static void test_shortLines() {
+        static const char full[] = "+SRBLESCAN: \"29:db:3c:cd:01:5a\",1,-53,\"\\1E\\FF\\06\"";
+        const size_t dataStart = strstr(full, ",\"\\") - full + 1;
+        char *line;
+        BTScanResult_t result;
+
+        for (size_t len = 0; len < dataStart; ++len) {
+                line = malloc(len > 0 ? len : 1);                               // no terminator, an overread shows in ASan / valgrind
+                memcpy(line, full, len);
+                CHECK_EQ(bx31at_parseScanResult(line, len, &result), LE_FORMAT_ERROR);
+                free(line);
+        }
+
+        for (size_t len = dataStart; len < sizeof(full) - 2; ++len) {           // cut in the advert data - complete bytes are kept
+                int dataChars = len > dataStart ? (int) (len - dataStart - 1) : 0;
+
+                line = malloc(len);
+                memcpy(line, full, len);
+                le_result_t res = bx31at_parseScanResult(line, len, &result);
+                CHECK_EQ(res, dataChars % 3 != 0 ? LE_FORMAT_ERROR : LE_OK);
+                if (res == LE_OK) CHECK_EQ(result.data_len, dataChars / 3);
+                free(line);
+        }
+}
+
+/* --- benchmark --- */
+
+static void bench_parsers(int maxLen) {
+        static char lines[TEST_LINES][TEST_LINE_MAX];
+        static size_t lens[TEST_LINES];
+        uint32_t seed = 0xbe4c4;
+        char copy[TEST_LINE_MAX];
+        BTScanResult_t result;
+        double start, newSeconds, oldSeconds;
+        uint64_t newLines = 0, oldLines = 0;
+
+        for (int i = 0; i < TEST_LINES; ++i) {
+                lens[i] = test_randomLine(lines[i], &seed, maxLen);
+        }
+
+        start = test_now();
+        do {
+                for (int i = 0; i < TEST_LINES; ++i) {
+                        if (bx31at_parseScanResult(lines[i], lens[i], &result) != LE_OK) abort();
+                }
+                newLines += TEST_LINES;
+        } while ((newSeconds = test_now() - start) < TEST_BENCH_SECONDS);
+
+        start = test_now();
+        do {
+                for (int i = 0; i < TEST_LINES; ++i) {
+                        memcpy(copy, lines[i], lens[i] + 1);                    // the AT client handed over a copy
+                        BTScanResult_t *old = bx31old_tokenizeScanResult(copy);
+                        if (old == NULL) abort();
+                        le_mem_Release(old);
+                }
+                oldLines += TEST_LINES;
+        } while ((oldSeconds = test_now() - start) < TEST_BENCH_SECONDS);
+
+        printf("adverts 1..%3d bytes: single pass %10.0f lines/s, old %10.0f lines/s, %.1fx\n",
+               maxLen, newLines / newSeconds, oldLines / oldSeconds,
+               (newLines / newSeconds) / (oldLines / oldSeconds));
+}
+
+int main(int argc, char **argv) {
+        scannedBTStationsPool = le_mem_CreatePool("ScannedBTStations", sizeof(BTScanResult_t));
+        le_mem_ExpandPool(scannedBTStationsPool, 1024);                         // MAX_SCANNED_STATION_MEM_POOL_SIZE
+
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                le_stub_verbose = false;
+                bench_parsers(BX31_LEGACY_ADVERT_LEN);
+                bench_parsers(MAX_BT_DATA_STRING_SIZE);
+                return 0;
+        }
+
+        TEST_RUN(test_fields);
+        TEST_RUN(test_againstOldParser);
+        TEST_RUN(test_overflow);
+        TEST_RUN(test_malformed);
+        TEST_RUN(test_shortLines);
+        return test_failures > 0;
+}
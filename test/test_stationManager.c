@@ -0,0 +1,834 @@
+/*
+ * test_stationManager.c
+ *
+ * Host test of the station manager (BTStationManager.c) on the real
+ * station table and payload slabs. BTStationManager.c is included, so the
+ * test can call the report sweep on its own. The btScan.api queries
+ * (StationQuery.c) are linked, they are served by the same thread. The
+ * modules around it (scan control, snapshot, station events, the BX31
+ * statistics) are replaced by the fakes below.
+ *
+ * The tests check the change detection, the report blob, the merge of
+ * the sightings of several radios, that the scan path - parser, scan
+ * queue and btmgr_updateList() - does not allocate once the stations are
+ * known, and the queries, inclusive cursors which go on while stations
+ * are removed. The heap allocations of everything linked are counted
+ * through -Wl,--wrap (see Makefile). With -b the cost per
+ * btmgr_updateList() and per reported station is measured, the
+ * fingerprint compare against the byte compare it replaced, the
+ * allocations per 1000 sightings against the pool object per scan line
+ * there was before, and the queries per second between the batches of
+ * scan results.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "test.h"
+#include "BTStationManager.c"
+#include "ScanQueue.h"
+
+#define TEST_BENCH_SECONDS 0.3                           // per measurement
+#define TEST_LINE_MAX 1024
+#define TEST_DELIVER_EVERY 64                            // scan results the main thread takes at once
+#define TEST_QUERY_STATIONS 5000                         // more than a query call looks at
+#define BENCH_CHURN 4                                    // stations lost and new per batch of scan results
+
+unsigned int test_failures;
+
+/* --- heap allocations of all objects linked, -Wl,--wrap=malloc,... --- */
+
+static uint64_t heapAllocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+        ++heapAllocations;
+        return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+        ++heapAllocations;
+        return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+        ++heapAllocations;
+        return __real_realloc(ptr, size);
+}
+
+/* --- fakes of the modules around the station manager --- */
+
+static unsigned int stationEvents;
+
+unsigned int scanctl_getExpiryInterval() { return SCANCTL_WINDOW_MIN; }
+unsigned int scanctl_getWindow() { return SCANCTL_WINDOW_MIN; }
+unsigned int scanctl_getInterval() { return SCANCTL_WINDOW_MIN; }
+void scanctl_update(unsigned int added, unsigned int removed, unsigned int stations) { }
+le_result_t snap_save(const char *path, uint32_t now, uint32_t lastReportTick, size_t maxBytes) { return LE_OK; }
+le_result_t snap_restore(const char *path, uint32_t now, uint32_t *lastReportTickPtr) { return LE_NOT_FOUND; }
+void stev_init() { }
+void stev_stationEvent(btScan_EventType_t type, uint32_t index, uint32_t tick) { ++stationEvents; }
+void stev_rssiChanged(uint32_t index, int8_t previousRssi, uint32_t tick) { }
+void stev_flush() { }
+void stev_getStats(stev_Stats_t *stats) { memset(stats, 0, sizeof(*stats)); }
+unsigned int bx31at_getDeviceCount() { return 1; }
+uint32_t bx31at_getTimeToFirstScan() { return 0; }
+uint32_t bx31at_getDroppedScanResults() { return 0; }
+uint32_t bx31at_getScanQueueHighWater() { return 0; }
+unsigned int bx31at_getScanDutyCycle() { return 100; }
+uint32_t bx31at_getRecoveryCount() { return 0; }
+uint32_t bx31at_getResetCount() { return 0; }
+uint64_t bx31at_getDowntimeMs() { return 0; }
+
+/* --- AirVantage side: the last station blob is decoded --- */
+
+static uint8_t blob[BTMGR_BLOB_MAX_BYTES];
+static size_t blobBytes;
+static unsigned int blobs;
+static bool decodeBlobs = true;                          // off for the benchmark
+
+static void test_avsDataAdd(char *path, void *data, avsService_DataType_t type) {
+        if (strncmp(path, AVS_STATION_BLOB_PATH ".", sizeof(AVS_STATION_BLOB_PATH)) != 0) return;
+
+        ++blobs;
+        if (!decodeBlobs) return;
+        CHECK_EQ(type, STRING);
+        blobBytes = sizeof(blob);
+        CHECK_EQ(le_base64_Decode(data, strlen(data), blob, &blobBytes), LE_OK);
+}
+
+static void test_avsDataPush() {
+}
+
+/* --- helpers --- */
+
+static uint32_t nowMs;
+
+static void test_setTime(uint32_t ms) {
+        nowMs = ms;
+        le_stub_setTime(ms / 1000, (ms % 1000) * 1000);
+}
+
+static void test_scanResult(BTScanResult_t *scanResult, uint64_t addr, uint8_t addrType, int rssi,
+                            const uint8_t *data, int dataLen) {
+        uint64_t fingerprint = BX31_FINGERPRINT_ADD(BX31_FINGERPRINT_OFFSET, addrType);
+
+        memset(scanResult, 0, sizeof(*scanResult));
+        scanResult->btStationAddress = addr;
+        scanResult->addrType = addrType;
+        scanResult->rssi = rssi;
+        scanResult->data_len = dataLen;
+        for (int i = 0; i < dataLen; ++i) {                                     // as the parser builds it
+                scanResult->advertData[i] = data[i];
+                fingerprint = BX31_FINGERPRINT_ADD(fingerprint, data[i]);
+        }
+        scanResult->fingerprint = BX31_FINGERPRINT_ADD(fingerprint, dataLen);
+}
+
+static size_t test_makeLine(char *line, uint64_t addr, int addrType, int rssi,
+                            const uint8_t *data, int dataLen) {
+        int len = sprintf(line, "+SRBLESCAN: \"%02x:%02x:%02x:%02x:%02x:%02x\",%d,%d,\"",
+                          (unsigned int) (addr >> 40) & 0xff, (unsigned int) (addr >> 32) & 0xff,
+                          (unsigned int) (addr >> 24) & 0xff, (unsigned int) (addr >> 16) & 0xff,
+                          (unsigned int) (addr >> 8) & 0xff, (unsigned int) addr & 0xff,
+                          addrType, rssi);
+
+        for (int i = 0; i < dataLen; ++i) {
+                len += sprintf(line + len, "\\%02X", data[i]);
+        }
+        line[len++] = '\"';
+        line[len] = '\0';
+        return len;
+}
+
+/* stations with a random advert each, the second set has the last byte of each advert changed */
+static void test_makeLines(char (*lines)[TEST_LINE_MAX], size_t *lens, size_t stations, int dataLen) {
+        uint8_t data[MAX_BT_DATA_STRING_SIZE];
+        uint32_t seed = 0xa110c;
+
+        for (size_t i = 0; i < stations; ++i) {
+                for (int j = 0; j < dataLen; ++j) data[j] = test_random(&seed);
+                uint64_t addr = (((uint64_t) test_random(&seed) << 16) ^ test_random(&seed)) & 0xffffffffffffULL;
+                lens[i] = test_makeLine(lines[i], addr, BX31_BT_PRIVATE_ADDR, -70, data, dataLen);
+                data[dataLen - 1] ^= 0x5a;
+                lens[stations + i] = test_makeLine(lines[stations + i], addr, BX31_BT_PRIVATE_ADDR, -70, data, dataLen);
+        }
+}
+
+/* one scan through the path of a BX31 - parsed into a queue slot, handed to the station manager */
+static void test_scan(ScanQueue_t *queue, char (*lines)[TEST_LINE_MAX], const size_t *lens, size_t count) {
+        BTScanResult_t *scanResult;
+
+        test_setTime(nowMs + 1000);
+        for (size_t i = 0; i < count; ++i) {
+                LE_ASSERT((scanResult = scanq_reserve(queue)) != NULL);
+                LE_ASSERT_OK(bx31at_parseScanResult(lines[i], lens[i], scanResult));
+                scanResult->radio = 0;
+                scanq_commit(queue);
+
+                if ((i + 1) % TEST_DELIVER_EVERY == 0 || i + 1 == count) {
+                        while ((scanResult = scanq_front(queue)) != NULL) {
+                                btmgr_updateList(scanResult);
+                                scanq_pop(queue);
+                        }
+                }
+        }
+}
+
+static void test_init() {
+        test_setTime(1000);
+        btmgr_init(test_avsDataAdd, test_avsDataPush);
+}
+
+static void test_destroy() {
+        btmgr_destroy();
+        lastReportTick = 0;
+        memset(radioSeenStations, 0, sizeof(radioSeenStations));
+}
+
+/* --- tests --- */
+
+static void test_changeDetection() {
+        static const uint8_t data[] = { 0x02, 0x01, 0x06, 0x05, 0xff, 0x4c, 0x00, 0x10, 0x01 };
+        static const uint8_t other[] = { 0x02, 0x01, 0x06, 0x05, 0xff, 0x4c, 0x00, 0x10, 0x02 };
+        BTScanResult_t scanResult;
+        uint32_t index;
+
+        test_init();
+        test_scanResult(&scanResult, 0x0a0b0c0d0e0fULL, BX31_BT_PUBLIC_ADDR, -60, data, sizeof(data));
+        btmgr_updateList(&scanResult);
+        index = sttbl_lookup(0x0a0b0c0d0e0fULL);
+        CHECK(index != STTBL_NO_INDEX);
+        CHECK_EQ(stationStore.changeMask[index],
+                 STATION_CHANGED_NEW | STATION_CHANGED_PAYLOAD | STATION_CHANGED_RSSI);
+        CHECK(memcmp(slab_data(stationStore.cold[index].payload), data, sizeof(data)) == 0);
+
+        btmgr_reportStations(lastReportTick, nowMs);
+        CHECK_EQ(stationStore.changeMask[index], 0);
+
+        test_setTime(2000);                                                     // same advert, RSSI within the deadband
+        test_scanResult(&scanResult, 0x0a0b0c0d0e0fULL, BX31_BT_PUBLIC_ADDR, -60 + BTMGR_RSSI_DEADBAND_DB,
+                        data, sizeof(data));
+        btmgr_updateList(&scanResult);
+        CHECK_EQ(stationStore.changeMask[index], 0);
+        CHECK_EQ(stationStore.lastSeen[index], 2000);
+
+        test_scanResult(&scanResult, 0x0a0b0c0d0e0fULL, BX31_BT_PUBLIC_ADDR, -60, other, sizeof(other));
+        btmgr_updateList(&scanResult);                                          // last byte changed
+        CHECK_EQ(stationStore.changeMask[index], STATION_CHANGED_PAYLOAD);
+        CHECK(memcmp(slab_data(stationStore.cold[index].payload), other, sizeof(other)) == 0);
+        btmgr_reportStations(lastReportTick, nowMs);
+
+        test_scanResult(&scanResult, 0x0a0b0c0d0e0fULL, BX31_BT_PUBLIC_ADDR, -60, other, sizeof(other) - 1);
+        btmgr_updateList(&scanResult);                                          // shorter
+        CHECK_EQ(stationStore.changeMask[index], STATION_CHANGED_PAYLOAD);
+        btmgr_reportStations(lastReportTick, nowMs);
+
+        test_scanResult(&scanResult, 0x0a0b0c0d0e0fULL, BX31_BT_PRIVATE_ADDR, -60, other, sizeof(other) - 1);
+        btmgr_updateList(&scanResult);                                          // only the addr type changed
+        CHECK_EQ(stationStore.changeMask[index], STATION_CHANGED_PAYLOAD);
+        CHECK_EQ(stationStore.cold[index].addrType, BX31_BT_PRIVATE_ADDR);
+        btmgr_reportStations(lastReportTick, nowMs);
+
+        test_scanResult(&scanResult, 0x0a0b0c0d0e0fULL, BX31_BT_PRIVATE_ADDR,
+                        -60 - BTMGR_RSSI_DEADBAND_DB - 1, other, sizeof(other) - 1);
+        btmgr_updateList(&scanResult);                                          // RSSI out of the deadband
+        CHECK_EQ(stationStore.changeMask[index], STATION_CHANGED_RSSI);
+
+        test_destroy();
+}
+
+static void test_reportBlob() {
+        uint8_t data[MAX_BT_DATA_STRING_SIZE];
+        BTScanResult_t scanResult;
+
+        for (int i = 0; i < MAX_BT_DATA_STRING_SIZE; ++i) data[i] = i;
+
+        test_init();
+        for (uint64_t addr = 1; addr <= 3; ++addr) {
+                test_setTime(1000 + addr * 1000);
+                test_scanResult(&scanResult, 0x112233440000ULL + addr, BX31_BT_PRIVATE_ADDR,
+                                -40 - (int) addr, data, (int) addr * 10);
+                btmgr_updateList(&scanResult);
+        }
+        test_setTime(10000);
+        blobs = 0;
+        CHECK_EQ(btmgr_reportStations(lastReportTick, nowMs), 3);
+        CHECK_EQ(blobs, 1);
+
+        CHECK(blob[0] == 'B' && blob[1] == 'S');
+        CHECK_EQ(blob[2], BTMGR_BLOB_VERSION);
+        CHECK_EQ((blob[4] << 24 | blob[5] << 16 | blob[6] << 8 | blob[7]), le_clk_GetAbsoluteTime().sec);
+        CHECK_EQ((blob[8] << 8 | blob[9]), 3);
+
+        const uint8_t *pos = blob + BTMGR_BLOB_HEADER_LEN;
+        for (uint64_t addr = 3; addr >= 1; --addr) {                            // newest first
+                uint64_t recordAddr = 0;
+
+                for (int i = 0; i < 6; ++i) recordAddr = recordAddr << 8 | pos[i];
+                CHECK_EQ(recordAddr, 0x112233440000ULL + addr);
+                CHECK_EQ(pos[6], STATION_CHANGED_NEW | STATION_CHANGED_PAYLOAD | STATION_CHANGED_RSSI);
+                CHECK_EQ(pos[7], BX31_BT_PRIVATE_ADDR);
+                CHECK_EQ((int8_t) pos[8], -40 - (int) addr);
+                CHECK_EQ(pos[9], 0);                                            // radio
+                CHECK_EQ((pos[10] << 8 | pos[11]), (10000 - (1000 + addr * 1000)) / 1000);
+                CHECK_EQ(pos[12], addr * 10);
+                CHECK(memcmp(pos + 13, data, addr * 10) == 0);
+                pos += BTMGR_BLOB_RECORD_LEN + 1 + addr * 10;
+        }
+        CHECK_EQ(pos - blob, blobBytes);
+
+        blobs = 0;                                                              // nothing new - no blob
+        CHECK_EQ(btmgr_reportStations(lastReportTick, nowMs), 0);
+        CHECK_EQ(blobs, 0);
+        test_destroy();
+}
+
+/* two radios: the station has the best RSSI of the radios which saw it within the max. age */
+static void test_multiRadio() {
+        static const uint8_t data[] = { 0x02, 0x01, 0x06 };
+        BTScanResult_t scanResult;
+        uint32_t index;
+
+        test_init();
+        test_scanResult(&scanResult, 0x0000000000a1ULL, BX31_BT_PUBLIC_ADDR, -70, data, sizeof(data));
+        scanResult.radio = 0;
+        btmgr_updateList(&scanResult);
+        index = sttbl_lookup(0x0000000000a1ULL);
+        CHECK_EQ(stationStore.cold[index].bestRadio, 0);
+        CHECK_EQ(stationStore.rssi[index], -70);
+
+        test_setTime(2000);                                                     // the other radio is closer
+        scanResult.rssi = -50;
+        scanResult.radio = 1;
+        btmgr_updateList(&scanResult);
+        CHECK_EQ(stationStore.cold[index].bestRadio, 1);
+        CHECK_EQ(stationStore.rssi[index], -50);
+        CHECK_EQ(stationStore.cold[index].radio[0].rssi, -70);
+        CHECK_EQ(stationStore.cold[index].radio[1].rssi, -50);
+
+        test_setTime(3000);                                                     // a weaker sighting does not win
+        scanResult.rssi = -65;
+        scanResult.radio = 0;
+        btmgr_updateList(&scanResult);
+        CHECK_EQ(stationStore.cold[index].bestRadio, 1);
+        CHECK_EQ(stationStore.rssi[index], -50);
+        CHECK_EQ(stationStore.cold[index].lastRadio, 0);
+
+        test_scanResult(&scanResult, 0x0000000000b2ULL, BX31_BT_PUBLIC_ADDR, -80, data, sizeof(data));
+        scanResult.radio = 1;                                                   // only in reach of the second radio
+        btmgr_updateList(&scanResult);
+        CHECK_EQ(stationStore.cold[sttbl_lookup(0x0000000000b2ULL)].bestRadio, 1);
+        CHECK_EQ(stationStore.cold[sttbl_lookup(0x0000000000b2ULL)].radio[0].rssi, STTBL_RSSI_NONE);
+        CHECK_EQ(radioSeenStations[0], 1);
+        CHECK_EQ(radioSeenStations[1], 2);
+
+        blobs = 0;                                                              // the record carries the best radio
+        CHECK_EQ(btmgr_reportStations(lastReportTick, nowMs), 2);
+        lastReportTick = nowMs;
+        CHECK_EQ(blobs, 1);
+        CHECK_EQ(blob[BTMGR_BLOB_HEADER_LEN + 9], 1);
+        CHECK_EQ((int8_t) blob[BTMGR_BLOB_HEADER_LEN + BTMGR_BLOB_RECORD_LEN + 1 + sizeof(data) + 8], -50);
+        CHECK_EQ(blob[BTMGR_BLOB_HEADER_LEN + BTMGR_BLOB_RECORD_LEN + 1 + sizeof(data) + 9], 1);
+
+        test_setTime(3000 + stationMaxAge * 1000 + 1);                          // the second radio lost it - its RSSI
+        test_scanResult(&scanResult, 0x0000000000a1ULL, BX31_BT_PUBLIC_ADDR, -66, data, sizeof(data));
+        scanResult.radio = 0;                                                   // is not used anymore
+        btmgr_updateList(&scanResult);
+        CHECK_EQ(stationStore.cold[index].bestRadio, 0);
+        CHECK_EQ(stationStore.rssi[index], -66);
+        CHECK(stationStore.changeMask[index] & STATION_CHANGED_RSSI);           // -50 was reported
+
+        test_destroy();
+}
+
+/* known stations are merged without any allocation - new ones only when the table or a slab grows */
+static void test_scanPathAllocations() {
+        const size_t stations = 2000;
+        char (*lines)[TEST_LINE_MAX] = malloc(2 * stations * TEST_LINE_MAX);
+        size_t *lens = malloc(2 * stations * sizeof(size_t));
+        ScanQueue_t *queue = scanq_create(BX31_SCAN_QUEUE_SIZE);
+        uint64_t heapBefore, poolBefore;
+
+        test_makeLines(lines, lens, stations, BX31_LEGACY_ADVERT_LEN);
+        test_init();
+
+        heapBefore = heapAllocations;
+        test_scan(queue, lines, lens, stations);                                // all new
+        CHECK_EQ(sttbl_count(), stations);
+        CHECK(heapAllocations - heapBefore < stations / 10);                    // the table and the slabs grow in steps
+
+        heapBefore = heapAllocations;
+        poolBefore = le_stub_getPoolAllocs();
+        test_scan(queue, lines, lens, stations);                                // the same adverts again
+        CHECK_EQ(heapAllocations - heapBefore, 0);
+        CHECK_EQ(le_stub_getPoolAllocs() - poolBefore, 0);
+
+        heapBefore = heapAllocations;
+        poolBefore = le_stub_getPoolAllocs();
+        test_scan(queue, lines + stations, lens + stations, stations);          // each advert changed, same length
+        CHECK_EQ(heapAllocations - heapBefore, 0);
+        CHECK_EQ(le_stub_getPoolAllocs() - poolBefore, 0);
+        CHECK_EQ(btmgr_reportStations(0, nowMs), stations);
+
+        test_destroy();
+        scanq_destroy(queue);
+        free(lines);
+        free(lens);
+}
+
+/* stations 1 .. count, with the RSSI -40 .. -99 and addr type spread over the addresses */
+static void test_addStations(size_t count) {
+        static const uint8_t data[] = { 0x02, 0x01, 0x06 };
+        BTScanResult_t scanResult;
+
+        for (uint64_t addr = 1; addr <= count; ++addr) {
+                test_scanResult(&scanResult, addr, addr % 3 == 0 ? BX31_BT_PUBLIC_ADDR : BX31_BT_PRIVATE_ADDR,
+                                -40 - (int) (addr * 7 % 60), data, sizeof(data));
+                btmgr_updateList(&scanResult);
+        }
+}
+
+static void test_getStation() {
+        static const uint8_t data[] = { 0x02, 0x01, 0x06, 0x05, 0xff, 0x4c, 0x00, 0x10, 0x01 };
+        BTScanResult_t scanResult;
+        uint8_t payload[BTSCAN_MAX_PAYLOAD_BYTES];
+        size_t payloadSize = sizeof(payload);
+        uint8_t addrType = 0, radio = 0;
+        int8_t rssi = 0;
+        uint32_t age = 0;
+
+        test_init();
+        test_scanResult(&scanResult, 0x0a0b0c0d0e0fULL, BX31_BT_PUBLIC_ADDR, -60, data, sizeof(data));
+        scanResult.radio = 1;
+        btmgr_updateList(&scanResult);
+        test_setTime(nowMs + 2500);
+
+        CHECK_EQ(btScan_GetStation(0x0a0b0c0d0e0fULL, &addrType, &rssi, &radio, &age, payload, &payloadSize), LE_OK);
+        CHECK_EQ(addrType, BX31_BT_PUBLIC_ADDR);
+        CHECK_EQ(rssi, -60);
+        CHECK_EQ(radio, 1);
+        CHECK_EQ(age, 2500);
+        CHECK_EQ(payloadSize, sizeof(data));
+        CHECK(memcmp(payload, data, sizeof(data)) == 0);
+
+        payloadSize = 4;                                                        // cut to the buffer
+        CHECK_EQ(btScan_GetStation(0x0a0b0c0d0e0fULL, &addrType, &rssi, &radio, &age, payload, &payloadSize),
+                 LE_OVERFLOW);
+        CHECK_EQ(payloadSize, 4);
+
+        payloadSize = sizeof(payload);
+        CHECK_EQ(btScan_GetStation(0x0a0b0c0d0e0eULL, &addrType, &rssi, &radio, &age, payload, &payloadSize),
+                 LE_NOT_FOUND);
+        CHECK_EQ(payloadSize, 0);
+        test_destroy();
+}
+
+/* an iteration returns each station which is there all along, though stations are removed between the calls */
+static void test_findStations() {
+        static bool returned[TEST_QUERY_STATIONS + 1];
+        static bool removed[TEST_QUERY_STATIONS + 1];
+        uint64_t addresses[BTSCAN_MAX_RESULTS];
+        int8_t rssis[BTSCAN_MAX_RESULTS];
+        uint64_t cursor = 0;
+        uint32_t seed = 0xf1d;
+
+        test_init();
+        test_addStations(TEST_QUERY_STATIONS);
+        memset(returned, 0, sizeof(returned));
+        memset(removed, 0, sizeof(removed));
+
+        do {
+                size_t addressesSize = BTSCAN_MAX_RESULTS, rssisSize = BTSCAN_MAX_RESULTS;
+
+                CHECK_EQ(btScan_FindStations(BTSCAN_ADDR_TYPE_ANY, -70, BTSCAN_SEEN_ANY, cursor,
+                                             addresses, &addressesSize, rssis, &rssisSize, &cursor), LE_OK);
+                CHECK_EQ(addressesSize, rssisSize);
+                for (size_t i = 0; i < addressesSize; ++i) {
+                        CHECK(rssis[i] >= -70);
+                        CHECK(addresses[i] >= 1 && addresses[i] <= TEST_QUERY_STATIONS);
+                        CHECK(!removed[addresses[i]]);
+                        returned[addresses[i]] = true;
+                }
+                for (int i = 0; i < 20 && sttbl_count() > 0; ++i) {             // the last stations move down
+                        uint32_t index = test_random(&seed) % sttbl_count();
+
+                        removed[sttbl_address(index)] = true;
+                        btmgr_removeStation(index);
+                }
+        } while (cursor != 0);
+
+        for (uint64_t addr = 1; addr <= TEST_QUERY_STATIONS; ++addr) {
+                if (!removed[addr] && -40 - (int) (addr * 7 % 60) >= -70) CHECK(returned[addr]);
+        }
+
+        cursor = 0;                                                             // more removals than the history
+        size_t addressesSize = 1, rssisSize = 1;
+        CHECK_EQ(btScan_FindStations(BTSCAN_ADDR_TYPE_ANY, BTSCAN_RSSI_ANY, BTSCAN_SEEN_ANY, cursor,
+                                     addresses, &addressesSize, rssis, &rssisSize, &cursor), LE_OK);
+        for (int i = 0; i <= STTBL_MOVE_HISTORY; ++i) btmgr_removeStation(0);
+        addressesSize = rssisSize = 1;
+        CHECK_EQ(btScan_FindStations(BTSCAN_ADDR_TYPE_ANY, BTSCAN_RSSI_ANY, BTSCAN_SEEN_ANY, cursor,
+                                     addresses, &addressesSize, rssis, &rssisSize, &cursor), LE_OUT_OF_RANGE);
+        CHECK_EQ(addressesSize, 0);
+        CHECK_EQ(cursor, 0);
+        test_destroy();
+}
+
+/* the strongest stations of all calls, kept by the client, are the strongest of the table */
+static void test_getStrongest() {
+        static int8_t expected[TEST_QUERY_STATIONS];
+        uint64_t addresses[BTSCAN_MAX_RESULTS], best[BTSCAN_MAX_RESULTS];
+        int8_t rssis[BTSCAN_MAX_RESULTS], bestRssis[BTSCAN_MAX_RESULTS];
+        size_t bestCount = 0, expectedCount = 0;
+        uint64_t cursor = 0;
+
+        test_init();
+        test_addStations(TEST_QUERY_STATIONS);
+        for (uint64_t addr = 1; addr <= TEST_QUERY_STATIONS; ++addr) {          // reference: RSSI of the public
+                if (addr % 3 == 0) expected[expectedCount++] = -40 - (int) (addr * 7 % 60);   // stations, sorted
+        }
+        for (size_t i = 1; i < expectedCount; ++i) {
+                for (size_t j = i; j > 0 && expected[j - 1] < expected[j]; --j) {
+                        int8_t tmp = expected[j];
+                        expected[j] = expected[j - 1];
+                        expected[j - 1] = tmp;
+                }
+        }
+
+        do {
+                size_t addressesSize = BTSCAN_MAX_RESULTS, rssisSize = BTSCAN_MAX_RESULTS;
+
+                CHECK_EQ(btScan_GetStrongest(BX31_BT_PUBLIC_ADDR, BTSCAN_SEEN_ANY, cursor,
+                                             addresses, &addressesSize, rssis, &rssisSize, &cursor), LE_OK);
+                for (size_t i = 0; i < addressesSize; ++i) {
+                        CHECK(i == 0 || rssis[i] <= rssis[i - 1]);              // sorted
+                        CHECK_EQ(addresses[i] % 3, 0);
+                        if (bestCount == BTSCAN_MAX_RESULTS && rssis[i] <= bestRssis[bestCount - 1]) continue;
+
+                        size_t pos = bestCount < BTSCAN_MAX_RESULTS ? bestCount++ : bestCount - 1;
+                        while (pos > 0 && bestRssis[pos - 1] < rssis[i]) {
+                                bestRssis[pos] = bestRssis[pos - 1];
+                                best[pos] = best[pos - 1];
+                                --pos;
+                        }
+                        bestRssis[pos] = rssis[i];
+                        best[pos] = addresses[i];
+                }
+        } while (cursor != 0);
+
+        CHECK_EQ(bestCount, BTSCAN_MAX_RESULTS);
+        for (size_t i = 0; i < bestCount; ++i) {
+                CHECK_EQ(bestRssis[i], expected[i]);
+                CHECK_EQ(bestRssis[i], -40 - (int) (best[i] * 7 % 60));
+        }
+        test_destroy();
+}
+
+/* --- benchmark --- */
+
+/* change detection as before the fingerprint - addr type, length and a byte loop over the advert */
+static int bench_byteCmp(uint32_t index, BTScanResult_t *scanResult2) {
+        BT_Station_Container_t *scanResult1 = &stationStore.cold[index];
+
+        if (sttbl_address(index) != scanResult2->btStationAddress) return 1;
+        if (scanResult1->addrType != scanResult2->addrType) return 2;
+        if (scanResult1->data_len != scanResult2->data_len) return 3;
+
+        const uint8_t *advertData1 = slab_data(scanResult1->payload);
+        for (int i = 0; i < scanResult1->data_len; ++i) {
+                if (advertData1[i] != (uint8_t) scanResult2->advertData[i]) return 4 + i;
+        }
+        return 0;
+}
+
+static void bench_updates(size_t stations, int dataLen) {
+        BTScanResult_t *results = malloc(2 * stations * sizeof(BTScanResult_t));
+        uint32_t *order = malloc(stations * sizeof(uint32_t));                  // sightings in random order
+        uint8_t data[MAX_BT_DATA_STRING_SIZE];
+        uint32_t seed = 0xbe4c4;
+        double start, seconds;
+        uint64_t ops;
+        volatile int sink = 0;
+
+        for (size_t i = 0; i < stations; ++i) {                                 // two adverts per station
+                for (int j = 0; j < dataLen; ++j) data[j] = test_random(&seed);
+                uint64_t addr = (((uint64_t) test_random(&seed) << 16) ^ test_random(&seed)) & 0xffffffffffffULL;
+                test_scanResult(&results[i], addr, BX31_BT_PRIVATE_ADDR, -70, data, dataLen);
+                data[dataLen - 1] ^= 0x5a;
+                test_scanResult(&results[stations + i], addr, BX31_BT_PRIVATE_ADDR, -70, data, dataLen);
+                order[i] = i;
+        }
+        for (size_t i = stations - 1; i > 0; --i) {
+                size_t j = test_random(&seed) % (i + 1);
+                uint32_t tmp = order[i];
+                order[i] = order[j];
+                order[j] = tmp;
+        }
+
+        test_init();
+        le_stub_verbose = false;
+        decodeBlobs = false;
+        for (size_t i = 0; i < stations; ++i) btmgr_updateList(&results[i]);
+
+        ops = 0;                                                                // change detection only (lookup + compare)
+        start = test_now();
+        do {
+                for (size_t i = 0; i < stations; ++i) {
+                        BTScanResult_t *scanResult = &results[order[i]];
+                        sink += btmgr_ScanCmp(sttbl_lookup(scanResult->btStationAddress), scanResult);
+                }
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double fingerprintNs = seconds * 1e9 / ops;
+
+        ops = 0;
+        start = test_now();
+        do {
+                for (size_t i = 0; i < stations; ++i) {
+                        BTScanResult_t *scanResult = &results[order[i]];
+                        sink += bench_byteCmp(sttbl_lookup(scanResult->btStationAddress), scanResult);
+                }
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double byteCmpNs = seconds * 1e9 / ops;
+
+        ops = 0;                                                                // sightings of known stations with an
+        start = test_now();                                                     // unchanged advert - the common case
+        do {
+                test_setTime(nowMs + 10);
+                for (size_t i = 0; i < stations; ++i) btmgr_updateList(&results[order[i]]);
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double unchangedNs = seconds * 1e9 / ops;
+
+        ops = 0;                                                                // each sighting changes the advert
+        start = test_now();
+        do {
+                test_setTime(nowMs + 10);
+                for (size_t i = 0; i < stations; ++i) {
+                        btmgr_updateList(&results[(ops / stations % 2) * stations + order[i]]);
+                }
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double changedNs = seconds * 1e9 / ops;
+
+        ops = 0;                                                                // report - every station has a new RSSI
+        start = test_now();
+        do {
+                test_setTime(nowMs + 10);
+                for (size_t i = 0; i < stations; ++i) {
+                        stationStore.lastSeen[i] = nowMs;
+                        stationStore.changeMask[i] = STATION_CHANGED_RSSI;
+                }
+                if (btmgr_reportStations(nowMs - 1, nowMs) != stations) abort();
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double reportNs = seconds * 1e9 / ops;
+
+        ops = 0;                                                                // report - all seen, nothing changed
+        start = test_now();
+        do {
+                if (btmgr_reportStations(nowMs - 1, nowMs) != 0) abort();
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double unchangedReportNs = seconds * 1e9 / ops;
+
+        printf("%6zu stations, %3d byte adverts: compare fingerprint %5.1f ns, bytes %5.1f ns; "
+               "updateList unchanged %5.1f ns, changed %5.1f ns; reportStation %5.1f ns, nothing to report %5.1f ns\n",
+               stations, dataLen, fingerprintNs, byteCmpNs, unchangedNs, changedNs, reportNs, unchangedReportNs);
+
+        le_stub_verbose = true;
+        decodeBlobs = true;
+        test_destroy();
+        free(results);
+        free(order);
+}
+
+/* the scan path before: a result object from the pool per line, released when the advert did not change */
+static void bench_oldScan(le_mem_PoolRef_t pool, char (*lines)[TEST_LINE_MAX], const size_t *lens, size_t count) {
+        test_setTime(nowMs + 1000);
+        for (size_t i = 0; i < count; ++i) {
+                BTScanResult_t *scanResult = le_mem_TryAlloc(pool);
+                LE_ASSERT(scanResult != NULL);
+                LE_ASSERT_OK(bx31at_parseScanResult(lines[i], lens[i], scanResult));
+                scanResult->radio = 0;
+                btmgr_updateList(scanResult);
+                le_mem_Release(scanResult);
+        }
+
+        char *finalResponse = malloc(sizeof("OK"));                             // strdup() of the final response
+        LE_ASSERT(finalResponse != NULL);
+        memcpy(finalResponse, "OK", sizeof("OK"));
+        free(finalResponse);
+}
+
+static void bench_allocations(size_t stations) {
+        char (*lines)[TEST_LINE_MAX] = malloc(2 * stations * TEST_LINE_MAX);
+        size_t *lens = malloc(2 * stations * sizeof(size_t));
+        ScanQueue_t *queue = scanq_create(BX31_SCAN_QUEUE_SIZE);
+        le_mem_PoolRef_t pool = le_mem_CreatePool("stationScan", sizeof(BTScanResult_t));
+        uint64_t heapBefore, poolBefore, scans;
+        double start, seconds;
+
+        le_mem_ExpandPool(pool, 1024);                                          // MAX_SCANNED_STATION_MEM_POOL_SIZE
+        test_makeLines(lines, lens, stations, BX31_LEGACY_ADVERT_LEN);
+        test_init();
+        le_stub_verbose = false;
+        decodeBlobs = false;
+
+        heapBefore = heapAllocations;
+        poolBefore = le_stub_getPoolAllocs();
+        test_scan(queue, lines, lens, stations);
+        double newHeap = (heapAllocations - heapBefore) * 1000.0 / stations;
+        double newPool = (le_stub_getPoolAllocs() - poolBefore) * 1000.0 / stations;
+
+        scans = 0;                                                              // known stations, unchanged adverts
+        heapBefore = heapAllocations;
+        poolBefore = le_stub_getPoolAllocs();
+        start = test_now();
+        do {
+                test_scan(queue, lines, lens, stations);
+                ++scans;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double knownHeap = (heapAllocations - heapBefore) * 1000.0 / (scans * stations);
+        double knownPool = (le_stub_getPoolAllocs() - poolBefore) * 1000.0 / (scans * stations);
+        double knownNs = seconds * 1e9 / (scans * stations);
+
+        scans = 0;
+        heapBefore = heapAllocations;
+        poolBefore = le_stub_getPoolAllocs();
+        start = test_now();
+        do {
+                bench_oldScan(pool, lines, lens, stations);
+                ++scans;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double oldHeap = (heapAllocations - heapBefore) * 1000.0 / (scans * stations);
+        double oldPool = (le_stub_getPoolAllocs() - poolBefore) * 1000.0 / (scans * stations);
+        double oldNs = seconds * 1e9 / (scans * stations);
+
+        printf("%6zu stations, per 1000 sightings: new stations %5.1f heap / %6.1f pool allocations; "
+               "known %4.1f heap / %6.1f pool, %5.1f ns per sighting; "
+               "pool object per line %4.1f heap / %6.1f pool, %5.1f ns\n",
+               stations, newHeap, newPool, knownHeap, knownPool, knownNs, oldHeap, oldPool, oldNs);
+
+        le_stub_verbose = true;
+        decodeBlobs = true;
+        test_destroy();
+        scanq_destroy(queue);
+        free(lines);
+        free(lens);
+}
+
+/* time of a query call since *startPtr, the next call starts at the end of it */
+static void bench_lap(double *startPtr, double *totalPtr, double *maxPtr) {
+        double end = test_now();
+        double us = (end - *startPtr) * 1e6;
+
+        *totalPtr += us;
+        if (us > *maxPtr) *maxPtr = us;
+        *startPtr = end;
+}
+
+/* the main thread takes a batch of scan results, then answers one call of each kind - as if they were waiting */
+static void bench_queries(size_t stations) {
+        BTScanResult_t *results = malloc(stations * sizeof(BTScanResult_t));
+        uint8_t data[BX31_LEGACY_ADVERT_LEN];
+        uint8_t payload[BTSCAN_MAX_PAYLOAD_BYTES];
+        uint64_t addresses[BTSCAN_MAX_RESULTS];
+        int8_t rssis[BTSCAN_MAX_RESULTS];
+        uint64_t findCursor = 0, strongestCursor = 0, batches = 0;
+        uint32_t seed = 0x9e4e5;
+        double totalUs[3] = { 0 }, maxUs[3] = { 0 }, ingestSeconds = 0;
+        double start, seconds;
+
+        for (size_t i = 0; i < stations; ++i) {
+                for (size_t j = 0; j < sizeof(data); ++j) data[j] = test_random(&seed);
+                uint64_t addr = (((uint64_t) test_random(&seed) << 16) ^ test_random(&seed)) & 0xffffffffffffULL;
+                test_scanResult(&results[i], addr, BX31_BT_PRIVATE_ADDR, -40 - (int) (test_random(&seed) % 60),
+                                data, sizeof(data));
+        }
+
+        test_init();
+        le_stub_verbose = false;
+        decodeBlobs = false;
+        for (size_t i = 0; i < stations; ++i) btmgr_updateList(&results[i]);
+
+        start = test_now();
+        do {
+                double t = test_now();
+
+                test_setTime(nowMs + 1);
+                for (int i = 0; i < TEST_DELIVER_EVERY; ++i) {
+                        BTScanResult_t *scanResult = &results[test_random(&seed) % stations];
+
+                        if (i < BENCH_CHURN) {                                  // a station lost, a new one seen
+                                uint32_t index = sttbl_lookup(scanResult->btStationAddress);
+                                if (index != STTBL_NO_INDEX) btmgr_removeStation(index);
+                                scanResult->btStationAddress = (((uint64_t) test_random(&seed) << 16)
+                                                                ^ test_random(&seed)) & 0xffffffffffffULL;
+                        }
+                        btmgr_updateList(scanResult);
+                }
+                ingestSeconds += test_now() - t;
+
+                size_t payloadSize = sizeof(payload);
+                uint8_t addrType, radio;
+                int8_t rssi;
+                uint32_t age;
+                t = test_now();
+                btScan_GetStation(results[test_random(&seed) % stations].btStationAddress,
+                                  &addrType, &rssi, &radio, &age, payload, &payloadSize);
+                bench_lap(&t, &totalUs[0], &maxUs[0]);
+
+                size_t addressesSize = BTSCAN_MAX_RESULTS, rssisSize = BTSCAN_MAX_RESULTS;
+                btScan_FindStations(BTSCAN_ADDR_TYPE_ANY, -70, 60000, findCursor,
+                                    addresses, &addressesSize, rssis, &rssisSize, &findCursor);
+                bench_lap(&t, &totalUs[1], &maxUs[1]);
+
+                addressesSize = rssisSize = BTSCAN_MAX_RESULTS;
+                btScan_GetStrongest(BTSCAN_ADDR_TYPE_ANY, 60000, strongestCursor,
+                                    addresses, &addressesSize, rssis, &rssisSize, &strongestCursor);
+                bench_lap(&t, &totalUs[2], &maxUs[2]);
+                ++batches;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+
+        printf("%6zu stations, %d sightings (%d new) and 3 queries per batch: %4.0fk sightings/s and %6.0f queries/s; "
+               "GetStation %5.2f us (max %5.1f), FindStations %5.2f us (max %5.1f), GetStrongest %6.2f us (max %6.1f); "
+               "ingest alone %5.2f M sightings/s\n",
+               stations, TEST_DELIVER_EVERY, BENCH_CHURN, batches * TEST_DELIVER_EVERY / seconds / 1000,
+               batches * 3 / seconds, totalUs[0] / batches, maxUs[0], totalUs[1] / batches, maxUs[1],
+               totalUs[2] / batches, maxUs[2], batches * TEST_DELIVER_EVERY / ingestSeconds / 1e6);
+
+        le_stub_verbose = true;
+        decodeBlobs = true;
+        test_destroy();
+        free(results);
+}
+
+int main(int argc, char **argv) {
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                bench_updates(1000, BX31_LEGACY_ADVERT_LEN);
+                bench_updates(10000, BX31_LEGACY_ADVERT_LEN);
+                bench_updates(1000, MAX_BT_DATA_STRING_SIZE);
+                bench_updates(10000, MAX_BT_DATA_STRING_SIZE);
+                bench_allocations(1000);
+                bench_allocations(10000);
+                bench_queries(1000);
+                bench_queries(10000);
+                bench_queries(50000);
+                return 0;
+        }
+
+        TEST_RUN(test_changeDetection);
+        TEST_RUN(test_reportBlob);
+        TEST_RUN(test_multiRadio);
+        TEST_RUN(test_scanPathAllocations);
+        TEST_RUN(test_getStation);
+        TEST_RUN(test_findStations);
+        TEST_RUN(test_getStrongest);
+        return test_failures > 0;
+}
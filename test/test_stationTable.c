@@ -0,0 +1,585 @@
+/*
+ * test_stationTable.c
+ *
+ * Host test of the station table (StationTable.c). StationTable.c is
+ * included, so the test can look at the hash slots and the aging list
+ * links and can make the allocations of a resize fail.
+ *
+ * Random sightings, lookups, removals, expiries and resizes are run
+ * against a reference set. After each step the slots (probe distances,
+ * Robin Hood order), the hot and cold arrays, the aging list and the
+ * move history are checked against it. With -b lookups, sightings and
+ * sweeps are measured for 100 to 50k stations, and the bytes a report
+ * sweep touches are compared with the hashmap of pool objects the table
+ * replaced.
+ *
+ *  This is part of the "BX31_ATService" Project
+ *  Created on: Oct 17, 2026
+ */
+
+#include "test.h"
+
+static long allocationsLeft = -1;                        // allocations until one fails, -1 = never
+static long liveBlocks;                                  // allocated by the table and not freed
+
+static void *test_malloc(size_t size) {
+        if (allocationsLeft == 0) return NULL;
+        if (allocationsLeft > 0) --allocationsLeft;
+        ++liveBlocks;
+        return malloc(size);
+}
+
+static void *test_calloc(size_t count, size_t size) {
+        if (allocationsLeft == 0) return NULL;
+        if (allocationsLeft > 0) --allocationsLeft;
+        ++liveBlocks;
+        return calloc(count, size);
+}
+
+static void test_free(void *ptr) {
+        if (ptr != NULL) --liveBlocks;
+        free(ptr);
+}
+
+#define malloc test_malloc
+#define calloc test_calloc
+#define free test_free
+#include "StationTable.c"
+#undef malloc
+#undef calloc
+#undef free
+
+#define TEST_UNIVERSE 8192                               // addresses the random steps pick from
+#define TEST_CLUSTER_SHARE 8                             // 1/8 of them hash to the same slot in tables up to
+#define TEST_CLUSTER_MASK 0x3ff                          // 1024 slots - long probe sequences
+#define TEST_STEPS 200000
+#define TEST_BENCH_SECONDS 0.3                           // per measurement
+#define BENCH_CACHE_LINE 64
+#define BENCH_OLD_BUCKETS 1024                           // le_hashmap created for 600 stations
+
+unsigned int test_failures;
+
+static uint64_t universe[TEST_UNIVERSE];
+static struct {
+	bool present;
+	uint32_t lastSeen;                 // tick of the last sighting, the aging list is ordered by it
+	uint32_t touchSeq;                 // order of the sightings - ticks repeat
+} ref[TEST_UNIVERSE];
+static size_t refCount;
+static uint32_t touchSeq;
+static uint32_t tick;
+static uint32_t tickSeed = 0x71c;
+
+static void test_makeUniverse(uint32_t *seed) {
+        for (int k = 0; k < TEST_UNIVERSE; ++k) {
+                uint64_t key;
+
+                do {
+                        key = (((uint64_t) test_random(seed) << 16) ^ test_random(seed)) & 0xffffffffffffULL;
+                } while (k % TEST_CLUSTER_SHARE == 0 && (sttbl_hash(key) & TEST_CLUSTER_MASK) != 0);
+                universe[k] = key;
+        }
+}
+
+static void test_reset() {
+        sttbl_destroy();
+        CHECK_EQ(liveBlocks, 0);
+        maxCapacity = SIZE_MAX;
+        memset(ref, 0, sizeof(ref));
+        refCount = 0;
+        touchSeq = 0;
+}
+
+/* the cold part and the RSSI carry the reference index, so a station which lost its cold part shows */
+static void test_sight(int k) {
+        bool isNew;
+        uint32_t index = sttbl_lookupOrInsert(universe[k], &isNew);
+
+        if (index == STTBL_NO_INDEX) {
+                CHECK(sttbl_count() >= maxCapacity);
+                return;
+        }
+        CHECK_EQ(isNew, !ref[k].present);
+        if (isNew) {
+                CHECK_EQ(stationStore.cold[index].fingerprint, 0);
+                stationStore.cold[index].fingerprint = k;
+                stationStore.rssi[index] = (int8_t) k;
+                ref[k].present = true;
+                ++refCount;
+        }
+
+        tick += test_random(&tickSeed) % 3;                                     // the same tick for several sightings
+        sttbl_touch(index, tick);
+        ref[k].lastSeen = tick;
+        ref[k].touchSeq = ++touchSeq;
+}
+
+static void test_removeAt(uint32_t index) {
+        uint32_t last = sttbl_count() - 1;
+        uint64_t lastKey = sttbl_address(last);
+        uint32_t movesBefore = sttbl_moves();
+        int k = (int) stationStore.cold[index].fingerprint;
+
+        CHECK_EQ(sttbl_address(index), universe[k]);
+        sttbl_removeAt(index);
+        ref[k].present = false;
+        --refCount;
+
+        if (index == last) {                                                    // nothing moved
+                CHECK_EQ(sttbl_moves(), movesBefore);
+        } else {                                                                // last station moved into the gap
+                CHECK_EQ(sttbl_moves(), movesBefore + 1);
+                CHECK_EQ(sttbl_movedTo(movesBefore), index);
+                CHECK_EQ(sttbl_address(index), lastKey);
+        }
+        CHECK_EQ(sttbl_movedTo(sttbl_moves()), STTBL_NO_INDEX);
+        CHECK_EQ(sttbl_lookup(universe[k]), STTBL_NO_INDEX);
+}
+
+/* slots, arrays and aging list against the reference */
+static void test_checkTable() {
+        size_t count = sttbl_count();
+        size_t occupied = 0;
+
+        CHECK_EQ(count, refCount);
+        CHECK(count <= sttbl_capacity());
+        CHECK(2 * sttbl_capacity() <= slotMask + 1);                            // load factor <= 0.5
+
+        for (size_t pos = 0; pos <= slotMask; ++pos) {
+                Station_Slot_t *slot = &slots[pos];
+                Station_Slot_t *next = &slots[(pos + 1) & slotMask];
+
+                if (slot->probeLen == 0) {
+                        CHECK(next->probeLen <= 1);                             // nothing is displaced across an empty slot
+                        continue;
+                }
+                ++occupied;
+                CHECK_EQ(((pos - (sttbl_hash(slot->key) & slotMask)) & slotMask) + 1, slot->probeLen);
+                CHECK(next->probeLen <= slot->probeLen + 1);                    // Robin Hood order
+                CHECK(slot->recordIndex < count);
+                if (slot->recordIndex < count) CHECK_EQ(sttbl_address(slot->recordIndex), slot->key);
+        }
+        CHECK_EQ(occupied, count);
+
+        for (uint32_t i = 0; i < count; ++i) {                                  // hot and cold part of a station together
+                int k = (int) stationStore.cold[i].fingerprint;
+
+                CHECK(k >= 0 && k < TEST_UNIVERSE && ref[k].present);
+                if (k < 0 || k >= TEST_UNIVERSE) continue;
+                CHECK_EQ(sttbl_address(i), universe[k]);
+                CHECK_EQ(stationStore.rssi[i], (int8_t) k);
+                CHECK_EQ(stationStore.lastSeen[i], ref[k].lastSeen);
+        }
+
+        for (int k = 0; k < TEST_UNIVERSE; ++k) {
+                uint32_t index = sttbl_lookup(universe[k]);
+
+                CHECK_EQ(index != STTBL_NO_INDEX, ref[k].present);
+                if (index != STTBL_NO_INDEX) CHECK_EQ(stationStore.cold[index].fingerprint, k);
+        }
+
+        size_t visited = 0;                                                     // newest to oldest - the sightings in
+        uint32_t newer = STTBL_NO_INDEX;                                        // reverse order
+        uint32_t newerSeq = UINT32_MAX;
+        for (uint32_t index = sttbl_newest(); index != STTBL_NO_INDEX && visited <= count;
+             index = sttbl_older(index)) {
+                int k = (int) stationStore.cold[index].fingerprint;
+
+                CHECK(index < count);
+                CHECK_EQ(newerIndexes[index], newer);
+                CHECK(ref[k].touchSeq < newerSeq);
+                CHECK(!STTBL_TICK_AFTER(stationStore.lastSeen[index], newer == STTBL_NO_INDEX
+                                        ? tick : stationStore.lastSeen[newer]));
+                newerSeq = ref[k].touchSeq;
+                newer = index;
+                ++visited;
+        }
+        CHECK_EQ(visited, count);
+        CHECK_EQ(sttbl_oldest(), newer);
+}
+
+/* --- tests --- */
+
+static void test_randomSteps() {
+        uint32_t seed = 0x57a7104;
+
+        test_reset();
+        LE_ASSERT_OK(sttbl_init(4));
+        for (int step = 0; step < TEST_STEPS; ++step) {
+                uint32_t r = test_random(&seed) % 100;
+                int k = test_random(&seed) % TEST_UNIVERSE;
+
+                if (r < 50) {                                                   // sighting
+                        test_sight(k);
+                } else if (r < 65) {                                            // lookup
+                        uint32_t index = sttbl_lookup(universe[k]);
+                        CHECK_EQ(index != STTBL_NO_INDEX, ref[k].present);
+                } else if (r < 85 && sttbl_count() > 0) {                       // removal anywhere - the last and the
+                        test_removeAt(test_random(&seed) % sttbl_count());      // oldest / newest station included
+                } else if (r < 97 && sttbl_count() > 0) {                       // expiry at the oldest end
+                        test_removeAt(sttbl_oldest());
+                } else if (r < 98 && sttbl_count() > 0) {
+                        test_removeAt(sttbl_newest());
+                } else if (r < 99) {                                            // grow or shrink
+                        size_t capacity = test_random(&seed) % (2 * sttbl_count() + 16);
+                        CHECK_EQ(sttbl_reserve(capacity), LE_OK);
+                        CHECK(sttbl_capacity() >= sttbl_count());
+                } else {                                                        // limit, as the memory budget does
+                        sttbl_setMaxCapacity(sttbl_count() + test_random(&seed) % 64);
+                }
+
+                if (step % 64 == 0 || step > TEST_STEPS - 64) test_checkTable();
+                if (test_failures > 20) break;
+        }
+        sttbl_setMaxCapacity(SIZE_MAX);
+}
+
+/* a resize which fails at any of its allocations leaves the table as it was */
+static void test_resizeCommit() {
+        uint32_t seed = 0xc0331;
+
+        test_reset();
+        LE_ASSERT_OK(sttbl_init(64));
+        for (int i = 0; i < 300; ++i) test_sight(test_random(&seed) % TEST_UNIVERSE);
+        test_checkTable();
+
+        for (long fail = 0; ; ++fail) {
+                size_t capacity = sttbl_capacity();
+                long blocksBefore = liveBlocks;
+                Station_Slot_t *slotsBefore = slots;
+
+                allocationsLeft = fail;
+                le_result_t res = sttbl_reserve(capacity * 2);
+                allocationsLeft = -1;
+
+                if (res == LE_OK) {
+                        CHECK_EQ(sttbl_capacity(), capacity * 2);
+                        CHECK(fail >= 10);                                      // slots + 9 arrays
+                        test_checkTable();
+                        break;
+                }
+                CHECK_EQ(res, LE_NO_MEMORY);
+                CHECK_EQ(sttbl_capacity(), capacity);
+                CHECK_EQ(liveBlocks, blocksBefore);                            // nothing kept, nothing leaked
+                CHECK(slots == slotsBefore);
+                test_checkTable();
+        }
+
+        size_t capacity = sttbl_capacity();                                     // growing on insert fails the same way
+        while (sttbl_count() < capacity) test_sight(test_random(&seed) % TEST_UNIVERSE);
+        for (int k = 0; k < TEST_UNIVERSE; ++k) {
+                if (ref[k].present) continue;
+                bool isNew;
+                allocationsLeft = 3;
+                le_stub_verbose = false;
+                CHECK_EQ(sttbl_lookupOrInsert(universe[k], &isNew), STTBL_NO_INDEX);
+                le_stub_verbose = true;
+                allocationsLeft = -1;
+                break;
+        }
+        CHECK_EQ(sttbl_capacity(), capacity);
+        test_checkTable();
+}
+
+/* an iteration which stopped catches up with the moves, at most STTBL_MOVE_HISTORY of them */
+static void test_moveHistory() {
+        uint32_t seed = 0x30fe;
+
+        test_reset();
+        LE_ASSERT_OK(sttbl_init(1024));
+        for (int k = 0; k < 1000; ++k) test_sight(k);
+
+        uint32_t firstMove = sttbl_moves();
+        for (int i = 0; i < STTBL_MOVE_HISTORY; ++i) {
+                test_removeAt(test_random(&seed) % (sttbl_count() - 1));         // never the last - always a move
+        }
+        CHECK_EQ(sttbl_moves() - firstMove, STTBL_MOVE_HISTORY);
+        CHECK(sttbl_movedTo(firstMove) != STTBL_NO_INDEX);                      // just in the history
+
+        test_removeAt(0);
+        CHECK_EQ(sttbl_movedTo(firstMove), STTBL_NO_INDEX);                     // dropped out
+        CHECK(sttbl_movedTo(firstMove + 1) != STTBL_NO_INDEX);
+        test_checkTable();
+}
+
+/* --- benchmark --- */
+
+static void bench_sweep(size_t stations) {
+        uint32_t seed = 0xbe4c4;
+        uint64_t *keys = malloc(stations * sizeof(uint64_t));
+        double start, seconds;
+        uint64_t ops;
+        bool isNew;
+
+        sttbl_destroy();
+        LE_ASSERT_OK(sttbl_init(stations));
+        for (size_t i = 0; i < stations; ++i) {
+                keys[i] = (((uint64_t) test_random(&seed) << 16) ^ test_random(&seed)) & 0xffffffffffffULL;
+                sttbl_touch(sttbl_lookupOrInsert(keys[i], &isNew), i);
+        }
+
+        uint32_t maxProbe = 0;
+        uint64_t sumProbe = 0;
+        for (size_t pos = 0; pos <= slotMask; ++pos) {
+                if (slots[pos].probeLen > maxProbe) maxProbe = slots[pos].probeLen;
+                sumProbe += slots[pos].probeLen;
+        }
+
+        ops = 0;                                                                // sighting of a known station, random order
+        start = test_now();
+        do {
+                for (size_t i = 0; i < stations; ++i) {
+                        uint32_t index = sttbl_lookupOrInsert(keys[test_random(&seed) % stations], &isNew);
+                        sttbl_touch(index, stations + ops + i);
+                }
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double sightNs = seconds * 1e9 / ops;
+
+        ops = 0;                                                                // lookup of an unknown address
+        start = test_now();
+        do {
+                for (size_t i = 0; i < stations; ++i) {
+                        if (sttbl_lookup(((uint64_t) 1 << 48) | i) != STTBL_NO_INDEX) abort();
+                }
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double missNs = seconds * 1e9 / ops;
+
+        ops = 0;                                                                // aging sweep over all stations, oldest
+        volatile uint64_t sum = 0;                                              // first - as the expiry and the report
+        start = test_now();
+        do {
+                for (uint32_t index = sttbl_oldest(); index != STTBL_NO_INDEX; index = newerIndexes[index]) {
+                        sum += stationStore.lastSeen[index];
+                }
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double sweepNs = seconds * 1e9 / ops;
+
+        ops = 0;                                                                // churn - a station expires, a new one
+        start = test_now();                                                     // is inserted
+        do {
+                for (size_t i = 0; i < stations; ++i) {
+                        sttbl_removeAt(sttbl_oldest());
+                        keys[0] = (((uint64_t) test_random(&seed) << 16) ^ test_random(&seed)) & 0xffffffffffffULL;
+                        sttbl_touch(sttbl_lookupOrInsert(keys[0], &isNew), 0);
+                }
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double churnNs = seconds * 1e9 / ops;
+
+        printf("%6zu stations: sighting %5.1f ns, miss %5.1f ns, sweep %5.2f ns/station, "
+               "churn %5.1f ns, probe avg %.2f max %u, %zu bytes/station\n",
+               stations, sightNs, missNs, sweepNs, churnNs,
+               (double) sumProbe / stations, maxProbe, sttbl_memoryBytes() / stations);
+        free(keys);
+}
+
+/* the cache lines a sweep touched - a set of line addresses */
+static uintptr_t *benchLines;
+static size_t benchLinesMask;
+static size_t benchLineCount;
+
+static void bench_linesReset(size_t maxLines) {
+        size_t size = 1;
+
+        while (size < 2 * maxLines) size <<= 1;
+        free(benchLines);
+        LE_ASSERT((benchLines = calloc(size, sizeof(uintptr_t))) != NULL);
+        benchLinesMask = size - 1;
+        benchLineCount = 0;
+}
+
+static void bench_touch(const void *ptr, size_t len) {
+        for (uintptr_t line = (uintptr_t) ptr / BENCH_CACHE_LINE;
+             line <= ((uintptr_t) ptr + len - 1) / BENCH_CACHE_LINE; ++line) {
+                size_t pos = (line * 0x9e3779b97f4a7c15ULL) >> 20 & benchLinesMask;
+
+                while (benchLines[pos] != 0 && benchLines[pos] != line) pos = (pos + 1) & benchLinesMask;
+                if (benchLines[pos] == 0) {
+                        benchLines[pos] = line;
+                        ++benchLineCount;
+                }
+        }
+}
+
+/*
+ * The store before the station table - a le_hashmap of pool objects. A
+ * sweep iterated over all stations, bucket by bucket, and looked at the
+ * entry, the station container and the scan result (RSSI) of each.
+ */
+typedef struct bench_OldEntry {
+	struct bench_OldEntry *next;           // le_hashmap entry - list link, key, value, hash
+	struct bench_OldEntry *prev;
+	const uint64_t *keyPtr;
+	void *valuePtr;
+	size_t hash;
+} bench_OldEntry_t;
+
+typedef struct {
+	uint64_t btStationAddress;             // BT_Station_Container_t as it was
+	le_clk_Time_t lastSeen;
+	bool isDirty;
+	void *scanResult;
+} bench_OldContainer_t;
+
+typedef struct {
+	uint64_t btStationAddress;             // BTScanResult_t as it was
+	uint8_t addrType;
+	int rssi;
+	int data_len;
+	char advertData[MAX_BT_DATA_STRING_SIZE];
+} bench_OldScanResult_t;
+
+static bench_OldEntry_t *oldBuckets[BENCH_OLD_BUCKETS];
+
+static void bench_oldInsert(le_mem_PoolRef_t entries, le_mem_PoolRef_t containers,
+                            le_mem_PoolRef_t results, uint64_t address, uint32_t tick) {
+        bench_OldEntry_t *entry = le_mem_ForceAlloc(entries);
+        bench_OldContainer_t *sCont = le_mem_ForceAlloc(containers);
+        bench_OldScanResult_t *scanResult = le_mem_ForceAlloc(results);
+        size_t bucket = (size_t) (address ^ (address >> 32)) % BENCH_OLD_BUCKETS;
+
+        memset(scanResult, 0, sizeof(*scanResult));
+        scanResult->btStationAddress = address;
+        scanResult->rssi = -70;
+        sCont->btStationAddress = address;
+        sCont->lastSeen.sec = tick / 1000;
+        sCont->lastSeen.usec = tick % 1000 * 1000;
+        sCont->isDirty = false;
+        sCont->scanResult = scanResult;
+        entry->keyPtr = &sCont->btStationAddress;
+        entry->valuePtr = sCont;
+        entry->hash = bucket;
+        entry->prev = NULL;
+        entry->next = oldBuckets[bucket];
+        oldBuckets[bucket] = entry;
+}
+
+static uint64_t bench_oldSweep(bool track) {
+        uint64_t sum = 0;
+
+        for (size_t bucket = 0; bucket < BENCH_OLD_BUCKETS; ++bucket) {
+                if (track) bench_touch(&oldBuckets[bucket], sizeof(oldBuckets[bucket]));
+                for (bench_OldEntry_t *entry = oldBuckets[bucket]; entry != NULL; entry = entry->next) {
+                        bench_OldContainer_t *sCont = entry->valuePtr;
+                        bench_OldScanResult_t *scanResult = sCont->scanResult;
+
+                        if (track) {
+                                bench_touch(entry, sizeof(*entry));
+                                bench_touch(sCont, sizeof(*sCont));
+                                bench_touch(&scanResult->rssi, sizeof(scanResult->rssi));
+                        }
+                        sum += sCont->lastSeen.sec + sCont->btStationAddress + scanResult->rssi;
+                }
+        }
+        return sum;
+}
+
+/* what btmgr_reportStations() reads of a station with nothing to report, newest first */
+static uint64_t bench_reportSweep(uint32_t since, bool track) {
+        uint64_t sum = 0;
+
+        for (uint32_t index = sttbl_newest();
+             index != STTBL_NO_INDEX && STTBL_TICK_AFTER(stationStore.lastSeen[index], since);
+             index = olderIndexes[index]) {
+                if (track) {
+                        bench_touch(&stationStore.lastSeen[index], sizeof(uint32_t));
+                        bench_touch(&stationStore.changeMask[index], sizeof(uint8_t));
+                        bench_touch(&stationStore.lastReportedSeen[index], sizeof(uint32_t));
+                        bench_touch(&olderIndexes[index], sizeof(uint32_t));
+                }
+                sum += stationStore.changeMask[index] + stationStore.lastReportedSeen[index];
+        }
+        return sum;
+}
+
+/*
+ * Bytes touched by a report sweep when all stations were seen since the
+ * last report and when 10% were, and its time per station, for the table
+ * and for the hashmap of pool objects before. The stations are seen in
+ * random order, so the aging list order is not the index order.
+ */
+static void bench_sweepBytes(size_t stations) {
+        le_mem_PoolRef_t entries = le_mem_CreatePool("oldEntries", sizeof(bench_OldEntry_t));
+        le_mem_PoolRef_t containers = le_mem_CreatePool("oldContainers", sizeof(bench_OldContainer_t));
+        le_mem_PoolRef_t results = le_mem_CreatePool("oldScanResults", sizeof(bench_OldScanResult_t));
+        uint32_t seed = 0x5eeb;
+        uint64_t *keys = malloc(stations * sizeof(uint64_t));
+        volatile uint64_t sum = 0;
+        double start, seconds;
+        uint64_t ops;
+        bool isNew;
+
+        sttbl_destroy();
+        LE_ASSERT_OK(sttbl_init(stations));
+        memset(oldBuckets, 0, sizeof(oldBuckets));
+        le_mem_ExpandPool(entries, stations);
+        le_mem_ExpandPool(containers, stations);
+        le_mem_ExpandPool(results, stations);
+        for (size_t i = 0; i < stations; ++i) {
+                keys[i] = (((uint64_t) test_random(&seed) << 16) ^ test_random(&seed)) & 0xffffffffffffULL;
+                sttbl_touch(sttbl_lookupOrInsert(keys[i], &isNew), 1);
+                bench_oldInsert(entries, containers, results, keys[i], 1);
+        }
+        for (size_t i = 0; i < stations; ++i) {                                 // seen again in random order
+                sttbl_touch(sttbl_lookup(keys[test_random(&seed) % stations]), 2 + i);
+        }
+        uint32_t tenthSince = 2 + stations - stations / 10;                     // the newest 10% were seen since
+
+        bench_linesReset(8 * stations);
+        bench_reportSweep(0, true);
+        size_t allBytes = benchLineCount * BENCH_CACHE_LINE;
+        bench_linesReset(8 * stations);
+        bench_reportSweep(tenthSince, true);
+        size_t tenthBytes = benchLineCount * BENCH_CACHE_LINE;
+        bench_linesReset(8 * stations);
+        bench_oldSweep(true);
+        size_t oldBytes = benchLineCount * BENCH_CACHE_LINE;
+
+        ops = 0;
+        start = test_now();
+        do {
+                sum += bench_reportSweep(0, false);
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double sweepNs = seconds * 1e9 / ops;
+
+        ops = 0;
+        start = test_now();
+        do {
+                sum += bench_oldSweep(false);
+                ops += stations;
+        } while ((seconds = test_now() - start) < TEST_BENCH_SECONDS);
+        double oldNs = seconds * 1e9 / ops;
+
+        printf("%6zu stations: report sweep touches %7zu bytes (%4zu/station, %7zu if 10%% were seen), "
+               "%5.2f ns/station; hashmap of pool objects %8zu bytes (%4zu/station), %6.2f ns/station\n",
+               stations, allBytes, allBytes / stations, tenthBytes, sweepNs,
+               oldBytes, oldBytes / stations, oldNs);
+
+        free(benchLines);
+        benchLines = NULL;
+        free(keys);
+}
+
+int main(int argc, char **argv) {
+        uint32_t seed = 0x0123;
+
+        test_makeUniverse(&seed);
+
+        if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+                static const size_t sizes[] = { 100, 1000, 5000, 10000, 20000, 50000 };
+
+                for (size_t i = 0; i < NUM_ARRAY_MEMBERS(sizes); ++i) bench_sweep(sizes[i]);
+                for (size_t i = 0; i < NUM_ARRAY_MEMBERS(sizes); ++i) bench_sweepBytes(sizes[i]);
+                return 0;
+        }
+
+        TEST_RUN(test_randomSteps);
+        TEST_RUN(test_resizeCommit);
+        TEST_RUN(test_moveHistory);
+        sttbl_destroy();
+        return test_failures > 0;
+}
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+#
+# bx31_sim.py
+#
+# Host side stand-in for the BX310x module. It opens a pseudo terminal and
+# answers the AT commands used by bx31at_startupStep() / bx31at_ScanBLE().
+# The module settings can be queried (AT+SRWCFG? ...) and start with the
+# values given by --settings, "configured" (default) or "factory".
+# Each AT+SRBLESCAN produces +SRBLESCAN lines for a synthetic station
+# population with churn, payload changes and random address rotation.
+# --fail-rate and --hang-rate make scans fail (ERROR) or never answer, to
+# exercise the recovery of the scan thread.
+#
+# Example - 2000 stations, 5% churn and 10% payload changes per scan:
+#
+#     tools/bx31_sim.py --stations 2000 --churn 0.05 --payload-change 0.1 \
+#                       --link /tmp/bx31
+#
+# and build the component with -DBX31_SERIAL_DEVICE=\"/tmp/bx31\"
+#
+#  This is part of the "BX31_ATService" Project
+#  Created on: Oct 17, 2026
+#
+
+import argparse
+import os
+import random
+import re
+import select
+import sys
+import time
+import tty
+
+BT_PUBLIC_ADDR = 0
+BT_PRIVATE_ADDR = 1
+
+MAX_ADVERT_LEN = 31
+MAX_EXTENDED_ADVERT_LEN = 255                                   # BLE 5 extended advertising
+
+SETTINGS = ("SRWCFG", "SRBTSYSTEM", "SRBTPS", "SRBLEADV")
+CONFIGURED = {"SRWCFG": "0", "SRBTSYSTEM": "1", "SRBTPS": "0", "SRBLEADV": "0"}
+FACTORY = {"SRWCFG": "1", "SRBTSYSTEM": "0", "SRBTPS": "1", "SRBLEADV": "1"}
+
+
+class Station:
+
+    def __init__(self, rnd, private_share, extended_share):
+        self.rnd = rnd
+        self.extended = rnd.random() < extended_share
+        self.addr_type = BT_PRIVATE_ADDR if rnd.random() < private_share else BT_PUBLIC_ADDR
+        self.addr = self.new_address()
+        self.rssi = rnd.randint(-95, -35)
+        self.payload = self.new_payload()
+
+    def new_address(self):
+        addr = self.rnd.getrandbits(48)
+        if self.addr_type == BT_PRIVATE_ADDR:
+            addr = (addr & 0x3fffffffffff) | 0x400000000000     # resolvable private address
+        return addr
+
+    def new_payload(self):
+        if self.extended:
+            ad = bytes([0x02, 0x01, 0x06])                       # flags
+            while len(ad) < self.rnd.randint(32, MAX_EXTENDED_ADVERT_LEN):
+                manufacturer = bytes(self.rnd.getrandbits(8) for _ in range(self.rnd.randint(4, 60)))
+                ad += bytes([len(manufacturer) + 3, 0xff, 0x06, 0x00]) + manufacturer
+            return ad[:MAX_EXTENDED_ADVERT_LEN]
+        manufacturer = bytes(self.rnd.getrandbits(8) for _ in range(self.rnd.randint(4, 24)))
+        ad = bytes([0x02, 0x01, 0x06])                           # flags
+        ad += bytes([len(manufacturer) + 3, 0xff, 0x06, 0x00]) + manufacturer
+        return ad[:MAX_ADVERT_LEN]
+
+    def change_payload(self):
+        data = bytearray(self.payload)
+        pos = self.rnd.randrange(7, len(data)) if len(data) > 7 else len(data) - 1
+        data[pos] = (data[pos] + 1) & 0xff
+        self.payload = bytes(data)
+
+    def line(self):
+        self.rssi = max(-100, min(-20, self.rssi + self.rnd.randint(-4, 4)))
+        addr = ":".join("%02x" % ((self.addr >> (8 * i)) & 0xff) for i in range(5, -1, -1))
+        data = "".join("\\%02X" % b for b in self.payload)
+        return '+SRBLESCAN: "%s",%d,%d,"%s"' % (addr, self.addr_type, self.rssi, data)
+
+
+class Population:
+
+    def __init__(self, args):
+        self.args = args
+        self.rnd = random.Random(args.seed)
+        self.stations = [self.new_station() for _ in range(args.stations)]
+
+    def new_station(self):
+        return Station(self.rnd, self.args.private_share, self.args.extended)
+
+    def next_scan(self):
+        """ applies churn, payload changes and address rotation and returns
+            the stations heard in this scan """
+        args = self.args
+        for i, station in enumerate(self.stations):
+            if self.rnd.random() < args.churn:
+                self.stations[i] = self.new_station()
+                continue
+            if self.rnd.random() < args.payload_change:
+                station.change_payload()
+            if station.addr_type == BT_PRIVATE_ADDR and self.rnd.random() < args.rotate:
+                station.addr = station.new_address()
+
+        heard = [s for s in self.stations if self.rnd.random() >= args.miss]
+        self.rnd.shuffle(heard)
+        return heard
+
+
+class Bx31Sim:
+
+    def __init__(self, args):
+        self.args = args
+        self.population = Population(args)
+        self.master, slave = os.openpty()
+        tty.setraw(slave)
+        self.slave_name = os.ttyname(slave)
+        self.rx = b""
+        self.scans = 0
+        self.settings = dict(CONFIGURED if args.settings == "configured" else FACTORY)
+        self.fault_rnd = random.Random(args.seed)
+
+    def write(self, text):
+        os.write(self.master, text.encode())
+
+    def respond(self, *lines, final="OK"):
+        for line in lines:
+            self.write("\r\n%s\r\n" % line)
+        self.write("\r\n%s\r\n" % final)
+
+    def scan(self, seconds):
+        heard = self.population.next_scan()
+        duration = self.args.scan_seconds if self.args.scan_seconds is not None else seconds
+        started = time.monotonic()
+        sent = 0
+
+        for i, station in enumerate(heard):
+            due = started + duration * i / max(len(heard), 1)      # spread the lines over the scan window
+            delay = due - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            line = "\r\n%s\r\n" % station.line()
+            self.write(line)
+            sent += len(line)
+
+        if not heard:
+            self.write("\r\n+SRBLESCAN_NONE\r\n")
+        remaining = started + duration - time.monotonic()
+        if remaining > 0:
+            time.sleep(remaining)
+        self.write("\r\nOK\r\n")
+
+        self.scans += 1
+        elapsed = time.monotonic() - started
+        log("scan %d: %d stations, %d bytes in %.3fs (%.0f lines/s), wall clock %.3f" %
+            (self.scans, len(heard), sent, elapsed, len(heard) / elapsed if elapsed else 0, time.time()))
+
+    def command(self, cmd):
+        if self.args.echo:
+            self.write(cmd + "\r")
+        log("<- %s" % cmd, verbose=True)
+
+        if cmd == "AT":
+            self.respond()
+        elif cmd == "ATI":
+            self.respond("BX310x simulator")
+        elif re.match(r"AT\+(%s)\?$" % "|".join(SETTINGS), cmd):
+            name = cmd[3:-1]
+            self.respond("+%s: %s" % (name, self.settings[name]))
+        elif re.match(r"AT\+(%s)=\d$" % "|".join(SETTINGS), cmd):
+            name, value = cmd[3:].split("=")
+            self.settings[name] = value
+            log("%s set to %s" % (name, value))
+            self.respond()
+        else:
+            match = re.match(r"AT\+SRBLESCAN=(\d+)(,\d+)?$", cmd)
+            fault = self.fault_rnd.random() if match else 1.0
+            if fault < self.args.hang_rate:
+                log("scan command swallowed")
+            elif fault < self.args.hang_rate + self.args.fail_rate:
+                log("scan command failed")
+                self.respond(final="ERROR")
+            elif match:
+                self.scan(int(match.group(1)))
+            else:
+                self.respond(final="ERROR")
+
+    def run(self):
+        if self.args.link:
+            if os.path.islink(self.args.link):
+                os.unlink(self.args.link)
+            os.symlink(self.slave_name, self.args.link)
+        log("BX31 simulator on %s%s, %d stations" %
+            (self.slave_name, " (" + self.args.link + ")" if self.args.link else "", self.args.stations))
+
+        try:
+            while True:
+                readable, _, _ = select.select([self.master], [], [], 1.0)
+                if not readable:
+                    continue
+                self.rx += os.read(self.master, 1024)
+                while b"\r" in self.rx:
+                    cmd, self.rx = self.rx.split(b"\r", 1)
+                    cmd = cmd.strip().decode(errors="replace")
+                    if cmd:
+                        self.command(cmd)
+        finally:
+            if self.args.link and os.path.islink(self.args.link):
+                os.unlink(self.args.link)
+
+
+verboseLog = False
+
+
+def log(text, verbose=False):
+    if verbose and not verboseLog:
+        return
+    sys.stderr.write("%.3f %s\n" % (time.monotonic(), text))
+    sys.stderr.flush()
+
+
+def main():
+    global verboseLog
+
+    parser = argparse.ArgumentParser(description="BX310x AT command simulator on a pseudo terminal")
+    parser.add_argument("--stations", type=int, default=100, help="station population size (default 100)")
+    parser.add_argument("--churn", type=float, default=0.02,
+                        help="share of stations replaced by new ones per scan (default 0.02)")
+    parser.add_argument("--payload-change", type=float, default=0.05,
+                        help="share of stations changing their advertisement per scan (default 0.05)")
+    parser.add_argument("--private-share", type=float, default=0.3,
+                        help="share of stations using a random private address (default 0.3)")
+    parser.add_argument("--extended", type=float, default=0.0,
+                        help="share of stations sending BLE 5 extended adverts of up to 255 bytes (default 0)")
+    parser.add_argument("--rotate", type=float, default=0.1,
+                        help="share of private address stations rotating the address per scan (default 0.1)")
+    parser.add_argument("--miss", type=float, default=0.05,
+                        help="probability a station is not heard in a scan (default 0.05)")
+    parser.add_argument("--scan-seconds", type=float, default=None,
+                        help="scan duration, default is the duration given in AT+SRBLESCAN")
+    parser.add_argument("--settings", choices=("configured", "factory"), default="configured",
+                        help="module settings on start (default configured - nothing to write)")
+    parser.add_argument("--fail-rate", type=float, default=0.0,
+                        help="probability a scan command is answered with ERROR (default 0)")
+    parser.add_argument("--hang-rate", type=float, default=0.0,
+                        help="probability a scan command is not answered at all (default 0)")
+    parser.add_argument("--seed", type=int, default=None, help="random seed for reproducible runs")
+    parser.add_argument("--link", help="create a symlink to the pseudo terminal, e.g. /tmp/bx31")
+    parser.add_argument("--echo", action="store_true", help="echo the received commands")
+    parser.add_argument("-v", "--verbose", action="store_true", help="log the received commands")
+    args = parser.parse_args()
+    verboseLog = args.verbose
+
+    try:
+        Bx31Sim(args).run()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
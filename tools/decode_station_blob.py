@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+#
+# decode_station_blob.py
+#
+# Decodes the binary station report blob (BTScan.stations.<chunk>) as
+# recorded by BTStationManager.c. Takes the base64 string(s) as arguments
+# or one per line on stdin.
+#
+#  This is part of the "BX31_ATService" Project
+#  Created on: Oct 17, 2026
+#
+
+import base64
+import struct
+import sys
+
+BLOB_VERSIONS = (1, 2)                                  # v2 added the radio byte
+STATION_CHANGED_NEW = 0x01
+STATION_CHANGED_PAYLOAD = 0x02
+STATION_CHANGED_RSSI = 0x04
+
+
+def decode(blob):
+    magic, version, _, base_time, count = struct.unpack_from(">2sBBIH", blob, 0)
+    if magic != b"BS":
+        raise ValueError("bad magic %r" % magic)
+    if version not in BLOB_VERSIONS:
+        raise ValueError("unsupported blob version %d" % version)
+
+    pos = 10
+    stations = []
+    for _ in range(count):
+        addr = blob[pos:pos + 6]
+        if version == 1:
+            flags, addr_type, rssi, age = struct.unpack_from(">BBbH", blob, pos + 6)
+            radio = 0
+            pos += 11
+        else:
+            flags, addr_type, rssi, radio, age = struct.unpack_from(">BBbBH", blob, pos + 6)
+            pos += 12
+        station = {
+            "address": ":".join("%02x" % b for b in addr),
+            "flags": flags,
+            "addrType": addr_type,
+            "rssi": rssi,
+            "radio": radio,
+            "lastseen": base_time - age,
+        }
+        if flags & STATION_CHANGED_PAYLOAD:
+            data_len = blob[pos]
+            station["data"] = blob[pos + 1:pos + 1 + data_len].hex()
+            pos += 1 + data_len
+        stations.append(station)
+
+    return version, base_time, stations
+
+
+def main():
+    inputs = sys.argv[1:] or [line.strip() for line in sys.stdin if line.strip()]
+    for encoded in inputs:
+        version, base_time, stations = decode(base64.b64decode(encoded))
+        print("blob v%d, time %d, %d stations" % (version, base_time, len(stations)))
+        for s in stations:
+            print("  %(address)s flags=0x%(flags)02x type=%(addrType)d rssi=%(rssi)d radio=%(radio)d "
+                  "lastseen=%(lastseen)d" % s
+                  + ("  data=" + s["data"] if "data" in s else ""))
+
+
+if __name__ == "__main__":
+    main()
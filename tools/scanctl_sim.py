@@ -0,0 +1,347 @@
+#!/usr/bin/env python3
+#
+# scanctl_sim.py
+#
+# Simulation of the adaptive scan controller (ScanControl.c) against a
+# station population whose churn changes over time. The stations arrive
+# and leave at random, the radio scans with the window and interval of
+# the controller, the janitor check of the station manager expires the
+# stations and feeds the added / removed counts back to the controller -
+# like btmgr_periodicalCheck() does. The thresholds, levels and bounds are
+# read from ScanControl.h and the check period from BTStationManager.h,
+# the rules of scanctl_update() / scanctl_apply() and the expiry interval
+# (scanctl_getExpiryInterval()) are modelled below.
+#
+# For each phase it reports the scan levels, the duty cycle and the
+# detection latency (arrival of a station until it is first heard), plus
+# the latency each fixed level would give on the busiest phase - so the
+# latency bought with the duty cycle can be compared.
+#
+# --check verifies the behaviour of the controller and exits with 1 if it
+# does not hold: below SCANCTL_CHURN_LOW percent it backs off a level per
+# check down to level 0 (window min, interval max), between LOW and
+# SCANCTL_CHURN_HIGH it steps up a level, from HIGH on it jumps to the top
+# level (window max, back to back); a quiet phase settles at level 0 / 1, a
+# busy phase reaches the top level once its stations were heard (within
+# SCANCTL_INTERVAL_MAX plus two checks) and detects the stations faster
+# than the quietest level would.
+#
+# Example - 15 min quiet, 5 min busy, 15 min quiet, 500 stations:
+#
+#     tools/scanctl_sim.py --phases quiet:900:3600,busy:300:60,quiet:900:3600 \
+#                          --stations 500 --check
+#
+# To run the component itself against changing churn use tools/bx31_sim.py
+# and watch BTScan.stats.scan.window / .interval.
+#
+#  This is part of the "BX31_ATService" Project
+#  Created on: Oct 17, 2026
+#
+
+import argparse
+import heapq
+import os
+import random
+import re
+import sys
+
+COMPONENT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "BX31_ATServiceComponent")
+
+
+def read_defines(header):
+    defines = {}
+    with open(os.path.join(COMPONENT_DIR, header)) as f:
+        for match in re.finditer(r"^#define\s+(\w+)\s+(\d+)\b", f.read(), re.M):
+            defines[match.group(1)] = int(match.group(2))
+    return defines
+
+
+SCANCTL = read_defines("ScanControl.h")
+CHECK_PERIOD = read_defines("BTStationManager.h")["MAX_BT_STATION_AGE"]   # janitor timer, also the max. station age
+
+
+class ScanControl:
+    """ the rules of ScanControl.c """
+
+    def __init__(self):
+        self.window_min = SCANCTL["SCANCTL_WINDOW_MIN"]
+        self.window_max = SCANCTL["SCANCTL_WINDOW_MAX"]
+        self.interval_max = SCANCTL["SCANCTL_INTERVAL_MAX"]
+        self.top = SCANCTL["SCANCTL_LEVELS"] - 1
+        self.pinned = False
+        self.expiry_interval = 0
+        self.expiry_interval_since = 0.0
+        self.set_level(self.top)                                # start busy, the station table is empty
+
+    def set_level(self, level, pinned=False, now=0.0):
+        self.level = level
+        self.pinned = pinned
+        self.window = self.window_min + (self.window_max - self.window_min) * level // self.top
+        self.interval = self.window + (self.interval_max - self.window) * (self.top - level) // self.top
+        if self.interval >= self.expiry_interval:
+            self.expiry_interval = self.interval
+        else:
+            self.expiry_interval_since = now                   # keep the longer one for a while
+
+    def get_expiry_interval(self, now):
+        if self.expiry_interval > self.interval and now - self.expiry_interval_since >= 2 * self.expiry_interval:
+            self.expiry_interval = self.interval
+        return self.expiry_interval
+
+    def update(self, added, removed, stations, now=0.0):
+        churn = (added + removed) * 100 // (stations if stations > 0 else 1)
+        if self.pinned:
+            return churn
+        if churn >= SCANCTL["SCANCTL_CHURN_HIGH"]:
+            self.set_level(self.top, now=now)
+        elif churn >= SCANCTL["SCANCTL_CHURN_LOW"]:
+            self.set_level(min(self.level + 1, self.top), now=now)
+        else:
+            self.set_level(max(self.level - 1, 0), now=now)
+        return churn
+
+
+class Phase:
+
+    def __init__(self, spec, start):
+        name, duration, lifetime = spec.split(":")
+        self.name = name
+        self.start = start
+        self.end = start + float(duration)
+        self.lifetime = float(lifetime)                         # mean time a station stays
+        self.latencies = []
+        self.missed = 0
+        self.busy = 0.0
+        self.levels = []
+
+    def __contains__(self, t):
+        return self.start <= t < self.end
+
+
+def make_population(rnd, phases, stations):
+    """ stations as (arrival, departure) - the population size stays at about
+        'stations', the churn follows the mean lifetime of the phase """
+    population = [(0.0, rnd.expovariate(1.0 / phases[0].lifetime)) for _ in range(stations)]
+    for phase in phases:
+        t = phase.start
+        while True:
+            t += rnd.expovariate(stations / phase.lifetime)
+            if t >= phase.end:
+                break
+            population.append((t, t + rnd.expovariate(1.0 / phase.lifetime)))
+    return population
+
+
+def phase_at(phases, t):
+    for phase in phases:
+        if t in phase:
+            return phase
+    return None
+
+
+def simulate(phases, stations, miss, seed, level=None):
+    rnd = random.Random(seed)
+    population = make_population(rnd, phases, stations)
+    ctl = ScanControl()
+    if level is not None:
+        ctl.set_level(level, pinned=True)
+
+    end = phases[-1].end
+    heard = []                                                  # (time, station) as streamed in by the scans
+    table = {}                                                  # station -> last seen
+    detected = set()
+    added = 0
+    next_check = CHECK_PERIOD
+    scan_start = 0.0
+    checks = []                                                 # (time, churn, level) after each check
+
+    by_arrival = sorted(range(len(population)), key=lambda i: population[i][0])
+    present = []                                                # heap of (departure, station)
+    arrived = 0
+
+    while scan_start < end:
+        window, interval = ctl.window, ctl.interval
+        scan_end = scan_start + window
+
+        while arrived < len(by_arrival) and population[by_arrival[arrived]][0] < scan_end:
+            i = by_arrival[arrived]
+            heapq.heappush(present, (population[i][1], i))
+            arrived += 1
+        while present and present[0][0] <= scan_start:
+            heapq.heappop(present)
+
+        for departure, i in present:
+            arrival = population[i][0]
+            first, last = max(scan_start, arrival), min(scan_end, departure)
+            if last > first and rnd.random() >= miss:
+                heapq.heappush(heard, (rnd.uniform(first, last), i))
+
+        phase = phase_at(phases, scan_start)
+        if phase is not None:
+            phase.busy += min(window, end - scan_start)
+        scan_start += interval
+
+        while next_check <= scan_start and next_check <= end:
+            while heard and heard[0][0] <= next_check:
+                t, i = heapq.heappop(heard)
+                if i not in table:
+                    added += 1
+                table[i] = t
+                if i not in detected:
+                    detected.add(i)
+                    arrival_phase = phase_at(phases, population[i][0])
+                    if arrival_phase is not None:
+                        arrival_phase.latencies.append(t - population[i][0])
+
+            max_age = max(CHECK_PERIOD, 2 * ctl.get_expiry_interval(next_check))
+            expired = [i for i, t in table.items() if next_check - t > max_age]
+            for i in expired:
+                del table[i]
+
+            churn = ctl.update(added, len(expired), len(table), next_check)
+            checks.append((next_check, churn, ctl.level))
+            phase = phase_at(phases, next_check - 1e-9)
+            if phase is not None:
+                phase.levels.append(ctl.level)
+            added = 0
+            next_check += CHECK_PERIOD
+
+    for i, (arrival, departure) in enumerate(population):
+        phase = phase_at(phases, arrival)
+        if phase is not None and i not in detected and departure < end:
+            phase.missed += 1
+    return checks
+
+
+def make_phases(spec):
+    phases = []
+    start = 0.0
+    for part in spec.split(","):
+        phase = Phase(part, start)
+        phases.append(phase)
+        start = phase.end
+    return phases
+
+
+def percentile(values, share):
+    if not values:
+        return float("nan")
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * share))]
+
+
+def mean(values):
+    return sum(values) / len(values) if values else float("nan")
+
+
+def check_rules(failures):
+    """ the rules of scanctl_update() one by one """
+    ctl = ScanControl()
+    low, high = SCANCTL["SCANCTL_CHURN_LOW"], SCANCTL["SCANCTL_CHURN_HIGH"]
+
+    def expect(condition, text):
+        if not condition:
+            failures.append(text)
+
+    expect((ctl.window, ctl.interval) == (ctl.window_max, ctl.window_max),
+           "top level does not scan the longest window back to back")
+    for step in range(ctl.top):
+        ctl.update(low - 1, 0, 100)
+        expect(ctl.level == ctl.top - step - 1, "churn below %d%% does not back off one level" % low)
+    ctl.update(0, 0, 100)
+    expect(ctl.level == 0, "level 0 is not kept while quiet")
+    expect((ctl.window, ctl.interval) == (ctl.window_min, ctl.interval_max),
+           "level 0 does not scan the shortest window at the longest interval")
+    ctl.update(low, 0, 100)
+    expect(ctl.level == 1, "churn of %d%% does not step up one level" % low)
+    ctl.update(0, high - 1, 100)
+    expect(ctl.level == 2, "churn of %d%% does not step up one level" % (high - 1))
+    ctl.update(high // 2, high - high // 2, 100)
+    expect(ctl.level == ctl.top, "churn of %d%% does not jump to the top level" % high)
+    ctl.update(0, 0, 0)
+    expect(ctl.level == ctl.top - 1, "an empty table is not taken as quiet")
+
+
+def check_scenario(phases, fixed, failures):
+    top = SCANCTL["SCANCTL_LEVELS"] - 1
+    busiest = min(phases, key=lambda p: p.lifetime)
+    quietest = max(phases, key=lambda p: p.lifetime)
+
+    reaction = SCANCTL["SCANCTL_INTERVAL_MAX"] // CHECK_PERIOD + 2            # checks until the stations of a busy phase
+                                                                            # were heard by a scan and counted
+    for phase in phases:
+        settled = phase.levels[len(phase.levels) // 2:]                     # the arrivals of a 60 s scan come in one
+        backed_off = sum(1 for level in settled if level <= 1)              # check, so it may step up once in a while
+        if phase.lifetime == quietest.lifetime and 3 * backed_off < 2 * len(settled):
+            failures.append("%s phase is at level 0 or 1 in only %d of the last %d checks"
+                            % (phase.name, backed_off, len(settled)))
+    if top not in busiest.levels[:reaction]:
+        failures.append("%s phase does not reach level %d within %d checks: %s"
+                        % (busiest.name, top, reaction, busiest.levels[:reaction]))
+    if not busiest.busy / (busiest.end - busiest.start) > quietest.busy / (quietest.end - quietest.start):
+        failures.append("%s phase does not scan more than %s phase" % (busiest.name, quietest.name))
+    if not mean(busiest.latencies) < mean(fixed[0].latencies):
+        failures.append("%s phase detects the stations not faster (%.1f s) than level 0 (%.1f s)"
+                        % (busiest.name, mean(busiest.latencies), mean(fixed[0].latencies)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="simulation of the adaptive scan controller (ScanControl.c)")
+    parser.add_argument("--phases", default="quiet:900:3600,busy:300:60,quiet:900:3600",
+                        help="name:seconds:mean station lifetime in seconds, comma separated "
+                             "(default quiet:900:3600,busy:300:60,quiet:900:3600)")
+    parser.add_argument("--stations", type=int, default=500, help="station population size (default 500)")
+    parser.add_argument("--miss", type=float, default=0.05,
+                        help="probability a station is not heard in a scan (default 0.05)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default 1)")
+    parser.add_argument("--check", action="store_true", help="verify the controller behaviour, exit 1 if it fails")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print churn and level of each check")
+    args = parser.parse_args()
+
+    phases = make_phases(args.phases)
+    checks = simulate(phases, args.stations, args.miss, args.seed)
+    if args.verbose:
+        for t, churn, level in checks:
+            print("%7.0f s  churn %3d%%  level %d" % (t, churn, level))
+
+    print("adaptive: thresholds %d%% / %d%%, %d levels, window %d..%d s, interval max %d s, check every %d s"
+          % (SCANCTL["SCANCTL_CHURN_LOW"], SCANCTL["SCANCTL_CHURN_HIGH"], SCANCTL["SCANCTL_LEVELS"],
+             SCANCTL["SCANCTL_WINDOW_MIN"], SCANCTL["SCANCTL_WINDOW_MAX"], SCANCTL["SCANCTL_INTERVAL_MAX"],
+             CHECK_PERIOD))
+    print("%-8s %7s %9s %7s %6s %10s %10s %7s" %
+          ("phase", "seconds", "lifetime", "levels", "duty", "latency", "p95", "missed"))
+    for phase in phases:
+        levels = "%d..%d" % (min(phase.levels), max(phase.levels)) if phase.levels else "-"
+        print("%-8s %7.0f %8.0fs %7s %5.1f%% %9.1fs %9.1fs %7d" %
+              (phase.name, phase.end - phase.start, phase.lifetime, levels,
+               100.0 * phase.busy / (phase.end - phase.start),
+               mean(phase.latencies), percentile(phase.latencies, 0.95), phase.missed))
+
+    busiest = min(phases, key=lambda p: p.lifetime)
+    spec = "%s:%.0f:%.0f" % (busiest.name, busiest.end - busiest.start, busiest.lifetime)
+    print("\nfixed levels on the %s phase:" % busiest.name)
+    print("%-8s %7s %9s %6s %10s %10s %7s" % ("level", "window", "interval", "duty", "latency", "p95", "missed"))
+    fixed = []
+    for level in range(SCANCTL["SCANCTL_LEVELS"]):
+        fixed_phases = make_phases(spec)
+        simulate(fixed_phases, args.stations, args.miss, args.seed, level)
+        ctl = ScanControl()
+        ctl.set_level(level)
+        phase = fixed_phases[0]
+        fixed.append(phase)
+        print("%-8d %6ds %8ds %5.1f%% %9.1fs %9.1fs %7d" %
+              (level, ctl.window, ctl.interval, 100.0 * phase.busy / (phase.end - phase.start),
+               mean(phase.latencies), percentile(phase.latencies, 0.95), phase.missed))
+
+    if args.check:
+        failures = []
+        check_rules(failures)
+        check_scenario(phases, fixed, failures)
+        for failure in failures:
+            print("FAILED: %s" % failure)
+        print("check %s" % ("failed" if failures else "passed"))
+        sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()